@@ -57,31 +57,12 @@ using Microsoft::WRL::ComPtr;
 #include "imgui/imgui.h"
 
 //////////////////////////////////////////////////////////////////////////
-// Common game industry typedefs
-//  * Very compact when used in expressions.
-//  * Express the size in bytes.
+// Common game industry typedefs (u32, f32, KB...)
 //////////////////////////////////////////////////////////////////////////
+#include "CoreTypes.h"
 
-// Unsigned
-using u8 = uint8_t;
-using u16 = uint16_t;
-using u32 = uint32_t;
-using u64 = uint64_t;
-
-// Signed
-using s8 = int8_t;
-using s16 = int16_t;
-using s32 = int32_t;
-using s64 = int64_t;
-
-// Floating point
-using f32 = float;
-using f64 = double;
-
-// Memory
-using memtype_t = u8;
-constexpr u64 KB = 1024;
-constexpr u64 MB = 1024 * KB;
+// Thread-safe random number generators (randf() and friends below)
+#include "Random.h"
 
 // Vector maths.
 using v2 = DirectX::SimpleMath::Vector2;
@@ -134,8 +115,9 @@ constexpr f32 radToDeg(const f32 radians)
 	return radians * 180.0f / kfPI;
 }
 
-// Random numbers (0, 1) and (-1, 1) for floats and vectors.
-inline f32 randf_norm() { return (float)rand() / RAND_MAX; }
+// Random numbers [0, 1) and [-1, 1) for floats and vectors, from a
+// per-thread generator so they are safe to call from jobs.
+inline f32 randf_norm() { return random_unit(thread_random().next()); }
 inline f32 randf() { return randf_norm() * 2.0f - 1.0f; }
 inline v2 randv2() { return v2(randf(),randf()); }
 inline v3 randv3() { return v3(randf(), randf(), randf()); }
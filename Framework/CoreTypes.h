@@ -0,0 +1,33 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Common game industry typedefs
+//  * Very compact when used in expressions.
+//  * Express the size in bytes.
+//
+// Kept free of any Windows/DirectX headers so that portable code
+// (job system, headless simulator) can share them.
+//////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+
+// Unsigned
+using u8 = uint8_t;
+using u16 = uint16_t;
+using u32 = uint32_t;
+using u64 = uint64_t;
+
+// Signed
+using s8 = int8_t;
+using s16 = int16_t;
+using s32 = int32_t;
+using s64 = int64_t;
+
+// Floating point
+using f32 = float;
+using f64 = double;
+
+// Memory
+using memtype_t = u8;
+constexpr u64 KB = 1024;
+constexpr u64 MB = 1024 * KB;
@@ -0,0 +1,148 @@
+#include "CpuFeatures.h"
+
+#include <cctype>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define CPU_FEATURES_X86 1
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+
+namespace
+{
+#if defined(CPU_FEATURES_X86)
+	void cpuid(const u32 kLeaf, const u32 kSubLeaf, u32 regs[4])
+	{
+	#if defined(_MSC_VER)
+		int info[4];
+		__cpuidex(info, static_cast<int>(kLeaf), static_cast<int>(kSubLeaf));
+		for (int i = 0; i < 4; ++i)
+		{
+			regs[i] = static_cast<u32>(info[i]);
+		}
+	#else
+		__cpuid_count(kLeaf, kSubLeaf, regs[0], regs[1], regs[2], regs[3]);
+	#endif
+	}
+
+	u64 xgetbv0()
+	{
+	#if defined(_MSC_VER)
+		return _xgetbv(0);
+	#else
+		u32 eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<u64>(edx) << 32) | eax;
+	#endif
+	}
+#endif
+
+	CpuFeatures detect_features()
+	{
+		CpuFeatures features = {};
+
+	#if defined(CPU_FEATURES_X86)
+		u32 regs[4];
+		cpuid(0, 0, regs);
+		const u32 kMaxLeaf = regs[0];
+		if (kMaxLeaf < 1)
+		{
+			return features;
+		}
+
+		cpuid(1, 0, regs);
+		const u32 kEcx1 = regs[2];
+		features.m_sse41 = (kEcx1 & (1u << 19)) != 0;
+		features.m_fma = (kEcx1 & (1u << 12)) != 0;
+		const bool kOsxsave = (kEcx1 & (1u << 27)) != 0;
+		const bool kAvxBit = (kEcx1 & (1u << 28)) != 0;
+
+		if (kOsxsave)
+		{
+			// XCR0: bits 1-2 are SSE/AVX state, bits 5-7 are AVX-512 state
+			const u64 kXcr0 = xgetbv0();
+			features.m_osSavesYmm = (kXcr0 & 0x6) == 0x6;
+			features.m_osSavesZmm = features.m_osSavesYmm && (kXcr0 & 0xE0) == 0xE0;
+		}
+
+		features.m_avx = kAvxBit && features.m_osSavesYmm;
+
+		if (kMaxLeaf >= 7)
+		{
+			cpuid(7, 0, regs);
+			const u32 kEbx7 = regs[1];
+			features.m_avx2 = features.m_avx && (kEbx7 & (1u << 5)) != 0;
+			features.m_avx512f = features.m_osSavesZmm && (kEbx7 & (1u << 16)) != 0;
+		}
+		features.m_fma = features.m_fma && features.m_avx;
+	#endif
+
+		return features;
+	}
+}
+
+const CpuFeatures& cpu_features()
+{
+	static const CpuFeatures s_features = detect_features();
+	return s_features;
+}
+
+bool cpu_supports(const SimdLevel::SimdLevelEnum kLevel)
+{
+	const CpuFeatures& features = cpu_features();
+	switch (kLevel)
+	{
+	case SimdLevel::kScalar: return true;
+	case SimdLevel::kSSE4: return features.m_sse41;
+	case SimdLevel::kAVX2: return features.m_avx2 && features.m_fma;
+	case SimdLevel::kAVX512: return features.m_avx512f;
+	default: return false;
+	}
+}
+
+SimdLevel::SimdLevelEnum cpu_best_simd_level()
+{
+	for (int level = SimdLevel::kMaxLevels - 1; level > SimdLevel::kScalar; --level)
+	{
+		if (cpu_supports(static_cast<SimdLevel::SimdLevelEnum>(level)))
+		{
+			return static_cast<SimdLevel::SimdLevelEnum>(level);
+		}
+	}
+	return SimdLevel::kScalar;
+}
+
+const char* simd_level_name(const SimdLevel::SimdLevelEnum kLevel)
+{
+	static const char* const s_names[SimdLevel::kMaxLevels] = { "Scalar", "SSE4", "AVX2", "AVX-512" };
+	return (kLevel >= 0 && kLevel < SimdLevel::kMaxLevels) ? s_names[kLevel] : "Unknown";
+}
+
+bool parse_simd_level(const char* pName, SimdLevel::SimdLevelEnum& rLevelOut)
+{
+	// Lower case and drop punctuation so "AVX-512", "avx512" and "AVX_512" all match
+	char name[16] = {};
+	u32 length = 0;
+	for (const char* p = pName; *p && length + 1 < sizeof(name); ++p)
+	{
+		if (std::isalnum(static_cast<unsigned char>(*p)))
+		{
+			name[length++] = static_cast<char>(std::tolower(static_cast<unsigned char>(*p)));
+		}
+	}
+
+	static const char* const s_keys[SimdLevel::kMaxLevels] = { "scalar", "sse4", "avx2", "avx512" };
+	for (int level = 0; level < SimdLevel::kMaxLevels; ++level)
+	{
+		if (std::strcmp(name, s_keys[level]) == 0)
+		{
+			rLevelOut = static_cast<SimdLevel::SimdLevelEnum>(level);
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+//================================================================================
+// CPU feature detection (cpuid/xgetbv) used to pick SIMD kernel variants at
+// runtime. Portable: no Windows or DirectX headers.
+//================================================================================
+
+#include "CoreTypes.h"
+
+// ========================================================
+// SIMD instruction set levels, ordered from narrowest to widest
+// ========================================================
+namespace SimdLevel
+{
+	enum SimdLevelEnum
+	{
+		kScalar,
+		kSSE4,
+		kAVX2,
+		kAVX512,
+
+		kMaxLevels
+	};
+}
+
+struct CpuFeatures
+{
+	bool m_sse41;
+	bool m_avx;
+	bool m_avx2;
+	bool m_fma;
+	bool m_avx512f;
+
+	// The OS saves the YMM / ZMM register state on context switch.
+	bool m_osSavesYmm;
+	bool m_osSavesZmm;
+};
+
+// Features of the executing CPU, detected once on first call.
+const CpuFeatures& cpu_features();
+
+// True if the CPU and OS can run code compiled for the given level.
+bool cpu_supports(const SimdLevel::SimdLevelEnum kLevel);
+
+// Widest level supported by the executing CPU.
+SimdLevel::SimdLevelEnum cpu_best_simd_level();
+
+// "Scalar", "SSE4", "AVX2", "AVX-512".
+const char* simd_level_name(const SimdLevel::SimdLevelEnum kLevel);
+
+// Parse a level name (case insensitive, also accepts "avx512"). Returns false if unknown.
+bool parse_simd_level(const char* pName, SimdLevel::SimdLevelEnum& rLevelOut);
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// ========================================================
+// class InplaceJob
+// Move-only replacement for std::function<void()> that stores the callable
+// inline in a fixed buffer and never touches the heap. Callables larger than
+// kStorageSize are rejected at compile time: capture pointers/references to
+// big state instead of copying it into the job.
+// ========================================================
+
+class InplaceJob final
+{
+public:
+	// Fits a std::function on every supported standard library, so existing
+	// std::function jobs still convert.
+	static constexpr std::size_t kStorageSize = 64;
+
+	InplaceJob() : ops(nullptr) {}
+
+	template<typename Fn, typename = typename std::enable_if<!std::is_same<typename std::decay<Fn>::type, InplaceJob>::value>::type>
+	InplaceJob(Fn&& fn)
+	{
+		using Callable = typename std::decay<Fn>::type;
+		static_assert(sizeof(Callable) <= kStorageSize, "Job capture is too large for InplaceJob storage");
+		static_assert(alignof(Callable) <= alignof(std::max_align_t), "Job capture is over-aligned for InplaceJob storage");
+
+		new (storage) Callable(std::forward<Fn>(fn));
+		ops = &OpsFor<Callable>::table;
+	}
+
+	InplaceJob(InplaceJob&& other) : ops(nullptr)
+	{
+		*this = std::move(other);
+	}
+
+	InplaceJob& operator=(InplaceJob&& other)
+	{
+		if (this != &other)
+		{
+			reset();
+			if (other.ops)
+			{
+				other.ops->move(storage, other.storage);
+				ops = other.ops;
+				other.reset();
+			}
+		}
+		return *this;
+	}
+
+	InplaceJob(const InplaceJob&) = delete;
+	InplaceJob& operator=(const InplaceJob&) = delete;
+
+	~InplaceJob()
+	{
+		reset();
+	}
+
+	void operator()()
+	{
+		assert(ops);
+		ops->invoke(storage);
+	}
+
+	explicit operator bool() const { return ops != nullptr; }
+
+	// Destroy the stored callable, leaving the job empty.
+	void reset()
+	{
+		if (ops)
+		{
+			ops->destroy(storage);
+			ops = nullptr;
+		}
+	}
+
+private:
+	struct Ops
+	{
+		void (*invoke)(void* callable);
+		void (*move)(void* dst, void* src);
+		void (*destroy)(void* callable);
+	};
+
+	template<typename Callable>
+	struct OpsFor
+	{
+		static void invoke(void* callable) { (*static_cast<Callable*>(callable))(); }
+		static void move(void* dst, void* src) { new (dst) Callable(std::move(*static_cast<Callable*>(src))); }
+		static void destroy(void* callable) { static_cast<Callable*>(callable)->~Callable(); }
+
+		static const Ops table;
+	};
+
+	alignas(std::max_align_t) unsigned char storage[kStorageSize];
+	const Ops* ops;
+};
+
+template<typename Callable>
+const InplaceJob::Ops InplaceJob::OpsFor<Callable>::table = {
+	&InplaceJob::OpsFor<Callable>::invoke,
+	&InplaceJob::OpsFor<Callable>::move,
+	&InplaceJob::OpsFor<Callable>::destroy
+};
@@ -0,0 +1,117 @@
+#include "JobGraph.h"
+
+#include <cassert>
+
+JobGraph::JobGraph(JobQueue& queue) :
+	queue(queue)
+{}
+
+JobGraph::~JobGraph()
+{
+	waitAll();
+}
+
+JobHandle JobGraph::addJob(JobQueue::Job job)
+{
+	assert(!submitted);
+
+	if (nodeCount == nodes.size())
+	{
+		nodes.emplace_back(new Node());
+	}
+
+	Node& node = *nodes[nodeCount];
+	node.job = std::move(job);
+	node.successors.clear();
+	node.unfinishedDependencies.store(0, std::memory_order_relaxed);
+	node.incomplete.store(1, std::memory_order_relaxed);
+
+	JobHandle handle;
+	handle.index = nodeCount++;
+	return handle;
+}
+
+void JobGraph::dependsOn(JobHandle job, JobHandle dependency)
+{
+	assert(!submitted);
+	assert(job.index < nodeCount && dependency.index < nodeCount);
+	assert(job.index != dependency.index);
+
+	nodes[dependency.index]->successors.push_back(job.index);
+	nodes[job.index]->unfinishedDependencies.fetch_add(1, std::memory_order_relaxed);
+}
+
+void JobGraph::submit()
+{
+	assert(!submitted);
+	submitted = true;
+	unfinishedJobs.store(nodeCount, std::memory_order_release);
+
+	// Collect the roots before pushing any: a running root may unblock a
+	// successor, which must then not be mistaken for a root.
+	roots.clear();
+	for (u32 i = 0; i < nodeCount; ++i)
+	{
+		if (nodes[i]->unfinishedDependencies.load(std::memory_order_relaxed) == 0)
+		{
+			roots.push_back(i);
+		}
+	}
+	assert(!roots.empty() || nodeCount == 0); // Otherwise the graph has a cycle
+
+	for (u32 root : roots)
+	{
+		scheduleNode(root);
+	}
+}
+
+void JobGraph::wait(JobHandle job)
+{
+	assert(job.index < nodeCount);
+	queue.waitCounter(nodes[job.index]->incomplete);
+}
+
+void JobGraph::waitAll()
+{
+	if (submitted)
+	{
+		queue.waitCounter(unfinishedJobs);
+	}
+}
+
+bool JobGraph::isComplete(JobHandle job) const
+{
+	assert(job.index < nodeCount);
+	return nodes[job.index]->incomplete.load(std::memory_order_acquire) == 0;
+}
+
+void JobGraph::reset()
+{
+	waitAll();
+	nodeCount = 0;
+	submitted = false;
+}
+
+void JobGraph::scheduleNode(u32 index)
+{
+	queue.pushJob([this, index]() { runNode(index); });
+}
+
+void JobGraph::runNode(u32 index)
+{
+	Node& node = *nodes[index];
+	node.job();
+	node.job.reset();
+
+	// Release successors whose last dependency this was
+	for (u32 successor : node.successors)
+	{
+		if (nodes[successor]->unfinishedDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			scheduleNode(successor);
+		}
+	}
+
+	node.incomplete.store(0, std::memory_order_release);
+	unfinishedJobs.fetch_sub(1, std::memory_order_acq_rel);
+}
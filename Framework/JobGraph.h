@@ -0,0 +1,87 @@
+#pragma once
+
+#include "JobQueue.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// ========================================================
+// class JobGraph
+// A DAG of jobs with explicit dependencies, run on a JobQueue.
+//
+//   JobGraph graph(queue);
+//   JobHandle a = graph.addJob([]{ ... });
+//   JobHandle b = graph.addJob([]{ ... });
+//   graph.dependsOn(b, a);   // b starts once a has finished
+//   graph.submit();
+//   graph.wait(b);
+//
+// Each job carries a completion counter of unfinished dependencies; the job
+// that finishes last pushes its successors, so nothing blocks on a whole
+// stage. Nodes are recycled by reset(), so a graph rebuilt every frame stops
+// allocating once it has reached its largest size.
+// ========================================================
+
+struct JobHandle
+{
+	static constexpr u32 kInvalid = 0xFFFFFFFFu;
+
+	u32 index = kInvalid;
+
+	bool valid() const { return index != kInvalid; }
+};
+
+class JobGraph final
+{
+public:
+	explicit JobGraph(JobQueue& queue);
+
+	// Waits for any submitted work before destroying the nodes.
+	~JobGraph();
+
+	JobGraph(const JobGraph&) = delete;
+	JobGraph& operator=(const JobGraph&) = delete;
+
+	// Add a job. Only valid before submit().
+	JobHandle addJob(JobQueue::Job job);
+
+	// job will not start until dependency has finished. Only valid before submit().
+	void dependsOn(JobHandle job, JobHandle dependency);
+
+	// Push every job without dependencies; the rest follow as they unblock.
+	void submit();
+
+	// Wait for one job, running queued work meanwhile.
+	void wait(JobHandle job);
+
+	// Wait for every job in the graph.
+	void waitAll();
+
+	bool isComplete(JobHandle job) const;
+
+	// Wait for completion and clear the graph for reuse.
+	void reset();
+
+	u32 jobCount() const { return nodeCount; }
+
+private:
+	struct Node
+	{
+		JobQueue::Job job;
+		std::vector<u32> successors;
+		std::atomic<u32> unfinishedDependencies{ 0 };
+		// 1 until the job has run.
+		std::atomic<u32> incomplete{ 1 };
+	};
+
+	void runNode(u32 index);
+	void scheduleNode(u32 index);
+
+	JobQueue& queue;
+	std::vector<std::unique_ptr<Node>> nodes;
+	std::vector<u32> roots;
+	u32 nodeCount = 0;
+	std::atomic<u32> unfinishedJobs{ 0 };
+	bool submitted = false;
+};
@@ -0,0 +1,323 @@
+#include "JobQueue.h"
+#include "SpinWait.h"
+
+#include <cassert>
+#include <chrono>
+
+namespace
+{
+	u32 xorshift32(u32& state)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+}
+
+thread_local const JobQueue* JobQueue::tlsOwner = nullptr;
+thread_local JobQueue::Worker* JobQueue::tlsWorker = nullptr;
+
+JobQueue::JobQueue(u32 kMaxQueuedJobs) :
+	maxQueuedJobs(kMaxQueuedJobs),
+	slots(new JobSlot[kMaxQueuedJobs]),
+	freeSlotHead(0),
+	injectQueue(kMaxQueuedJobs),
+	queuedJobs(0),
+	pendingJobs(0),
+	sleepingWorkers(0)
+{
+	assert(kMaxQueuedJobs > 0 && kMaxQueuedJobs < kNoSlot);
+
+	// Chain every slot into the free list
+	for (u32 i = 0; i < kMaxQueuedJobs; ++i)
+	{
+		slots[i].nextFree.store(i + 1 < kMaxQueuedJobs ? i + 1 : kNoSlot, std::memory_order_relaxed);
+	}
+	freeSlotHead.store(0, std::memory_order_release);
+}
+
+JobQueue::~JobQueue()
+{
+	waitAll();
+
+	if (!workers.empty())
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			terminating = true;
+			wakeCondition.notify_all();
+		}
+
+		for (std::unique_ptr<Worker>& worker : workers)
+		{
+			worker->thread.join();
+		}
+	}
+}
+
+void JobQueue::launch(u32 numWorkers)
+{
+	assert(workers.empty()); // Not already launched!
+
+	if (numWorkers == 0)
+	{
+		numWorkers = std::thread::hardware_concurrency();
+		numWorkers = numWorkers ? numWorkers : 1;
+	}
+
+	// Create every deque before any thread starts, thieves walk the whole array
+	workers.reserve(numWorkers);
+	for (u32 i = 0; i < numWorkers; ++i)
+	{
+		// Deques can hold every slot, so they are never asked to grow
+		std::unique_ptr<Worker> worker(new Worker(maxQueuedJobs));
+		worker->index = i;
+		worker->randomState = 0x9E3779B9u * (i + 1);
+		workers.push_back(std::move(worker));
+	}
+
+	for (std::unique_ptr<Worker>& worker : workers)
+	{
+		worker->thread = std::thread(&JobQueue::queueLoop, this, worker.get());
+	}
+}
+
+void JobQueue::pushJob(Job job)
+{
+	u32 slot = acquireSlot();
+	while (slot == kNoSlot)
+	{
+		// Every slot is taken: make room by running queued work here
+		if (!runPendingJob())
+		{
+			std::this_thread::yield();
+		}
+		slot = acquireSlot();
+	}
+	slots[slot].job = std::move(job);
+
+	pendingJobs.fetch_add(1, std::memory_order_relaxed);
+	queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+
+	if (Worker* worker = currentWorker())
+	{
+		worker->deque.push(slot);
+	}
+	else
+	{
+		// The queue holds every slot, but a cell stays occupied until the
+		// consumer that claimed it finishes reading, so a preempted consumer
+		// can make it look full for a moment.
+		SpinWait spinWait;
+		while (!injectQueue.tryPush(slot))
+		{
+			spinWait.spinOnce();
+		}
+	}
+
+	// Pairs with the seq_cst increment of sleepingWorkers: either we see the
+	// sleeper, or the sleeper sees queuedJobs > 0 and does not sleep.
+	if (sleepingWorkers.load(std::memory_order_seq_cst) > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wakeCondition.notify_one();
+	}
+}
+
+void JobQueue::waitAll()
+{
+	while (pendingJobs.load(std::memory_order_acquire) > 0)
+	{
+		if (runPendingJob())
+		{
+			continue;
+		}
+
+		// Everything left is running on other threads. Time out now and then
+		// in case those jobs push more work we could help with.
+		std::unique_lock<std::mutex> lock(idleMutex);
+		idleCondition.wait_for(lock, std::chrono::milliseconds(1),
+			[this]() { return pendingJobs.load(std::memory_order_acquire) == 0; });
+	}
+}
+
+void JobQueue::waitCounter(const std::atomic<u32>& counter)
+{
+	SpinWait spinWait;
+	while (counter.load(std::memory_order_acquire) > 0)
+	{
+		if (runPendingJob())
+		{
+			spinWait.reset();
+		}
+		else
+		{
+			spinWait.spinOnce();
+		}
+	}
+}
+
+bool JobQueue::runPendingJob()
+{
+	const u32 kSlot = findJob(currentWorker());
+	if (kSlot != kNoSlot)
+	{
+		runJob(kSlot);
+		return true;
+	}
+	return false;
+}
+
+void JobQueue::queueLoop(Worker* worker)
+{
+	tlsOwner = this;
+	tlsWorker = worker;
+
+	SpinWait spinWait;
+	for (;;)
+	{
+		const u32 kSlot = findJob(worker);
+		if (kSlot != kNoSlot)
+		{
+			runJob(kSlot);
+			spinWait.reset();
+			continue;
+		}
+
+		// Spin, then yield, and only park once work has stayed away a while:
+		// a parked worker costs a syscall to wake.
+		if (!spinWait.shouldPark())
+		{
+			spinWait.spinOnce();
+			continue;
+		}
+		spinWait.reset();
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+		wakeCondition.wait(lock, [this]() { return terminating || queuedJobs.load(std::memory_order_seq_cst) > 0; });
+		sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+
+		if (terminating)
+		{
+			break;
+		}
+	}
+
+	tlsOwner = nullptr;
+	tlsWorker = nullptr;
+}
+
+u32 JobQueue::findJob(Worker* worker)
+{
+	u32 slot = kNoSlot;
+
+	if (worker && worker->deque.pop(slot))
+	{
+		queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+		return slot;
+	}
+
+	if (injectQueue.tryPop(slot))
+	{
+		queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+		return slot;
+	}
+
+	slot = stealJob(worker);
+	if (slot != kNoSlot)
+	{
+		queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+	}
+	return slot;
+}
+
+u32 JobQueue::stealJob(Worker* thief)
+{
+	const u32 kNumWorkers = workerCount();
+	if (kNumWorkers == 0)
+	{
+		return kNoSlot;
+	}
+
+	// Random starting victim spreads thieves across the pool
+	static thread_local u32 s_externalRandomState = 0x2545F491u;
+	u32& randomState = thief ? thief->randomState : s_externalRandomState;
+	const u32 kStart = xorshift32(randomState) % kNumWorkers;
+
+	u32 slot = kNoSlot;
+	for (u32 i = 0; i < kNumWorkers; ++i)
+	{
+		Worker* victim = workers[(kStart + i) % kNumWorkers].get();
+		if (victim != thief && victim->deque.steal(slot))
+		{
+			return slot;
+		}
+	}
+	return kNoSlot;
+}
+
+void JobQueue::runJob(u32 slot)
+{
+	// Move the job out and free its slot before running it. Only queued jobs
+	// then hold slots, so a full pool can always drain by running them, even
+	// when the running jobs are themselves blocked in pushJob.
+	Job job(std::move(slots[slot].job));
+	releaseSlot(slot);
+	job();
+	job.reset();
+
+	if (pendingJobs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		std::lock_guard<std::mutex> lock(idleMutex);
+		idleCondition.notify_all();
+	}
+}
+
+u32 JobQueue::acquireSlot()
+{
+	u64 head = freeSlotHead.load(std::memory_order_acquire);
+	for (;;)
+	{
+		const u32 kSlot = static_cast<u32>(head);
+		if (kSlot == kNoSlot)
+		{
+			return kNoSlot;
+		}
+
+		// A stale nextFree is harmless: the tag makes the exchange fail
+		const u64 kNext = slots[kSlot].nextFree.load(std::memory_order_relaxed);
+		const u64 kNewHead = (((head >> 32) + 1) << 32) | kNext;
+		if (freeSlotHead.compare_exchange_weak(head, kNewHead, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			return kSlot;
+		}
+	}
+}
+
+void JobQueue::releaseSlot(u32 slot)
+{
+	u64 head = freeSlotHead.load(std::memory_order_relaxed);
+	u64 newHead;
+	do
+	{
+		slots[slot].nextFree.store(static_cast<u32>(head), std::memory_order_relaxed);
+		newHead = (((head >> 32) + 1) << 32) | slot;
+	} while (!freeSlotHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+}
+
+JobQueue::Worker* JobQueue::currentWorker() const
+{
+	return tlsOwner == this ? tlsWorker : nullptr;
+}
+
+JobQueue& sharedJobQueue()
+{
+	static JobQueue* s_pQueue = []() {
+		JobQueue* pQueue = new JobQueue();
+		pQueue->launch();
+		return pQueue;
+	}();
+	return *s_pQueue;
+}
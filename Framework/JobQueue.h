@@ -1,87 +1,126 @@
 #pragma once
 
-#include <functional>
-#include <thread>
-#include <mutex>
+#include "CoreTypes.h"
+#include "InplaceJob.h"
+#include "MpmcQueue.h"
+#include "WorkStealingDeque.h"
+
+#include <atomic>
 #include <condition_variable>
-#include <queue>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 // ========================================================
 // class JobQueue
+// Pool of worker threads with per-worker Chase-Lev deques and work stealing.
+//
+// Jobs pushed from a worker (i.e. from inside another job) go to that
+// worker's own deque; jobs pushed from any other thread go to a shared
+// lock-free MPMC injection queue. Idle workers steal from each other, spin
+// with backoff, and only then park on a condition variable.
+// Threads that call waitAll() help run jobs rather than block.
+//
+// Jobs are move-only InplaceJobs living in a fixed array of slots allocated
+// up front, and the deques and injection queue only pass slot indices
+// around, so pushing a job never allocates. When every slot is in use,
+// pushJob runs queued jobs on the calling thread until one frees up. A job
+// is moved out of its slot before it runs.
 // ========================================================
 
 class JobQueue final
 {
 public:
-	typedef std::function<void()> Job;
+	typedef InplaceJob Job;
 
-	// Wait for the worker thread to exit.
-	~JobQueue()
-	{
-		if (worker.joinable())
-		{
-			waitAll();
-			mutex.lock();
-			terminating = true;
-			condition.notify_one();
-			mutex.unlock();
-			worker.join();
-		}
-	}
-
-	// Launch the worker thread.
-	void launch()
-	{
-		ASSERT(!worker.joinable()); // Not already launched!
-		worker = std::thread(&JobQueue::queueLoop, this);
-	}
+	// kMaxQueuedJobs bounds the number of jobs queued or running at once.
+	explicit JobQueue(u32 kMaxQueuedJobs = 16384);
 
-	// Add a new job to the thread's queue.
-	void pushJob(Job job)
-	{
-		std::lock_guard<std::mutex> lock(mutex);
-		queue.push(std::move(job));
-		condition.notify_one();
-	}
+	// Wait for all work, then stop and join the workers.
+	~JobQueue();
 
-	// Wait until all work items have been completed.
-	void waitAll()
-	{
-		std::unique_lock<std::mutex> lock(mutex);
-		condition.wait(lock, [this]() { return queue.empty(); });
-	}
+	// Launch the worker threads. Zero means one per hardware thread.
+	void launch(u32 numWorkers = 0);
+
+	// Add a new job to the queue.
+	void pushJob(Job job);
+
+	// Wait until all work items have been completed. The calling thread runs
+	// queued jobs while it waits, so this is safe to call from inside a job.
+	void waitAll();
+
+	// Wait until counter reaches zero, running queued jobs meanwhile. Used to
+	// wait on a batch of jobs without waiting for unrelated work.
+	void waitCounter(const std::atomic<u32>& counter);
+
+	// Run one queued job on the calling thread. Returns false if none was found.
+	bool runPendingJob();
+
+	// Number of launched worker threads.
+	u32 workerCount() const { return static_cast<u32>(workers.size()); }
 
 private:
-	void queueLoop()
+	static constexpr u32 kNoSlot = 0xFFFFFFFFu;
+
+	struct JobSlot
+	{
+		Job job;
+		std::atomic<u32> nextFree;
+	};
+
+	struct Worker
 	{
-		for (;;)
-		{
-			Job job;
-			{
-				std::unique_lock<std::mutex> lock(mutex);
-				condition.wait(lock, [this] { return !queue.empty() || terminating; });
-				if (terminating)
-				{
-					break;
-				}
-				job = queue.front();
-			}
-
-			job();
-
-			{
-				std::lock_guard<std::mutex> lock(mutex);
-				queue.pop();
-				condition.notify_one();
-			}
-		}
-	}
+		explicit Worker(u32 dequeCapacity) : deque(dequeCapacity) {}
+
+		WorkStealingDeque<u32> deque;
+		std::thread thread;
+		u32 index = 0;
+		u32 randomState = 0;
+	};
+
+	void queueLoop(Worker* worker);
+
+	// Own deque first, then the injection queue, then steal from the others.
+	// Returns a slot index or kNoSlot.
+	u32 findJob(Worker* worker);
+	u32 stealJob(Worker* thief);
+	void runJob(u32 slot);
+
+	// Lock-free free list of slots (Treiber stack with an ABA tag in the top 32 bits).
+	u32 acquireSlot();
+	void releaseSlot(u32 slot);
+
+	// Worker owned by this queue running on the calling thread, or null.
+	Worker* currentWorker() const;
+
+	static thread_local const JobQueue* tlsOwner;
+	static thread_local Worker* tlsWorker;
+
+	const u32 maxQueuedJobs;
+	std::unique_ptr<JobSlot[]> slots;
+	std::atomic<u64> freeSlotHead;
+
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	// Slot indices pushed from threads that are not workers of this queue.
+	// Holds every slot, so a push can never find it full.
+	MpmcQueue<u32> injectQueue;
+
+	// Jobs queued but not yet started (drives sleeping) and not yet finished (drives waitAll).
+	std::atomic<u32> queuedJobs;
+	std::atomic<u32> pendingJobs;
 
+	// Idle workers park here.
+	std::mutex sleepMutex;
+	std::condition_variable wakeCondition;
+	std::atomic<u32> sleepingWorkers;
 	bool terminating = false;
 
-	std::thread worker;
-	std::queue<Job> queue;
-	std::mutex mutex;
-	std::condition_variable condition;
+	// waitAll() parks here once nothing is left to help with.
+	std::mutex idleMutex;
+	std::condition_variable idleCondition;
 };
 
+// Process wide queue, launched with one worker per hardware thread on first use.
+JobQueue& sharedJobQueue();
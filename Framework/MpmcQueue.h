@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// ========================================================
+// class MpmcQueue
+// Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's
+// bounded MPMC queue, 1024cores.net).
+//
+// Each cell carries a sequence number that says whose turn it is: a producer
+// may write cell i when its sequence equals the enqueue position, a consumer
+// may read it when the sequence equals position + 1. Producers and consumers
+// only contend on their own position counter, with one CAS per operation and
+// no locks. Capacity is rounded up to a power of two. T must be default
+// constructible and movable; in practice it is a slot index.
+// ========================================================
+
+template<typename T>
+class MpmcQueue final
+{
+public:
+	explicit MpmcQueue(size_t minCapacity = 1024)
+	{
+		size_t capacity = 2;
+		while (capacity < minCapacity)
+		{
+			capacity <<= 1;
+		}
+		mask = capacity - 1;
+		cells.reset(new Cell[capacity]);
+		for (size_t i = 0; i < capacity; ++i)
+		{
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		enqueuePos.store(0, std::memory_order_relaxed);
+		dequeuePos.store(0, std::memory_order_relaxed);
+	}
+
+	MpmcQueue(const MpmcQueue&) = delete;
+	MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+	// Returns false if the queue is full.
+	bool tryPush(T item)
+	{
+		Cell* cell;
+		size_t pos = enqueuePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			cell = &cells[pos & mask];
+			const size_t kSequence = cell->sequence.load(std::memory_order_acquire);
+			const intptr_t kDiff = static_cast<intptr_t>(kSequence) - static_cast<intptr_t>(pos);
+			if (kDiff == 0)
+			{
+				if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (kDiff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				pos = enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->item = std::move(item);
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Returns false if the queue is empty.
+	bool tryPop(T& rItem)
+	{
+		Cell* cell;
+		size_t pos = dequeuePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			cell = &cells[pos & mask];
+			const size_t kSequence = cell->sequence.load(std::memory_order_acquire);
+			const intptr_t kDiff = static_cast<intptr_t>(kSequence) - static_cast<intptr_t>(pos + 1);
+			if (kDiff == 0)
+			{
+				if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (kDiff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				pos = dequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		rItem = std::move(cell->item);
+		cell->sequence.store(pos + mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Approximate, only meaningful when no other thread is pushing or popping.
+	bool empty() const
+	{
+		return enqueuePos.load(std::memory_order_acquire) == dequeuePos.load(std::memory_order_acquire);
+	}
+
+	size_t capacity() const { return mask + 1; }
+
+private:
+	static constexpr size_t kCacheLine = 64;
+
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		T item;
+	};
+
+	// Producers and consumers each get their own cache line
+	std::unique_ptr<Cell[]> cells;
+	size_t mask = 0;
+	char pad0[kCacheLine];
+	std::atomic<size_t> enqueuePos;
+	char pad1[kCacheLine - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> dequeuePos;
+	char pad2[kCacheLine - sizeof(std::atomic<size_t>)];
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "JobQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <vector>
+
+// ========================================================
+// Chunked data parallel loops over the job system.
+//
+// [begin, end) is cut into fixed chunks of `grain` items (the last one may be
+// shorter) and each chunk becomes one job. The partition depends only on
+// begin, end and grain, never on the number of workers or on timing, so
+// parallel_reduce combines the same partial results in the same order on
+// every run. The calling thread runs the first chunk and then helps with the
+// rest, so these may be nested inside jobs.
+// ========================================================
+
+// fn(chunkBegin, chunkEnd) is called once per chunk.
+template<typename Fn>
+void parallel_for(JobQueue& queue, u32 begin, u32 end, u32 grain, const Fn& fn)
+{
+	assert(grain > 0);
+	if (begin >= end)
+	{
+		return;
+	}
+
+	const u32 kNumChunks = (end - begin + grain - 1) / grain;
+	if (kNumChunks == 1)
+	{
+		fn(begin, end);
+		return;
+	}
+
+	std::atomic<u32> remaining(kNumChunks - 1);
+	for (u32 chunk = 1; chunk < kNumChunks; ++chunk)
+	{
+		const u32 kFirst = begin + chunk * grain;
+		const u32 kLast = std::min(end, kFirst + grain);
+		queue.pushJob([&fn, &remaining, kFirst, kLast]() {
+			fn(kFirst, kLast);
+			remaining.fetch_sub(1, std::memory_order_release);
+		});
+	}
+
+	fn(begin, std::min(end, begin + grain));
+	queue.waitCounter(remaining);
+}
+
+template<typename Fn>
+void parallel_for(u32 begin, u32 end, u32 grain, const Fn& fn)
+{
+	parallel_for(sharedJobQueue(), begin, end, grain, fn);
+}
+
+// map(chunkBegin, chunkEnd) returns a partial T per chunk; partials are folded
+// left to right with combine(T, T), starting from identity.
+template<typename T, typename MapFn, typename CombineFn>
+T parallel_reduce(JobQueue& queue, u32 begin, u32 end, u32 grain, const T& identity, const MapFn& map, const CombineFn& combine)
+{
+	assert(grain > 0);
+	if (begin >= end)
+	{
+		return identity;
+	}
+
+	const u32 kNumChunks = (end - begin + grain - 1) / grain;
+	std::vector<T> partials(kNumChunks, identity);
+
+	parallel_for(queue, 0, kNumChunks, 1, [&](u32 firstChunk, u32 lastChunk) {
+		for (u32 chunk = firstChunk; chunk < lastChunk; ++chunk)
+		{
+			const u32 kFirst = begin + chunk * grain;
+			partials[chunk] = map(kFirst, std::min(end, kFirst + grain));
+		}
+	});
+
+	T result = identity;
+	for (const T& partial : partials)
+	{
+		result = combine(result, partial);
+	}
+	return result;
+}
+
+template<typename T, typename MapFn, typename CombineFn>
+T parallel_reduce(u32 begin, u32 end, u32 grain, const T& identity, const MapFn& map, const CombineFn& combine)
+{
+	return parallel_reduce(sharedJobQueue(), begin, end, grain, identity, map, combine);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "CoreTypes.h"
+
+#include <atomic>
+#include <thread>
+
+// ========================================================
+// class PerThread
+// One T per thread that touches it, for jobs that accumulate results without
+// sharing them: each thread gets its own instance from local(), and the
+// owner merges them with forEach() once the jobs are done.
+//
+// A thread finds its instance through a small thread_local cache keyed by a
+// per-object id, and the first time it calls local() it links a new
+// instance into a lock-free list, so local() never locks and instances
+// never share a cache line. Ids are never reused, so a cache entry left by a
+// destroyed object can never match again. Each instance records the thread
+// that owns it, so a thread using more than kCacheSize objects of one T in
+// turn finds its instance again by walking the list when it comes back to
+// one evicted from its cache, and keeps its contents.
+// ========================================================
+
+template<typename T>
+class PerThread final
+{
+public:
+	static constexpr u32 kCacheSize = 8;
+
+	PerThread() : id(nextId()), head(nullptr) {}
+
+	~PerThread()
+	{
+		Node* node = head.load(std::memory_order_acquire);
+		while (node)
+		{
+			Node* next = node->next;
+			delete node;
+			node = next;
+		}
+	}
+
+	PerThread(const PerThread&) = delete;
+	PerThread& operator=(const PerThread&) = delete;
+
+	// The calling thread's instance, value-initialized on first use.
+	T& local()
+	{
+		struct CacheEntry
+		{
+			u64 id;
+			Node* node;
+		};
+		static thread_local CacheEntry t_cache[kCacheSize] = {};
+		static thread_local u32 t_nextEntry = 0;
+
+		for (const CacheEntry& entry : t_cache)
+		{
+			if (entry.id == id)
+			{
+				return entry.node->value;
+			}
+		}
+
+		// Evicted from the cache, or first use. Other threads only push at
+		// the head, so the list below it never changes.
+		const std::thread::id kThread = std::this_thread::get_id();
+		Node* node = head.load(std::memory_order_acquire);
+		while (node && node->owner != kThread)
+		{
+			node = node->next;
+		}
+		if (!node)
+		{
+			node = new Node();
+			node->owner = kThread;
+			node->next = head.load(std::memory_order_relaxed);
+			while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+			{
+			}
+		}
+		t_cache[t_nextEntry] = CacheEntry{ id, node };
+		t_nextEntry = (t_nextEntry + 1) % kCacheSize;
+		return node->value;
+	}
+
+	// fn(T&) for every instance. Only while no thread is inside local() or
+	// using its instance.
+	template<typename Fn>
+	void forEach(const Fn& fn)
+	{
+		for (Node* node = head.load(std::memory_order_acquire); node; node = node->next)
+		{
+			fn(node->value);
+		}
+	}
+
+	template<typename Fn>
+	void forEach(const Fn& fn) const
+	{
+		for (const Node* node = head.load(std::memory_order_acquire); node; node = node->next)
+		{
+			fn(static_cast<const T&>(node->value));
+		}
+	}
+
+private:
+	struct Node
+	{
+		T value{};
+		Node* next = nullptr;
+		std::thread::id owner;
+
+		// Keeps the fields above off the next instance's cache lines
+		char pad[64];
+	};
+
+	static u64 nextId()
+	{
+		// Zero marks an empty cache entry
+		static std::atomic<u64> s_nextId(1);
+		return s_nextId.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	const u64 id;
+	std::atomic<Node*> head;
+};
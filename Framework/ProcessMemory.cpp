@@ -0,0 +1,72 @@
+#include "ProcessMemory.h"
+
+#if defined(_WIN32)
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <cstdio>
+	#include <sys/resource.h>
+	#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+u64 current_resident_bytes()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return 0;
+	}
+	return counters.WorkingSetSize;
+}
+
+u64 peak_resident_bytes()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return 0;
+	}
+	return counters.PeakWorkingSetSize;
+}
+
+#else
+
+u64 current_resident_bytes()
+{
+	// Second field of statm is the resident page count
+	FILE* pFile = std::fopen("/proc/self/statm", "r");
+	if (!pFile)
+	{
+		return 0;
+	}
+
+	unsigned long long size = 0;
+	unsigned long long resident = 0;
+	const int kRead = std::fscanf(pFile, "%llu %llu", &size, &resident);
+	std::fclose(pFile);
+	return kRead == 2 ? resident * static_cast<u64>(sysconf(_SC_PAGESIZE)) : 0;
+}
+
+u64 peak_resident_bytes()
+{
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+	{
+		return 0;
+	}
+#if defined(__APPLE__)
+	return static_cast<u64>(usage.ru_maxrss);
+#else
+	return static_cast<u64>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+#endif
@@ -0,0 +1,15 @@
+#pragma once
+
+//================================================================================
+// Resident memory of the current process, for startup and memory reports.
+// Portable: no Windows or DirectX headers.
+//================================================================================
+
+#include "CoreTypes.h"
+
+// Bytes of physical memory the process uses now (working set on Windows).
+// Zero if the platform cannot tell.
+u64 current_resident_bytes();
+
+// Highest current_resident_bytes() since the process started.
+u64 peak_resident_bytes();
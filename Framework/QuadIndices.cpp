@@ -0,0 +1,41 @@
+#include "QuadIndices.h"
+
+#include "ParallelFor.h"
+
+#include <cassert>
+
+namespace
+{
+	// Quads per job; 384 KB of indices
+	constexpr u32 kQuadIndexGrain = 16384;
+
+	template<typename Index>
+	void write_quads(Index* pIndices, const u32 kFirstQuad, const u32 kNumQuads)
+	{
+		// Whole quads in order, so each job streams through its span once
+		u32 vertex = kFirstQuad * kQuadVertices;
+		for (u32 q = 0; q < kNumQuads; ++q, vertex += kQuadVertices, pIndices += kQuadIndices)
+		{
+			pIndices[0] = static_cast<Index>(vertex);
+			pIndices[1] = static_cast<Index>(vertex + 1);
+			pIndices[2] = static_cast<Index>(vertex + 2);
+			pIndices[3] = static_cast<Index>(vertex);
+			pIndices[4] = static_cast<Index>(vertex + 2);
+			pIndices[5] = static_cast<Index>(vertex + 3);
+		}
+	}
+}
+
+void write_quad_pattern(u16* pIndices, const u32 kNumQuads)
+{
+	assert(kNumQuads <= kQuadPatternQuads);
+	write_quads(pIndices, 0, kNumQuads);
+}
+
+void write_quad_indices(u32* pIndices, const u32 kFirstQuad, const u32 kNumQuads)
+{
+	assert((static_cast<u64>(kFirstQuad) + kNumQuads) * kQuadVertices <= 0x100000000ull);
+	parallel_for(0, kNumQuads, kQuadIndexGrain, [pIndices, kFirstQuad](u32 first, u32 last) {
+		write_quads(pIndices + size_t(first) * kQuadIndices, kFirstQuad + first, last - first);
+	});
+}
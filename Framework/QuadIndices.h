@@ -0,0 +1,43 @@
+#pragma once
+
+//================================================================================
+// Index generation for particle quads. Quad q is vertices 4q..4q+3, drawn as
+// the triangles (0, 1, 2) and (0, 2, 3). Two ways to get the indices:
+//
+//  - Shared pattern: kQuadPatternQuads quads of 16-bit indices, built once
+//    and reused for every block of quads. Block b is the same pattern drawn
+//    as instance b, with the vertex shader offsetting by the instance ID,
+//    since the vertex ID does not see a base vertex. 192 KB covers any count.
+//  - Full: 32-bit indices for a range of quads, written in parallel straight
+//    into memory the caller owns, e.g. a mapped buffer, with no intermediate
+//    copy.
+//
+// Portable: no Windows or DirectX headers.
+//================================================================================
+
+#include "CoreTypes.h"
+
+constexpr u32 kQuadVertices = 4;
+constexpr u32 kQuadIndices = 6;
+
+// Largest pattern whose vertices all fit a 16-bit index.
+constexpr u32 kQuadPatternQuads = 65536 / kQuadVertices;
+constexpr u32 kQuadPatternVertices = kQuadPatternQuads * kQuadVertices;
+constexpr u32 kQuadPatternIndices = kQuadPatternQuads * kQuadIndices;
+
+// Write the pattern for kNumQuads quads (at most kQuadPatternQuads) to
+// pIndices, which holds kNumQuads * kQuadIndices entries.
+void write_quad_pattern(u16* pIndices, const u32 kNumQuads);
+
+// Number of pattern instances needed for kNumQuads quads. The last may be
+// a partial block, whose extra quads the vertex shader drops.
+inline u32 quad_pattern_draw_count(const u32 kNumQuads)
+{
+	return (kNumQuads + kQuadPatternQuads - 1) / kQuadPatternQuads;
+}
+
+// Write the 32-bit indices of quads [kFirstQuad, kFirstQuad + kNumQuads) to
+// pIndices, in parallel on the shared job queue. pIndices receives
+// kNumQuads * kQuadIndices entries and is only written, never read, so it
+// may point at write-combined mapped memory.
+void write_quad_indices(u32* pIndices, const u32 kFirstQuad, const u32 kNumQuads);
@@ -0,0 +1,291 @@
+#pragma once
+
+//================================================================================
+// Random
+// Random number generators that are safe to use from many threads at once.
+//
+//  - philox4x32(): the Philox4x32-10 counter-based generator (Salmon et al.,
+//    "Parallel random numbers: as easy as 1, 2, 3", SC11). Output is a pure
+//    function of (key, counter), so any thread can produce the numbers for
+//    item i directly, with no shared state and no dependence on how work is
+//    split. CounterRng wraps it with a 64-bit seed and item index.
+//  - Xoshiro128Plus: a small, fast sequential generator (Blackman & Vigna),
+//    for one thread that needs a long stream of numbers.
+//  - XoshiroStream: kXoshiroLanes independent xoshiro128+ generators stepped
+//    together with SSE2, for filling arrays. Lanes are seeded from Philox so
+//    they never overlap in practice.
+//
+// Neither generator is cryptographic.
+//================================================================================
+
+#include "CoreTypes.h"
+
+#include <atomic>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define RANDOM_HAS_SSE2 1
+#endif
+
+// ========================================================
+// Conversions from random bits
+// ========================================================
+
+// Uniform in [0, 1), from the top 24 bits.
+inline f32 random_unit(const u32 kBits)
+{
+	return static_cast<f32>(kBits >> 8) * (1.0f / 16777216.0f);
+}
+
+// Uniform in [kLow, kHigh).
+inline f32 random_range(const u32 kBits, const f32 kLow, const f32 kHigh)
+{
+	return kLow + (kHigh - kLow) * random_unit(kBits);
+}
+
+// ========================================================
+// Philox4x32-10
+// ========================================================
+
+inline void philox4x32(u32 counter[4], const u32 key[2])
+{
+	constexpr u32 kMultiplier0 = 0xD2511F53u;
+	constexpr u32 kMultiplier1 = 0xCD9E8D57u;
+	constexpr u32 kWeyl0 = 0x9E3779B9u;
+	constexpr u32 kWeyl1 = 0xBB67AE85u;
+
+	u32 k0 = key[0];
+	u32 k1 = key[1];
+	for (u32 round = 0; round < 10; ++round)
+	{
+		const u64 kProduct0 = static_cast<u64>(kMultiplier0) * counter[0];
+		const u64 kProduct1 = static_cast<u64>(kMultiplier1) * counter[2];
+		const u32 c1 = counter[1];
+		const u32 c3 = counter[3];
+		counter[0] = static_cast<u32>(kProduct1 >> 32) ^ c1 ^ k0;
+		counter[1] = static_cast<u32>(kProduct1);
+		counter[2] = static_cast<u32>(kProduct0 >> 32) ^ c3 ^ k1;
+		counter[3] = static_cast<u32>(kProduct0);
+		k0 += kWeyl0;
+		k1 += kWeyl1;
+	}
+}
+
+// ========================================================
+// class CounterRng
+// Philox keyed by a seed. block(index, stream) returns four random words
+// for item index; stream separates independent uses of the same item (e.g.
+// position and velocity), each giving another four words.
+// ========================================================
+
+class CounterRng final
+{
+public:
+	explicit CounterRng(const u64 kSeed = 0)
+	{
+		m_key[0] = static_cast<u32>(kSeed);
+		m_key[1] = static_cast<u32>(kSeed >> 32);
+	}
+
+	void block(const u64 kIndex, const u32 kStream, u32 out[4]) const
+	{
+		out[0] = static_cast<u32>(kIndex);
+		out[1] = static_cast<u32>(kIndex >> 32);
+		out[2] = kStream;
+		out[3] = 0;
+		philox4x32(out, m_key);
+	}
+
+private:
+	u32 m_key[2];
+};
+
+// ========================================================
+// class Xoshiro128Plus
+// ========================================================
+
+class Xoshiro128Plus final
+{
+public:
+	// Seeded from Philox block (kSeed, kStream), so distinct streams of the
+	// same seed start at unrelated states.
+	explicit Xoshiro128Plus(const u64 kSeed = 0, const u32 kStream = 0)
+	{
+		seed(kSeed, kStream);
+	}
+
+	void seed(const u64 kSeed, const u32 kStream)
+	{
+		CounterRng(kSeed).block(0, kStream, m_state);
+		// The all-zero state is the one fixed point
+		if ((m_state[0] | m_state[1] | m_state[2] | m_state[3]) == 0)
+		{
+			m_state[0] = 1;
+		}
+	}
+
+	u32 next()
+	{
+		const u32 kResult = m_state[0] + m_state[3];
+		const u32 kShifted = m_state[1] << 9;
+		m_state[2] ^= m_state[0];
+		m_state[3] ^= m_state[1];
+		m_state[1] ^= m_state[2];
+		m_state[0] ^= m_state[3];
+		m_state[2] ^= kShifted;
+		m_state[3] = (m_state[3] << 11) | (m_state[3] >> 21);
+		return kResult;
+	}
+
+	// Uniform in [kLow, kHigh). The low bits of xoshiro128+ are weak, and
+	// random_unit() only uses the top 24.
+	f32 uniform(const f32 kLow, const f32 kHigh) { return random_range(next(), kLow, kHigh); }
+
+private:
+	u32 m_state[4];
+};
+
+// ========================================================
+// class XoshiroStream
+// kXoshiroLanes xoshiro128+ generators in structure-of-arrays form. next()
+// steps every lane at once and yields one word per lane; fill_uniform()
+// writes whole arrays of floats that way.
+// ========================================================
+
+constexpr u32 kXoshiroLanes = 16;
+
+class XoshiroStream final
+{
+public:
+	explicit XoshiroStream(const u64 kSeed = 0, const u32 kStream = 0)
+	{
+		seed(kSeed, kStream);
+	}
+
+	// Lane l starts from Philox block (l, kStream) of kSeed.
+	void seed(const u64 kSeed, const u32 kStream)
+	{
+		const CounterRng rng(kSeed);
+		for (u32 lane = 0; lane < kXoshiroLanes; ++lane)
+		{
+			u32 state[4];
+			rng.block(lane, kStream, state);
+			if ((state[0] | state[1] | state[2] | state[3]) == 0)
+			{
+				state[0] = 1;
+			}
+			for (u32 w = 0; w < 4; ++w)
+			{
+				m_state[w][lane] = state[w];
+			}
+		}
+		m_buffered = kXoshiroLanes;
+	}
+
+	// One word from each lane.
+	void next(u32 out[kXoshiroLanes])
+	{
+#ifdef RANDOM_HAS_SSE2
+		for (u32 lane = 0; lane < kXoshiroLanes; lane += 4)
+		{
+			__m128i s0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_state[0][lane]));
+			__m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_state[1][lane]));
+			__m128i s2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_state[2][lane]));
+			__m128i s3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_state[3][lane]));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + lane), _mm_add_epi32(s0, s3));
+			const __m128i kShifted = _mm_slli_epi32(s1, 9);
+			s2 = _mm_xor_si128(s2, s0);
+			s3 = _mm_xor_si128(s3, s1);
+			s1 = _mm_xor_si128(s1, s2);
+			s0 = _mm_xor_si128(s0, s3);
+			s2 = _mm_xor_si128(s2, kShifted);
+			s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&m_state[0][lane]), s0);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&m_state[1][lane]), s1);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&m_state[2][lane]), s2);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&m_state[3][lane]), s3);
+		}
+#else
+		for (u32 lane = 0; lane < kXoshiroLanes; ++lane)
+		{
+			u32& s0 = m_state[0][lane];
+			u32& s1 = m_state[1][lane];
+			u32& s2 = m_state[2][lane];
+			u32& s3 = m_state[3][lane];
+
+			out[lane] = s0 + s3;
+			const u32 kShifted = s1 << 9;
+			s2 ^= s0;
+			s3 ^= s1;
+			s1 ^= s2;
+			s0 ^= s3;
+			s2 ^= kShifted;
+			s3 = (s3 << 11) | (s3 >> 21);
+		}
+#endif
+	}
+
+	// Write kCount floats uniform in [kLow, kHigh). Whole batches of
+	// kXoshiroLanes are drawn, so the output depends only on the seed and
+	// the counts passed to earlier calls.
+	void fill_uniform(f32* pOut, const u32 kCount, const f32 kLow, const f32 kHigh)
+	{
+		u32 bits[kXoshiroLanes];
+		for (u32 first = 0; first < kCount; first += kXoshiroLanes)
+		{
+			next(bits);
+			const u32 kBatch = kCount - first < kXoshiroLanes ? kCount - first : kXoshiroLanes;
+#ifdef RANDOM_HAS_SSE2
+			if (kBatch == kXoshiroLanes)
+			{
+				const __m128 kScale = _mm_set1_ps((kHigh - kLow) * (1.0f / 16777216.0f));
+				const __m128 kOffset = _mm_set1_ps(kLow);
+				for (u32 lane = 0; lane < kXoshiroLanes; lane += 4)
+				{
+					const __m128i kTop = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bits + lane)), 8);
+					_mm_storeu_ps(pOut + first + lane, _mm_add_ps(kOffset, _mm_mul_ps(kScale, _mm_cvtepi32_ps(kTop))));
+				}
+				continue;
+			}
+#endif
+			for (u32 lane = 0; lane < kBatch; ++lane)
+			{
+				pOut[first + lane] = random_range(bits[lane], kLow, kHigh);
+			}
+		}
+	}
+
+	// Single draw, served from a buffered batch.
+	f32 uniform(const f32 kLow, const f32 kHigh)
+	{
+		if (m_buffered == kXoshiroLanes)
+		{
+			next(m_buffer);
+			m_buffered = 0;
+		}
+		return random_range(m_buffer[m_buffered++], kLow, kHigh);
+	}
+
+private:
+	// Accessed with unaligned loads and stores rather than declared
+	// alignas(16): LorenzSimulator embeds a stream and is allocated with
+	// new, which only guarantees 8 bytes on 32-bit targets before C++17.
+	// On aligned addresses the unaligned forms cost nothing.
+	u32 m_state[4][kXoshiroLanes];
+	u32 m_buffer[kXoshiroLanes];
+	u32 m_buffered;
+};
+
+// ========================================================
+// Per-thread generator for incidental randomness (randf() and friends).
+// Each thread gets its own stream, so calls never contend or race.
+// ========================================================
+
+inline Xoshiro128Plus& thread_random()
+{
+	static std::atomic<u32> nextStream(0);
+	thread_local Xoshiro128Plus rng(0x5EED5EEDu, nextStream.fetch_add(1, std::memory_order_relaxed));
+	return rng;
+}
@@ -122,6 +122,9 @@ ID3D11Buffer* create_dynamic_structured_buffer(ID3D11Device* pDevice, u32 elemen
 	return pBuffer;
 }
 
+// Structured buffer read and written by shaders. Returns nullptr if it cannot
+// be created, e.g. when a large particle buffer does not fit in video
+// memory, so callers can fall back rather than crash.
 template<typename StructureElementType>
 ID3D11Buffer* create_default_structured_buffer(ID3D11Device* pDevice, u32 numElements, D3D11_SUBRESOURCE_DATA* pData)
 {
@@ -136,7 +139,10 @@ ID3D11Buffer* create_default_structured_buffer(ID3D11Device* pDevice, u32 numEle
 	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
 
 	HRESULT hr = pDevice->CreateBuffer(&desc, pData, &pBuffer);
-	ASSERT(!FAILED(hr) && pBuffer);
+	if (FAILED(hr))
+	{
+		SAFE_RELEASE(pBuffer);
+	}
 
 	return pBuffer;
 }
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "CoreTypes.h"
+
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define SPIN_WAIT_HAS_PAUSE 1
+#endif
+
+// Tell the core we are busy waiting (PAUSE on x86), so a hyper-threaded
+// sibling gets the pipeline and the exit from the loop is not mispredicted.
+inline void cpu_relax()
+{
+#ifdef SPIN_WAIT_HAS_PAUSE
+	_mm_pause();
+#else
+	std::this_thread::yield();
+#endif
+}
+
+// ========================================================
+// class SpinWait
+// Backoff for spin-then-park loops: a few rounds of exponentially longer
+// PAUSE bursts, then yielding the time slice. Once shouldPark() returns true
+// the caller is expected to block on its own condition variable and reset().
+// ========================================================
+
+class SpinWait final
+{
+public:
+	// Pause spins double each round up to 2^kPauseRounds, then yields follow.
+	static constexpr u32 kPauseRounds = 6;
+	static constexpr u32 kYieldRounds = 16;
+
+	void spinOnce()
+	{
+		if (count < kPauseRounds)
+		{
+			for (u32 i = 0, n = 1u << count; i < n; ++i)
+			{
+				cpu_relax();
+			}
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+		++count;
+	}
+
+	bool shouldPark() const { return count >= kPauseRounds + kYieldRounds; }
+
+	void reset() { count = 0; }
+
+private:
+	u32 count = 0;
+};
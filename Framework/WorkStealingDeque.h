@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// ========================================================
+// class WorkStealingDeque
+// Chase-Lev work-stealing deque (Le, Pop, Cohen & Zappa Nardelli, "Correct
+// and Efficient Work-Stealing for Weak Memory Models", PPoPP 2013).
+//
+// The owning thread pushes and pops at the bottom (LIFO, cache warm); any
+// other thread may steal from the top (FIFO). T must be trivially copyable,
+// in practice a pointer or index. The ring grows on demand; retired rings are
+// kept until destruction because a concurrent thief may still be reading them.
+// ========================================================
+
+template<typename T>
+class WorkStealingDeque final
+{
+public:
+	explicit WorkStealingDeque(int64_t initialCapacity = 1024)
+	{
+		int64_t capacity = 1;
+		while (capacity < initialCapacity)
+		{
+			capacity <<= 1;
+		}
+		ring.store(new Ring(capacity), std::memory_order_relaxed);
+	}
+
+	~WorkStealingDeque()
+	{
+		delete ring.load(std::memory_order_relaxed);
+		for (Ring* retired : retiredRings)
+		{
+			delete retired;
+		}
+	}
+
+	WorkStealingDeque(const WorkStealingDeque&) = delete;
+	WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+	// Owner only.
+	void push(T item)
+	{
+		const int64_t b = bottom.load(std::memory_order_relaxed);
+		const int64_t t = top.load(std::memory_order_acquire);
+		Ring* r = ring.load(std::memory_order_relaxed);
+
+		if (b - t > r->capacity - 1)
+		{
+			r = grow(r, b, t);
+		}
+
+		r->put(b, item);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	// Owner only. Returns false if the deque was empty.
+	bool pop(T& itemOut)
+	{
+		const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		Ring* r = ring.load(std::memory_order_relaxed);
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		if (t > b)
+		{
+			// Empty
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return false;
+		}
+
+		itemOut = r->get(b);
+		if (t == b)
+		{
+			// Last item: race thieves for it
+			const bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return won;
+		}
+		return true;
+	}
+
+	// Any thread. Returns false if empty or if another thread won the race.
+	bool steal(T& itemOut)
+	{
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t b = bottom.load(std::memory_order_acquire);
+
+		if (t >= b)
+		{
+			return false;
+		}
+
+		Ring* r = ring.load(std::memory_order_acquire);
+		T item = r->get(t);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			return false;
+		}
+		itemOut = item;
+		return true;
+	}
+
+	// Approximate, for heuristics only.
+	bool empty() const
+	{
+		return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Ring
+	{
+		explicit Ring(int64_t c) : capacity(c), mask(c - 1), items(new std::atomic<T>[static_cast<std::size_t>(c)]) {}
+		~Ring() { delete[] items; }
+
+		void put(int64_t i, T item) { items[i & mask].store(item, std::memory_order_relaxed); }
+		T get(int64_t i) const { return items[i & mask].load(std::memory_order_relaxed); }
+
+		const int64_t capacity;
+		const int64_t mask;
+		std::atomic<T>* items;
+	};
+
+	Ring* grow(Ring* oldRing, int64_t b, int64_t t)
+	{
+		Ring* newRing = new Ring(oldRing->capacity * 2);
+		for (int64_t i = t; i < b; ++i)
+		{
+			newRing->put(i, oldRing->get(i));
+		}
+		retiredRings.push_back(oldRing);
+		ring.store(newRing, std::memory_order_release);
+		return newRing;
+	}
+
+	// Thieves hammer top while the owner works on bottom, keep them on
+	// separate cache lines. Padding rather than alignas so heap allocated
+	// deques do not need C++17 aligned new.
+	std::atomic<int64_t> top{ 0 };
+	char topPadding[64 - sizeof(std::atomic<int64_t>)];
+	std::atomic<int64_t> bottom{ 0 };
+	char bottomPadding[64 - sizeof(std::atomic<int64_t>)];
+	std::atomic<Ring*> ring{ nullptr };
+	std::vector<Ring*> retiredRings;
+};
@@ -0,0 +1,161 @@
+//================================================================================
+// CompactParticleBench
+// Encode and decode throughput of the 8 byte CompactParticle format against
+// the 28 byte LorenzParticle, and a check of its documented error bounds.
+//
+// Particles are settled onto the attractor with the app's Euler step, and the
+// format covers their bounds and ages. For every instruction set the machine
+// supports, the table gives single core encode and decode rates, the worst
+// position and age errors as a fraction of the bounds in CompactParticle.h
+// (must be <= 1), and whether the encoding matches the scalar kernel bit for
+// bit. The velocity line compares Euler's stored velocities with the ones
+// decoding recomputes.
+//
+// Exits with 1 if any bound is exceeded or any encoding differs.
+//
+// Usage: CompactParticleBench [particles] [iterations]
+//================================================================================
+
+#include "LorenzKernels.h"
+#include "LorenzSimulator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	template<typename Fn>
+	f64 best_seconds(const u32 kIterations, Fn fn)
+	{
+		f64 best = 1e30;
+		for (u32 i = 0; i < kIterations; ++i)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			fn();
+			const f64 seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+			best = seconds < best ? seconds : best;
+		}
+		return best;
+	}
+
+	struct Errors
+	{
+		f64 m_position;
+		f64 m_age;
+	};
+
+	// Worst errors of the decoded streams relative to their bounds.
+	Errors measure_errors(const std::vector<LorenzParticle>& reference, ParticleStreams& decoded, const CompactParticleFormat& format)
+	{
+		Errors errors = { 0.0, 0.0 };
+		const f32 kAgeBound = compact_age_error(format);
+		const Float3 kBound = compact_position_error(format);
+		for (u32 i = 0; i < static_cast<u32>(reference.size()); ++i)
+		{
+			const LorenzParticle& p = reference[i];
+			errors.m_position = std::max(errors.m_position, std::fabs(decoded.stream(ParticleStreams::kPosX)[i] - p.m_position.x) / f64(kBound.x));
+			errors.m_position = std::max(errors.m_position, std::fabs(decoded.stream(ParticleStreams::kPosY)[i] - p.m_position.y) / f64(kBound.y));
+			errors.m_position = std::max(errors.m_position, std::fabs(decoded.stream(ParticleStreams::kPosZ)[i] - p.m_position.z) / f64(kBound.z));
+			errors.m_age = std::max(errors.m_age, std::fabs(decoded.stream(ParticleStreams::kAge)[i] - p.m_age) / f64(kAgeBound));
+		}
+		return errors;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const u32 kParticles = argc > 1 ? static_cast<u32>(std::strtoul(argv[1], nullptr, 10)) : 1000000;
+	const u32 kIterations = argc > 2 ? static_cast<u32>(std::strtoul(argv[2], nullptr, 10)) : 10;
+	const f32 kDeltaTime = 1.0f / 120.0f;
+
+	// Settle onto the attractor
+	LorenzSimulator simulator;
+	simulator.init(kParticles, 1);
+	for (u32 i = 0; i < 240; ++i)
+	{
+		simulator.step(kDeltaTime);
+	}
+
+	std::vector<LorenzParticle> reference(kParticles);
+	simulator.read_particles(reference.data());
+
+	ParticleBounds bounds = kEmptyParticleBounds;
+	f32 maxAge = 0.0f;
+	for (const LorenzParticle& p : reference)
+	{
+		bounds = merge_bounds(bounds, ParticleBounds{ p.m_position, p.m_position });
+		maxAge = std::max(maxAge, p.m_age);
+	}
+	const CompactParticleFormat kFormat = make_compact_format(bounds, maxAge);
+
+	ParticleStreams source;
+	source.resize(kParticles);
+	source.load_aos(reference.data(), 0, kParticles);
+	const ParticleStreamRange kSource = source.range(0, kParticles);
+
+	ParticleStreams decoded;
+	decoded.resize(kParticles);
+	const ParticleStreamRange kDecoded = decoded.range(0, kParticles);
+
+	std::printf("particles: %u, bytes: %u compact vs %u fp32, step: (%.2e, %.2e, %.2e), age step: %.3f s\n", kParticles,
+		static_cast<u32>(sizeof(CompactParticle)), static_cast<u32>(sizeof(LorenzParticle)),
+		kFormat.m_step.x, kFormat.m_step.y, kFormat.m_step.z, kFormat.m_ageStep);
+
+	// fp32 baseline: the AoS conversion an upload or snapshot does today
+	std::vector<LorenzParticle> aos(kParticles);
+	const f64 kAosSeconds = best_seconds(kIterations, [&]() { source.store_aos(aos.data(), 0, kParticles); });
+	std::printf("%-8s %10s %10s %10s %10s %10s %6s\n", "kernel", "enc ns/p", "enc GB/s", "dec ns/p", "pos/bound", "age/bound", "bits");
+	std::printf("%-8s %10.3f %10.2f %10s %10s %10s %6s\n", "fp32 aos", kAosSeconds * 1e9 / kParticles,
+		kParticles * (16.0 + sizeof(LorenzParticle)) / kAosSeconds * 1e-9, "", "", "", "");
+
+	std::vector<CompactParticle> scalarEncoded(kParticles);
+	lorenz_kernel_table(SimdLevel::kScalar)->m_pEncodeCompact(kSource, kFormat, scalarEncoded.data());
+
+	bool passed = true;
+	std::vector<CompactParticle> encoded(kParticles);
+	for (int level = SimdLevel::kScalar; level < SimdLevel::kMaxLevels; ++level)
+	{
+		const SimdLevel::SimdLevelEnum kLevel = static_cast<SimdLevel::SimdLevelEnum>(level);
+		const LorenzKernelTable* pTable = lorenz_kernel_table(kLevel);
+		if (!pTable || !cpu_supports(kLevel))
+		{
+			continue;
+		}
+
+		const f64 kEncodeSeconds = best_seconds(kIterations, [&]() { pTable->m_pEncodeCompact(kSource, kFormat, encoded.data()); });
+		const f64 kDecodeSeconds = best_seconds(kIterations, [&]() {
+			pTable->m_pDecodeCompact(encoded.data(), kFormat, simulator.parameters(), kDecoded);
+		});
+
+		const bool kSameBits = std::memcmp(encoded.data(), scalarEncoded.data(), kParticles * sizeof(CompactParticle)) == 0;
+		const Errors kErrors = measure_errors(reference, decoded, kFormat);
+		passed = passed && kSameBits && kErrors.m_position <= 1.0 && kErrors.m_age <= 1.0;
+
+		// Encode reads position and age (16 bytes) and writes 8
+		std::printf("%-8s %10.3f %10.2f %10.3f %10.3f %10.3f %6s\n", pTable->m_pName, kEncodeSeconds * 1e9 / kParticles,
+			kParticles * (16.0 + sizeof(CompactParticle)) / kEncodeSeconds * 1e-9, kDecodeSeconds * 1e9 / kParticles,
+			kErrors.m_position, kErrors.m_age, kSameBits ? "same" : "DIFF");
+	}
+
+	// Euler stores the derivative at the previous position; decoding takes it
+	// at the (quantized) current one
+	f64 sumError2 = 0.0;
+	f64 sumSpeed2 = 0.0;
+	for (u32 i = 0; i < kParticles; ++i)
+	{
+		const Float3& v = reference[i].m_velocity;
+		const f64 dx = decoded.stream(ParticleStreams::kVelX)[i] - v.x;
+		const f64 dy = decoded.stream(ParticleStreams::kVelY)[i] - v.y;
+		const f64 dz = decoded.stream(ParticleStreams::kVelZ)[i] - v.z;
+		sumError2 += dx * dx + dy * dy + dz * dz;
+		sumSpeed2 += f64(v.x) * v.x + f64(v.y) * v.y + f64(v.z) * v.z;
+	}
+	std::printf("velocity: rms error %.3f of rms speed (one Euler step of lag plus quantization)\n", std::sqrt(sumError2 / sumSpeed2));
+	std::printf("%s\n", passed ? "error bounds hold" : "FAILED: error bound exceeded or encodings differ");
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,241 @@
+//================================================================================
+// IntegratorAccuracy
+// Accuracy per FLOP of the Euler, RK4 and Dormand-Prince 5(4) kernels.
+//
+// Particles are first settled onto the attractor, then every integrator
+// advances the same start state over a fixed horizon at a range of step sizes
+// (tolerances for Dormand-Prince, which adapts its own substeps within each
+// step). Positions are compared with a double precision RK4 reference taken
+// at a much smaller step. The FLOP counts are per particle, counted from the
+// kernels in LorenzKernelsImpl.h; for Dormand-Prince they use the number of
+// substeps the kernel actually attempted.
+//
+// The summary gives, per integrator, the cheapest setting whose RMS error is
+// below a target, and its cost relative to Euler at the app's default step of
+// 1/120 s. The target defaults to that Euler run's own error, i.e. the cost
+// of today's fidelity.
+//
+// Usage: IntegratorAccuracy [particles] [horizonSeconds] [targetRmsError]
+//================================================================================
+
+#include "LorenzKernels.h"
+#include "LorenzSimulator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+	// Per particle FLOPs (fused multiply-add counts as two). A Lorenz
+	// derivative is 8.
+	constexpr f64 kEulerFlops = 8.0 + 3.0 * 2.0;
+	constexpr f64 kRK4Flops = 4.0 * 8.0 + 3.0 * 3.0 * 2.0 + 3.0 * 6.0;
+	// Six derivatives, stage sums (2n + 1 per axis for n terms: 3, 5, 7, 9,
+	// 11 and 11 for the solution), the 6 term error sum, scaling and controller.
+	constexpr f64 kDormandPrinceAttemptFlops = 6.0 * 8.0 + 3.0 * 46.0 + 3.0 * 13.0 + 3.0 * 7.0 + 12.0;
+	constexpr f64 kDormandPrinceIntervalFlops = 8.0;
+
+	struct Result
+	{
+		Integrator::IntegratorEnum m_integrator;
+		f64 m_setting;
+		f64 m_flopsPerSecond;
+		f64 m_rmsError;
+		f64 m_maxError;
+		f64 m_nanoseconds;
+	};
+
+	// Double precision RK4 for the reference trajectory.
+	void reference_rk4(f64 p[3], const LorenzParameters& params, const f64 kStep)
+	{
+		auto derivative = [&params](const f64 q[3], f64 d[3]) {
+			d[0] = params.m_sigma * (q[1] - q[0]);
+			d[1] = q[0] * (params.m_rho - q[2]) - q[1];
+			d[2] = q[0] * q[1] - params.m_beta * q[2];
+		};
+
+		f64 k1[3], k2[3], k3[3], k4[3], q[3];
+		derivative(p, k1);
+		for (int a = 0; a < 3; ++a) q[a] = p[a] + 0.5 * kStep * k1[a];
+		derivative(q, k2);
+		for (int a = 0; a < 3; ++a) q[a] = p[a] + 0.5 * kStep * k2[a];
+		derivative(q, k3);
+		for (int a = 0; a < 3; ++a) q[a] = p[a] + kStep * k3[a];
+		derivative(q, k4);
+		for (int a = 0; a < 3; ++a) p[a] += kStep / 6.0 * (k1[a] + 2.0 * k2[a] + 2.0 * k3[a] + k4[a]);
+	}
+
+	Result run(LorenzSimulator& simulator, const std::vector<LorenzParticle>& start, const std::vector<f64>& reference,
+		const Integrator::IntegratorEnum kIntegrator, const f32 kStep, const f32 kTolerance, const f64 kHorizon)
+	{
+		const u32 kCount = static_cast<u32>(start.size());
+		simulator.set_particles(start.data(), kCount);
+
+		const LorenzKernelTable& kernels = lorenz_kernels();
+		const u32 kSteps = static_cast<u32>(std::lround(kHorizon / kStep));
+
+		u64 attempts = 0;
+		const auto begin = std::chrono::steady_clock::now();
+		for (u32 first = 0; first < kCount; first += kParticlePageSize)
+		{
+			const ParticleStreamRange kRange = simulator.pool().range(first, std::min(kCount - first, kParticlePageSize));
+			for (u32 s = 0; s < kSteps; ++s)
+			{
+				switch (kIntegrator)
+				{
+				case Integrator::kEuler: kernels.m_pStepEuler(kRange, simulator.parameters(), kStep); break;
+				case Integrator::kRK4: kernels.m_pStepRK4(kRange, simulator.parameters(), kStep); break;
+				default: attempts += kernels.m_pStepDormandPrince(kRange, simulator.parameters(), kStep, kTolerance); break;
+				}
+			}
+		}
+		const f64 kSeconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - begin).count();
+
+		Result result;
+		result.m_integrator = kIntegrator;
+		result.m_setting = kIntegrator == Integrator::kDormandPrince ? kTolerance : kStep;
+		switch (kIntegrator)
+		{
+		case Integrator::kEuler: result.m_flopsPerSecond = kSteps * kEulerFlops; break;
+		case Integrator::kRK4: result.m_flopsPerSecond = kSteps * kRK4Flops; break;
+		default: result.m_flopsPerSecond = static_cast<f64>(attempts) / kCount * kDormandPrinceAttemptFlops + kSteps * kDormandPrinceIntervalFlops; break;
+		}
+		result.m_flopsPerSecond /= kHorizon;
+		result.m_nanoseconds = kSeconds * 1e9 / (static_cast<f64>(kCount) * kHorizon);
+
+		const ParticlePool& pool = simulator.pool();
+		f64 sumSquares = 0.0;
+		result.m_maxError = 0.0;
+		for (u32 i = 0; i < kCount; ++i)
+		{
+			const f64 dx = pool.at(ParticleStreams::kPosX, i) - reference[3 * i + 0];
+			const f64 dy = pool.at(ParticleStreams::kPosY, i) - reference[3 * i + 1];
+			const f64 dz = pool.at(ParticleStreams::kPosZ, i) - reference[3 * i + 2];
+			const f64 kError2 = dx * dx + dy * dy + dz * dz;
+			sumSquares += kError2;
+			result.m_maxError = std::fmax(result.m_maxError, std::sqrt(kError2));
+		}
+		result.m_rmsError = std::sqrt(sumSquares / kCount);
+		return result;
+	}
+
+	void print(const Result& result)
+	{
+		char setting[32];
+		if (result.m_integrator == Integrator::kDormandPrince)
+			std::snprintf(setting, sizeof(setting), "tol %.0e", result.m_setting);
+		else
+			std::snprintf(setting, sizeof(setting), "dt 1/%.0f", 1.0 / result.m_setting);
+
+		if (!std::isfinite(result.m_rmsError))
+		{
+			std::printf("%-6s %-10s %12.0f %12s %12s %10.1f\n", integrator_name(result.m_integrator), setting,
+				result.m_flopsPerSecond, "diverged", "", result.m_nanoseconds);
+			return;
+		}
+		std::printf("%-6s %-10s %12.0f %12.3e %12.3e %10.1f\n", integrator_name(result.m_integrator), setting,
+			result.m_flopsPerSecond, result.m_rmsError, result.m_maxError, result.m_nanoseconds);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const u32 kParticles = argc > 1 ? static_cast<u32>(std::strtoul(argv[1], nullptr, 10)) : 4096;
+	// Every step size below divides 0.1 s, so the horizon is kept to a
+	// multiple of it and all runs cover exactly the same time
+	const f64 kRequestedHorizon = argc > 2 ? std::strtod(argv[2], nullptr) : 0.5;
+	const f64 kHorizon = std::fmax(std::round(kRequestedHorizon * 10.0), 1.0) / 10.0;
+	const f64 kDefaultStep = 1.0f / 120.0f;
+
+	// Settle onto the attractor so the start state is typical of a running system
+	LorenzSimulator simulator;
+	simulator.init(kParticles, 1);
+	simulator.set_integrator(Integrator::kRK4);
+	for (u32 i = 0; i < 480; ++i)
+	{
+		simulator.step(1.0f / 240.0f);
+	}
+
+	std::vector<LorenzParticle> start(kParticles);
+	simulator.read_particles(start.data());
+
+	const f64 kReferenceStep = 1e-4;
+	const u32 kReferenceSteps = static_cast<u32>(std::lround(kHorizon / kReferenceStep));
+	std::vector<f64> reference(3 * kParticles);
+	for (u32 i = 0; i < kParticles; ++i)
+	{
+		f64 p[3] = { start[i].m_position.x, start[i].m_position.y, start[i].m_position.z };
+		for (u32 s = 0; s < kReferenceSteps; ++s)
+		{
+			reference_rk4(p, simulator.parameters(), kReferenceStep);
+		}
+		reference[3 * i + 0] = p[0];
+		reference[3 * i + 1] = p[1];
+		reference[3 * i + 2] = p[2];
+	}
+
+	std::printf("particles: %u, horizon: %g s, kernel: %s, reference: f64 RK4 at dt %g\n",
+		kParticles, kHorizon, lorenz_kernels().m_pName, kReferenceStep);
+	std::printf("%-6s %-10s %12s %12s %12s %10s\n", "method", "setting", "flop/p/simS", "rms error", "max error", "ns/p/simS");
+
+	std::vector<Result> results;
+	const f32 kSteps[] = { 1.0f / 10.0f, 1.0f / 20.0f, 1.0f / 30.0f, 1.0f / 60.0f, 1.0f / 120.0f, 1.0f / 240.0f, 1.0f / 480.0f, 1.0f / 960.0f };
+	const Result* pEulerDefault = nullptr;
+	for (const f32 kStep : kSteps)
+	{
+		results.push_back(run(simulator, start, reference, Integrator::kEuler, kStep, 0.0f, kHorizon));
+		print(results.back());
+	}
+	for (const f32 kStep : kSteps)
+	{
+		results.push_back(run(simulator, start, reference, Integrator::kRK4, kStep, 0.0f, kHorizon));
+		print(results.back());
+	}
+
+	// Dormand-Prince is handed 1/10 s intervals and picks its own substeps
+	const f32 kTolerances[] = { 1e-1f, 1e-2f, 1e-3f, 1e-4f, 1e-5f, 1e-6f };
+	for (const f32 kTolerance : kTolerances)
+	{
+		results.push_back(run(simulator, start, reference, Integrator::kDormandPrince, 1.0f / 10.0f, kTolerance, kHorizon));
+		print(results.back());
+	}
+
+	for (const Result& result : results)
+	{
+		if (result.m_integrator == Integrator::kEuler && result.m_setting == kDefaultStep)
+		{
+			pEulerDefault = &result;
+		}
+	}
+	const f64 kTarget = argc > 3 ? std::strtod(argv[3], nullptr) : pEulerDefault->m_rmsError;
+
+	// Cheapest setting of each integrator that meets the target
+	std::printf("\ncheapest setting with rms error <= %g, against Euler at dt 1/120 (%.0f flop/p/simS):\n",
+		kTarget, pEulerDefault->m_flopsPerSecond);
+	for (int integrator = 0; integrator < Integrator::kNumIntegrators; ++integrator)
+	{
+		const Result* pBest = nullptr;
+		for (const Result& result : results)
+		{
+			if (result.m_integrator == integrator && result.m_rmsError <= kTarget &&
+				(!pBest || result.m_flopsPerSecond < pBest->m_flopsPerSecond))
+			{
+				pBest = &result;
+			}
+		}
+
+		if (!pBest)
+		{
+			std::printf("%-6s not reached\n", integrator_name(static_cast<Integrator::IntegratorEnum>(integrator)));
+			continue;
+		}
+
+		print(*pBest);
+		std::printf("       %.1fx the flops of Euler at dt 1/120\n", pBest->m_flopsPerSecond / pEulerDefault->m_flopsPerSecond);
+	}
+	return 0;
+}
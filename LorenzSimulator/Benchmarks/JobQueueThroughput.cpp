@@ -0,0 +1,267 @@
+//================================================================================
+// JobQueueThroughput
+// Push/pop throughput of the job transport with 1 to 64 producer threads.
+//
+// Two comparisons are made at each producer count:
+//  - Whole queue: producers push empty jobs into the original single worker
+//    mutex/condition_variable JobQueue (reproduced below as LegacyJobQueue)
+//    and into the current JobQueue, then wait for them to drain.
+//  - Transport only: the same producers feed one consumer through a
+//    std::queue guarded by a mutex with notify_one on every push, and
+//    through the lock-free MpmcQueue with a spinning consumer.
+//
+// Usage: JobQueueThroughput [jobs] [maxProducers]
+//================================================================================
+
+#include "JobQueue.h"
+#include "MpmcQueue.h"
+#include "SpinWait.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// ========================================================
+	// class LegacyJobQueue
+	// The JobQueue this repository started with: one worker, one mutex shared
+	// by push and pop, and a notify on every push and pop.
+	// ========================================================
+
+	class LegacyJobQueue final
+	{
+	public:
+		typedef std::function<void()> Job;
+
+		~LegacyJobQueue()
+		{
+			if (worker.joinable())
+			{
+				waitAll();
+				mutex.lock();
+				terminating = true;
+				condition.notify_one();
+				mutex.unlock();
+				worker.join();
+			}
+		}
+
+		void launch()
+		{
+			assert(!worker.joinable());
+			worker = std::thread(&LegacyJobQueue::queueLoop, this);
+		}
+
+		void pushJob(Job job)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push(std::move(job));
+			condition.notify_one();
+		}
+
+		void waitAll()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this]() { return queue.empty(); });
+		}
+
+	private:
+		void queueLoop()
+		{
+			for (;;)
+			{
+				Job job;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					condition.wait(lock, [this] { return !queue.empty() || terminating; });
+					if (terminating)
+					{
+						break;
+					}
+					job = queue.front();
+				}
+
+				job();
+
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					queue.pop();
+					condition.notify_one();
+				}
+			}
+		}
+
+		bool terminating = false;
+		std::thread worker;
+		std::queue<Job> queue;
+		std::mutex mutex;
+		std::condition_variable condition;
+	};
+
+	// Runs kProducers threads that each call produce(first, count) for their
+	// share of kItems, releasing them together. Returns seconds from the
+	// release until finish() returns.
+	template<typename ProduceFn, typename FinishFn>
+	f64 run_producers(const u32 kProducers, const u32 kItems, ProduceFn produce, FinishFn finish)
+	{
+		std::atomic<bool> go(false);
+		std::vector<std::thread> producers;
+		producers.reserve(kProducers);
+		for (u32 i = 0; i < kProducers; ++i)
+		{
+			const u32 kFirst = static_cast<u32>(static_cast<u64>(kItems) * i / kProducers);
+			const u32 kLast = static_cast<u32>(static_cast<u64>(kItems) * (i + 1) / kProducers);
+			producers.emplace_back([&go, &produce, kFirst, kLast]() {
+				while (!go.load(std::memory_order_acquire))
+				{
+					std::this_thread::yield();
+				}
+				produce(kFirst, kLast - kFirst);
+			});
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+		go.store(true, std::memory_order_release);
+		for (std::thread& producer : producers)
+		{
+			producer.join();
+		}
+		finish();
+		return std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	f64 legacy_job_queue(const u32 kProducers, const u32 kJobs)
+	{
+		std::atomic<u32> done(0);
+		LegacyJobQueue queue;
+		queue.launch();
+		const f64 kSeconds = run_producers(kProducers, kJobs,
+			[&](u32, u32 count) {
+				for (u32 i = 0; i < count; ++i)
+				{
+					queue.pushJob([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+				}
+			},
+			[&]() { queue.waitAll(); });
+		assert(done.load() == kJobs);
+		return kSeconds;
+	}
+
+	f64 job_queue(const u32 kProducers, const u32 kJobs, const u32 kWorkers)
+	{
+		std::atomic<u32> done(0);
+		JobQueue queue;
+		queue.launch(kWorkers);
+		const f64 kSeconds = run_producers(kProducers, kJobs,
+			[&](u32, u32 count) {
+				for (u32 i = 0; i < count; ++i)
+				{
+					queue.pushJob([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+				}
+			},
+			[&]() { queue.waitAll(); });
+		assert(done.load() == kJobs);
+		return kSeconds;
+	}
+
+	f64 mutex_transport(const u32 kProducers, const u32 kItems)
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::queue<u32> queue;
+		u64 sum = 0;
+
+		std::thread consumer([&]() {
+			for (u32 received = 0; received < kItems; ++received)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [&]() { return !queue.empty(); });
+				sum += queue.front();
+				queue.pop();
+			}
+		});
+
+		const f64 kSeconds = run_producers(kProducers, kItems,
+			[&](u32 first, u32 count) {
+				for (u32 i = 0; i < count; ++i)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					queue.push(first + i);
+					condition.notify_one();
+				}
+			},
+			[&]() { consumer.join(); });
+		assert(sum == static_cast<u64>(kItems) * (kItems - 1) / 2);
+		(void)sum;
+		return kSeconds;
+	}
+
+	f64 mpmc_transport(const u32 kProducers, const u32 kItems)
+	{
+		MpmcQueue<u32> queue(16384);
+		u64 sum = 0;
+
+		std::thread consumer([&]() {
+			SpinWait spinWait;
+			u32 item = 0;
+			for (u32 received = 0; received < kItems; ++received)
+			{
+				while (!queue.tryPop(item))
+				{
+					spinWait.spinOnce();
+				}
+				spinWait.reset();
+				sum += item;
+			}
+		});
+
+		const f64 kSeconds = run_producers(kProducers, kItems,
+			[&](u32 first, u32 count) {
+				SpinWait spinWait;
+				for (u32 i = 0; i < count; ++i)
+				{
+					while (!queue.tryPush(first + i))
+					{
+						spinWait.spinOnce();
+					}
+					spinWait.reset();
+				}
+			},
+			[&]() { consumer.join(); });
+		assert(sum == static_cast<u64>(kItems) * (kItems - 1) / 2);
+		(void)sum;
+		return kSeconds;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const u32 kJobs = argc > 1 ? static_cast<u32>(std::strtoul(argv[1], nullptr, 10)) : 1u << 20;
+	const u32 kMaxProducers = argc > 2 ? static_cast<u32>(std::strtoul(argv[2], nullptr, 10)) : 64;
+	const u32 kHardwareThreads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+
+	std::printf("jobs: %u, hardware threads: %u, throughput in M items/s\n", kJobs, kHardwareThreads);
+	std::printf("%9s %12s %12s %12s %12s %12s\n", "producers", "legacy", "JobQueue(1)", "JobQueue(N)", "mutex+cv", "MPMC");
+
+	for (u32 producers = 1; producers <= kMaxProducers; producers *= 2)
+	{
+		const f64 kMillions = kJobs * 1e-6;
+		const f64 kLegacy = kMillions / legacy_job_queue(producers, kJobs);
+		const f64 kSingleWorker = kMillions / job_queue(producers, kJobs, 1);
+		const f64 kAllWorkers = kMillions / job_queue(producers, kJobs, kHardwareThreads);
+		const f64 kMutex = kMillions / mutex_transport(producers, kJobs);
+		const f64 kMpmc = kMillions / mpmc_transport(producers, kJobs);
+		std::printf("%9u %12.2f %12.2f %12.2f %12.2f %12.2f\n", producers, kLegacy, kSingleWorker, kAllWorkers, kMutex, kMpmc);
+		std::fflush(stdout);
+	}
+	return 0;
+}
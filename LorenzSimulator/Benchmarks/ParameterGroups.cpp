@@ -0,0 +1,165 @@
+//================================================================================
+// ParameterGroups
+// Many independently parameterized Lorenz systems in one simulator, against
+// one simulator per system (what running an app instance per parameter set
+// amounts to).
+//
+// Group g uses rho spread evenly over [10, 40], with the default sigma and
+// beta. Every pass steps the same start state:
+//  - separate: one LorenzSimulator per group, all alive at once and each
+//    stepped in turn every step, as concurrent instances would be.
+//  - single: one simulator without a table, i.e. every particle on the
+//    default parameters, for the cost of the table itself.
+//  - grouped: one simulator with a parameter table, particles in group order.
+//  - interleaved: the same table with particle i in group i % groups, the
+//    worst layout, where every run is a single particle.
+// Grouped results must match the separate ones bit for bit; the benchmark
+// fails otherwise. Particles per group are rounded up to whole SIMD batches
+// so the runs are stepped by the same code as in the separate simulators.
+//
+// Usage: ParameterGroups [groups] [particlesPerGroup] [steps] [euler|rk4|dopri]
+//================================================================================
+
+#include "LorenzSimulator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	constexpr u32 kSeed = 11;
+
+	f64 seconds_since(const std::chrono::steady_clock::time_point& start)
+	{
+		return std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const u32 kNumGroups = argc > 1 ? std::min(static_cast<u32>(std::strtoul(argv[1], nullptr, 10)), kMaxParameterGroups) : 256;
+	const u32 kRequestedPerGroup = argc > 2 ? static_cast<u32>(std::strtoul(argv[2], nullptr, 10)) : 4096;
+	const u32 kSteps = argc > 3 ? static_cast<u32>(std::strtoul(argv[3], nullptr, 10)) : 100;
+	Integrator::IntegratorEnum integrator = Integrator::kEuler;
+	if (argc > 4 && !parse_integrator(argv[4], integrator))
+	{
+		std::fprintf(stderr, "unknown integrator '%s'\n", argv[4]);
+		return 2;
+	}
+	if (kNumGroups == 0)
+	{
+		std::fprintf(stderr, "need at least one group\n");
+		return 2;
+	}
+
+	const u32 kPerGroup = std::max((kRequestedPerGroup + kParticleLaneWidth - 1) & ~(kParticleLaneWidth - 1), kParticleLaneWidth);
+	const u32 kNumParticles = kNumGroups * kPerGroup;
+	const f32 kDeltaTime = 1.0f / 120.0f;
+	const f64 kParticleSteps = static_cast<f64>(kNumParticles) * kSteps;
+
+	std::vector<LorenzParameters> table(kNumGroups);
+	for (u32 g = 0; g < kNumGroups; ++g)
+	{
+		table[g] = kDefaultLorenzParameters;
+		table[g].m_rho = kNumGroups > 1 ? 10.0f + 30.0f * g / (kNumGroups - 1) : kDefaultLorenzParameters.m_rho;
+	}
+
+	std::vector<LorenzParticle> start(kNumParticles);
+	{
+		LorenzSimulator seeder;
+		seeder.init(kNumParticles, kSeed);
+		seeder.read_particles(start.data());
+	}
+
+	std::printf("groups: %u x %u particles, steps: %u, kernel: %s, integrator: %s\n", kNumGroups, kPerGroup, kSteps,
+		lorenz_kernels().m_pName, integrator_name(integrator));
+	std::printf("%12s %10s %14s %12s\n", "layout", "ms", "M p-steps/s", "ns/particle");
+	auto report = [kParticleSteps](const char* pName, const f64 kSeconds) {
+		std::printf("%12s %10.2f %14.1f %12.3f\n", pName, kSeconds * 1e3, kParticleSteps / kSeconds * 1e-6, kSeconds * 1e9 / kParticleSteps);
+		std::fflush(stdout);
+	};
+
+	// One simulator per group
+	std::vector<LorenzParticle> separate(kNumParticles);
+	{
+		std::vector<LorenzSimulator> simulators(kNumGroups);
+		for (u32 g = 0; g < kNumGroups; ++g)
+		{
+			simulators[g].set_integrator(integrator);
+			simulators[g].parameters() = table[g];
+			simulators[g].set_particles(start.data() + g * kPerGroup, kPerGroup);
+		}
+
+		const auto stepStart = std::chrono::steady_clock::now();
+		for (u32 i = 0; i < kSteps; ++i)
+		{
+			for (LorenzSimulator& rSimulator : simulators)
+			{
+				rSimulator.step(kDeltaTime);
+			}
+		}
+		report("separate", std::max(seconds_since(stepStart), 1e-9));
+
+		for (u32 g = 0; g < kNumGroups; ++g)
+		{
+			simulators[g].read_particles(separate.data() + g * kPerGroup);
+		}
+	}
+
+	LorenzSimulator simulator;
+	simulator.set_integrator(integrator);
+	simulator.set_particles(start.data(), kNumParticles);
+	{
+		const auto stepStart = std::chrono::steady_clock::now();
+		for (u32 i = 0; i < kSteps; ++i)
+		{
+			simulator.step(kDeltaTime);
+		}
+		report("single", std::max(seconds_since(stepStart), 1e-9));
+	}
+
+	simulator.set_particles(start.data(), kNumParticles);
+	simulator.set_parameter_groups(table.data(), kNumGroups);
+
+	// Group order, as set_parameter_groups() lays them out
+	std::vector<LorenzParticle> grouped(kNumParticles);
+	{
+		const auto stepStart = std::chrono::steady_clock::now();
+		for (u32 i = 0; i < kSteps; ++i)
+		{
+			simulator.step(kDeltaTime);
+		}
+		report("grouped", std::max(seconds_since(stepStart), 1e-9));
+		simulator.read_particles(grouped.data());
+	}
+
+	// Single particle runs
+	{
+		std::vector<u16> groups(kNumParticles);
+		for (u32 i = 0; i < kNumParticles; ++i)
+		{
+			groups[i] = static_cast<u16>(i % kNumGroups);
+		}
+		simulator.set_particles(start.data(), kNumParticles);
+		simulator.set_particle_groups(groups.data());
+
+		const auto stepStart = std::chrono::steady_clock::now();
+		for (u32 i = 0; i < kSteps; ++i)
+		{
+			simulator.step(kDeltaTime);
+		}
+		report("interleaved", std::max(seconds_since(stepStart), 1e-9));
+	}
+
+	if (std::memcmp(separate.data(), grouped.data(), kNumParticles * sizeof(LorenzParticle)) != 0)
+	{
+		std::printf("FAILED: grouped results differ from separate simulators\n");
+		return 1;
+	}
+	std::printf("grouped results match separate simulators bit for bit\n");
+	return 0;
+}
@@ -0,0 +1,156 @@
+//================================================================================
+// ParticleInitStartup
+// Startup time and peak resident memory of the app's particle buffer
+// initialization, before and after it moved to a single staging block.
+//
+//  - legacy: one host array per GPU buffer (old, updated, render), each
+//    filled serially with its own generator, all three resident until the
+//    last upload.
+//  - staged: one host array filled in parallel with initial_lorenz_particle,
+//    used as the initial data of all three buffers, then released.
+//
+// CreateBuffer copies its initial data through the driver; here an upload is
+// a copy through a small fixed buffer, so the resident memory measured is the
+// host side only. Each run happens in its own process so the peaks do not
+// mask each other; with no arguments both modes are run at 500k and 5M.
+//
+// Usage: ParticleInitStartup [legacy|staged] [particles]
+//================================================================================
+
+#include "LorenzSimulator.h"
+#include "ParallelFor.h"
+#include "ProcessMemory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+	constexpr u32 kNumGpuBuffers = 3;
+	constexpr size_t kUploadChunkBytes = 4 * 1024 * 1024;
+	constexpr u32 kInitGrain = 16384;
+
+	// Stand-in for CreateBuffer with initial data. Returns a checksum so the
+	// copies cannot be optimized away.
+	u64 upload(const LorenzParticle* pParticles, const u32 kCount)
+	{
+		static std::vector<char> uploadChunk(kUploadChunkBytes);
+		const char* pBytes = reinterpret_cast<const char*>(pParticles);
+		const size_t kBytes = size_t(kCount) * sizeof(LorenzParticle);
+		u64 checksum = 0;
+		for (size_t offset = 0; offset < kBytes; offset += kUploadChunkBytes)
+		{
+			const size_t kRun = std::min(kBytes - offset, kUploadChunkBytes);
+			std::memcpy(uploadChunk.data(), pBytes + offset, kRun);
+			checksum += static_cast<u8>(uploadChunk[kRun - 1]);
+		}
+		return checksum;
+	}
+
+	// The fill the app used before: a sequential generator per buffer.
+	void fill_legacy(std::vector<LorenzParticle>& rParticles, const f32 kPositionScale, const bool kRandomVelocity, const u32 kSeed)
+	{
+		Xoshiro128Plus rng(kSeed, 0);
+		for (LorenzParticle& p : rParticles)
+		{
+			p.m_position = Float3{ rng.uniform(-kPositionScale, kPositionScale), rng.uniform(-kPositionScale, kPositionScale),
+				rng.uniform(-kPositionScale, kPositionScale) };
+			p.m_age = rng.uniform(0.0f, 20.0f);
+			p.m_velocity = kRandomVelocity ? Float3{ rng.uniform(-1.0f, 1.0f), rng.uniform(-1.0f, 1.0f), rng.uniform(-1.0f, 1.0f) }
+				: Float3{ 0.0f, 0.0f, 0.0f };
+		}
+	}
+
+	u64 init_legacy(const u32 kCount)
+	{
+		std::vector<LorenzParticle> old(kCount);
+		fill_legacy(old, 10.0f, true, 1);
+		u64 checksum = upload(old.data(), kCount);
+
+		std::vector<LorenzParticle> updated(kCount);
+		fill_legacy(updated, 5.0f, false, 2);
+		checksum += upload(updated.data(), kCount);
+
+		std::vector<LorenzParticle> render(kCount);
+		fill_legacy(render, 5.0f, false, 3);
+		checksum += upload(render.data(), kCount);
+		return checksum;
+	}
+
+	u64 init_staged(const u32 kCount)
+	{
+		std::vector<LorenzParticle> staging(kCount);
+		const CounterRng rng(1);
+		LorenzParticle* pStaging = staging.data();
+		parallel_for(0, kCount, kInitGrain, [pStaging, &rng](u32 first, u32 last) {
+			for (u32 i = first; i < last; ++i)
+			{
+				pStaging[i] = initial_lorenz_particle(rng, i, 10.0f, true);
+			}
+		});
+
+		u64 checksum = 0;
+		for (u32 b = 0; b < kNumGpuBuffers; ++b)
+		{
+			checksum += upload(pStaging, kCount);
+		}
+		return checksum;
+	}
+
+	int run(const bool kStaged, const u32 kCount)
+	{
+		// Start the workers first, as the app does before on_init
+		sharedJobQueue();
+		const u64 kBaseline = peak_resident_bytes();
+
+		const auto start = std::chrono::steady_clock::now();
+		const u64 kChecksum = kStaged ? init_staged(kCount) : init_legacy(kCount);
+		const f64 kSeconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+
+		const u64 kPeak = peak_resident_bytes();
+		std::printf("%-7s %10u %10.1f %14.1f %14.1f %10.1f   (checksum %llu)\n", kStaged ? "staged" : "legacy", kCount,
+			kSeconds * 1e3, kPeak / (1024.0 * 1024.0), (kPeak - std::min(kPeak, kBaseline)) / (1024.0 * 1024.0),
+			current_resident_bytes() / (1024.0 * 1024.0), static_cast<unsigned long long>(kChecksum));
+		std::fflush(stdout);
+		return 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 2)
+	{
+		const std::string kMode = argv[1];
+		if (kMode != "legacy" && kMode != "staged")
+		{
+			std::printf("Usage: ParticleInitStartup [legacy|staged] [particles]\n");
+			return 1;
+		}
+		return run(kMode == "staged", static_cast<u32>(std::strtoul(argv[2], nullptr, 10)));
+	}
+
+	std::printf("particle: %u bytes, buffers: %u, workers: %u\n", static_cast<u32>(sizeof(LorenzParticle)), kNumGpuBuffers,
+		sharedJobQueue().workerCount());
+	std::printf("%-7s %10s %10s %14s %14s %10s\n", "mode", "particles", "init ms", "peak RSS MB", "init peak MB", "after MB");
+	std::fflush(stdout);
+
+	const u32 kCounts[] = { 500000, 5000000 };
+	const char* kModes[] = { "legacy", "staged" };
+	for (const u32 kCount : kCounts)
+	{
+		for (const char* pMode : kModes)
+		{
+			const std::string kCommand = std::string("\"") + argv[0] + "\" " + pMode + " " + std::to_string(kCount);
+			if (std::system(kCommand.c_str()) != 0)
+			{
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
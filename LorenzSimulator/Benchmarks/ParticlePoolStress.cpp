@@ -0,0 +1,151 @@
+//================================================================================
+// ParticlePoolStress
+// Scales the CPU simulator from 100k to 50M particles by growing its paged
+// ParticlePool a step at a time, as the app does when the capacity is raised.
+//
+// For each size the table gives:
+//  - contiguous: reallocating one array of streams, copying the previous
+//    particles across and touching the new ones, which is what a non-paged
+//    container has to do.
+//  - paged: the same growth in a bare ParticlePool, which only adds pages.
+//  - init: LorenzSimulator::grow(), i.e. paged growth plus generating the
+//    new particles' initial state. Pages and allocations are cumulative.
+//  - step: simulator.step() throughput over the whole pool.
+//
+// Each pass is freed before the next starts, so they never hold memory at
+// the same time.
+//
+// Usage: ParticlePoolStress [maxParticles] [steps]
+//================================================================================
+
+#include "LorenzSimulator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	f64 seconds_since(const std::chrono::steady_clock::time_point& start)
+	{
+		return std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Grow a contiguous container to kCount, copying the previous contents.
+	void grow_contiguous(ParticleStreams& rStreams, const u32 kCount)
+	{
+		ParticleStreams grown;
+		grown.resize(kCount);
+		for (u32 k = 0; k < ParticleStreams::kNumStreams; ++k)
+		{
+			const ParticleStreams::Stream kStream = static_cast<ParticleStreams::Stream>(k);
+			if (rStreams.size() > 0)
+			{
+				std::memcpy(grown.stream(kStream), rStreams.stream(kStream), rStreams.size() * sizeof(f32));
+			}
+			// Touch the new particles, as initialization would
+			std::memset(grown.stream(kStream) + rStreams.size(), 0, (kCount - rStreams.size()) * sizeof(f32));
+		}
+		rStreams = std::move(grown);
+	}
+
+	// Grow a pool to kCount, touching the new particles.
+	bool grow_paged(ParticlePool& rPool, const u32 kCount)
+	{
+		const u32 kOldCount = rPool.size();
+		if (!rPool.resize(kCount))
+		{
+			return false;
+		}
+		for (u32 first = kOldCount; first < kCount; first += ParticlePool::page_remaining(first))
+		{
+			const u32 kRun = std::min(kCount - first, ParticlePool::page_remaining(first));
+			for (u32 k = 0; k < ParticleStreams::kNumStreams; ++k)
+			{
+				std::memset(rPool.stream(static_cast<ParticleStreams::Stream>(k), first), 0, kRun * sizeof(f32));
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const u32 kMaxParticles = argc > 1 ? static_cast<u32>(std::strtoul(argv[1], nullptr, 10)) : 50000000;
+	const u32 kSteps = argc > 2 ? static_cast<u32>(std::strtoul(argv[2], nullptr, 10)) : 10;
+	const f32 kDeltaTime = 1.0f / 120.0f;
+
+	std::vector<u32> sizes;
+	const u32 kSizes[] = { 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000, 25000000, 50000000 };
+	for (const u32 kSize : kSizes)
+	{
+		if (kSize <= kMaxParticles)
+		{
+			sizes.push_back(kSize);
+		}
+	}
+
+	std::vector<f64> contiguousSeconds;
+	{
+		ParticleStreams streams;
+		for (const u32 kSize : sizes)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			grow_contiguous(streams, kSize);
+			contiguousSeconds.push_back(seconds_since(start));
+		}
+	}
+
+	std::vector<f64> pagedSeconds;
+	{
+		ParticlePool pool;
+		for (const u32 kSize : sizes)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			if (!grow_paged(pool, kSize))
+			{
+				std::printf("%10u failed to grow the pool\n", kSize);
+				return 1;
+			}
+			pagedSeconds.push_back(seconds_since(start));
+		}
+	}
+
+	std::printf("page: %u particles (%.2f MB), growth %u/%u, kernel: %s, steps: %u\n", kParticlePageSize,
+		kParticlePageSize * ParticleStreams::kNumStreams * sizeof(f32) / (1024.0 * 1024.0),
+		kParticlePoolGrowthNum, kParticlePoolGrowthDen, lorenz_kernels().m_pName, kSteps);
+	std::printf("%10s %14s %10s %10s %6s %6s %9s %14s %12s\n", "particles", "contiguous ms", "paged ms", "init ms",
+		"pages", "allocs", "MB", "M p-steps/s", "ns/particle");
+
+	LorenzSimulator simulator;
+	for (size_t s = 0; s < sizes.size(); ++s)
+	{
+		const u32 kSize = sizes[s];
+		const auto initStart = std::chrono::steady_clock::now();
+		if (!simulator.grow(kSize, 1))
+		{
+			std::printf("%10u failed to grow the pool\n", kSize);
+			return 1;
+		}
+		simulator.set_active_count(kSize);
+		const f64 kInitSeconds = seconds_since(initStart);
+
+		const auto stepStart = std::chrono::steady_clock::now();
+		for (u32 i = 0; i < kSteps; ++i)
+		{
+			simulator.step(kDeltaTime);
+		}
+		const f64 kStepSeconds = std::max(seconds_since(stepStart), 1e-9);
+		const f64 kParticleSteps = static_cast<f64>(kSize) * kSteps;
+
+		const ParticlePool& pool = simulator.pool();
+		std::printf("%10u %14.2f %10.2f %10.2f %6u %6u %9.1f %14.1f %12.3f\n", kSize, contiguousSeconds[s] * 1e3, pagedSeconds[s] * 1e3, kInitSeconds * 1e3,
+			pool.page_count(), pool.growth_count(), pool.allocated_bytes() / (1024.0 * 1024.0),
+			kParticleSteps / kStepSeconds * 1e-6, kStepSeconds * 1e9 / kParticleSteps);
+		std::fflush(stdout);
+	}
+	return 0;
+}
@@ -0,0 +1,133 @@
+//================================================================================
+// QuadIndexGeneration
+// CPU cost of the particle quad index buffer (Framework/QuadIndices.h).
+//
+//  - vector: the app's old path, a std::vector of 6N 32-bit indices filled
+//    serially, then handed to CreateBuffer.
+//  - mapped: write_quad_indices() writing the 6N 32-bit indices in parallel
+//    straight into the destination. An aligned block stands in for the
+//    mapped buffer, so "host MB" is 0: the only memory is the buffer itself.
+//  - pattern: write_quad_pattern(), one 16-bit block of kQuadPatternQuads
+//    quads shared by every instance.
+//
+// Times are the best of several runs; the destination is written once first
+// so page faults are not counted.
+//
+// Usage: QuadIndexGeneration [particles] [repeats]
+//================================================================================
+
+#include "ParticleStreams.h"
+#include "QuadIndices.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	f64 seconds_since(const std::chrono::steady_clock::time_point& start)
+	{
+		return std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// The loop init_index_buffer used to run.
+	void fill_vector(std::vector<u32>& rIndices, const u32 kNumQuads)
+	{
+		rIndices.resize(size_t(6) * kNumQuads);
+		for (u32 i = 0; i < kNumQuads; ++i)
+		{
+			rIndices[6 * size_t(i)] = 4 * i;
+			rIndices[6 * size_t(i) + 1] = 4 * i + 1;
+			rIndices[6 * size_t(i) + 2] = 4 * i + 2;
+			rIndices[6 * size_t(i) + 3] = 4 * i;
+			rIndices[6 * size_t(i) + 4] = 4 * i + 2;
+			rIndices[6 * size_t(i) + 5] = 4 * i + 3;
+		}
+	}
+
+	// Check every quad of a buffer against the expected vertices.
+	template<typename Index>
+	bool check_quads(const Index* pIndices, const u32 kNumQuads)
+	{
+		for (u32 q = 0; q < kNumQuads; ++q)
+		{
+			const Index* pQuad = pIndices + size_t(q) * kQuadIndices;
+			const u32 kVertex = q * kQuadVertices;
+			if (pQuad[0] != static_cast<Index>(kVertex) || pQuad[1] != static_cast<Index>(kVertex + 1) ||
+				pQuad[2] != static_cast<Index>(kVertex + 2) || pQuad[3] != static_cast<Index>(kVertex) ||
+				pQuad[4] != static_cast<Index>(kVertex + 2) || pQuad[5] != static_cast<Index>(kVertex + 3))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void print(const char* pName, const f64 kSeconds, const f64 kHostBytes, const f64 kBufferBytes, const bool kValid)
+	{
+		std::printf("%-8s %10.3f %10.2f %12.2f %8s\n", pName, kSeconds * 1e3, kHostBytes / (1024.0 * 1024.0),
+			kBufferBytes / (1024.0 * 1024.0), kValid ? "ok" : "WRONG");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const u32 kParticles = argc > 1 ? static_cast<u32>(std::strtoul(argv[1], nullptr, 10)) : 3000000;
+	const u32 kRepeats = argc > 2 ? std::max(1u, static_cast<u32>(std::strtoul(argv[2], nullptr, 10))) : 5;
+	const size_t kNumIndices = size_t(kParticles) * kQuadIndices;
+
+	std::printf("particles: %u, indices: %zu, pattern: %u quads, repeats: %u\n", kParticles, kNumIndices, kQuadPatternQuads, kRepeats);
+	std::printf("%-8s %10s %10s %12s %8s\n", "method", "ms", "host MB", "buffer MB", "check");
+
+	// vector: allocation is part of the old path's cost, so it is timed
+	{
+		f64 best = 1e30;
+		bool valid = true;
+		for (u32 r = 0; r < kRepeats; ++r)
+		{
+			std::vector<u32> indices;
+			const auto start = std::chrono::steady_clock::now();
+			fill_vector(indices, kParticles);
+			best = std::min(best, seconds_since(start));
+			if (r == 0)
+			{
+				valid = check_quads(indices.data(), kParticles);
+			}
+		}
+		print("vector", best, kNumIndices * sizeof(u32), kNumIndices * sizeof(u32), valid);
+	}
+
+	// mapped
+	{
+		u32* pMapped = static_cast<u32*>(aligned_alloc_bytes(kNumIndices * sizeof(u32), 64));
+		std::memset(pMapped, 0, kNumIndices * sizeof(u32));
+		f64 best = 1e30;
+		for (u32 r = 0; r < kRepeats; ++r)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			write_quad_indices(pMapped, 0, kParticles);
+			best = std::min(best, seconds_since(start));
+		}
+		print("mapped", best, 0.0, kNumIndices * sizeof(u32), check_quads(pMapped, kParticles));
+		aligned_free_bytes(pMapped);
+	}
+
+	// pattern
+	{
+		std::vector<u16> pattern(kQuadPatternIndices);
+		f64 best = 1e30;
+		for (u32 r = 0; r < kRepeats; ++r)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			write_quad_pattern(pattern.data(), kQuadPatternQuads);
+			best = std::min(best, seconds_since(start));
+		}
+		print("pattern", best, kQuadPatternIndices * sizeof(u16), kQuadPatternIndices * sizeof(u16),
+			check_quads(pattern.data(), kQuadPatternQuads));
+		std::printf("         %u instances of the pattern cover %u particles\n", quad_pattern_draw_count(kParticles), kParticles);
+	}
+	return 0;
+}
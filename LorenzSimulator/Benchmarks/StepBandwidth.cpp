@@ -0,0 +1,97 @@
+//================================================================================
+// StepBandwidth
+// Single core throughput of the Lorenz step: scalar AoS reference (the
+// CS_Main layout) against the SoA SIMD kernel, with a streaming copy of the
+// same byte count as the memory bandwidth ceiling. The SoA kernel is timed
+// once per instruction set the machine supports.
+//
+// Usage: StepBandwidth [particles] [iterations]
+//================================================================================
+
+#include "LorenzKernels.h"
+#include "LorenzSimulator.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	template<typename Fn>
+	f64 best_seconds(const u32 kIterations, Fn fn)
+	{
+		f64 best = 1e30;
+		for (u32 i = 0; i < kIterations; ++i)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			fn();
+			const f64 seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+			best = seconds < best ? seconds : best;
+		}
+		return best;
+	}
+
+	void report(const char* pName, const u32 kParticles, const f64 kBytesPerParticle, const f64 kSeconds)
+	{
+		std::printf("%-16s %8.1f M particles/s %7.2f GB/s %8.3f ns/particle\n", pName,
+			kParticles / kSeconds * 1e-6, kParticles * kBytesPerParticle / kSeconds * 1e-9, kSeconds * 1e9 / kParticles);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const u32 kParticles = argc > 1 ? static_cast<u32>(std::strtoul(argv[1], nullptr, 10)) : 3000000;
+	const u32 kIterations = argc > 2 ? static_cast<u32>(std::strtoul(argv[2], nullptr, 10)) : 20;
+	const f32 kDeltaTime = 1.0f / 120.0f;
+
+	LorenzSimulator simulator;
+	simulator.init(kParticles, 1);
+
+	std::vector<LorenzParticle> oldParticles(kParticles);
+	std::vector<LorenzParticle> updatedParticles(kParticles);
+	simulator.read_particles(oldParticles.data());
+
+	std::printf("particles: %u, default kernel: %s\n", kParticles, lorenz_kernels().m_pName);
+	const SimdLevel::SimdLevelEnum kDefaultLevel = lorenz_kernels().m_level;
+
+	// AoS reads and writes a whole 28 byte particle
+	const f64 kAosSeconds = best_seconds(kIterations, [&]() {
+		lorenz_step(oldParticles.data(), updatedParticles.data(), kParticles, simulator.parameters(), kDeltaTime);
+		oldParticles.swap(updatedParticles);
+	});
+	report("AoS scalar", kParticles, 2.0 * sizeof(LorenzParticle), kAosSeconds);
+
+	// SoA reads position and age (16 bytes), writes all seven streams (28 bytes)
+	f64 soaSeconds = 0.0;
+	for (int level = SimdLevel::kScalar; level < SimdLevel::kMaxLevels; ++level)
+	{
+		if (!lorenz_force_kernels(static_cast<SimdLevel::SimdLevelEnum>(level)))
+		{
+			continue;
+		}
+
+		char name[32];
+		std::snprintf(name, sizeof(name), "SoA %s", lorenz_kernels().m_pName);
+		const f64 kSeconds = best_seconds(kIterations, [&]() { simulator.step(kDeltaTime); });
+		report(name, kParticles, 16.0 + 28.0, kSeconds);
+
+		if (level == kDefaultLevel)
+		{
+			soaSeconds = kSeconds;
+		}
+	}
+	lorenz_force_kernels(kDefaultLevel);
+	const f64 kSoaSeconds = soaSeconds;
+
+	// Streaming copy moving the same 44 bytes per particle
+	const size_t kCopyBytes = size_t(kParticles) * 22;
+	std::vector<u8> src(kCopyBytes, 1);
+	std::vector<u8> dst(kCopyBytes, 0);
+	const f64 kCopySeconds = best_seconds(kIterations, [&]() { std::memcpy(dst.data(), src.data(), kCopyBytes); });
+	report("memcpy ceiling", kParticles, 44.0, kCopySeconds);
+
+	std::printf("SoA speedup over AoS: %.2fx, %.0f%% of copy bandwidth\n", kAosSeconds / kSoaSeconds, 100.0 * kCopySeconds / kSoaSeconds);
+	return 0;
+}
@@ -0,0 +1,128 @@
+//================================================================================
+// TemporalBlocking
+// Multi-substep stepping with and without temporal cache blocking.
+//
+// For K = 1..maxSubsteps the table gives the time per particle-substep of:
+//  - untiled: K calls to step(dt), each streaming every particle through
+//    memory once.
+//  - tile N: step(dt, K) with substep_tile() = N, where each tile of N
+//    particles takes all K substeps while it is in cache. A tile of
+//    kSimulatorGrain is one parallel chunk.
+// Every run starts from the same state, and the tiled results must match the
+// untiled ones bit for bit (no lifecycle is set, so nothing respawns between
+// substeps); the benchmark fails otherwise.
+//
+// Usage: TemporalBlocking [particles] [maxSubsteps] [euler|rk4|dp]
+//================================================================================
+
+#include "LorenzSimulator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	constexpr u32 kSeed = 7;
+
+	f64 seconds_since(const std::chrono::steady_clock::time_point& start)
+	{
+		return std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	bool same_bits(const std::vector<LorenzParticle>& kA, const std::vector<LorenzParticle>& kB)
+	{
+		return std::memcmp(kA.data(), kB.data(), kA.size() * sizeof(LorenzParticle)) == 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const u32 kNumParticles = argc > 1 ? static_cast<u32>(std::strtoul(argv[1], nullptr, 10)) : 5000000;
+	const u32 kMaxSubsteps = argc > 2 ? std::max(1u, static_cast<u32>(std::strtoul(argv[2], nullptr, 10))) : 32;
+	const char* pIntegrator = argc > 3 ? argv[3] : "euler";
+	const f32 kDeltaTime = 1.0f / 120.0f;
+
+	Integrator::IntegratorEnum integrator = Integrator::kEuler;
+	if (std::strcmp(pIntegrator, "rk4") == 0)
+	{
+		integrator = Integrator::kRK4;
+	}
+	else if (std::strcmp(pIntegrator, "dp") == 0)
+	{
+		integrator = Integrator::kDormandPrince;
+	}
+	else if (std::strcmp(pIntegrator, "euler") != 0)
+	{
+		std::fprintf(stderr, "unknown integrator '%s'\n", pIntegrator);
+		return 2;
+	}
+
+	const u32 kTiles[] = { 256, kSimulatorSubstepTile, 4096, kSimulatorGrain };
+	constexpr u32 kNumTiles = sizeof(kTiles) / sizeof(kTiles[0]);
+
+	LorenzSimulator simulator;
+	simulator.set_integrator(integrator);
+	simulator.init(kNumParticles, kSeed);
+
+	// Settled start state, restored before every run
+	std::vector<LorenzParticle> start(kNumParticles);
+	std::vector<LorenzParticle> reference(kNumParticles);
+	std::vector<LorenzParticle> result(kNumParticles);
+	simulator.read_particles(start.data());
+
+	std::printf("particles: %u (%.1f MB of streams), kernel: %s, integrator: %s\n", kNumParticles,
+		kNumParticles * ParticleStreams::kNumStreams * sizeof(f32) / (1024.0 * 1024.0), lorenz_kernels().m_pName, pIntegrator);
+	std::printf("ns per particle-substep\n");
+	std::printf("%4s %10s", "K", "untiled");
+	for (const u32 kTile : kTiles)
+	{
+		char label[32];
+		std::snprintf(label, sizeof(label), "tile %u", kTile);
+		std::printf(" %12s %8s", label, "speedup");
+	}
+	std::printf("\n");
+
+	bool allMatch = true;
+	for (u32 k = 1; k <= kMaxSubsteps; ++k)
+	{
+		const f64 kParticleSteps = static_cast<f64>(kNumParticles) * k;
+
+		simulator.set_particles(start.data(), kNumParticles);
+		const auto untiledStart = std::chrono::steady_clock::now();
+		for (u32 i = 0; i < k; ++i)
+		{
+			simulator.step(kDeltaTime);
+		}
+		const f64 kUntiledSeconds = std::max(seconds_since(untiledStart), 1e-9);
+		simulator.read_particles(reference.data());
+		std::printf("%4u %10.3f", k, kUntiledSeconds * 1e9 / kParticleSteps);
+
+		for (u32 t = 0; t < kNumTiles; ++t)
+		{
+			simulator.set_particles(start.data(), kNumParticles);
+			simulator.set_substep_tile(kTiles[t]);
+			const auto tiledStart = std::chrono::steady_clock::now();
+			simulator.step(kDeltaTime, k);
+			const f64 kTiledSeconds = std::max(seconds_since(tiledStart), 1e-9);
+			simulator.read_particles(result.data());
+
+			const bool kMatch = same_bits(reference, result);
+			allMatch = allMatch && kMatch;
+			std::printf(" %12.3f %7.2fx%s", kTiledSeconds * 1e9 / kParticleSteps, kUntiledSeconds / kTiledSeconds, kMatch ? "" : "!");
+		}
+		std::printf("\n");
+		std::fflush(stdout);
+	}
+
+	if (!allMatch)
+	{
+		std::printf("FAILED: tiled results differ from untiled (marked !)\n");
+		return 1;
+	}
+	std::printf("tiled results match untiled bit for bit\n");
+	return 0;
+}
@@ -0,0 +1,428 @@
+#include "BifurcationDiagram.h"
+
+#include "JobQueue.h"
+#include "LittleEndian.h"
+#include "StepScan.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+// ========================================================
+// class BifurcationSampler
+// Observer that records samples while the simulator steps, into per-thread
+// buffers that drain() empties between steps.
+// ========================================================
+
+class BifurcationSampler : public LorenzStepObserver
+{
+public:
+	virtual void drain(std::vector<BifurcationSample>& rSamples) = 0;
+};
+
+namespace
+{
+	// Axis values and members of the pilot run that fits an open value range,
+	// its share of the measured steps, and the margin added on either side.
+	constexpr u32 kPilotValues = 64;
+	constexpr u32 kPilotEnsemble = 4;
+	constexpr u32 kPilotStepDivisor = 4;
+	constexpr f32 kPilotMargin = 0.02f;
+
+	// Measured steps between drains. Short enough that the sample buffers
+	// stay in cache; growing them over a whole batch cost a third of the run.
+	constexpr u32 kDrainSteps = 64;
+
+	// Counts serialized per fwrite.
+	constexpr u32 kCountsPerWrite = 1024;
+
+	// Local maxima of z.
+	class ZMaximaSampler final : public BifurcationSampler
+	{
+	public:
+		void before_step(const u32 kFirst, const ParticleStreamRange& range) override
+		{
+			(void)kFirst;
+			m_buffers.local().m_previous.save(range);
+		}
+
+		void after_step(const u32 kFirst, const ParticleStreamRange& range, const LorenzParameters& params,
+			const f64 kTime, const f32 kDeltaTime) override
+		{
+			(void)kTime;
+			ThreadBuffer& buffer = m_buffers.local();
+			const f32* pOldZ = buffer.m_previous.z();
+			const f32 kBeta = params.m_beta;
+
+			// dz/dt at both ends, falling through zero; false for NaN
+			scan_step_events(buffer.m_previous, range,
+				[kBeta](const f32 kX, const f32 kY, const f32 kZ) { return kX * kY - kBeta * kZ; },
+				[](const f32 kBefore, const f32 kAfter) { return static_cast<u32>(kBefore > 0.0f) & static_cast<u32>(kAfter <= 0.0f); },
+				[&](const u32 i, const f32 kBefore, const f32 kAfter) {
+					// Hermite cubic in z, with slopes scaled by the step
+					const f32 s = kBefore / (kBefore - kAfter);
+					const f32 kS2 = s * s;
+					const f32 kS3 = kS2 * s;
+					const f32 kZ = (2.0f * kS3 - 3.0f * kS2 + 1.0f) * pOldZ[i] + (kS3 - 2.0f * kS2 + s) * kDeltaTime * kBefore
+						+ (-2.0f * kS3 + 3.0f * kS2) * range.m_pPosZ[i] + (kS3 - kS2) * kDeltaTime * kAfter;
+					buffer.m_samples.push_back(BifurcationSample{ kFirst + i, kZ });
+				});
+		}
+
+		void drain(std::vector<BifurcationSample>& rSamples) override
+		{
+			m_buffers.forEach([&rSamples](ThreadBuffer& buffer) {
+				rSamples.insert(rSamples.end(), buffer.m_samples.begin(), buffer.m_samples.end());
+				buffer.m_samples.clear();
+			});
+		}
+
+	private:
+		struct ThreadBuffer
+		{
+			StepSnapshot m_previous;
+			std::vector<BifurcationSample> m_samples;
+		};
+
+		PerThread<ThreadBuffer> m_buffers;
+	};
+
+	// One coordinate of the crossings of a plane.
+	class SectionSampler final : public BifurcationSampler
+	{
+	public:
+		SectionSampler(const SectionPlane& plane, const u32 kCoordinate) :
+			m_section(plane),
+			m_coordinate(kCoordinate)
+		{
+			assert(kCoordinate < 3);
+		}
+
+		void before_step(const u32 kFirst, const ParticleStreamRange& range) override
+		{
+			m_section.before_step(kFirst, range);
+		}
+
+		void after_step(const u32 kFirst, const ParticleStreamRange& range, const LorenzParameters& params,
+			const f64 kTime, const f32 kDeltaTime) override
+		{
+			m_section.after_step(kFirst, range, params, kTime, kDeltaTime);
+		}
+
+		void drain(std::vector<BifurcationSample>& rSamples) override
+		{
+			m_hits.clear();
+			m_section.drain(m_hits);
+			for (const SectionHit& hit : m_hits)
+			{
+				const f32 kCoordinates[3] = { hit.m_position.x, hit.m_position.y, hit.m_position.z };
+				rSamples.push_back(BifurcationSample{ hit.m_particle, kCoordinates[m_coordinate] });
+			}
+		}
+
+	private:
+		PoincareSection m_section;
+		u32 m_coordinate;
+		std::vector<SectionHit> m_hits;
+	};
+}
+
+const char* bifurcation_parameter_name(const BifurcationParameter::BifurcationParameterEnum kParameter)
+{
+	static const char* const s_names[BifurcationParameter::kNumParameters] = { "sigma", "rho", "beta" };
+	return (kParameter >= 0 && kParameter < BifurcationParameter::kNumParameters) ? s_names[kParameter] : "unknown";
+}
+
+bool parse_bifurcation_parameter(const char* pName, BifurcationParameter::BifurcationParameterEnum& rParameter)
+{
+	for (int parameter = 0; parameter < BifurcationParameter::kNumParameters; ++parameter)
+	{
+		if (std::strcmp(pName, bifurcation_parameter_name(static_cast<BifurcationParameter::BifurcationParameterEnum>(parameter))) == 0)
+		{
+			rParameter = static_cast<BifurcationParameter::BifurcationParameterEnum>(parameter);
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* bifurcation_quantity_name(const BifurcationQuantity::BifurcationQuantityEnum kQuantity)
+{
+	static const char* const s_names[BifurcationQuantity::kNumQuantities] = { "zmax", "section" };
+	return (kQuantity >= 0 && kQuantity < BifurcationQuantity::kNumQuantities) ? s_names[kQuantity] : "unknown";
+}
+
+bool parse_bifurcation_quantity(const char* pName, BifurcationQuantity::BifurcationQuantityEnum& rQuantity)
+{
+	for (int quantity = 0; quantity < BifurcationQuantity::kNumQuantities; ++quantity)
+	{
+		if (std::strcmp(pName, bifurcation_quantity_name(static_cast<BifurcationQuantity::BifurcationQuantityEnum>(quantity))) == 0)
+		{
+			rQuantity = static_cast<BifurcationQuantity::BifurcationQuantityEnum>(quantity);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool write_bifurcation_pgm(std::FILE* pFile, const BifurcationImage& image, const bool kPerColumn)
+{
+	const u32 kWidth = image.m_width;
+	const u32 kHeight = image.m_height;
+
+	// Largest count of each column, or the largest overall in every entry
+	std::vector<u32> scale(kWidth, 0);
+	for (u32 row = 0; row < kHeight; ++row)
+	{
+		for (u32 column = 0; column < kWidth; ++column)
+		{
+			scale[column] = std::max(scale[column], image.m_counts[static_cast<size_t>(row) * kWidth + column]);
+		}
+	}
+	if (!kPerColumn)
+	{
+		const u32 kMax = scale.empty() ? 0 : *std::max_element(scale.begin(), scale.end());
+		std::fill(scale.begin(), scale.end(), kMax);
+	}
+	std::vector<f32> inverseLog(kWidth);
+	for (u32 column = 0; column < kWidth; ++column)
+	{
+		inverseLog[column] = scale[column] > 0 ? 255.0f / std::log1p(static_cast<f32>(scale[column])) : 0.0f;
+	}
+
+	if (std::fprintf(pFile, "P5\n%u %u\n255\n", kWidth, kHeight) < 0)
+	{
+		return false;
+	}
+	std::vector<u8> pixels(kWidth);
+	for (u32 row = 0; row < kHeight; ++row)
+	{
+		const u32* pCounts = image.m_counts.data() + static_cast<size_t>(row) * kWidth;
+		for (u32 column = 0; column < kWidth; ++column)
+		{
+			pixels[column] = static_cast<u8>(std::min(255.0f, std::log1p(static_cast<f32>(pCounts[column])) * inverseLog[column] + 0.5f));
+		}
+		if (kWidth > 0 && std::fwrite(pixels.data(), 1, kWidth, pFile) != kWidth)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool write_bifurcation_counts(std::FILE* pFile, const BifurcationImage& image, const BifurcationSettings& settings)
+{
+	BifurcationFileHeader header = {};
+	std::memcpy(header.m_magic, "LZBD", 4);
+	header.m_version = kBifurcationFileVersion;
+	header.m_width = image.m_width;
+	header.m_height = image.m_height;
+	header.m_valueMax = image.m_valueMax;
+	header.m_valueMin = image.m_valueMin;
+	header.m_parameter = settings.m_parameter;
+	header.m_quantity = settings.m_quantity;
+	header.m_axis = settings.m_axis;
+
+	u8 headerBytes[kBifurcationHeaderSize];
+	std::memcpy(headerBytes, header.m_magic, 4);
+	u8* pOut = put_u32(put_u32(put_u32(headerBytes + 4, header.m_version), header.m_width), header.m_height);
+	pOut = put_u32(put_u32(put_f32(put_f32(pOut, header.m_valueMax), header.m_valueMin), header.m_parameter), header.m_quantity);
+	pOut = put_sweep_axis(pOut, header.m_axis);
+	assert(pOut == headerBytes + kBifurcationHeaderSize);
+	if (std::fwrite(headerBytes, sizeof(headerBytes), 1, pFile) != 1)
+	{
+		return false;
+	}
+
+	u8 bytes[kCountsPerWrite * sizeof(u32)];
+	const size_t kCount = image.m_counts.size();
+	for (size_t first = 0; first < kCount; first += kCountsPerWrite)
+	{
+		const size_t kBatch = std::min(kCount - first, static_cast<size_t>(kCountsPerWrite));
+		pOut = bytes;
+		for (size_t i = first; i < first + kBatch; ++i)
+		{
+			pOut = put_u32(pOut, image.m_counts[i]);
+		}
+		if (std::fwrite(bytes, sizeof(u32), kBatch, pFile) != kBatch)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+BifurcationDiagram::BifurcationDiagram(const BifurcationSettings& settings, JobQueue* pJobQueue) :
+	m_settings(settings),
+	m_jobQueue(pJobQueue ? *pJobQueue : sharedJobQueue()),
+	m_simulator(&m_jobQueue),
+	m_rangeFitted(settings.m_valueMin < settings.m_valueMax)
+{
+	assert(settings.m_ensemble > 0 && settings.m_height > 0);
+	if (settings.m_quantity == BifurcationQuantity::kSection)
+	{
+		m_pSampler.reset(new SectionSampler(settings.m_plane, settings.m_sectionCoordinate));
+	}
+	else
+	{
+		m_pSampler.reset(new ZMaximaSampler());
+	}
+	m_simulator.set_integrator(settings.m_integrator);
+	m_simulator.set_tolerance(settings.m_tolerance);
+
+	m_image.m_width = settings.m_axis.m_count;
+	m_image.m_height = settings.m_height;
+	m_image.m_valueMax = settings.m_valueMax;
+	m_image.m_valueMin = settings.m_valueMin;
+	m_image.m_counts.assign(static_cast<size_t>(m_image.m_width) * m_image.m_height, 0);
+	m_image.m_samples = 0;
+	m_image.m_outside = 0;
+}
+
+BifurcationDiagram::~BifurcationDiagram()
+{
+}
+
+u32 BifurcationDiagram::default_batch() const
+{
+	// The thread waiting on the batch runs jobs too
+	const u32 kThreads = m_jobQueue.workerCount() + 1;
+	const u32 kValues = (kThreads * kSimulatorGrain + m_settings.m_ensemble - 1) / m_settings.m_ensemble;
+	return std::max(std::min(std::min(kValues, m_settings.m_axis.m_count), kMaxParameterGroups), 1u);
+}
+
+LorenzParameters BifurcationDiagram::axis_parameters(const u32 kIndex) const
+{
+	LorenzParameters params = m_settings.m_parameters;
+	const f32 kValue = m_settings.m_axis.value(kIndex);
+	switch (m_settings.m_parameter)
+	{
+	case BifurcationParameter::kSigma:
+		params.m_sigma = kValue;
+		break;
+	case BifurcationParameter::kBeta:
+		params.m_beta = kValue;
+		break;
+	default:
+		params.m_rho = kValue;
+		break;
+	}
+	return params;
+}
+
+bool BifurcationDiagram::fit_range()
+{
+	if (m_rangeFitted)
+	{
+		return true;
+	}
+
+	const SweepAxis& kAxis = m_settings.m_axis;
+	const u32 kNumValues = std::min(kPilotValues, kAxis.m_count);
+	m_batchParameters.clear();
+	for (u32 i = 0; i < kNumValues; ++i)
+	{
+		const u32 kIndex = kNumValues > 1 ? static_cast<u32>(static_cast<u64>(i) * (kAxis.m_count - 1) / (kNumValues - 1)) : 0;
+		m_batchParameters.push_back(axis_parameters(kIndex));
+	}
+	f32 lo = INFINITY;
+	f32 hi = -INFINITY;
+	const bool kRan = run_batch(m_batchParameters, std::min(kPilotEnsemble, m_settings.m_ensemble),
+		std::max(m_settings.m_measureSteps / kPilotStepDivisor, 1u), [this, &lo, &hi]() {
+			for (const BifurcationSample& sample : m_samples)
+			{
+				if (std::isfinite(sample.m_value))
+				{
+					lo = std::min(lo, sample.m_value);
+					hi = std::max(hi, sample.m_value);
+				}
+			}
+		});
+	if (!kRan)
+	{
+		return false;
+	}
+	if (!(lo <= hi))
+	{
+		// Nothing recorded, e.g. every value settles on a fixed point
+		lo = 0.0f;
+		hi = 1.0f;
+	}
+	const f32 kMargin = std::max(kPilotMargin * (hi - lo), 1e-3f * std::max(std::fabs(lo), 1.0f));
+	m_image.m_valueMin = lo - kMargin;
+	m_image.m_valueMax = hi + kMargin;
+	m_rangeFitted = true;
+	return true;
+}
+
+bool BifurcationDiagram::run_values(const u32 kFirst, const u32 kCount)
+{
+	if (kFirst > m_settings.m_axis.m_count || kCount > m_settings.m_axis.m_count - kFirst || kCount > kMaxParameterGroups)
+	{
+		return false;
+	}
+	if (kCount == 0)
+	{
+		return true;
+	}
+	if (!fit_range())
+	{
+		return false;
+	}
+
+	m_batchParameters.clear();
+	for (u32 i = 0; i < kCount; ++i)
+	{
+		m_batchParameters.push_back(axis_parameters(kFirst + i));
+	}
+	const u32 kEnsemble = m_settings.m_ensemble;
+	const u32 kWidth = m_image.m_width;
+	const u32 kHeight = m_image.m_height;
+	const f32 kTop = m_image.m_valueMax;
+	const f32 kRowsPerValue = static_cast<f32>(kHeight) / (m_image.m_valueMax - m_image.m_valueMin);
+	return run_batch(m_batchParameters, kEnsemble, m_settings.m_measureSteps, [&]() {
+		for (const BifurcationSample& sample : m_samples)
+		{
+			// Also false for NaN
+			const f32 kRow = (kTop - sample.m_value) * kRowsPerValue;
+			if (!(kRow >= 0.0f && kRow < static_cast<f32>(kHeight)))
+			{
+				++m_image.m_outside;
+				continue;
+			}
+			const u32 kColumn = kFirst + sample.m_particle / kEnsemble;
+			++m_image.m_counts[static_cast<size_t>(kRow) * kWidth + kColumn];
+			++m_image.m_samples;
+		}
+	});
+}
+
+template<typename Fn>
+bool BifurcationDiagram::run_batch(const std::vector<LorenzParameters>& params, const u32 kEnsemble, const u32 kMeasureSteps, const Fn& consume)
+{
+	// Group g holds particles [g * kEnsemble, (g + 1) * kEnsemble)
+	const u32 kNumGroups = static_cast<u32>(params.size());
+	const u64 kNumParticles = static_cast<u64>(kNumGroups) * kEnsemble;
+	if (kNumParticles > UINT32_MAX || !m_simulator.init(static_cast<u32>(kNumParticles), m_settings.m_seed))
+	{
+		return false;
+	}
+	m_simulator.set_parameter_groups(params.data(), kNumGroups);
+
+	if (m_settings.m_transientSteps > 0)
+	{
+		m_simulator.step(m_settings.m_stepSize, m_settings.m_transientSteps);
+	}
+
+	m_simulator.set_step_observer(m_pSampler.get());
+	for (u32 step = 0; step < kMeasureSteps; step += kDrainSteps)
+	{
+		m_simulator.step(m_settings.m_stepSize, std::min(kDrainSteps, kMeasureSteps - step));
+		m_samples.clear();
+		m_pSampler->drain(m_samples);
+		consume();
+	}
+	m_simulator.set_step_observer(nullptr);
+	return true;
+}
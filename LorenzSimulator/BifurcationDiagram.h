@@ -0,0 +1,206 @@
+#pragma once
+
+//================================================================================
+// BifurcationDiagram
+// Density image of the long-term behaviour of the Lorenz system as one
+// parameter (usually rho) varies. Each column is one value of the parameter,
+// and each row is one bin of the recorded quantity, which is either
+//  - the local maxima of z, the observable of Lorenz's own return map, or
+//  - one coordinate of the crossings of a PoincareSection plane.
+//
+// Values run in batches in one LorenzSimulator. Every value is a parameter
+// group of m_ensemble contiguous members, so a batch steps in parallel at
+// full SIMD speed, tile by tile, with no per-value setup. The transient is a
+// single multi-substep call with nothing observing. The measured steps then
+// run with an observer that records samples in-line into per-thread buffers
+// (PerThread), so no trajectory is ever stored. Every few dozen steps the
+// samples are drained and binned into their columns.
+//
+// A z maximum is where dz/dt = xy - beta z turns from positive to negative
+// within a step. Its height is read off the Hermite cubic through both ends
+// of the step, at the linear root of dz/dt; z is stationary there, so the
+// error in the root hardly matters.
+//
+// If the value range is left open, a short pilot run over a few values spread
+// along the axis fits it before the first batch.
+//================================================================================
+
+#include "ParameterSweep.h"
+#include "PoincareSection.h"
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+class JobQueue;
+class BifurcationSampler;
+
+namespace BifurcationParameter
+{
+	enum BifurcationParameterEnum
+	{
+		kSigma,
+		kRho,
+		kBeta,
+		kNumParameters
+	};
+}
+
+namespace BifurcationQuantity
+{
+	enum BifurcationQuantityEnum
+	{
+		kZMaxima,
+		kSection,
+		kNumQuantities
+	};
+}
+
+// Short lower case names ("sigma", "rho", "beta"; "zmax", "section"), and
+// lookups by name that return false if the name is unknown.
+const char* bifurcation_parameter_name(const BifurcationParameter::BifurcationParameterEnum kParameter);
+bool parse_bifurcation_parameter(const char* pName, BifurcationParameter::BifurcationParameterEnum& rParameter);
+const char* bifurcation_quantity_name(const BifurcationQuantity::BifurcationQuantityEnum kQuantity);
+bool parse_bifurcation_quantity(const char* pName, BifurcationQuantity::BifurcationQuantityEnum& rQuantity);
+
+struct BifurcationSettings
+{
+	// Values of the parameters that stay fixed.
+	LorenzParameters m_parameters = kDefaultLorenzParameters;
+
+	// Parameter varied along the image, one column per axis value.
+	BifurcationParameter::BifurcationParameterEnum m_parameter = BifurcationParameter::kRho;
+	SweepAxis m_axis = { 1.0f, 200.0f, 2000 };
+
+	BifurcationQuantity::BifurcationQuantityEnum m_quantity = BifurcationQuantity::kZMaxima;
+
+	// Plane and coordinate (0 = x, 1 = y, 2 = z) of section crossings.
+	SectionPlane m_plane;
+	u32 m_sectionCoordinate = 0;
+
+	// Members per value, each from its own initial_lorenz_particle().
+	u32 m_ensemble = 16;
+
+	f32 m_stepSize = 0.005f;
+	Integrator::IntegratorEnum m_integrator = Integrator::kRK4;
+	f32 m_tolerance = 1e-4f;
+
+	// Steps discarded, then measured.
+	u32 m_transientSteps = 8000;
+	u32 m_measureSteps = 8000;
+
+	// Image rows, and the value range they cover from top to bottom. The
+	// range is fitted by a pilot run unless m_valueMin < m_valueMax.
+	u32 m_height = 1000;
+	f32 m_valueMin = 0.0f;
+	f32 m_valueMax = 0.0f;
+
+	u32 m_seed = 1;
+};
+
+// A recorded value of the simulator particle m_particle.
+struct BifurcationSample
+{
+	u32 m_particle;
+	f32 m_value;
+};
+
+struct BifurcationImage
+{
+	u32 m_width;
+	u32 m_height;
+
+	// Value at the top edge of row 0, and at the bottom edge of the last row.
+	f32 m_valueMax;
+	f32 m_valueMin;
+
+	// Samples per pixel, row by row from the top.
+	std::vector<u32> m_counts;
+
+	// Samples binned, and samples outside the value range or not finite.
+	u64 m_samples;
+	u64 m_outside;
+};
+
+// Binary file header of write_bifurcation_counts(), followed by the counts.
+// Written field by field in declaration order, little-endian with no padding.
+struct BifurcationFileHeader
+{
+	char m_magic[4];
+	u32 m_version;
+	u32 m_width;
+	u32 m_height;
+	f32 m_valueMax;
+	f32 m_valueMin;
+	u32 m_parameter;
+	u32 m_quantity;
+	SweepAxis m_axis;
+};
+
+// Bytes of the binary header.
+constexpr u32 kBifurcationHeaderSize = 44;
+
+constexpr u32 kBifurcationFileVersion = 1;
+
+// Write the image as an 8-bit binary PGM, brightness the log of the count.
+// Counts are scaled by the largest in their column if kPerColumn, so sparse
+// and dense columns are equally visible, or by the largest overall.
+bool write_bifurcation_pgm(std::FILE* pFile, const BifurcationImage& image, const bool kPerColumn);
+
+// Write the raw counts as little-endian u32, after a BifurcationFileHeader,
+// so the file does not depend on the host's byte order or struct layout.
+bool write_bifurcation_counts(std::FILE* pFile, const BifurcationImage& image, const BifurcationSettings& settings);
+
+// ========================================================
+// class BifurcationDiagram
+// Accumulates the image over any number of run_values() calls, so callers
+// can report progress or spread the axis over several runs.
+// ========================================================
+
+class BifurcationDiagram final
+{
+public:
+	// Runs its parallel loops on pJobQueue, or on sharedJobQueue() if null.
+	explicit BifurcationDiagram(const BifurcationSettings& settings, JobQueue* pJobQueue = nullptr);
+	~BifurcationDiagram();
+
+	BifurcationDiagram(const BifurcationDiagram&) = delete;
+	BifurcationDiagram& operator=(const BifurcationDiagram&) = delete;
+
+	// Fit the value range with a pilot run if the settings leave it open.
+	// run_values() calls it first if needed. Returns false if the pilot's
+	// particles cannot be allocated.
+	bool fit_range();
+
+	// Integrate axis values [kFirst, kFirst + kCount) and bin their samples.
+	// Returns false, binning nothing, if the values are not on the axis, kCount
+	// is over kMaxParameterGroups, or the particles cannot be allocated.
+	bool run_values(const u32 kFirst, const u32 kCount);
+
+	// Values per run_values() call that give every worker a full simulator
+	// chunk, at most kMaxParameterGroups.
+	u32 default_batch() const;
+
+	const BifurcationSettings& settings() const { return m_settings; }
+	const BifurcationImage& image() const { return m_image; }
+
+private:
+	LorenzParameters axis_parameters(const u32 kIndex) const;
+
+	// Run one value per group of params, kEnsemble members each, and call
+	// consume() with m_samples after every drain of the sampler. Returns false
+	// if the particles cannot be allocated.
+	template<typename Fn>
+	bool run_batch(const std::vector<LorenzParameters>& params, const u32 kEnsemble, const u32 kMeasureSteps, const Fn& consume);
+
+	BifurcationSettings m_settings;
+	JobQueue& m_jobQueue;
+	LorenzSimulator m_simulator;
+	std::unique_ptr<BifurcationSampler> m_pSampler;
+	BifurcationImage m_image;
+	bool m_rangeFitted;
+
+	// Batch scratch, kept to avoid allocating every batch.
+	std::vector<LorenzParameters> m_batchParameters;
+	std::vector<BifurcationSample> m_samples;
+};
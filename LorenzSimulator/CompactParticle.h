@@ -0,0 +1,140 @@
+#pragma once
+
+//================================================================================
+// CompactParticle
+// An 8 byte particle for paths that only need to move positions and ages
+// (snapshots, streaming, upload), against 28 bytes for LorenzParticle.
+//
+//  - Position: 16-bit fixed point per axis, relative to a box (normally the
+//    attractor bounds). Positions outside the box clamp to its faces; NaN
+//    encodes as the minimum corner.
+//  - Age: 8-bit fixed point over [0, age range]. Older ages clamp.
+//  - Velocity is not stored. Decoding recomputes it as the Lorenz derivative
+//    at the decoded position, which is exactly what the Euler integrator
+//    stores up to one step of lag, and a close match for the streak
+//    direction with the other integrators.
+//
+// Error bounds, for values inside the encoded range:
+//  - |decoded - position| <= step / 2 per axis, plus float rounding of at
+//    most 4 ulp of the box's largest coordinate (compact_position_error()).
+//  - |decoded - age| <= age step / 2, plus 1 ulp (compact_age_error()).
+// CompactParticleBench measures both on settled particles and fails if
+// either bound is exceeded.
+//
+// Two little-endian 32-bit words, so SIMD kernels can build a particle from
+// two integer lanes:
+//   word 0: x | y << 16
+//   word 1: z | age << 16 | reserved (zero) << 24
+//================================================================================
+
+#include "LorenzParticle.h"
+
+#include <cmath>
+
+#if !defined(__GNUC__) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#include <xmmintrin.h>
+#endif
+
+struct CompactParticle
+{
+	u16 m_x;
+	u16 m_y;
+	u16 m_z;
+	u8 m_age;
+	u8 m_reserved;
+};
+
+static_assert(sizeof(CompactParticle) == 8, "CompactParticle must be two 32-bit words");
+
+// Largest quantized values.
+constexpr u32 kCompactPositionMax = 0xFFFF;
+constexpr u32 kCompactAgeMax = 0xFF;
+
+// Maps between quantized and real values: real = origin + q * step.
+struct CompactParticleFormat
+{
+	Float3 m_origin;
+	Float3 m_step;
+	f32 m_ageStep;
+};
+
+// Format covering kBounds and ages in [0, kAgeRange]. A flat axis gets a
+// tiny nonzero step so decoding stays finite.
+inline CompactParticleFormat make_compact_format(const ParticleBounds& kBounds, const f32 kAgeRange)
+{
+	auto step = [](const f32 kMin, const f32 kMax) {
+		const f32 kExtent = kMax - kMin;
+		return kExtent > 1e-6f ? kExtent / kCompactPositionMax : 1e-6f / kCompactPositionMax;
+	};
+
+	CompactParticleFormat format;
+	format.m_origin = kBounds.m_min;
+	format.m_step = Float3{ step(kBounds.m_min.x, kBounds.m_max.x), step(kBounds.m_min.y, kBounds.m_max.y), step(kBounds.m_min.z, kBounds.m_max.z) };
+	format.m_ageStep = (kAgeRange > 0.0f ? kAgeRange : 1.0f) / kCompactAgeMax;
+	return format;
+}
+
+// Largest position error per axis for a position inside the format's box.
+inline Float3 compact_position_error(const CompactParticleFormat& format)
+{
+	auto bound = [](const f32 kOrigin, const f32 kStep) {
+		const f32 kLargest = (kOrigin < 0.0f ? -kOrigin : kOrigin) + kCompactPositionMax * kStep;
+		return 0.5f * kStep + 4.0f * kLargest * 1.1920929e-7f;
+	};
+	return Float3{ bound(format.m_origin.x, format.m_step.x), bound(format.m_origin.y, format.m_step.y), bound(format.m_origin.z, format.m_step.z) };
+}
+
+// Largest age error for an age inside the format's range.
+inline f32 compact_age_error(const CompactParticleFormat& format)
+{
+	return 0.5f * format.m_ageStep + kCompactAgeMax * format.m_ageStep * 1.1920929e-7f;
+}
+
+// Round to nearest, ties to even in the default rounding mode, as
+// std::nearbyint and cvtps_epi32 do. Not std::nearbyint itself: the kernel
+// translation units include this header, and must not emit out-of-line
+// copies of standard functions built for their instruction set (see
+// SimdOps.h).
+inline s32 compact_round(const f32 kValue)
+{
+#if defined(__GNUC__)
+	return static_cast<s32>(__builtin_nearbyintf(kValue));
+#elif defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	return _mm_cvtss_si32(_mm_set_ss(kValue));
+#else
+	return static_cast<s32>(std::nearbyint(kValue));
+#endif
+}
+
+// Scalar reference for the SIMD kernels in LorenzKernelTable. Encoding gives
+// the same bits; decoding may differ in the last bit where the kernels fuse
+// the multiply-add.
+inline CompactParticle encode_compact_particle(const LorenzParticle& p, const CompactParticleFormat& format)
+{
+	auto quantize = [](const f32 kValue, const f32 kOrigin, const f32 kInvStep, const f32 kMax) {
+		f32 q = (kValue - kOrigin) * kInvStep;
+		q = q > 0.0f ? q : 0.0f;
+		q = q < kMax ? q : kMax;
+		return static_cast<u32>(compact_round(q));
+	};
+
+	CompactParticle c;
+	c.m_x = static_cast<u16>(quantize(p.m_position.x, format.m_origin.x, 1.0f / format.m_step.x, kCompactPositionMax));
+	c.m_y = static_cast<u16>(quantize(p.m_position.y, format.m_origin.y, 1.0f / format.m_step.y, kCompactPositionMax));
+	c.m_z = static_cast<u16>(quantize(p.m_position.z, format.m_origin.z, 1.0f / format.m_step.z, kCompactPositionMax));
+	c.m_age = static_cast<u8>(quantize(p.m_age, 0.0f, 1.0f / format.m_ageStep, kCompactAgeMax));
+	c.m_reserved = 0;
+	return c;
+}
+
+inline LorenzParticle decode_compact_particle(const CompactParticle& c, const CompactParticleFormat& format, const LorenzParameters& params)
+{
+	LorenzParticle p;
+	p.m_position = Float3{
+		static_cast<f32>(c.m_x) * format.m_step.x + format.m_origin.x,
+		static_cast<f32>(c.m_y) * format.m_step.y + format.m_origin.y,
+		static_cast<f32>(c.m_z) * format.m_step.z + format.m_origin.z };
+	p.m_age = static_cast<f32>(c.m_age) * format.m_ageStep;
+	p.m_velocity = lorenz_derivative(p.m_position, params);
+	return p;
+}
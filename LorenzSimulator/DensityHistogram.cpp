@@ -0,0 +1,350 @@
+#include "DensityHistogram.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Particles whose voxels are found at once, in a branch-free pass the
+	// compiler vectorizes, before they are counted.
+	constexpr u32 kBinBlock = 64;
+
+	// Brick index of a position outside the grid.
+	constexpr u32 kOutside = ~0u;
+
+	// Particles sampled by fit_bounds(), the share trimmed from either end of
+	// each axis, and the padding added to the trimmed extent on either side.
+	constexpr u32 kFitSamples = 65536;
+	constexpr f32 kFitTrim = 0.0001f;
+	constexpr f32 kFitMargin = 0.05f;
+
+	// Lower and upper trimmed values of rValues, which is reordered.
+	void trimmed_range(std::vector<f32>& rValues, f32& rLo, f32& rHi)
+	{
+		const size_t kTrim = static_cast<size_t>(kFitTrim * rValues.size());
+		std::nth_element(rValues.begin(), rValues.begin() + kTrim, rValues.end());
+		rLo = rValues[kTrim];
+		std::nth_element(rValues.begin(), rValues.end() - 1 - kTrim, rValues.end());
+		rHi = rValues[rValues.size() - 1 - kTrim];
+	}
+}
+
+u32* DensityHistogram::SparseGrid::allocate_brick()
+{
+	if (m_slabFree == 0)
+	{
+		if (m_slabsUsed == m_slabs.size())
+		{
+			m_slabs.emplace_back(new u32[kBricksPerSlab * kDensityBrickVoxels]);
+		}
+		++m_slabsUsed;
+		m_slabFree = kBricksPerSlab;
+	}
+	u32* pBrick = m_slabs[m_slabsUsed - 1].get() + (kBricksPerSlab - m_slabFree) * kDensityBrickVoxels;
+	--m_slabFree;
+	std::memset(pBrick, 0, kDensityBrickVoxels * sizeof(u32));
+	return pBrick;
+}
+
+void DensityHistogram::SparseGrid::clear()
+{
+	std::fill(m_bricks.begin(), m_bricks.end(), nullptr);
+	m_slabFree = 0;
+	m_slabsUsed = 0;
+	m_binned = 0;
+	m_outside = 0;
+}
+
+DensityHistogram::DensityHistogram(const u32 kResolution) :
+	m_resolution(kResolution),
+	m_resolutionShift(0),
+	m_bricksPerAxis(kResolution >> kDensityBrickShift),
+	// Around the attractor of the default parameters
+	m_boundsMin(Float3{ -30.0f, -30.0f, 0.0f }),
+	m_boundsMax(Float3{ 30.0f, 30.0f, 60.0f })
+{
+	assert(is_density_resolution(kResolution));
+	while ((1u << m_resolutionShift) < kResolution)
+	{
+		++m_resolutionShift;
+	}
+	reset_grid(m_merged);
+}
+
+void DensityHistogram::reset_grid(SparseGrid& rGrid) const
+{
+	rGrid.m_bricks.assign(static_cast<size_t>(m_bricksPerAxis) * m_bricksPerAxis * m_bricksPerAxis, nullptr);
+}
+
+void DensityHistogram::set_bounds(const Float3& boundsMin, const Float3& boundsMax)
+{
+	assert(boundsMin.x < boundsMax.x && boundsMin.y < boundsMax.y && boundsMin.z < boundsMax.z);
+	m_boundsMin = boundsMin;
+	m_boundsMax = boundsMax;
+	clear();
+}
+
+void DensityHistogram::fit_bounds(const LorenzSimulator& simulator)
+{
+	const ParticlePool& kPool = simulator.pool();
+	const u32 kCount = simulator.active_count();
+	const u32 kStride = std::max(kCount / kFitSamples, 1u);
+
+	std::vector<f32> values[3];
+	for (u32 i = 0; i < kCount; i += kStride)
+	{
+		const f32 kX = kPool.at(ParticleStreams::kPosX, i);
+		const f32 kY = kPool.at(ParticleStreams::kPosY, i);
+		const f32 kZ = kPool.at(ParticleStreams::kPosZ, i);
+		if (std::isfinite(kX) && std::isfinite(kY) && std::isfinite(kZ))
+		{
+			values[0].push_back(kX);
+			values[1].push_back(kY);
+			values[2].push_back(kZ);
+		}
+	}
+	if (values[0].empty())
+	{
+		return;
+	}
+
+	f32 lo[3];
+	f32 hi[3];
+	for (u32 axis = 0; axis < 3; ++axis)
+	{
+		trimmed_range(values[axis], lo[axis], hi[axis]);
+
+		// A single particle, or all of them at a fixed point
+		const f32 kMargin = std::max(kFitMargin * (hi[axis] - lo[axis]), 1e-3f * std::max(std::fabs(lo[axis]), 1.0f));
+		lo[axis] -= kMargin;
+		hi[axis] += kMargin;
+	}
+	set_bounds(Float3{ lo[0], lo[1], lo[2] }, Float3{ hi[0], hi[1], hi[2] });
+}
+
+void DensityHistogram::before_step(const u32 kFirst, const ParticleStreamRange& range)
+{
+	(void)kFirst;
+	(void)range;
+}
+
+void DensityHistogram::after_step(const u32 kFirst, const ParticleStreamRange& range, const LorenzParameters& params,
+	const f64 kTime, const f32 kDeltaTime)
+{
+	(void)kFirst;
+	(void)params;
+	(void)kTime;
+	(void)kDeltaTime;
+
+	SparseGrid& grid = m_threadGrids.local();
+	if (grid.m_bricks.empty())
+	{
+		reset_grid(grid);
+	}
+
+	// Voxel coordinates are offset by one and clamped to [0, resolution + 1]
+	// before truncation, so everything below the grid lands on -1 and
+	// everything above it on the resolution; NaN fails both comparisons and
+	// lands on -1 too. As u32 both are at or above the resolution.
+	const f32 kScaleX = static_cast<f32>(m_resolution) / (m_boundsMax.x - m_boundsMin.x);
+	const f32 kScaleY = static_cast<f32>(m_resolution) / (m_boundsMax.y - m_boundsMin.y);
+	const f32 kScaleZ = static_cast<f32>(m_resolution) / (m_boundsMax.z - m_boundsMin.z);
+	const f32 kOffsetX = 1.0f - m_boundsMin.x * kScaleX;
+	const f32 kOffsetY = 1.0f - m_boundsMin.y * kScaleY;
+	const f32 kOffsetZ = 1.0f - m_boundsMin.z * kScaleZ;
+	const f32 kLimit = static_cast<f32>(m_resolution + 1);
+	const u32 kResolutionShift = m_resolutionShift;
+	const u32 kBrickAxisShift = m_resolutionShift - kDensityBrickShift;
+	constexpr u32 kMask = kDensityBrickSize - 1;
+
+	u32 bricks[kBinBlock];
+	u32 voxels[kBinBlock];
+	u32* counters[kBinBlock];
+	u32 discard = 0; // Counter of the positions outside the grid
+	u64 outside = 0;
+	const u32 kCount = range.m_count;
+	for (u32 block = 0; block < kCount; block += kBinBlock)
+	{
+		const u32 kBlockCount = std::min(kBinBlock, kCount - block);
+		const f32* pX = range.m_pPosX + block;
+		const f32* pY = range.m_pPosY + block;
+		const f32* pZ = range.m_pPosZ + block;
+		for (u32 i = 0; i < kBlockCount; ++i)
+		{
+			f32 x = pX[i] * kScaleX + kOffsetX;
+			f32 y = pY[i] * kScaleY + kOffsetY;
+			f32 z = pZ[i] * kScaleZ + kOffsetZ;
+			x = x > 0.0f ? x : 0.0f;
+			y = y > 0.0f ? y : 0.0f;
+			z = z > 0.0f ? z : 0.0f;
+			x = x < kLimit ? x : kLimit;
+			y = y < kLimit ? y : kLimit;
+			z = z < kLimit ? z : kLimit;
+			const u32 kIX = static_cast<u32>(static_cast<s32>(x)) - 1;
+			const u32 kIY = static_cast<u32>(static_cast<s32>(y)) - 1;
+			const u32 kIZ = static_cast<u32>(static_cast<s32>(z)) - 1;
+			const u32 kOutsideMask = 0u - static_cast<u32>(((kIX | kIY | kIZ) >> kResolutionShift) != 0);
+			const u32 kBrick = ((((kIZ >> kDensityBrickShift) << kBrickAxisShift) | (kIY >> kDensityBrickShift)) << kBrickAxisShift)
+				| (kIX >> kDensityBrickShift);
+			bricks[i] = kBrick | kOutsideMask;
+			voxels[i] = (((kIZ & kMask) << kDensityBrickShift | (kIY & kMask)) << kDensityBrickShift) | (kIX & kMask);
+		}
+
+		// Counters are found first and incremented after, so the cache misses
+		// of a whole block overlap instead of each waiting on the last
+		for (u32 i = 0; i < kBlockCount; ++i)
+		{
+			if (bricks[i] == kOutside)
+			{
+				++outside;
+				counters[i] = &discard;
+				continue;
+			}
+			u32*& rBrick = grid.m_bricks[bricks[i]];
+			if (!rBrick)
+			{
+				rBrick = grid.allocate_brick();
+			}
+			counters[i] = rBrick + voxels[i];
+		}
+
+		for (u32 i = 0; i < kBlockCount; ++i)
+		{
+			++*counters[i];
+		}
+	}
+	grid.m_binned += kCount - outside;
+	grid.m_outside += outside;
+}
+
+void DensityHistogram::merge()
+{
+	m_threadGrids.forEach([this](SparseGrid& grid) {
+		if (grid.m_slabsUsed > 0)
+		{
+			const size_t kNumBricks = grid.m_bricks.size();
+			for (size_t b = 0; b < kNumBricks; ++b)
+			{
+				const u32* pBrick = grid.m_bricks[b];
+				if (!pBrick)
+				{
+					continue;
+				}
+				u32*& rMerged = m_merged.m_bricks[b];
+				if (!rMerged)
+				{
+					rMerged = m_merged.allocate_brick();
+				}
+				for (u32 v = 0; v < kDensityBrickVoxels; ++v)
+				{
+					rMerged[v] += pBrick[v];
+				}
+			}
+		}
+		m_merged.m_binned += grid.m_binned;
+		m_merged.m_outside += grid.m_outside;
+		grid.clear();
+	});
+}
+
+void DensityHistogram::clear()
+{
+	m_threadGrids.forEach([](SparseGrid& grid) { grid.clear(); });
+	m_merged.clear();
+}
+
+bool DensityHistogram::write_volume(std::FILE* pFile)
+{
+	merge();
+
+	const u32 kResolution = m_resolution;
+	const u32 kBricksPerAxis = m_bricksPerAxis;
+	const f32 kScale = m_merged.m_binned > 0 ? static_cast<f32>(1.0 / static_cast<f64>(m_merged.m_binned)) : 0.0f;
+	std::vector<f32> slice(static_cast<size_t>(kResolution) * kResolution);
+	for (u32 z = 0; z < kResolution; ++z)
+	{
+		std::fill(slice.begin(), slice.end(), 0.0f);
+		const u32 kBrickZ = z >> kDensityBrickShift;
+		const u32 kVoxelZ = (z & (kDensityBrickSize - 1)) << (2 * kDensityBrickShift);
+		for (u32 by = 0; by < kBricksPerAxis; ++by)
+		{
+			for (u32 bx = 0; bx < kBricksPerAxis; ++bx)
+			{
+				const u32* pBrick = m_merged.m_bricks[(static_cast<size_t>(kBrickZ) * kBricksPerAxis + by) * kBricksPerAxis + bx];
+				if (!pBrick)
+				{
+					continue;
+				}
+				for (u32 vy = 0; vy < kDensityBrickSize; ++vy)
+				{
+					const u32* pRow = pBrick + kVoxelZ + (vy << kDensityBrickShift);
+					f32* pOut = slice.data() + static_cast<size_t>((by << kDensityBrickShift) + vy) * kResolution + (bx << kDensityBrickShift);
+					for (u32 vx = 0; vx < kDensityBrickSize; ++vx)
+					{
+						pOut[vx] = static_cast<f32>(pRow[vx]) * kScale;
+					}
+				}
+			}
+		}
+		if (std::fwrite(slice.data(), sizeof(f32), slice.size(), pFile) != slice.size())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool DensityHistogram::write_projection_pgm(std::FILE* pFile, const u32 kAxis)
+{
+	assert(kAxis < 3);
+	merge();
+
+	// Image axes: the two other than kAxis, in order
+	const u32 kU = kAxis == 0 ? 1 : 0;
+	const u32 kV = kAxis == 2 ? 1 : 2;
+	const u32 kResolution = m_resolution;
+	const u32 kBricksPerAxis = m_bricksPerAxis;
+	std::vector<u32> image(static_cast<size_t>(kResolution) * kResolution, 0);
+	const size_t kNumBricks = m_merged.m_bricks.size();
+	for (size_t b = 0; b < kNumBricks; ++b)
+	{
+		const u32* pBrick = m_merged.m_bricks[b];
+		if (!pBrick)
+		{
+			continue;
+		}
+		const u32 kBrick[3] = { static_cast<u32>(b % kBricksPerAxis), static_cast<u32>(b / kBricksPerAxis % kBricksPerAxis),
+			static_cast<u32>(b / kBricksPerAxis / kBricksPerAxis) };
+		for (u32 v = 0; v < kDensityBrickVoxels; ++v)
+		{
+			const u32 kVoxel[3] = { v & (kDensityBrickSize - 1), (v >> kDensityBrickShift) & (kDensityBrickSize - 1), v >> (2 * kDensityBrickShift) };
+			const u32 kColumn = (kBrick[kU] << kDensityBrickShift) + kVoxel[kU];
+			const u32 kRow = kResolution - 1 - ((kBrick[kV] << kDensityBrickShift) + kVoxel[kV]);
+			u32& rPixel = image[static_cast<size_t>(kRow) * kResolution + kColumn];
+			rPixel = std::max(rPixel, pBrick[v]);
+		}
+	}
+
+	const u32 kMax = *std::max_element(image.begin(), image.end());
+	const f32 kInverseLog = kMax > 0 ? 255.0f / std::log1p(static_cast<f32>(kMax)) : 0.0f;
+	if (std::fprintf(pFile, "P5\n%u %u\n255\n", kResolution, kResolution) < 0)
+	{
+		return false;
+	}
+	std::vector<u8> pixels(kResolution);
+	for (u32 row = 0; row < kResolution; ++row)
+	{
+		const u32* pCounts = image.data() + static_cast<size_t>(row) * kResolution;
+		for (u32 column = 0; column < kResolution; ++column)
+		{
+			pixels[column] = static_cast<u8>(std::min(255.0f, std::log1p(static_cast<f32>(pCounts[column])) * kInverseLog + 0.5f));
+		}
+		if (std::fwrite(pixels.data(), 1, kResolution, pFile) != kResolution)
+		{
+			return false;
+		}
+	}
+	return true;
+}
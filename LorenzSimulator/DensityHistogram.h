@@ -0,0 +1,129 @@
+#pragma once
+
+//================================================================================
+// DensityHistogram
+// Bins particle positions into a 3D voxel grid after every step while
+// LorenzSimulator steps them. Once the particles are on the attractor, the
+// normalized counts estimate its invariant measure.
+//
+// As a LorenzStepObserver it bins each range into a grid owned by the
+// stepping thread (see PerThread), so threads never share a counter or touch
+// an atomic. Grids are sparse: the volume is cut into bricks of
+// kDensityBrickSize^3 voxels, allocated the first time a particle lands in
+// them, since the attractor fills only a few percent of its bounding box. A
+// 512^3 grid of the attractor then needs about 14 MB of bricks where a dense
+// one would need 512 MB per thread. merge() adds every thread's bricks into one grid
+// between steps, and the writers read that grid slice by slice, so no dense
+// volume is ever held in memory.
+//
+// Bounds are set once, before binning, and fit_bounds() reads them off the
+// particles, trimming stragglers that have not yet reached the attractor.
+// Positions outside the bounds, or not finite, are counted but not binned.
+//================================================================================
+
+#include "LorenzSimulator.h"
+
+#include "PerThread.h"
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+// Voxels per brick edge, as a shift.
+constexpr u32 kDensityBrickShift = 3;
+constexpr u32 kDensityBrickSize = 1u << kDensityBrickShift;
+constexpr u32 kDensityBrickVoxels = kDensityBrickSize * kDensityBrickSize * kDensityBrickSize;
+
+constexpr u32 kDefaultDensityResolution = 256;
+
+// Largest supported resolution; the brick directory of each thread has
+// (resolution / kDensityBrickSize)^3 entries, 16 MB at this size.
+constexpr u32 kMaxDensityResolution = 1024;
+
+// Resolutions are powers of two from kDensityBrickSize to
+// kMaxDensityResolution, so voxel and brick indices are shifts and masks.
+inline bool is_density_resolution(const u32 kResolution)
+{
+	return kResolution >= kDensityBrickSize && kResolution <= kMaxDensityResolution && (kResolution & (kResolution - 1)) == 0;
+}
+
+// ========================================================
+// class DensityHistogram
+// Attach with LorenzSimulator::set_step_observer(). Every step of every
+// observed particle adds one count.
+// ========================================================
+
+class DensityHistogram final : public LorenzStepObserver
+{
+public:
+	// kResolution voxels along each axis (see is_density_resolution()).
+	explicit DensityHistogram(const u32 kResolution = kDefaultDensityResolution);
+
+	u32 resolution() const { return m_resolution; }
+
+	// Grid bounds. Only between steps; clears the counts.
+	void set_bounds(const Float3& boundsMin, const Float3& boundsMax);
+	const Float3& bounds_min() const { return m_boundsMin; }
+	const Float3& bounds_max() const { return m_boundsMax; }
+
+	// Set the bounds to the box holding all but a sliver of the live
+	// particles along each axis, padded by a few percent. Only between steps.
+	void fit_bounds(const LorenzSimulator& simulator);
+
+	// LorenzStepObserver.
+	void before_step(const u32 kFirst, const ParticleStreamRange& range) override;
+	void after_step(const u32 kFirst, const ParticleStreamRange& range, const LorenzParameters& params,
+		const f64 kTime, const f32 kDeltaTime) override;
+
+	// Add every thread's counts into the merged grid and empty them. Only
+	// between steps. The counts and writers below see merged counts alone.
+	void merge();
+
+	// Drop every count. Only between steps.
+	void clear();
+
+	// Positions binned, and positions outside the bounds or not finite.
+	u64 binned_count() const { return m_merged.m_binned; }
+	u64 outside_count() const { return m_merged.m_outside; }
+
+	// Bricks allocated by the merged grid.
+	u32 brick_count() const { return m_merged.m_slabsUsed * kBricksPerSlab - m_merged.m_slabFree; }
+
+	// Write resolution()^3 little-endian f32 with no header, x fastest then y
+	// then z. Each voxel is its share of binned_count(), so the volume sums
+	// to 1. Merges first. Returns false on a write error.
+	bool write_volume(std::FILE* pFile);
+
+	// Write the maximum along axis kAxis (0 = x, 1 = y, 2 = z) as an 8-bit
+	// binary PGM, brightness the log of the count. The image shows the other
+	// two axes in order, the second one up. Merges first.
+	bool write_projection_pgm(std::FILE* pFile, const u32 kAxis);
+
+private:
+	static constexpr u32 kBricksPerSlab = 64;
+
+	// Sparse counts: a directory of brick pointers, bricks carved out of
+	// slabs that are kept across clear() for reuse.
+	struct SparseGrid
+	{
+		std::vector<u32*> m_bricks;
+		std::vector<std::unique_ptr<u32[]>> m_slabs;
+		u32 m_slabFree = 0;
+		u32 m_slabsUsed = 0;
+		u64 m_binned = 0;
+		u64 m_outside = 0;
+
+		u32* allocate_brick();
+		void clear();
+	};
+
+	void reset_grid(SparseGrid& rGrid) const;
+
+	u32 m_resolution;
+	u32 m_resolutionShift;
+	u32 m_bricksPerAxis;
+	Float3 m_boundsMin;
+	Float3 m_boundsMax;
+	PerThread<SparseGrid> m_threadGrids;
+	SparseGrid m_merged;
+};
@@ -0,0 +1,79 @@
+#include "FixedStepScheduler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+	// Weight of the newest measurement in the smoothed substep cost.
+	constexpr f64 kCostSmoothing = 0.25;
+}
+
+FixedStepScheduler::FixedStepScheduler(const FixedStepSettings& settings) :
+	m_settings(settings)
+{
+	reset();
+}
+
+FixedStepPlan FixedStepScheduler::plan_frame(const f32 kFrameTime)
+{
+	assert(m_settings.m_stepSize > 0.0f);
+	const f64 kStepSize = m_settings.m_stepSize;
+
+	m_accumulator += std::max(kFrameTime, 0.0f);
+	const u64 kDue = static_cast<u64>(std::floor(m_accumulator / kStepSize));
+
+	FixedStepPlan plan;
+	plan.m_stepSize = m_settings.m_stepSize;
+	plan.m_budgetLimited = false;
+
+	u64 substeps = std::min<u64>(kDue, m_settings.m_maxSubsteps);
+
+	// Always allow one substep so the simulation cannot stall outright
+	if (m_settings.m_budgetSeconds > 0.0f && m_substepCost > 0.0)
+	{
+		const u64 kAffordable = std::max<u64>(static_cast<u64>(m_settings.m_budgetSeconds / m_substepCost), 1);
+		if (kAffordable < substeps)
+		{
+			substeps = kAffordable;
+			plan.m_budgetLimited = true;
+		}
+	}
+
+	plan.m_substeps = static_cast<u32>(substeps);
+	m_accumulator -= substeps * kStepSize;
+
+	// Drop whole steps we could not run, keeping the fractional remainder
+	const f64 kDropped = (kDue - substeps) * kStepSize;
+	m_accumulator = std::max(m_accumulator - kDropped, 0.0);
+
+	plan.m_simulatedTime = static_cast<f32>(substeps * kStepSize);
+	plan.m_droppedTime = static_cast<f32>(kDropped);
+	plan.m_alpha = static_cast<f32>(m_accumulator / kStepSize);
+
+	m_totalSubsteps += substeps;
+	m_totalSimulatedTime += substeps * kStepSize;
+	m_totalDroppedTime += kDropped;
+	return plan;
+}
+
+void FixedStepScheduler::record_cost(const u32 kSubsteps, const f64 kSeconds)
+{
+	if (kSubsteps == 0)
+	{
+		return;
+	}
+
+	const f64 kCost = kSeconds / kSubsteps;
+	m_substepCost = m_substepCost > 0.0 ? m_substepCost + kCostSmoothing * (kCost - m_substepCost) : kCost;
+}
+
+void FixedStepScheduler::reset()
+{
+	m_accumulator = 0.0;
+	m_substepCost = 0.0;
+	m_totalSubsteps = 0;
+	m_totalSimulatedTime = 0.0;
+	m_totalDroppedTime = 0.0;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+//================================================================================
+// FixedStepScheduler
+// Decouples the simulation step from the frame rate. Frame time is added to
+// an accumulator and drained in whole substeps of a fixed size, so every
+// integration uses the same dt whatever the frame rate, and a hitch turns
+// into several ordinary steps instead of one huge unstable one.
+//
+// Each frame runs at most m_maxSubsteps substeps, and fewer if the measured
+// cost per substep says more would overrun m_budgetSeconds. Whatever cannot
+// be simulated within those limits is dropped rather than carried over, so a
+// slow machine falls behind wall-clock time instead of spiralling, and the
+// dropped time is reported so the caller can show it.
+//================================================================================
+
+#include "CoreTypes.h"
+
+#include <chrono>
+
+struct FixedStepSettings
+{
+	// Simulated seconds per substep.
+	f32 m_stepSize = 1.0f / 120.0f;
+
+	// Hard cap on substeps per frame.
+	u32 m_maxSubsteps = 8;
+
+	// Wall-clock seconds per frame the substeps may use. Zero disables the budget.
+	f32 m_budgetSeconds = 0.008f;
+};
+
+// What one frame should run, and what it gave up.
+struct FixedStepPlan
+{
+	u32 m_substeps;
+	f32 m_stepSize;
+
+	// m_substeps * m_stepSize.
+	f32 m_simulatedTime;
+
+	// Simulated time discarded this frame because of the substep cap or budget.
+	f32 m_droppedTime;
+
+	// Fraction of a step left in the accumulator, for interpolating rendering.
+	f32 m_alpha;
+
+	// True if the budget, rather than the accumulator or the cap, set m_substeps.
+	bool m_budgetLimited;
+};
+
+class FixedStepScheduler
+{
+public:
+	explicit FixedStepScheduler(const FixedStepSettings& settings = FixedStepSettings());
+
+	// Add kFrameTime simulated seconds and decide how many substeps to run.
+	// Negative frame times are ignored.
+	FixedStepPlan plan_frame(const f32 kFrameTime);
+
+	// Report how long the planned substeps took, to refine the per-substep
+	// cost that the budget is checked against.
+	void record_cost(const u32 kSubsteps, const f64 kSeconds);
+
+	// Plan a frame, call step(stepSize) once per substep on this thread, and
+	// time it.
+	template<typename StepFn>
+	FixedStepPlan advance(const f32 kFrameTime, StepFn step)
+	{
+		const FixedStepPlan kPlan = plan_frame(kFrameTime);
+		const auto start = std::chrono::steady_clock::now();
+		for (u32 i = 0; i < kPlan.m_substeps; ++i)
+		{
+			step(kPlan.m_stepSize);
+		}
+		record_cost(kPlan.m_substeps, std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count());
+		return kPlan;
+	}
+
+	// Empty the accumulator and forget the totals and measured cost.
+	void reset();
+
+	// Settings can be changed between frames.
+	FixedStepSettings& settings() { return m_settings; }
+	const FixedStepSettings& settings() const { return m_settings; }
+
+	// Smoothed wall-clock seconds per substep, zero until measured.
+	f64 substep_cost() const { return m_substepCost; }
+
+	// Totals since construction or reset().
+	u64 total_substeps() const { return m_totalSubsteps; }
+	f64 total_simulated_time() const { return m_totalSimulatedTime; }
+	f64 total_dropped_time() const { return m_totalDroppedTime; }
+
+private:
+	FixedStepSettings m_settings;
+	f64 m_accumulator;
+	f64 m_substepCost;
+
+	u64 m_totalSubsteps;
+	f64 m_totalSimulatedTime;
+	f64 m_totalDroppedTime;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+//================================================================================
+// LittleEndian
+// Writers for the binary files of the tools (ParameterSweep, PoincareSection,
+// BifurcationDiagram). Each puts one value into a byte buffer as
+// little-endian and returns the byte after it, so headers and records are
+// serialized field by field: no padding reaches the file, and the bytes do
+// not depend on the host's byte order, struct layout or enum sizes.
+//================================================================================
+
+#include "LorenzParticle.h"
+
+#include <cstring>
+
+inline u8* put_u32(u8* pOut, const u32 kValue)
+{
+	pOut[0] = static_cast<u8>(kValue);
+	pOut[1] = static_cast<u8>(kValue >> 8);
+	pOut[2] = static_cast<u8>(kValue >> 16);
+	pOut[3] = static_cast<u8>(kValue >> 24);
+	return pOut + 4;
+}
+
+inline u8* put_u64(u8* pOut, const u64 kValue)
+{
+	return put_u32(put_u32(pOut, static_cast<u32>(kValue)), static_cast<u32>(kValue >> 32));
+}
+
+inline u8* put_f32(u8* pOut, const f32 kValue)
+{
+	u32 bits;
+	std::memcpy(&bits, &kValue, sizeof(bits));
+	return put_u32(pOut, bits);
+}
+
+inline u8* put_f64(u8* pOut, const f64 kValue)
+{
+	u64 bits;
+	std::memcpy(&bits, &kValue, sizeof(bits));
+	return put_u64(pOut, bits);
+}
+
+inline u8* put_float3(u8* pOut, const Float3& kValue)
+{
+	return put_f32(put_f32(put_f32(pOut, kValue.x), kValue.y), kValue.z);
+}
@@ -0,0 +1,105 @@
+#include "LorenzKernels.h"
+#include "LorenzKernelsImpl.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	const LorenzKernelTable* select_default_table()
+	{
+		// Explicit override for benchmarking
+		if (const char* pForced = std::getenv("LORENZ_FORCE_ISA"))
+		{
+			SimdLevel::SimdLevelEnum level;
+			if (!parse_simd_level(pForced, level))
+			{
+				std::fprintf(stderr, "LORENZ_FORCE_ISA: unknown instruction set '%s', ignoring\n", pForced);
+			}
+			else if (const LorenzKernelTable* pTable = lorenz_kernel_table(level))
+			{
+				if (cpu_supports(level))
+				{
+					return pTable;
+				}
+				std::fprintf(stderr, "LORENZ_FORCE_ISA: CPU does not support %s, ignoring\n", simd_level_name(level));
+			}
+			else
+			{
+				std::fprintf(stderr, "LORENZ_FORCE_ISA: %s kernels were not compiled in, ignoring\n", simd_level_name(level));
+			}
+		}
+
+		// Widest variant that is both compiled in and supported
+		for (int level = cpu_best_simd_level(); level >= SimdLevel::kScalar; --level)
+		{
+			if (const LorenzKernelTable* pTable = lorenz_kernel_table(static_cast<SimdLevel::SimdLevelEnum>(level)))
+			{
+				return pTable;
+			}
+		}
+		return lorenz_kernels_scalar();
+	}
+
+	std::atomic<const LorenzKernelTable*> s_pActiveTable(nullptr);
+}
+
+const LorenzKernelTable& lorenz_kernels()
+{
+	const LorenzKernelTable* pTable = s_pActiveTable.load(std::memory_order_acquire);
+	if (!pTable)
+	{
+		// Racing threads all compute the same answer, keep whichever lands first
+		const LorenzKernelTable* pExpected = nullptr;
+		pTable = select_default_table();
+		if (!s_pActiveTable.compare_exchange_strong(pExpected, pTable, std::memory_order_acq_rel))
+		{
+			pTable = pExpected;
+		}
+	}
+	return *pTable;
+}
+
+const LorenzKernelTable* lorenz_kernel_table(const SimdLevel::SimdLevelEnum kLevel)
+{
+	switch (kLevel)
+	{
+	case SimdLevel::kScalar: return lorenz_kernels_scalar();
+	case SimdLevel::kSSE4: return lorenz_kernels_sse4();
+	case SimdLevel::kAVX2: return lorenz_kernels_avx2();
+	case SimdLevel::kAVX512: return lorenz_kernels_avx512();
+	default: return nullptr;
+	}
+}
+
+bool lorenz_force_kernels(const SimdLevel::SimdLevelEnum kLevel)
+{
+	const LorenzKernelTable* pTable = lorenz_kernel_table(kLevel);
+	if (!pTable || !cpu_supports(kLevel))
+	{
+		return false;
+	}
+	s_pActiveTable.store(pTable, std::memory_order_release);
+	return true;
+}
+
+const char* integrator_name(const Integrator::IntegratorEnum kIntegrator)
+{
+	static const char* const s_names[Integrator::kNumIntegrators] = { "euler", "rk4", "dopri" };
+	return (kIntegrator >= 0 && kIntegrator < Integrator::kNumIntegrators) ? s_names[kIntegrator] : "unknown";
+}
+
+bool parse_integrator(const char* pName, Integrator::IntegratorEnum& rIntegrator)
+{
+	for (int integrator = 0; integrator < Integrator::kNumIntegrators; ++integrator)
+	{
+		if (std::strcmp(pName, integrator_name(static_cast<Integrator::IntegratorEnum>(integrator))) == 0)
+		{
+			rIntegrator = static_cast<Integrator::IntegratorEnum>(integrator);
+			return true;
+		}
+	}
+	return false;
+}
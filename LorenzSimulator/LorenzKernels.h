@@ -0,0 +1,96 @@
+#pragma once
+
+//================================================================================
+// SIMD kernels over ParticleStreams.
+//
+// Each kernel is compiled once per instruction set (LorenzKernels<ISA>.cpp)
+// and exposed through a LorenzKernelTable of function pointers. The widest
+// table the CPU supports is selected once on first use; set the environment
+// variable LORENZ_FORCE_ISA (scalar, sse4, avx2, avx512) or call
+// lorenz_force_kernels() to override it when benchmarking.
+//================================================================================
+
+#include "CompactParticle.h"
+#include "CpuFeatures.h"
+#include "ParticleStreams.h"
+
+struct LorenzKernelTable
+{
+	SimdLevel::SimdLevelEnum m_level;
+	const char* m_pName;
+
+	// Particles processed per instruction.
+	u32 m_width;
+
+	// Advance every particle in the range by one forward Euler step (CS_Main).
+	void (*m_pStepEuler)(const ParticleStreamRange& range, const LorenzParameters& params, const f32 kDeltaTime);
+
+	// Advance every particle in the range by one classic Runge-Kutta 4 step.
+	void (*m_pStepRK4)(const ParticleStreamRange& range, const LorenzParameters& params, const f32 kDeltaTime);
+
+	// Advance every particle in the range by kDeltaTime with adaptive
+	// Dormand-Prince 5(4) substeps, each within kTolerance * (1 + |position|).
+	// Returns the number of particle substeps attempted.
+	u64 (*m_pStepDormandPrince)(const ParticleStreamRange& range, const LorenzParameters& params, const f32 kDeltaTime, const f32 kTolerance);
+
+	// Encode the positions and ages of the range into range.m_count compact
+	// particles. Only reads the range.
+	void (*m_pEncodeCompact)(const ParticleStreamRange& range, const CompactParticleFormat& format, CompactParticle* pOut);
+
+	// Decode range.m_count compact particles into the range, recomputing
+	// velocity from position.
+	void (*m_pDecodeCompact)(const CompactParticle* pIn, const CompactParticleFormat& format, const LorenzParameters& params, const ParticleStreamRange& range);
+};
+
+namespace Integrator
+{
+	enum IntegratorEnum
+	{
+		kEuler,
+		kRK4,
+		kDormandPrince,
+		kNumIntegrators
+	};
+}
+
+// Short lower case name ("euler", "rk4", "dopri").
+const char* integrator_name(const Integrator::IntegratorEnum kIntegrator);
+
+// Parse a name as returned by integrator_name(). Returns false if unknown.
+bool parse_integrator(const char* pName, Integrator::IntegratorEnum& rIntegrator);
+
+// The active kernel table.
+const LorenzKernelTable& lorenz_kernels();
+
+// Kernel table for a specific level, or nullptr if it was not compiled in.
+const LorenzKernelTable* lorenz_kernel_table(const SimdLevel::SimdLevelEnum kLevel);
+
+// Force the active table. Returns false (and changes nothing) if the level was
+// not compiled in or the CPU cannot run it. Not safe while kernels are running.
+bool lorenz_force_kernels(const SimdLevel::SimdLevelEnum kLevel);
+
+// One step of kIntegrator with the active table. The tolerance only applies
+// to Integrator::kDormandPrince.
+inline void lorenz_integrate_streams(const ParticleStreamRange& range, const LorenzParameters& params, const f32 kDeltaTime,
+	const Integrator::IntegratorEnum kIntegrator, const f32 kTolerance)
+{
+	const LorenzKernelTable& kernels = lorenz_kernels();
+	switch (kIntegrator)
+	{
+	case Integrator::kRK4:
+		kernels.m_pStepRK4(range, params, kDeltaTime);
+		break;
+	case Integrator::kDormandPrince:
+		kernels.m_pStepDormandPrince(range, params, kDeltaTime, kTolerance);
+		break;
+	default:
+		kernels.m_pStepEuler(range, params, kDeltaTime);
+		break;
+	}
+}
+
+// Convenience wrapper over lorenz_kernels().m_pStepEuler.
+inline void lorenz_step_streams(const ParticleStreamRange& range, const LorenzParameters& params, const f32 kDeltaTime)
+{
+	lorenz_kernels().m_pStepEuler(range, params, kDeltaTime);
+}
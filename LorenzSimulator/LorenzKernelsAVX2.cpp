@@ -0,0 +1,15 @@
+#include "LorenzKernelsImpl.h"
+
+// Compiled with -mavx2 -mfma (/arch:AVX2 on MSVC).
+#if defined(__AVX2__)
+const LorenzKernelTable* lorenz_kernels_avx2()
+{
+	static const LorenzKernelTable s_table = make_kernel_table<Avx2Ops>(SimdLevel::kAVX2);
+	return &s_table;
+}
+#else
+const LorenzKernelTable* lorenz_kernels_avx2()
+{
+	return nullptr;
+}
+#endif
@@ -0,0 +1,15 @@
+#include "LorenzKernelsImpl.h"
+
+// Compiled with -mavx512f (/arch:AVX512 on MSVC).
+#if defined(__AVX512F__)
+const LorenzKernelTable* lorenz_kernels_avx512()
+{
+	static const LorenzKernelTable s_table = make_kernel_table<Avx512Ops>(SimdLevel::kAVX512);
+	return &s_table;
+}
+#else
+const LorenzKernelTable* lorenz_kernels_avx512()
+{
+	return nullptr;
+}
+#endif
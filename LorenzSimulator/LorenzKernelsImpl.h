@@ -0,0 +1,438 @@
+#pragma once
+
+//================================================================================
+// Kernel bodies written once over a SIMD wrapper from SimdOps.h.
+// Only included by kernel translation units.
+//================================================================================
+
+#include "LorenzKernels.h"
+#include "SimdOps.h"
+
+namespace
+{
+	// Lorenz vector field with the parameters splatted across lanes.
+	template<typename Ops>
+	struct LorenzField
+	{
+		using Vec = typename Ops::Vec;
+
+		explicit LorenzField(const LorenzParameters& params) :
+			sigma(Ops::set1(params.m_sigma)), rho(Ops::set1(params.m_rho)), beta(Ops::set1(params.m_beta))
+		{}
+
+		// 8 flops per particle.
+		void eval(const Vec x, const Vec y, const Vec z, Vec& rDx, Vec& rDy, Vec& rDz) const
+		{
+			rDx = Ops::mul(sigma, Ops::sub(y, x));
+			rDy = Ops::sub(Ops::mul(x, Ops::sub(rho, z)), y);
+			rDz = Ops::sub(Ops::mul(x, y), Ops::mul(beta, z));
+		}
+
+		Vec sigma, rho, beta;
+	};
+
+	// Offset every stream pointer of a range, for the scalar tails.
+	inline ParticleStreamRange tail_range(const ParticleStreamRange& r, const u32 kFirst)
+	{
+		ParticleStreamRange tail = r;
+		tail.m_pPosX += kFirst; tail.m_pPosY += kFirst; tail.m_pPosZ += kFirst; tail.m_pAge += kFirst;
+		tail.m_pVelX += kFirst; tail.m_pVelY += kFirst; tail.m_pVelZ += kFirst;
+		tail.m_count = r.m_count - kFirst;
+		return tail;
+	}
+
+	// Forward Euler step of the Lorenz system, in place over a stream range.
+	// Matches CS_Main: velocity is the derivative at the old position.
+	template<typename Ops>
+	void step_euler(const ParticleStreamRange& r, const LorenzParameters& params, const f32 kDeltaTime)
+	{
+		using Vec = typename Ops::Vec;
+
+		const LorenzField<Ops> field(params);
+		const Vec dt = Ops::set1(kDeltaTime);
+
+		const u32 kVectorCount = r.m_count - (r.m_count % Ops::kWidth);
+
+		u32 i = 0;
+		for (; i < kVectorCount; i += Ops::kWidth)
+		{
+			const Vec x = Ops::load(r.m_pPosX + i);
+			const Vec y = Ops::load(r.m_pPosY + i);
+			const Vec z = Ops::load(r.m_pPosZ + i);
+
+			Vec vx, vy, vz;
+			field.eval(x, y, z, vx, vy, vz);
+
+			Ops::store(r.m_pVelX + i, vx);
+			Ops::store(r.m_pVelY + i, vy);
+			Ops::store(r.m_pVelZ + i, vz);
+			Ops::store(r.m_pPosX + i, Ops::fmadd(dt, vx, x));
+			Ops::store(r.m_pPosY + i, Ops::fmadd(dt, vy, y));
+			Ops::store(r.m_pPosZ + i, Ops::fmadd(dt, vz, z));
+			Ops::store(r.m_pAge + i, Ops::add(Ops::load(r.m_pAge + i), dt));
+		}
+
+		// Scalar tail for ranges that are not a multiple of the width
+		if (i < r.m_count)
+		{
+			step_euler<ScalarOps>(tail_range(r, i), params, kDeltaTime);
+		}
+	}
+
+	// One classic fourth order Runge-Kutta step of h per lane from (x, y, z)
+	// to (rNx, rNy, rNz). halfH and sixthH are h / 2 and h / 6.
+	template<typename Ops>
+	void rk4_advance(const LorenzField<Ops>& field, const typename Ops::Vec h, const typename Ops::Vec halfH,
+		const typename Ops::Vec sixthH, const typename Ops::Vec x, const typename Ops::Vec y, const typename Ops::Vec z,
+		typename Ops::Vec& rNx, typename Ops::Vec& rNy, typename Ops::Vec& rNz)
+	{
+		using Vec = typename Ops::Vec;
+
+		const Vec two = Ops::set1(2.0f);
+
+		Vec k1x, k1y, k1z, k2x, k2y, k2z, k3x, k3y, k3z, k4x, k4y, k4z;
+		field.eval(x, y, z, k1x, k1y, k1z);
+		field.eval(Ops::fmadd(halfH, k1x, x), Ops::fmadd(halfH, k1y, y), Ops::fmadd(halfH, k1z, z), k2x, k2y, k2z);
+		field.eval(Ops::fmadd(halfH, k2x, x), Ops::fmadd(halfH, k2y, y), Ops::fmadd(halfH, k2z, z), k3x, k3y, k3z);
+		field.eval(Ops::fmadd(h, k3x, x), Ops::fmadd(h, k3y, y), Ops::fmadd(h, k3z, z), k4x, k4y, k4z);
+
+		// x + h/6 (k1 + 2 k2 + 2 k3 + k4)
+		const Vec sx = Ops::add(Ops::fmadd(two, Ops::add(k2x, k3x), k1x), k4x);
+		const Vec sy = Ops::add(Ops::fmadd(two, Ops::add(k2y, k3y), k1y), k4y);
+		const Vec sz = Ops::add(Ops::fmadd(two, Ops::add(k2z, k3z), k1z), k4z);
+		rNx = Ops::fmadd(sixthH, sx, x);
+		rNy = Ops::fmadd(sixthH, sy, y);
+		rNz = Ops::fmadd(sixthH, sz, z);
+	}
+
+	// Classic fourth order Runge-Kutta step, in place over a stream range.
+	// Velocity is the mean velocity over the step, (new - old) / dt, so that
+	// streaks follow the path actually taken.
+	template<typename Ops>
+	void step_rk4(const ParticleStreamRange& r, const LorenzParameters& params, const f32 kDeltaTime)
+	{
+		using Vec = typename Ops::Vec;
+
+		const LorenzField<Ops> field(params);
+		const Vec dt = Ops::set1(kDeltaTime);
+		const Vec halfDt = Ops::set1(0.5f * kDeltaTime);
+		const Vec sixthDt = Ops::set1(kDeltaTime / 6.0f);
+		const Vec invDt = Ops::set1(kDeltaTime != 0.0f ? 1.0f / kDeltaTime : 0.0f);
+
+		const u32 kVectorCount = r.m_count - (r.m_count % Ops::kWidth);
+
+		u32 i = 0;
+		for (; i < kVectorCount; i += Ops::kWidth)
+		{
+			const Vec x = Ops::load(r.m_pPosX + i);
+			const Vec y = Ops::load(r.m_pPosY + i);
+			const Vec z = Ops::load(r.m_pPosZ + i);
+
+			Vec nx, ny, nz;
+			rk4_advance(field, dt, halfDt, sixthDt, x, y, z, nx, ny, nz);
+
+			Ops::store(r.m_pVelX + i, Ops::mul(Ops::sub(nx, x), invDt));
+			Ops::store(r.m_pVelY + i, Ops::mul(Ops::sub(ny, y), invDt));
+			Ops::store(r.m_pVelZ + i, Ops::mul(Ops::sub(nz, z), invDt));
+			Ops::store(r.m_pPosX + i, nx);
+			Ops::store(r.m_pPosY + i, ny);
+			Ops::store(r.m_pPosZ + i, nz);
+			Ops::store(r.m_pAge + i, Ops::add(Ops::load(r.m_pAge + i), dt));
+		}
+
+		if (i < r.m_count)
+		{
+			step_rk4<ScalarOps>(tail_range(r, i), params, kDeltaTime);
+		}
+	}
+
+	// Dormand-Prince 5(4) coefficients (Hairer, Norsett & Wanner, Solving
+	// ODEs I, table 5.2). kDp7x are the fifth order weights; kDpEx are the
+	// differences between the fifth and fourth order weights.
+	constexpr f32 kDp21 = 1.0f / 5.0f;
+	constexpr f32 kDp31 = 3.0f / 40.0f, kDp32 = 9.0f / 40.0f;
+	constexpr f32 kDp41 = 44.0f / 45.0f, kDp42 = -56.0f / 15.0f, kDp43 = 32.0f / 9.0f;
+	constexpr f32 kDp51 = 19372.0f / 6561.0f, kDp52 = -25360.0f / 2187.0f, kDp53 = 64448.0f / 6561.0f, kDp54 = -212.0f / 729.0f;
+	constexpr f32 kDp61 = 9017.0f / 3168.0f, kDp62 = -355.0f / 33.0f, kDp63 = 46732.0f / 5247.0f, kDp64 = 49.0f / 176.0f, kDp65 = -5103.0f / 18656.0f;
+	constexpr f32 kDp71 = 35.0f / 384.0f, kDp73 = 500.0f / 1113.0f, kDp74 = 125.0f / 192.0f, kDp75 = -2187.0f / 6784.0f, kDp76 = 11.0f / 84.0f;
+	constexpr f32 kDpE1 = 71.0f / 57600.0f, kDpE3 = -71.0f / 16695.0f, kDpE4 = 71.0f / 1920.0f, kDpE5 = -17253.0f / 339200.0f, kDpE6 = 22.0f / 525.0f, kDpE7 = -1.0f / 40.0f;
+
+	// Attempts per batch before the lanes still short of the interval finish
+	// it with kDpFallbackSubsteps fixed RK4 substeps instead.
+	constexpr u32 kDpMaxAttempts = 64;
+	constexpr u32 kDpFallbackSubsteps = 16;
+
+	// sum(a_j k_j) and y + h * sum(a_j k_j), for the Dormand-Prince stages.
+	template<typename Ops>
+	typename Ops::Vec dp_sum(const typename Ops::Vec a, const typename Ops::Vec k)
+	{
+		return Ops::mul(a, k);
+	}
+
+	template<typename Ops, typename... Rest>
+	typename Ops::Vec dp_sum(const typename Ops::Vec a, const typename Ops::Vec k, const Rest... rest)
+	{
+		return Ops::fmadd(a, k, dp_sum<Ops>(rest...));
+	}
+
+	template<typename Ops, typename... Terms>
+	typename Ops::Vec dp_combine(const typename Ops::Vec y, const typename Ops::Vec h, const Terms... terms)
+	{
+		return Ops::fmadd(h, dp_sum<Ops>(terms...), y);
+	}
+
+	// Adaptive Dormand-Prince 5(4) over kDeltaTime, in place over a stream
+	// range. Every lane carries its own step size and remaining time, and the
+	// batch keeps stepping until all of its lanes have covered kDeltaTime;
+	// finished lanes take zero length steps. A step is accepted when the
+	// embedded error is within kTolerance * (1 + |position|) on every axis.
+	// The first attempt always tries the whole interval. Lanes that have not
+	// covered it after kDpMaxAttempts take the rest in fixed RK4 substeps, so
+	// every particle ends at t + kDeltaTime. Returns the number of particle
+	// steps attempted (accepted or not, fallback substeps included), for cost
+	// accounting.
+	template<typename Ops>
+	u64 step_dormand_prince(const ParticleStreamRange& r, const LorenzParameters& params, const f32 kDeltaTime, const f32 kTolerance)
+	{
+		using Vec = typename Ops::Vec;
+		using Mask = typename Ops::Mask;
+
+		const LorenzField<Ops> field(params);
+		const Vec dt = Ops::set1(kDeltaTime);
+		const Vec invDt = Ops::set1(kDeltaTime != 0.0f ? 1.0f / kDeltaTime : 0.0f);
+		const Vec zero = Ops::set1(0.0f);
+		const Vec one = Ops::set1(1.0f);
+		const Vec tolerance = Ops::set1(kTolerance);
+		const Vec minStep = Ops::set1(kDeltaTime * 1e-3f);
+		const Vec doneThreshold = Ops::set1(kDeltaTime * 1e-5f);
+		const Vec fallbackScale = Ops::set1(1.0f / kDpFallbackSubsteps);
+
+		// Step size controller: 0.9 * err^(-1/4), clamped. The exponent is
+		// 1/4 rather than the textbook 1/5 so it can use two square roots;
+		// it is slightly more cautious both when growing and shrinking.
+		const Vec safety = Ops::set1(0.9f);
+		const Vec minFactor = Ops::set1(0.2f);
+		const Vec maxFactor = Ops::set1(5.0f);
+		const Vec minError = Ops::set1(1e-12f);
+
+		const Vec a21 = Ops::set1(kDp21);
+		const Vec a31 = Ops::set1(kDp31), a32 = Ops::set1(kDp32);
+		const Vec a41 = Ops::set1(kDp41), a42 = Ops::set1(kDp42), a43 = Ops::set1(kDp43);
+		const Vec a51 = Ops::set1(kDp51), a52 = Ops::set1(kDp52), a53 = Ops::set1(kDp53), a54 = Ops::set1(kDp54);
+		const Vec a61 = Ops::set1(kDp61), a62 = Ops::set1(kDp62), a63 = Ops::set1(kDp63), a64 = Ops::set1(kDp64), a65 = Ops::set1(kDp65);
+		const Vec a71 = Ops::set1(kDp71), a73 = Ops::set1(kDp73), a74 = Ops::set1(kDp74), a75 = Ops::set1(kDp75), a76 = Ops::set1(kDp76);
+		const Vec e1 = Ops::set1(kDpE1), e3 = Ops::set1(kDpE3), e4 = Ops::set1(kDpE4), e5 = Ops::set1(kDpE5), e6 = Ops::set1(kDpE6), e7 = Ops::set1(kDpE7);
+
+		const u32 kVectorCount = r.m_count - (r.m_count % Ops::kWidth);
+		u64 attempts = 0;
+
+		u32 i = 0;
+		for (; i < kVectorCount; i += Ops::kWidth)
+		{
+			const Vec x0 = Ops::load(r.m_pPosX + i);
+			const Vec y0 = Ops::load(r.m_pPosY + i);
+			const Vec z0 = Ops::load(r.m_pPosZ + i);
+			Vec x = x0, y = y0, z = z0;
+
+			// First same as last: k7 of an accepted step is k1 of the next
+			Vec k1x, k1y, k1z;
+			field.eval(x, y, z, k1x, k1y, k1z);
+
+			Vec remaining = dt;
+			Vec h = dt;
+			for (u32 attempt = 0; attempt < kDpMaxAttempts && Ops::any(Ops::cmp_gt(remaining, zero)); ++attempt)
+			{
+				h = Ops::min(h, remaining);
+				attempts += Ops::kWidth;
+
+				Vec k2x, k2y, k2z, k3x, k3y, k3z, k4x, k4y, k4z, k5x, k5y, k5z, k6x, k6y, k6z, k7x, k7y, k7z;
+				field.eval(dp_combine<Ops>(x, h, a21, k1x), dp_combine<Ops>(y, h, a21, k1y), dp_combine<Ops>(z, h, a21, k1z), k2x, k2y, k2z);
+				field.eval(dp_combine<Ops>(x, h, a31, k1x, a32, k2x),
+					dp_combine<Ops>(y, h, a31, k1y, a32, k2y),
+					dp_combine<Ops>(z, h, a31, k1z, a32, k2z), k3x, k3y, k3z);
+				field.eval(dp_combine<Ops>(x, h, a41, k1x, a42, k2x, a43, k3x),
+					dp_combine<Ops>(y, h, a41, k1y, a42, k2y, a43, k3y),
+					dp_combine<Ops>(z, h, a41, k1z, a42, k2z, a43, k3z), k4x, k4y, k4z);
+				field.eval(dp_combine<Ops>(x, h, a51, k1x, a52, k2x, a53, k3x, a54, k4x),
+					dp_combine<Ops>(y, h, a51, k1y, a52, k2y, a53, k3y, a54, k4y),
+					dp_combine<Ops>(z, h, a51, k1z, a52, k2z, a53, k3z, a54, k4z), k5x, k5y, k5z);
+				field.eval(dp_combine<Ops>(x, h, a61, k1x, a62, k2x, a63, k3x, a64, k4x, a65, k5x),
+					dp_combine<Ops>(y, h, a61, k1y, a62, k2y, a63, k3y, a64, k4y, a65, k5y),
+					dp_combine<Ops>(z, h, a61, k1z, a62, k2z, a63, k3z, a64, k4z, a65, k5z), k6x, k6y, k6z);
+
+				const Vec nx = dp_combine<Ops>(x, h, a71, k1x, a73, k3x, a74, k4x, a75, k5x, a76, k6x);
+				const Vec ny = dp_combine<Ops>(y, h, a71, k1y, a73, k3y, a74, k4y, a75, k5y, a76, k6y);
+				const Vec nz = dp_combine<Ops>(z, h, a71, k1z, a73, k3z, a74, k4z, a75, k5z, a76, k6z);
+				field.eval(nx, ny, nz, k7x, k7y, k7z);
+
+				// Embedded error, scaled per axis, worst axis wins
+				const Vec ex = dp_combine<Ops>(zero, h, e1, k1x, e3, k3x, e4, k4x, e5, k5x, e6, k6x, e7, k7x);
+				const Vec ey = dp_combine<Ops>(zero, h, e1, k1y, e3, k3y, e4, k4y, e5, k5y, e6, k6y, e7, k7y);
+				const Vec ez = dp_combine<Ops>(zero, h, e1, k1z, e3, k3z, e4, k4z, e5, k5z, e6, k6z, e7, k7z);
+				const Vec rx = Ops::div(Ops::abs(ex), Ops::mul(tolerance, Ops::add(one, Ops::max(Ops::abs(x), Ops::abs(nx)))));
+				const Vec ry = Ops::div(Ops::abs(ey), Ops::mul(tolerance, Ops::add(one, Ops::max(Ops::abs(y), Ops::abs(ny)))));
+				const Vec rz = Ops::div(Ops::abs(ez), Ops::mul(tolerance, Ops::add(one, Ops::max(Ops::abs(z), Ops::abs(nz)))));
+				const Vec error = Ops::max(Ops::max(rx, ry), rz);
+
+				// Steps already at the minimum size are accepted regardless
+				const Mask reject = Ops::cmp_gt(Ops::select(Ops::cmp_gt(h, minStep), error, zero), one);
+				x = Ops::select(reject, x, nx);
+				y = Ops::select(reject, y, ny);
+				z = Ops::select(reject, z, nz);
+				k1x = Ops::select(reject, k1x, k7x);
+				k1y = Ops::select(reject, k1y, k7y);
+				k1z = Ops::select(reject, k1z, k7z);
+				remaining = Ops::select(reject, remaining, Ops::sub(remaining, h));
+				remaining = Ops::select(Ops::cmp_gt(remaining, doneThreshold), remaining, zero);
+
+				const Vec factor = Ops::div(safety, Ops::sqrt(Ops::sqrt(Ops::max(error, minError))));
+				h = Ops::max(Ops::mul(h, Ops::min(Ops::max(factor, minFactor), maxFactor)), minStep);
+			}
+
+			// Out of attempts: finished lanes have nothing left and take zero
+			// length substeps, which leave them exactly where they are
+			if (Ops::any(Ops::cmp_gt(remaining, zero)))
+			{
+				const Vec subH = Ops::mul(remaining, fallbackScale);
+				const Vec halfH = Ops::mul(subH, Ops::set1(0.5f));
+				const Vec sixthH = Ops::mul(subH, Ops::set1(1.0f / 6.0f));
+				for (u32 substep = 0; substep < kDpFallbackSubsteps; ++substep)
+				{
+					rk4_advance(field, subH, halfH, sixthH, x, y, z, x, y, z);
+				}
+				attempts += Ops::kWidth * kDpFallbackSubsteps;
+			}
+
+			Ops::store(r.m_pVelX + i, Ops::mul(Ops::sub(x, x0), invDt));
+			Ops::store(r.m_pVelY + i, Ops::mul(Ops::sub(y, y0), invDt));
+			Ops::store(r.m_pVelZ + i, Ops::mul(Ops::sub(z, z0), invDt));
+			Ops::store(r.m_pPosX + i, x);
+			Ops::store(r.m_pPosY + i, y);
+			Ops::store(r.m_pPosZ + i, z);
+			Ops::store(r.m_pAge + i, Ops::add(Ops::load(r.m_pAge + i), dt));
+		}
+
+		if (i < r.m_count)
+		{
+			attempts += step_dormand_prince<ScalarOps>(tail_range(r, i), params, kDeltaTime, kTolerance);
+		}
+		return attempts;
+	}
+
+	// Quantize positions and ages to CompactParticle, two 32-bit words per
+	// particle. Values are clamped in float before rounding, which also sends
+	// NaN to zero.
+	template<typename Ops>
+	void encode_compact(const ParticleStreamRange& r, const CompactParticleFormat& format, CompactParticle* pOut)
+	{
+		using Vec = typename Ops::Vec;
+		using IVec = typename Ops::IVec;
+
+		const Vec originX = Ops::set1(format.m_origin.x);
+		const Vec originY = Ops::set1(format.m_origin.y);
+		const Vec originZ = Ops::set1(format.m_origin.z);
+		const Vec invStepX = Ops::set1(1.0f / format.m_step.x);
+		const Vec invStepY = Ops::set1(1.0f / format.m_step.y);
+		const Vec invStepZ = Ops::set1(1.0f / format.m_step.z);
+		const Vec invAgeStep = Ops::set1(1.0f / format.m_ageStep);
+		const Vec zero = Ops::set1(0.0f);
+		const Vec positionMax = Ops::set1(static_cast<f32>(kCompactPositionMax));
+		const Vec ageMax = Ops::set1(static_cast<f32>(kCompactAgeMax));
+
+		// max() first: it returns its second operand when the first is NaN
+		auto quantize = [zero](const Vec kValue, const Vec kOrigin, const Vec kInvStep, const Vec kMax) {
+			return Ops::to_int(Ops::min(Ops::max(Ops::mul(Ops::sub(kValue, kOrigin), kInvStep), zero), kMax));
+		};
+
+		const u32 kVectorCount = r.m_count - (r.m_count % Ops::kWidth);
+
+		u32 i = 0;
+		for (; i < kVectorCount; i += Ops::kWidth)
+		{
+			const IVec qx = quantize(Ops::load(r.m_pPosX + i), originX, invStepX, positionMax);
+			const IVec qy = quantize(Ops::load(r.m_pPosY + i), originY, invStepY, positionMax);
+			const IVec qz = quantize(Ops::load(r.m_pPosZ + i), originZ, invStepZ, positionMax);
+			const IVec qAge = quantize(Ops::load(r.m_pAge + i), zero, invAgeStep, ageMax);
+			Ops::store_pairs(reinterpret_cast<u32*>(pOut + i), Ops::ior(qx, Ops::template shift_left<16>(qy)),
+				Ops::ior(qz, Ops::template shift_left<16>(qAge)));
+		}
+
+		if (i < r.m_count)
+		{
+			encode_compact<ScalarOps>(tail_range(r, i), format, pOut + i);
+		}
+	}
+
+	// Expand CompactParticles into the range; velocity is the Lorenz
+	// derivative at the decoded position.
+	template<typename Ops>
+	void decode_compact(const CompactParticle* pIn, const CompactParticleFormat& format, const LorenzParameters& params, const ParticleStreamRange& r)
+	{
+		using Vec = typename Ops::Vec;
+		using IVec = typename Ops::IVec;
+
+		const LorenzField<Ops> field(params);
+		const Vec originX = Ops::set1(format.m_origin.x);
+		const Vec originY = Ops::set1(format.m_origin.y);
+		const Vec originZ = Ops::set1(format.m_origin.z);
+		const Vec stepX = Ops::set1(format.m_step.x);
+		const Vec stepY = Ops::set1(format.m_step.y);
+		const Vec stepZ = Ops::set1(format.m_step.z);
+		const Vec ageStep = Ops::set1(format.m_ageStep);
+		const IVec lowHalf = Ops::iset1(0xFFFF);
+		const IVec lowByte = Ops::iset1(0xFF);
+
+		const u32 kVectorCount = r.m_count - (r.m_count % Ops::kWidth);
+
+		u32 i = 0;
+		for (; i < kVectorCount; i += Ops::kWidth)
+		{
+			IVec word0, word1;
+			Ops::load_pairs(reinterpret_cast<const u32*>(pIn + i), word0, word1);
+
+			const Vec x = Ops::fmadd(Ops::to_float(Ops::iand(word0, lowHalf)), stepX, originX);
+			const Vec y = Ops::fmadd(Ops::to_float(Ops::template shift_right<16>(word0)), stepY, originY);
+			const Vec z = Ops::fmadd(Ops::to_float(Ops::iand(word1, lowHalf)), stepZ, originZ);
+			const Vec age = Ops::mul(Ops::to_float(Ops::iand(Ops::template shift_right<16>(word1), lowByte)), ageStep);
+
+			Vec vx, vy, vz;
+			field.eval(x, y, z, vx, vy, vz);
+
+			Ops::store(r.m_pPosX + i, x);
+			Ops::store(r.m_pPosY + i, y);
+			Ops::store(r.m_pPosZ + i, z);
+			Ops::store(r.m_pAge + i, age);
+			Ops::store(r.m_pVelX + i, vx);
+			Ops::store(r.m_pVelY + i, vy);
+			Ops::store(r.m_pVelZ + i, vz);
+		}
+
+		if (i < r.m_count)
+		{
+			decode_compact<ScalarOps>(pIn + i, format, params, tail_range(r, i));
+		}
+	}
+
+	// Fill a dispatch table with the kernels instantiated for one instruction set.
+	template<typename Ops>
+	LorenzKernelTable make_kernel_table(const SimdLevel::SimdLevelEnum kLevel)
+	{
+		LorenzKernelTable table;
+		table.m_level = kLevel;
+		table.m_pName = simd_level_name(kLevel);
+		table.m_width = Ops::kWidth;
+		table.m_pStepEuler = &step_euler<Ops>;
+		table.m_pStepRK4 = &step_rk4<Ops>;
+		table.m_pStepDormandPrince = &step_dormand_prince<Ops>;
+		table.m_pEncodeCompact = &encode_compact<Ops>;
+		table.m_pDecodeCompact = &decode_compact<Ops>;
+		return table;
+	}
+}
+
+// Per instruction set tables, defined in LorenzKernels<ISA>.cpp. They return
+// nullptr when the compiler could not build that variant.
+const LorenzKernelTable* lorenz_kernels_scalar();
+const LorenzKernelTable* lorenz_kernels_sse4();
+const LorenzKernelTable* lorenz_kernels_avx2();
+const LorenzKernelTable* lorenz_kernels_avx512();
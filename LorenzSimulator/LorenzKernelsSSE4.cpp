@@ -0,0 +1,15 @@
+#include "LorenzKernelsImpl.h"
+
+// Compiled with -msse4.1 (SSE2 baseline on MSVC x64).
+#if defined(LORENZ_HAS_SSE)
+const LorenzKernelTable* lorenz_kernels_sse4()
+{
+	static const LorenzKernelTable s_table = make_kernel_table<SseOps>(SimdLevel::kSSE4);
+	return &s_table;
+}
+#else
+const LorenzKernelTable* lorenz_kernels_sse4()
+{
+	return nullptr;
+}
+#endif
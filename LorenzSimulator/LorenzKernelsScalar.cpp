@@ -0,0 +1,8 @@
+#include "LorenzKernelsImpl.h"
+
+// Baseline variant, always available.
+const LorenzKernelTable* lorenz_kernels_scalar()
+{
+	static const LorenzKernelTable s_table = make_kernel_table<ScalarOps>(SimdLevel::kScalar);
+	return &s_table;
+}
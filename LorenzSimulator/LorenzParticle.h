@@ -0,0 +1,72 @@
+#pragma once
+
+//================================================================================
+// Portable (Windows-free) particle data shared between the headless simulator
+// and the DirectX application. Layouts mirror the HLSL structures in
+// Assets/Shaders/ParticleSimulate.fx so that buffers can be uploaded as-is.
+//================================================================================
+
+#include "CoreTypes.h"
+
+// Tightly packed float3, matching HLSL structured buffer packing.
+struct Float3
+{
+	f32 x;
+	f32 y;
+	f32 z;
+};
+
+struct Float4
+{
+	f32 x;
+	f32 y;
+	f32 z;
+	f32 w;
+};
+
+// Matches ParticleSystemApp::Particle and the HLSL Particle struct.
+struct LorenzParticle
+{
+	Float3 m_position;
+	f32 m_age;
+	Float3 m_velocity;
+};
+
+static_assert(sizeof(LorenzParticle) == 28, "LorenzParticle must match the 28 byte HLSL Particle layout");
+
+// The (sigma, rho, beta) triple of the Lorenz system.
+struct LorenzParameters
+{
+	f32 m_sigma;
+	f32 m_rho;
+	f32 m_beta;
+};
+
+// Axis aligned bounding box of a set of particle positions.
+struct ParticleBounds
+{
+	Float3 m_min;
+	Float3 m_max;
+};
+
+// Bounds containing nothing, the identity for merge_bounds.
+constexpr ParticleBounds kEmptyParticleBounds = { { 3.0e38f, 3.0e38f, 3.0e38f }, { -3.0e38f, -3.0e38f, -3.0e38f } };
+
+inline ParticleBounds merge_bounds(const ParticleBounds& a, const ParticleBounds& b)
+{
+	return ParticleBounds{
+		{ a.m_min.x < b.m_min.x ? a.m_min.x : b.m_min.x, a.m_min.y < b.m_min.y ? a.m_min.y : b.m_min.y, a.m_min.z < b.m_min.z ? a.m_min.z : b.m_min.z },
+		{ a.m_max.x > b.m_max.x ? a.m_max.x : b.m_max.x, a.m_max.y > b.m_max.y ? a.m_max.y : b.m_max.y, a.m_max.z > b.m_max.z ? a.m_max.z : b.m_max.z } };
+}
+
+// Default parameters used by the application at startup.
+constexpr LorenzParameters kDefaultLorenzParameters = { 17.683f, 25.0f, 1.6666f };
+
+// Lorenz system derivative, as evaluated by CS_Main.
+inline Float3 lorenz_derivative(const Float3& p, const LorenzParameters& params)
+{
+	return Float3{
+		params.m_sigma * (p.y - p.x),
+		p.x * (params.m_rho - p.z) - p.y,
+		p.x * p.y - params.m_beta * p.z };
+}
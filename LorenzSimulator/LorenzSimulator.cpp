@@ -0,0 +1,586 @@
+#include "LorenzSimulator.h"
+#include "LorenzKernels.h"
+
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+void lorenz_step(const LorenzParticle* pOld, LorenzParticle* pUpdated, const u32 kCount,
+	const LorenzParameters& params, const f32 kDeltaTime)
+{
+	for (u32 i = 0; i < kCount; ++i)
+	{
+		LorenzParticle p = pOld[i];
+
+		// Update its data according to Lorenz dynamical system
+		p.m_velocity = lorenz_derivative(p.m_position, params);
+		p.m_position.x += kDeltaTime * p.m_velocity.x;
+		p.m_position.y += kDeltaTime * p.m_velocity.y;
+		p.m_position.z += kDeltaTime * p.m_velocity.z;
+		p.m_age += kDeltaTime;
+
+		pUpdated[i] = p;
+	}
+}
+
+void LorenzStepObserverList::remove(LorenzStepObserver* pObserver)
+{
+	m_observers.erase(std::remove(m_observers.begin(), m_observers.end(), pObserver), m_observers.end());
+}
+
+void LorenzStepObserverList::before_step(const u32 kFirst, const ParticleStreamRange& range)
+{
+	for (LorenzStepObserver* pObserver : m_observers)
+	{
+		pObserver->before_step(kFirst, range);
+	}
+}
+
+void LorenzStepObserverList::after_step(const u32 kFirst, const ParticleStreamRange& range, const LorenzParameters& params,
+	const f64 kTime, const f32 kDeltaTime)
+{
+	for (LorenzStepObserver* pObserver : m_observers)
+	{
+		pObserver->after_step(kFirst, range, params, kTime, kDeltaTime);
+	}
+}
+
+template <typename Fn>
+void LorenzSimulator::for_each_group_run(const u32 kFirst, const u32 kCount, Fn fn) const
+{
+	if (m_groups.empty())
+	{
+		fn(kFirst, kCount, m_parameters);
+		return;
+	}
+
+	// The last run also takes the padding that step() rounds up to, past the
+	// last particle
+	const u32 kLast = kFirst + kCount;
+	auto run = std::upper_bound(m_groupRuns.begin(), m_groupRuns.end(), kFirst,
+		[](u32 index, const GroupRun& r) { return index < r.m_first; }) - 1;
+	for (u32 first = kFirst; first < kLast; ++run)
+	{
+		const u32 kRunEnd = run + 1 != m_groupRuns.end() ? run[1].m_first : kLast;
+		const u32 kEnd = std::min(kRunEnd, kLast);
+		fn(first, kEnd - first, m_groupParameters[run->m_group]);
+		first = kEnd;
+	}
+}
+
+LorenzSimulator::LorenzSimulator(JobQueue* pJobQueue) :
+	m_jobQueue(pJobQueue ? *pJobQueue : sharedJobQueue()),
+	m_parameters(kDefaultLorenzParameters),
+	m_integrator(Integrator::kEuler),
+	m_tolerance(kDefaultIntegratorTolerance),
+	m_substepTile(kSimulatorSubstepTile),
+	m_time(0.0),
+	m_pStepObserver(nullptr),
+	m_spawnCursor(0),
+	m_respawnedCount(0),
+	m_activeCount(0)
+{}
+
+bool LorenzSimulator::init(const u32 kNumParticles, const u32 kSeed)
+{
+	if (!reset_pool(kNumParticles))
+	{
+		return false;
+	}
+	fit_groups(kNumParticles);
+
+	m_activeCount = kNumParticles;
+	m_time = 0.0;
+	m_spawnCursor = 0;
+	m_respawnedCount = 0;
+	m_spawnRng.seed(kSeed, 0);
+	fill_initial(0, kNumParticles, kSeed);
+
+	if (m_lifecycle.m_maxAge > 0.0f)
+	{
+		stagger_ages();
+	}
+	return true;
+}
+
+bool LorenzSimulator::grow(const u32 kNumParticles, const u32 kSeed)
+{
+	const u32 kOldCount = particle_count();
+	if (kNumParticles <= kOldCount)
+	{
+		return true;
+	}
+	if (!m_pool.resize(kNumParticles))
+	{
+		return false;
+	}
+	fill_initial(kOldCount, kNumParticles, kSeed);
+	if (!m_groupParameters.empty())
+	{
+		m_groups.resize(kNumParticles, m_groups.empty() ? static_cast<u16>(0) : m_groups.back());
+		find_group_runs();
+	}
+	return true;
+}
+
+bool LorenzSimulator::set_particles(const LorenzParticle* pParticles, const u32 kNumParticles)
+{
+	if (!reset_pool(kNumParticles))
+	{
+		return false;
+	}
+	fit_groups(kNumParticles);
+
+	m_activeCount = kNumParticles;
+	parallel_for(m_jobQueue, 0, kNumParticles, kSimulatorGrain, [&](u32 first, u32 last) {
+		m_pool.load_aos(pParticles + first, first, last - first);
+	});
+
+	// The copied ages are in no particular order along the ring
+	if (m_lifecycle.m_maxAge > 0.0f)
+	{
+		stagger_ages();
+	}
+	return true;
+}
+
+void LorenzSimulator::read_particles(LorenzParticle* pParticles) const
+{
+	parallel_for(m_jobQueue, 0, m_activeCount, kSimulatorGrain, [&](u32 first, u32 last) {
+		m_pool.store_aos(pParticles + first, first, last - first);
+	});
+}
+
+void LorenzSimulator::read_compact_particles(CompactParticle* pParticles, const CompactParticleFormat& format) const
+{
+	const LorenzKernelTable& kernels = lorenz_kernels();
+	parallel_for(m_jobQueue, 0, m_activeCount, kSimulatorGrain, [&](u32 first, u32 last) {
+		// The encoder only reads the range
+		kernels.m_pEncodeCompact(const_cast<ParticlePool&>(m_pool).range(first, last - first), format, pParticles + first);
+	});
+}
+
+bool LorenzSimulator::set_compact_particles(const CompactParticle* pParticles, const u32 kNumParticles, const CompactParticleFormat& format)
+{
+	if (!reset_pool(kNumParticles))
+	{
+		return false;
+	}
+	fit_groups(kNumParticles);
+
+	m_activeCount = kNumParticles;
+	const LorenzKernelTable& kernels = lorenz_kernels();
+	parallel_for(m_jobQueue, 0, kNumParticles, kSimulatorGrain, [&](u32 first, u32 last) {
+		for_each_group_run(first, last - first, [&](u32 run, u32 count, const LorenzParameters& params) {
+			kernels.m_pDecodeCompact(pParticles + run, format, params, m_pool.range(run, count));
+		});
+	});
+
+	if (m_lifecycle.m_maxAge > 0.0f)
+	{
+		stagger_ages();
+	}
+	return true;
+}
+
+void LorenzSimulator::step(const f32 kDeltaTime)
+{
+	// Pages hold whole SIMD batches, so step up to the next batch boundary
+	// rather than falling back to a scalar tail. The extra lanes are padding
+	// or dead particles. Chunks are grain aligned and never cross a page.
+	const u32 kEnd = (m_activeCount + kParticleLaneWidth - 1) & ~(kParticleLaneWidth - 1);
+	parallel_for(m_jobQueue, 0, kEnd, kSimulatorGrain, [&](u32 first, u32 last) {
+		step_streams(first, last - first, kDeltaTime, m_time);
+	});
+	m_time += kDeltaTime;
+	recycle();
+}
+
+void LorenzSimulator::step(const f32 kDeltaTime, const u32 kSubsteps)
+{
+	const u32 kEnd = (m_activeCount + kParticleLaneWidth - 1) & ~(kParticleLaneWidth - 1);
+	parallel_for(m_jobQueue, 0, kEnd, kSimulatorGrain, [&](u32 first, u32 last) {
+		step_tiles(kDeltaTime, first, last - first, kSubsteps);
+	});
+	m_time += static_cast<f64>(kDeltaTime) * kSubsteps;
+	recycle();
+}
+
+void LorenzSimulator::step_range(const f32 kDeltaTime, const u32 kFirst, const u32 kCount)
+{
+	step_streams(kFirst, kCount, kDeltaTime, m_time);
+}
+
+void LorenzSimulator::step_range(const f32 kDeltaTime, const u32 kFirst, const u32 kCount, const u32 kSubsteps)
+{
+	step_tiles(kDeltaTime, kFirst, kCount, kSubsteps);
+}
+
+void LorenzSimulator::step_tiles(const f32 kDeltaTime, const u32 kFirst, const u32 kCount, const u32 kSubsteps)
+{
+	// Tiles stop at page ends, since a range cannot cross pages
+	const u32 kLast = kFirst + kCount;
+	for (u32 first = kFirst; first < kLast;)
+	{
+		const u32 kTile = std::min(std::min(m_substepTile, kLast - first), ParticlePool::page_remaining(first));
+		for (u32 i = 0; i < kSubsteps; ++i)
+		{
+			step_streams(first, kTile, kDeltaTime, m_time + static_cast<f64>(kDeltaTime) * i);
+		}
+		first += kTile;
+	}
+}
+
+u32 LorenzSimulator::recycle(const u32 kCount)
+{
+	const f32 kMaxAge = m_lifecycle.m_maxAge;
+	if (kMaxAge <= 0.0f || !m_lifecycle.m_respawn || kCount == 0)
+	{
+		return 0;
+	}
+	assert(kCount <= particle_count());
+
+	const Float3& emitter = m_lifecycle.m_emitterLocation;
+	const f32 kJitter = m_lifecycle.m_emitterJitter;
+
+	// The active count may have shrunk under the cursor
+	u32 cursor = m_spawnCursor < kCount ? m_spawnCursor : 0;
+	u32 respawned = 0;
+	while (respawned < kCount && m_pool.at(ParticleStreams::kAge, cursor) >= kMaxAge)
+	{
+		m_pool.at(ParticleStreams::kPosX, cursor) = emitter.x + m_spawnRng.uniform(-kJitter, kJitter);
+		m_pool.at(ParticleStreams::kPosY, cursor) = emitter.y + m_spawnRng.uniform(-kJitter, kJitter);
+		m_pool.at(ParticleStreams::kPosZ, cursor) = emitter.z + m_spawnRng.uniform(-kJitter, kJitter);
+		m_pool.at(ParticleStreams::kVelX, cursor) = 0.0f;
+		m_pool.at(ParticleStreams::kVelY, cursor) = 0.0f;
+		m_pool.at(ParticleStreams::kVelZ, cursor) = 0.0f;
+
+		// Keep the overshoot so the ring stays in age order
+		f32& rAge = m_pool.at(ParticleStreams::kAge, cursor);
+		rAge = std::fmod(rAge - kMaxAge, kMaxAge);
+
+		cursor = cursor + 1 < kCount ? cursor + 1 : 0;
+		++respawned;
+	}
+
+	m_spawnCursor = cursor;
+	m_respawnedCount += respawned;
+	return respawned;
+}
+
+u32 LorenzSimulator::count_dead(const u32 kFirst, const u32 kCount) const
+{
+	assert(kFirst + kCount <= particle_count());
+	const f32 kMaxAge = m_lifecycle.m_maxAge > 0.0f && !m_lifecycle.m_respawn ? m_lifecycle.m_maxAge : INFINITY;
+
+	u32 dead = 0;
+	u32 done = 0;
+	while (done < kCount)
+	{
+		const u32 kIndex = kFirst + done;
+		const u32 kRun = std::min(kCount - done, ParticlePool::page_remaining(kIndex));
+		const f32* pPosX = m_pool.stream(ParticleStreams::kPosX, kIndex);
+		const f32* pPosY = m_pool.stream(ParticleStreams::kPosY, kIndex);
+		const f32* pPosZ = m_pool.stream(ParticleStreams::kPosZ, kIndex);
+		const f32* pAge = m_pool.stream(ParticleStreams::kAge, kIndex);
+		for (u32 i = 0; i < kRun; ++i)
+		{
+			const bool kFinite = std::isfinite(pPosX[i]) && std::isfinite(pPosY[i]) && std::isfinite(pPosZ[i]);
+			dead += !kFinite || pAge[i] >= kMaxAge ? 1 : 0;
+		}
+		done += kRun;
+	}
+	return dead;
+}
+
+u32 LorenzSimulator::compact()
+{
+	const u32 kActive = m_activeCount;
+	const u32 kNumChunks = (kActive + kSimulatorGrain - 1) / kSimulatorGrain;
+	m_compactChunks.resize(kNumChunks);
+
+	CompactChunk* pChunks = m_compactChunks.data();
+	parallel_for(m_jobQueue, 0, kActive, kSimulatorGrain, [&](u32 first, u32 last) {
+		pChunks[first / kSimulatorGrain].m_alive = (last - first) - count_dead(first, last - first);
+	});
+
+	u32 kept = 0;
+	for (const CompactChunk& chunk : m_compactChunks)
+	{
+		kept += chunk.m_alive;
+	}
+	if (kept == kActive)
+	{
+		return 0;
+	}
+
+	// Dead particles before the new end pair up, in order, with live particles
+	// after it; there are exactly as many of each. Only the chunk straddling
+	// the new end needs counting again.
+	u32 deadOffset = 0;
+	u32 liveOffset = 0;
+	for (u32 c = 0; c < kNumChunks; ++c)
+	{
+		const u32 kFirst = c * kSimulatorGrain;
+		const u32 kLast = std::min(kFirst + kSimulatorGrain, kActive);
+		u32 aliveBefore = 0;
+		if (kLast <= kept)
+		{
+			aliveBefore = pChunks[c].m_alive;
+		}
+		else if (kFirst < kept)
+		{
+			aliveBefore = (kept - kFirst) - count_dead(kFirst, kept - kFirst);
+		}
+
+		pChunks[c].m_deadOffset = deadOffset;
+		pChunks[c].m_liveOffset = liveOffset;
+		deadOffset += (std::min(kLast, kept) - std::min(kFirst, kept)) - aliveBefore;
+		liveOffset += pChunks[c].m_alive - aliveBefore;
+	}
+	assert(deadOffset == liveOffset);
+
+	// Gather the live particles past the new end, then let each chunk before
+	// it swap its holes with them
+	m_compactSources.resize(liveOffset);
+	u32* pSources = m_compactSources.data();
+	parallel_for(m_jobQueue, 0, kActive, kSimulatorGrain, [&](u32 first, u32 last) {
+		u32 rank = pChunks[first / kSimulatorGrain].m_liveOffset;
+		for (u32 i = std::max(first, kept); i < last; ++i)
+		{
+			if (!is_dead(i))
+			{
+				pSources[rank++] = i;
+			}
+		}
+	});
+
+	parallel_for(m_jobQueue, 0, kept, kSimulatorGrain, [&](u32 first, u32 last) {
+		u32 rank = pChunks[first / kSimulatorGrain].m_deadOffset;
+		for (u32 i = first; i < last; ++i)
+		{
+			if (!is_dead(i))
+			{
+				continue;
+			}
+
+			const u32 kSource = pSources[rank++];
+			for (u32 k = 0; k < ParticleStreams::kNumStreams; ++k)
+			{
+				const ParticleStreams::Stream kStream = static_cast<ParticleStreams::Stream>(k);
+				std::swap(m_pool.at(kStream, i), m_pool.at(kStream, kSource));
+			}
+			if (!m_groups.empty())
+			{
+				std::swap(m_groups[i], m_groups[kSource]);
+			}
+		}
+	});
+	if (!m_groups.empty())
+	{
+		find_group_runs();
+	}
+
+	m_activeCount = kept;
+	if (m_spawnCursor >= kept)
+	{
+		m_spawnCursor = 0;
+	}
+
+	// Survivors swapped in from the tail broke the age order of the ring
+	if (m_lifecycle.m_maxAge > 0.0f && m_lifecycle.m_respawn)
+	{
+		stagger_ages();
+	}
+	return kActive - kept;
+}
+
+void LorenzSimulator::set_parameter_groups(const LorenzParameters* pParameters, const u32 kNumGroups)
+{
+	assert(kNumGroups > 0 && kNumGroups <= kMaxParameterGroups);
+	m_groupParameters.assign(pParameters, pParameters + kNumGroups);
+	m_groups.clear();
+	fit_groups(particle_count());
+}
+
+void LorenzSimulator::clear_parameter_groups()
+{
+	m_groupParameters.clear();
+	m_groups.clear();
+	m_groupRuns.clear();
+}
+
+void LorenzSimulator::set_particle_groups(const u16* pGroups)
+{
+	assert(!m_groupParameters.empty());
+	m_groups.assign(pGroups, pGroups + particle_count());
+	assert(std::all_of(m_groups.begin(), m_groups.end(), [this](u16 g) { return g < m_groupParameters.size(); }));
+	find_group_runs();
+}
+
+void LorenzSimulator::read_particle_groups(u16* pGroups) const
+{
+	if (m_groups.empty())
+	{
+		std::fill(pGroups, pGroups + m_activeCount, static_cast<u16>(0));
+		return;
+	}
+	std::copy(m_groups.begin(), m_groups.begin() + m_activeCount, pGroups);
+}
+
+void LorenzSimulator::set_active_count(const u32 kCount)
+{
+	// Shrinking keeps the ring in age order, but the particles that come back
+	// to life, or are live for the first time, kept whatever age they had
+	const u32 kOldCount = m_activeCount;
+	m_activeCount = std::min(kCount, particle_count());
+	if (m_activeCount > kOldCount && m_lifecycle.m_maxAge > 0.0f)
+	{
+		stagger_ages();
+	}
+}
+
+void LorenzSimulator::set_lifecycle(const LorenzLifecycle& lifecycle)
+{
+	// Without respawn the ring order is not kept up (see compact())
+	const bool kRestagger = lifecycle.m_maxAge > 0.0f
+		&& (lifecycle.m_maxAge != m_lifecycle.m_maxAge || (lifecycle.m_respawn && !m_lifecycle.m_respawn));
+	m_lifecycle = lifecycle;
+	if (kRestagger)
+	{
+		stagger_ages();
+	}
+}
+
+void LorenzSimulator::stagger_ages()
+{
+	// Oldest at the cursor, youngest just behind it, evenly spaced so that
+	// particles expire at a steady rate
+	const u32 kCount = m_activeCount;
+	const f32 kMaxAge = m_lifecycle.m_maxAge;
+	const u32 kCursor = m_spawnCursor < kCount ? m_spawnCursor : 0;
+	parallel_for(m_jobQueue, 0, kCount, kSimulatorGrain, [this, kCount, kMaxAge, kCursor](u32 first, u32 last) {
+		f32* pAge = m_pool.stream(ParticleStreams::kAge, first);
+		for (u32 i = first; i < last; ++i)
+		{
+			const u32 kRingIndex = i >= kCursor ? i - kCursor : i + kCount - kCursor;
+			pAge[i - first] = kMaxAge * static_cast<f32>(kCount - 1 - kRingIndex) / static_cast<f32>(kCount);
+		}
+	});
+	m_spawnCursor = kCursor;
+}
+
+bool LorenzSimulator::reset_pool(const u32 kNumParticles)
+{
+	// Every particle is overwritten, so the existing pages are reused rather
+	// than freed first; a failed resize leaves the pool as it was
+	if (!m_pool.resize(kNumParticles))
+	{
+		return false;
+	}
+	m_pool.shrink_to_fit();
+	return true;
+}
+
+void LorenzSimulator::fill_initial(const u32 kFirst, const u32 kLast, const u32 kSeed)
+{
+	const CounterRng rng(kSeed);
+	parallel_for(m_jobQueue, kFirst, kLast, kSimulatorGrain, [this, &rng](u32 first, u32 last) {
+		// A chunk that does not start on a grain boundary can span two pages
+		for (u32 run = first; run < last; run += ParticlePool::page_remaining(run))
+		{
+			const u32 kRun = std::min(last - run, ParticlePool::page_remaining(run));
+			const ParticleStreamRange r = m_pool.range(run, kRun);
+			for (u32 i = 0; i < kRun; ++i)
+			{
+				const LorenzParticle kParticle = initial_lorenz_particle(rng, run + i);
+				r.m_pPosX[i] = kParticle.m_position.x;
+				r.m_pPosY[i] = kParticle.m_position.y;
+				r.m_pPosZ[i] = kParticle.m_position.z;
+				r.m_pVelX[i] = kParticle.m_velocity.x;
+				r.m_pVelY[i] = kParticle.m_velocity.y;
+				r.m_pVelZ[i] = kParticle.m_velocity.z;
+				r.m_pAge[i] = kParticle.m_age;
+			}
+		}
+	});
+}
+
+bool LorenzSimulator::is_dead(const u32 kIndex) const
+{
+	const f32 kX = m_pool.at(ParticleStreams::kPosX, kIndex);
+	const f32 kY = m_pool.at(ParticleStreams::kPosY, kIndex);
+	const f32 kZ = m_pool.at(ParticleStreams::kPosZ, kIndex);
+	if (!std::isfinite(kX) || !std::isfinite(kY) || !std::isfinite(kZ))
+	{
+		return true;
+	}
+
+	const f32 kMaxAge = m_lifecycle.m_maxAge;
+	return kMaxAge > 0.0f && !m_lifecycle.m_respawn && m_pool.at(ParticleStreams::kAge, kIndex) >= kMaxAge;
+}
+
+void LorenzSimulator::fit_groups(const u32 kNumParticles)
+{
+	if (m_groupParameters.empty())
+	{
+		m_groups.clear();
+		m_groupRuns.clear();
+		return;
+	}
+	if (m_groups.size() == kNumParticles)
+	{
+		return;
+	}
+
+	m_groups.resize(kNumParticles);
+	const u64 kNumGroups = m_groupParameters.size();
+	u16* pGroups = m_groups.data();
+	parallel_for(m_jobQueue, 0, kNumParticles, kSimulatorGrain, [pGroups, kNumGroups, kNumParticles](u32 first, u32 last) {
+		for (u32 i = first; i < last; ++i)
+		{
+			pGroups[i] = static_cast<u16>(i * kNumGroups / kNumParticles);
+		}
+	});
+	find_group_runs();
+}
+
+void LorenzSimulator::find_group_runs()
+{
+	m_groupRuns.clear();
+	for (u32 i = 0; i < m_groups.size(); ++i)
+	{
+		if (i == 0 || m_groups[i] != m_groups[i - 1])
+		{
+			m_groupRuns.push_back(GroupRun{ i, m_groups[i] });
+		}
+	}
+}
+
+void LorenzSimulator::step_streams(const u32 kFirst, const u32 kCount, const f32 kDeltaTime, const f64 kTime)
+{
+	LorenzStepObserver* pObserver = m_pStepObserver;
+	for_each_group_run(kFirst, kCount, [this, pObserver, kDeltaTime, kTime](u32 first, u32 count, const LorenzParameters& params) {
+		const ParticleStreamRange kRange = m_pool.range(first, count);
+		if (!pObserver || first >= m_activeCount)
+		{
+			step_kernel(kRange, params, kDeltaTime);
+			return;
+		}
+
+		// The observer does not see the padding up to the next SIMD batch
+		ParticleStreamRange observed = kRange;
+		observed.m_count = std::min(count, m_activeCount - first);
+		pObserver->before_step(first, observed);
+		step_kernel(kRange, params, kDeltaTime);
+		pObserver->after_step(first, observed, params, kTime, kDeltaTime);
+	});
+}
+
+void LorenzSimulator::step_kernel(const ParticleStreamRange& range, const LorenzParameters& params, const f32 kDeltaTime) const
+{
+	lorenz_integrate_streams(range, params, kDeltaTime, m_integrator, m_tolerance);
+}
@@ -0,0 +1,369 @@
+#pragma once
+
+//================================================================================
+// LorenzSimulator
+// Headless CPU reproduction of CS_Main (Assets/Shaders/ParticleSimulate.fx).
+// Particles are stored as SIMD friendly streams in a paged ParticlePool and
+// stepped in place with forward Euler through the Lorenz equations; AoS
+// copies are produced on demand for GPU upload. Every pass over the particles is split into
+// kSimulatorGrain chunks and run on a JobQueue.
+//
+// The integrator defaults to Euler to match the GPU, and can be switched to
+// RK4 or adaptive Dormand-Prince 5(4), which stay on the attractor with far
+// larger steps (see the IntegratorAccuracy benchmark).
+//
+// With a lifecycle set, particles expire at a max age and respawn at the
+// emitter. Slots are recycled through a ring: ages are staggered along it, so
+// the expired particles are always the run starting at the ring cursor and
+// respawning costs O(expired) with no scan and no holes in the streams.
+// Anything that brings particles into the live range with ages of their own
+// (init(), set_particles(), set_compact_particles(), growing
+// set_active_count()) or reorders them (compact()) restaggers the live ages
+// to restore that order.
+//
+// Many independently parameterized systems can share one simulator. Each
+// particle then carries a u16 index into a table of parameter groups. The
+// runs of equal index are found once, whenever the indices change, and
+// stepping calls the kernels once per run with its group's parameters. The
+// kernels are unchanged, and particles laid out in group order (as
+// set_parameter_groups() leaves them) step as fast as without a table.
+// Without a table every particle uses parameters().
+//
+// A LorenzStepObserver sees every range of particles just before and after
+// each step, on the thread stepping it, for analyses that need every step
+// (PoincareSection, DensityHistogram) without storing trajectories.
+//
+// Only the first active_count() particles are live. step(), recycle() and
+// read_particles() touch that range alone, and compact() moves particles that
+// have died (non-finite, or expired without respawn) past its end.
+//================================================================================
+
+#include "LorenzKernels.h"
+#include "ParticlePool.h"
+
+#include "Random.h"
+
+#include <cassert>
+#include <vector>
+
+class JobQueue;
+
+// Particles per job for the parallel loops. A multiple of kParticleLaneWidth
+// so that only the final chunk can end in a partial SIMD batch.
+constexpr u32 kSimulatorGrain = 16384;
+static_assert(kParticlePageSize % kSimulatorGrain == 0, "Simulator chunks must not cross pool pages");
+
+// Default particles per tile for multi-substep steps: a tile takes every
+// substep before the next one starts. 1024 particles are 28 KB of streams,
+// which stays in a 32 KB L1 between substeps; L2-sized tiles measured about
+// a third as fast in TemporalBlocking. A multiple of kParticleLaneWidth.
+constexpr u32 kSimulatorSubstepTile = 1024;
+static_assert(kSimulatorGrain % kSimulatorSubstepTile == 0, "Substep tiles must not cross simulator chunks");
+
+// Group indices are u16.
+constexpr u32 kMaxParameterGroups = 65536;
+
+// Default Dormand-Prince tolerance, relative to 1 + |position|.
+constexpr f32 kDefaultIntegratorTolerance = 1e-4f;
+
+// ========================================================
+// class LorenzStepObserver
+// Called around every step of every range of particles, on the stepping
+// thread. before_step() and after_step() for one range always run in a row
+// on the same thread, but different ranges are stepped concurrently, so
+// implementations keep any scratch per thread (see PerThread). Ranges never
+// cross pool pages, stop at active_count() and take one set of parameters;
+// with substeps a range takes all of them before the next range starts (see
+// step(dt, kSubsteps)).
+// ========================================================
+
+class LorenzStepObserver
+{
+public:
+	virtual ~LorenzStepObserver() = default;
+
+	// Particles [kFirst, kFirst + range.m_count) are about to step.
+	virtual void before_step(const u32 kFirst, const ParticleStreamRange& range) = 0;
+
+	// The same particles have taken one step of kDeltaTime with params,
+	// starting at simulated time kTime.
+	virtual void after_step(const u32 kFirst, const ParticleStreamRange& range, const LorenzParameters& params,
+		const f64 kTime, const f32 kDeltaTime) = 0;
+};
+
+// ========================================================
+// class LorenzStepObserverList
+// Forwards every call to a list of observers, in the order they were added,
+// so several analyses can share a simulator's single observer slot.
+// ========================================================
+
+class LorenzStepObserverList final : public LorenzStepObserver
+{
+public:
+	// Only between steps. Observers are not owned.
+	void add(LorenzStepObserver* pObserver) { m_observers.push_back(pObserver); }
+	void remove(LorenzStepObserver* pObserver);
+
+	bool empty() const { return m_observers.empty(); }
+
+	void before_step(const u32 kFirst, const ParticleStreamRange& range) override;
+	void after_step(const u32 kFirst, const ParticleStreamRange& range, const LorenzParameters& params,
+		const f64 kTime, const f32 kDeltaTime) override;
+
+private:
+	std::vector<LorenzStepObserver*> m_observers;
+};
+
+// Particle expiry and respawn.
+struct LorenzLifecycle
+{
+	// Particles older than this respawn at the emitter. Zero means they live forever.
+	f32 m_maxAge = 0.0f;
+
+	// Respawned particles are placed uniformly in a cube of half size
+	// m_emitterJitter around m_emitterLocation; identical particles would
+	// otherwise follow identical paths forever.
+	Float3 m_emitterLocation = Float3{ 0.0f, 0.0f, 0.0f };
+	f32 m_emitterJitter = 0.1f;
+
+	// Without respawn, expired particles are dead and left for compact().
+	bool m_respawn = true;
+};
+
+// Initial state of particle kIndex: position uniform in a cube of half size
+// kPositionScale, velocity uniform in [-1, 1) per axis (or zero), and age
+// uniform in [0, 20). A pure function of the generator's seed and kIndex,
+// so particles can be initialized in any order on any thread.
+inline LorenzParticle initial_lorenz_particle(const CounterRng& rng, const u64 kIndex,
+	const f32 kPositionScale = 10.0f, const bool kRandomVelocity = true)
+{
+	u32 bits[4];
+	LorenzParticle p;
+	rng.block(kIndex, 0, bits);
+	p.m_position = Float3{ random_range(bits[0], -kPositionScale, kPositionScale),
+		random_range(bits[1], -kPositionScale, kPositionScale), random_range(bits[2], -kPositionScale, kPositionScale) };
+	p.m_age = random_range(bits[3], 0.0f, 20.0f);
+
+	p.m_velocity = Float3{ 0.0f, 0.0f, 0.0f };
+	if (kRandomVelocity)
+	{
+		rng.block(kIndex, 1, bits);
+		p.m_velocity = Float3{ random_range(bits[0], -1.0f, 1.0f), random_range(bits[1], -1.0f, 1.0f), random_range(bits[2], -1.0f, 1.0f) };
+	}
+	return p;
+}
+
+// Advance kCount AoS particles one step from pOld into pUpdated (may alias).
+// Scalar reference equivalent to one CS_Main dispatch over kCount particles.
+void lorenz_step(const LorenzParticle* pOld, LorenzParticle* pUpdated, const u32 kCount,
+	const LorenzParameters& params, const f32 kDeltaTime);
+
+class LorenzSimulator
+{
+public:
+	// Runs its parallel loops on pJobQueue, or on sharedJobQueue() if null.
+	explicit LorenzSimulator(JobQueue* pJobQueue = nullptr);
+
+	// Allocate kNumParticles and fill them with initial_lorenz_particle(), as
+	// ParticleSystemApp::init_particle_buffers does for the GPU, so the same
+	// seed gives the same particles on both and on any number of threads.
+	// Returns false, leaving the simulator unchanged, if the particles cannot
+	// be allocated.
+	bool init(const u32 kNumParticles, const u32 kSeed);
+
+	// Add particles up to kNumParticles, initialized exactly as init() would
+	// have. Existing particles stay where they are, and the active range is
+	// unchanged; set_active_count() brings the new ones to life.
+	// Returns false if the pool cannot grow that far.
+	bool grow(const u32 kNumParticles, const u32 kSeed);
+
+	// Replace the particle state with a copy of an existing AoS array. With
+	// a max age set, the ages are then restaggered as init() does. Returns
+	// false, leaving the simulator unchanged, if they cannot be allocated.
+	bool set_particles(const LorenzParticle* pParticles, const u32 kNumParticles);
+
+	// Write the live particles to an AoS array of active_count() entries.
+	void read_particles(LorenzParticle* pParticles) const;
+
+	// Write the live particles to active_count() CompactParticles, for
+	// snapshots and streaming at 8 bytes a particle (see CompactParticle.h).
+	void read_compact_particles(CompactParticle* pParticles, const CompactParticleFormat& format) const;
+
+	// Replace the particle state with decoded compact particles. Velocities
+	// are recomputed from position with the current parameters(), and ages
+	// restaggered and allocation failure reported as in set_particles().
+	bool set_compact_particles(const CompactParticle* pParticles, const u32 kNumParticles, const CompactParticleFormat& format);
+
+	// Advance the live particles by kDeltaTime seconds, then recycle().
+	void step(const f32 kDeltaTime);
+
+	// Advance the live particles by kSubsteps steps of kDeltaTime, then
+	// recycle() once. Each tile of substep_tile() particles takes all its
+	// substeps while it is in cache, so the streams cross memory once rather
+	// than kSubsteps times. With no max age set, matches kSubsteps calls to
+	// step(dt) bit for bit. With one, a particle that expires between
+	// substeps keeps integrating, up to kSubsteps - 1 substeps past its max
+	// age, and respawns at the end of the call, so results differ from
+	// stepping one substep at a time.
+	void step(const f32 kDeltaTime, const u32 kSubsteps);
+
+	// Advance particles [kFirst, kFirst + kCount) on the calling thread. Used
+	// by callers that schedule their own jobs, e.g. ParticleFramePipeline,
+	// which must also call recycle() and advance_time() themselves.
+	void step_range(const f32 kDeltaTime, const u32 kFirst, const u32 kCount);
+
+	// kSubsteps steps of [kFirst, kFirst + kCount), tiled as in step(dt, kSubsteps).
+	void step_range(const f32 kDeltaTime, const u32 kFirst, const u32 kCount, const u32 kSubsteps);
+
+	// Respawn expired particles among the first kCount, walking the ring
+	// from the cursor until it meets a live particle. Returns the number
+	// respawned. Does nothing without a max age or with respawn disabled.
+	u32 recycle(const u32 kCount);
+	u32 recycle() { return recycle(m_activeCount); }
+
+	// Number of dead particles in [kFirst, kFirst + kCount).
+	u32 count_dead(const u32 kFirst, const u32 kCount) const;
+
+	// Swap dead particles out of the live range to its tail and shrink
+	// active_count() to the survivors. Chunks are counted and the swaps made
+	// in parallel; only dead slots in the surviving range and live slots past
+	// it are written, so this is cheap when few particles die. Survivor order
+	// is not preserved, so with respawn enabled the live ages are restaggered
+	// along the ring afterwards. Returns the number removed.
+	u32 compact();
+
+	// Changing the max age, or enabling respawn, restaggers the ages along
+	// the ring (see above).
+	void set_lifecycle(const LorenzLifecycle& lifecycle);
+	const LorenzLifecycle& lifecycle() const { return m_lifecycle; }
+
+	// Simulated seconds since init(). step() advances it; callers of
+	// step_range() advance it once every range has taken its steps.
+	f64 time() const { return m_time; }
+	void advance_time(const f64 kSeconds) { m_time += kSeconds; }
+
+	// Observer called around every step, or null for none. Not owned; set
+	// only between steps.
+	void set_step_observer(LorenzStepObserver* pObserver) { m_pStepObserver = pObserver; }
+	LorenzStepObserver* step_observer() const { return m_pStepObserver; }
+
+	// Particles respawned since init().
+	u64 respawned_count() const { return m_respawnedCount; }
+
+	// Live range [0, active_count()). Clamped to particle_count(); reset to
+	// all particles by init() and set_particles(). Growing it with a max age
+	// set restaggers the live ages along the ring, since the particles
+	// joining it were not stepped or recycled while outside.
+	void set_active_count(const u32 kCount);
+	u32 active_count() const { return m_activeCount; }
+
+	// Accessors.
+	u32 particle_count() const { return m_pool.size(); }
+
+	JobQueue& job_queue() const { return m_jobQueue; }
+
+	ParticlePool& pool() { return m_pool; }
+	const ParticlePool& pool() const { return m_pool; }
+
+	// Parameters of every particle when no group table is set. Also used to
+	// recompute velocities in set_compact_particles() without one.
+	LorenzParameters& parameters() { return m_parameters; }
+	const LorenzParameters& parameters() const { return m_parameters; }
+
+	// Set a table of kNumGroups parameter sets and spread all particles over
+	// it in even contiguous runs: particle i joins group
+	// i * kNumGroups / particle_count(). Group assignments then survive any
+	// call that keeps particle_count(); otherwise they are spread in even runs
+	// again, except that particles added by grow() join the last group.
+	// compact() moves each particle's group with it.
+	void set_parameter_groups(const LorenzParameters* pParameters, const u32 kNumGroups);
+
+	// Back to parameters() for every particle.
+	void clear_parameter_groups();
+
+	// Assign all particle_count() particles from an array of group indices,
+	// each below group_count(). Runs of equal index step fastest.
+	void set_particle_groups(const u16* pGroups);
+
+	// Write the groups of the live particles to active_count() entries, in
+	// the order read_particles() uses.
+	void read_particle_groups(u16* pGroups) const;
+
+	// Table size; zero without a table.
+	u32 group_count() const { return static_cast<u32>(m_groupParameters.size()); }
+
+	LorenzParameters& group_parameters(const u32 kGroup) { return m_groupParameters[kGroup]; }
+	const LorenzParameters& group_parameters(const u32 kGroup) const { return m_groupParameters[kGroup]; }
+
+	// Group of particle kIndex; zero without a table.
+	u16 particle_group(const u32 kIndex) const { return m_groups.empty() ? 0 : m_groups[kIndex]; }
+
+	// Integrator used by step() and step_range(). The tolerance only applies
+	// to Integrator::kDormandPrince.
+	void set_integrator(const Integrator::IntegratorEnum kIntegrator) { m_integrator = kIntegrator; }
+	Integrator::IntegratorEnum integrator() const { return m_integrator; }
+
+	void set_tolerance(const f32 kTolerance) { m_tolerance = kTolerance; }
+	f32 tolerance() const { return m_tolerance; }
+
+	// Tile size for multi-substep steps; a nonzero multiple of
+	// kParticleLaneWidth. Tiles larger than kSimulatorGrain are cut at chunks.
+	void set_substep_tile(const u32 kTile)
+	{
+		assert(kTile > 0 && kTile % kParticleLaneWidth == 0);
+		m_substepTile = kTile;
+	}
+	u32 substep_tile() const { return m_substepTile; }
+
+private:
+	void step_streams(const u32 kFirst, const u32 kCount, const f32 kDeltaTime, const f64 kTime);
+	void step_kernel(const ParticleStreamRange& range, const LorenzParameters& params, const f32 kDeltaTime) const;
+	template <typename Fn> void for_each_group_run(const u32 kFirst, const u32 kCount, Fn fn) const;
+	void fit_groups(const u32 kNumParticles);
+	void find_group_runs();
+	void step_tiles(const f32 kDeltaTime, const u32 kFirst, const u32 kCount, const u32 kSubsteps);
+	void stagger_ages();
+	bool reset_pool(const u32 kNumParticles);
+	void fill_initial(const u32 kFirst, const u32 kLast, const u32 kSeed);
+	bool is_dead(const u32 kIndex) const;
+
+	JobQueue& m_jobQueue;
+	LorenzParameters m_parameters;
+	Integrator::IntegratorEnum m_integrator;
+	f32 m_tolerance;
+	u32 m_substepTile;
+	f64 m_time;
+	LorenzStepObserver* m_pStepObserver;
+
+	LorenzLifecycle m_lifecycle;
+	u32 m_spawnCursor;
+	u64 m_respawnedCount;
+	XoshiroStream m_spawnRng;
+	ParticlePool m_pool;
+	u32 m_activeCount;
+
+	// Parameter table, and the group of every particle (empty without a table).
+	std::vector<LorenzParameters> m_groupParameters;
+	std::vector<u16> m_groups;
+
+	// Maximal runs of m_groups with one index, in order.
+	struct GroupRun
+	{
+		u32 m_first;
+		u16 m_group;
+	};
+	std::vector<GroupRun> m_groupRuns;
+
+	// compact() scratch, kept to avoid allocating every frame.
+	struct CompactChunk
+	{
+		u32 m_alive;
+
+		// Rank of the chunk's first dead particle among those before the new
+		// end, and of its first live particle among those after it.
+		u32 m_deadOffset;
+		u32 m_liveOffset;
+	};
+	std::vector<CompactChunk> m_compactChunks;
+	std::vector<u32> m_compactSources;
+};
@@ -0,0 +1,363 @@
+#include "LyapunovEstimator.h"
+
+#include "LorenzSimulator.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+	// State followed by the three tangent vectors.
+	constexpr u32 kTangentValues = kLyapunovDimensions + kLyapunovDimensions * kLyapunovDimensions;
+
+	struct TangentState
+	{
+		f64 m_values[kTangentValues];
+
+		f64* vector(const u32 kIndex) { return m_values + kLyapunovDimensions * (kIndex + 1); }
+	};
+
+	// The Lorenz derivative and the Jacobian applied to each tangent vector.
+	void tangent_derivative(const TangentState& s, const LorenzParameters& params, TangentState& rOut)
+	{
+		const f64 kSigma = params.m_sigma;
+		const f64 kRho = params.m_rho;
+		const f64 kBeta = params.m_beta;
+		const f64 kX = s.m_values[0];
+		const f64 kY = s.m_values[1];
+		const f64 kZ = s.m_values[2];
+
+		rOut.m_values[0] = kSigma * (kY - kX);
+		rOut.m_values[1] = kX * (kRho - kZ) - kY;
+		rOut.m_values[2] = kX * kY - kBeta * kZ;
+
+		for (u32 i = 1; i <= kLyapunovDimensions; ++i)
+		{
+			const f64* pV = s.m_values + kLyapunovDimensions * i;
+			f64* pOut = rOut.m_values + kLyapunovDimensions * i;
+			pOut[0] = kSigma * (pV[1] - pV[0]);
+			pOut[1] = (kRho - kZ) * pV[0] - pV[1] - kX * pV[2];
+			pOut[2] = kY * pV[0] + kX * pV[1] - kBeta * pV[2];
+		}
+	}
+
+	void rk4_step(TangentState& rState, const LorenzParameters& params, const f64 kStep)
+	{
+		TangentState k1, k2, k3, k4, stage;
+		tangent_derivative(rState, params, k1);
+		for (u32 i = 0; i < kTangentValues; ++i)
+		{
+			stage.m_values[i] = rState.m_values[i] + 0.5 * kStep * k1.m_values[i];
+		}
+		tangent_derivative(stage, params, k2);
+		for (u32 i = 0; i < kTangentValues; ++i)
+		{
+			stage.m_values[i] = rState.m_values[i] + 0.5 * kStep * k2.m_values[i];
+		}
+		tangent_derivative(stage, params, k3);
+		for (u32 i = 0; i < kTangentValues; ++i)
+		{
+			stage.m_values[i] = rState.m_values[i] + kStep * k3.m_values[i];
+		}
+		tangent_derivative(stage, params, k4);
+		for (u32 i = 0; i < kTangentValues; ++i)
+		{
+			rState.m_values[i] += kStep / 6.0 * (k1.m_values[i] + 2.0 * (k2.m_values[i] + k3.m_values[i]) + k4.m_values[i]);
+		}
+	}
+
+	// Modified Gram-Schmidt over the tangent vectors, adding the log of each
+	// one's length after projection to pLogStretch (if not null). Returns
+	// false if the state or a vector is no longer finite.
+	bool renormalize(TangentState& rState, f64* pLogStretch)
+	{
+		for (u32 i = 0; i < kLyapunovDimensions; ++i)
+		{
+			f64* pV = rState.vector(i);
+			for (u32 j = 0; j < i; ++j)
+			{
+				const f64* pU = rState.vector(j);
+				const f64 kDot = pV[0] * pU[0] + pV[1] * pU[1] + pV[2] * pU[2];
+				pV[0] -= kDot * pU[0];
+				pV[1] -= kDot * pU[1];
+				pV[2] -= kDot * pU[2];
+			}
+
+			const f64 kLength = std::sqrt(pV[0] * pV[0] + pV[1] * pV[1] + pV[2] * pV[2]);
+			if (!(kLength > 0.0) || !std::isfinite(kLength))
+			{
+				return false;
+			}
+			pV[0] /= kLength;
+			pV[1] /= kLength;
+			pV[2] /= kLength;
+			if (pLogStretch)
+			{
+				pLogStretch[i] += std::log(kLength);
+			}
+		}
+		return std::isfinite(rState.m_values[0]) && std::isfinite(rState.m_values[1]) && std::isfinite(rState.m_values[2]);
+	}
+
+	f64 normal_quantile(const f64 kProbability)
+	{
+		// Newton on the normal CDF; it is concave above zero, so starting at
+		// zero approaches the root from below without overshooting
+		f64 z = 0.0;
+		for (u32 i = 0; i < 64; ++i)
+		{
+			const f64 kCdf = 0.5 * std::erfc(-z / std::sqrt(2.0));
+			const f64 kPdf = std::exp(-0.5 * z * z) / std::sqrt(2.0 * 3.14159265358979323846);
+			const f64 kStep = (kCdf - kProbability) / kPdf;
+			z -= kStep;
+			if (std::fabs(kStep) < 1e-12)
+			{
+				break;
+			}
+		}
+		return z;
+	}
+
+	bool same_parameters(const LorenzParameters& kA, const LorenzParameters& kB)
+	{
+		return kA.m_sigma == kB.m_sigma && kA.m_rho == kB.m_rho && kA.m_beta == kB.m_beta;
+	}
+}
+
+bool lyapunov_exponents(const LorenzParameters& params, const LyapunovSettings& settings, const Float3& kStart, f64 exponents[kLyapunovDimensions])
+{
+	const f64 kStep = settings.m_stepSize;
+	const u32 kRenormalize = std::max(settings.m_renormalizeSteps, 1u);
+	const u32 kTransientSteps = static_cast<u32>(std::ceil(settings.m_transientTime / kStep));
+	// Whole renormalization intervals, so every measured step is accounted for
+	const u32 kIntervals = std::max(static_cast<u32>(std::ceil(settings.m_measureTime / (kStep * kRenormalize))), 1u);
+
+	TangentState state = {};
+	state.m_values[0] = kStart.x;
+	state.m_values[1] = kStart.y;
+	state.m_values[2] = kStart.z;
+	for (u32 i = 0; i < kLyapunovDimensions; ++i)
+	{
+		state.vector(i)[i] = 1.0;
+	}
+
+	for (u32 step = 1; step <= kTransientSteps; ++step)
+	{
+		rk4_step(state, params, kStep);
+		if (step % kRenormalize == 0 && !renormalize(state, nullptr))
+		{
+			return false;
+		}
+	}
+	if (!renormalize(state, nullptr))
+	{
+		return false;
+	}
+
+	f64 logStretch[kLyapunovDimensions] = {};
+	for (u32 interval = 0; interval < kIntervals; ++interval)
+	{
+		for (u32 step = 0; step < kRenormalize; ++step)
+		{
+			rk4_step(state, params, kStep);
+		}
+		if (!renormalize(state, logStretch))
+		{
+			return false;
+		}
+	}
+
+	const f64 kMeasured = static_cast<f64>(kIntervals) * kRenormalize * kStep;
+	for (u32 i = 0; i < kLyapunovDimensions; ++i)
+	{
+		exponents[i] = logStretch[i] / kMeasured;
+	}
+	return true;
+}
+
+LyapunovSpectrum estimate_lyapunov_spectrum(const LorenzParameters& params, const LyapunovSettings& settings, JobQueue* pJobQueue)
+{
+	const auto kStart = std::chrono::steady_clock::now();
+	JobQueue& queue = pJobQueue ? *pJobQueue : sharedJobQueue();
+
+	struct Member
+	{
+		f64 m_exponents[kLyapunovDimensions];
+		bool m_valid;
+	};
+	std::vector<Member> members(settings.m_members);
+
+	const CounterRng rng(settings.m_seed);
+	Member* pMembers = members.data();
+	parallel_for(queue, 0, settings.m_members, 1, [&params, &settings, &rng, pMembers](u32 first, u32 last) {
+		for (u32 m = first; m < last; ++m)
+		{
+			const Float3 kPosition = initial_lorenz_particle(rng, m).m_position;
+			pMembers[m].m_valid = lyapunov_exponents(params, settings, kPosition, pMembers[m].m_exponents);
+		}
+	});
+
+	LyapunovSpectrum spectrum;
+	f64 sum[kLyapunovDimensions] = {};
+	f64 sumSquares[kLyapunovDimensions] = {};
+	u32 valid = 0;
+	for (const Member& member : members)
+	{
+		if (!member.m_valid)
+		{
+			continue;
+		}
+		++valid;
+		for (u32 i = 0; i < kLyapunovDimensions; ++i)
+		{
+			sum[i] += member.m_exponents[i];
+			sumSquares[i] += member.m_exponents[i] * member.m_exponents[i];
+		}
+	}
+
+	const f64 kCritical = valid >= 2 ? student_t_critical(settings.m_confidence, valid - 1) : INFINITY;
+	for (u32 i = 0; i < kLyapunovDimensions; ++i)
+	{
+		const f64 kMean = valid > 0 ? sum[i] / valid : NAN;
+		const f64 kVariance = valid >= 2 ? std::max((sumSquares[i] - valid * kMean * kMean) / (valid - 1), 0.0) : INFINITY;
+		spectrum.m_exponents[i] = kMean;
+		spectrum.m_halfWidths[i] = valid >= 2 ? kCritical * std::sqrt(kVariance / valid) : INFINITY;
+	}
+	spectrum.m_kaplanYorkeDimension = valid > 0 ? kaplan_yorke_dimension(spectrum.m_exponents) : NAN;
+	spectrum.m_members = valid;
+	spectrum.m_seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - kStart).count();
+	return spectrum;
+}
+
+f64 kaplan_yorke_dimension(const f64 exponents[kLyapunovDimensions])
+{
+	f64 sum = 0.0;
+	for (u32 j = 0; j < kLyapunovDimensions; ++j)
+	{
+		if (sum + exponents[j] < 0.0)
+		{
+			return j + sum / std::fabs(exponents[j]);
+		}
+		sum += exponents[j];
+	}
+	return kLyapunovDimensions;
+}
+
+f64 student_t_critical(const f64 kConfidence, const u32 kDegreesOfFreedom)
+{
+	assert(kConfidence > 0.0 && kConfidence < 1.0 && kDegreesOfFreedom > 0);
+	const f64 kProbability = 0.5 * (1.0 + kConfidence);
+
+	// Exact for one and two degrees of freedom
+	if (kDegreesOfFreedom == 1)
+	{
+		return std::tan(3.14159265358979323846 * (kProbability - 0.5));
+	}
+	if (kDegreesOfFreedom == 2)
+	{
+		return (2.0 * kProbability - 1.0) / std::sqrt(2.0 * kProbability * (1.0 - kProbability));
+	}
+
+	// Cornish-Fisher expansion about the normal quantile, within 0.2% from
+	// three degrees of freedom at 95%
+	const f64 kZ = normal_quantile(kProbability);
+	const f64 kZ2 = kZ * kZ;
+	const f64 kNu = kDegreesOfFreedom;
+	return kZ
+		+ kZ * (kZ2 + 1.0) / (4.0 * kNu)
+		+ kZ * ((5.0 * kZ2 + 16.0) * kZ2 + 3.0) / (96.0 * kNu * kNu)
+		+ kZ * (((3.0 * kZ2 + 19.0) * kZ2 + 17.0) * kZ2 - 15.0) / (384.0 * kNu * kNu * kNu);
+}
+
+// ========================================================
+// LyapunovEstimator
+// ========================================================
+
+LyapunovEstimator::LyapunovEstimator(const LyapunovSettings& settings, JobQueue* pJobQueue) :
+	m_settings(settings),
+	m_pJobQueue(pJobQueue),
+	m_requested(kDefaultLorenzParameters),
+	m_hasRequest(false),
+	m_pending(false),
+	m_running(false),
+	m_quit(false),
+	m_result(),
+	m_resultParams(kDefaultLorenzParameters),
+	m_hasResult(false)
+{
+	m_thread = std::thread(&LyapunovEstimator::run, this);
+}
+
+LyapunovEstimator::~LyapunovEstimator()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_one();
+	m_thread.join();
+}
+
+void LyapunovEstimator::request(const LorenzParameters& params)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_hasRequest && same_parameters(params, m_requested))
+		{
+			return;
+		}
+		m_requested = params;
+		m_hasRequest = true;
+		m_pending = true;
+	}
+	m_wake.notify_one();
+}
+
+bool LyapunovEstimator::poll(LyapunovSpectrum& rSpectrum, LorenzParameters& rParams)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_hasResult)
+	{
+		return false;
+	}
+	rSpectrum = m_result;
+	rParams = m_resultParams;
+	m_hasResult = false;
+	return true;
+}
+
+bool LyapunovEstimator::busy() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pending || m_running;
+}
+
+void LyapunovEstimator::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		m_wake.wait(lock, [this]() { return m_quit || m_pending; });
+		if (m_quit)
+		{
+			return;
+		}
+
+		const LorenzParameters kParams = m_requested;
+		m_pending = false;
+		m_running = true;
+		lock.unlock();
+
+		const LyapunovSpectrum kSpectrum = estimate_lyapunov_spectrum(kParams, m_settings, m_pJobQueue);
+
+		lock.lock();
+		m_result = kSpectrum;
+		m_resultParams = kParams;
+		m_hasResult = true;
+		m_running = false;
+	}
+}
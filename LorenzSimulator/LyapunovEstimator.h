@@ -0,0 +1,146 @@
+#pragma once
+
+//================================================================================
+// LyapunovEstimator
+// Lyapunov spectrum of the Lorenz system (the derivative in CS_Main) for
+// one (sigma, rho, beta), estimated over an ensemble of trajectories.
+//
+// Each ensemble member integrates the state together with three tangent
+// vectors under the variational equations dV/dt = J(x) V, using classic RK4
+// in double precision. Every few steps the tangent vectors are
+// re-orthonormalized with modified Gram-Schmidt, and the log of each
+// vector's stretch is accumulated; dividing by the measured time gives that
+// member's exponents, largest first. A transient, during which the tangent
+// vectors are renormalized but nothing is accumulated, first lets both the
+// state settle onto the attractor and the vectors align with the Lyapunov
+// directions.
+//
+// Members start from initial_lorenz_particle() positions and run in
+// parallel, one job each. The spectrum is the ensemble mean, with a
+// Student-t confidence interval from the spread of the members' finite-time
+// estimates. The interval does not cover the finite-time bias, which shrinks
+// as 1 / measure time (about 0.01 in lambda1 after 400 s for the classic
+// parameters). Members whose state leaves the finite range are dropped.
+//
+// The exponents always sum to the trace of J, -(sigma + 1 + beta), up to
+// integration error, which makes a cheap self check. For the classic
+// parameters (10, 28, 8/3) the spectrum is about (0.906, 0, -14.572).
+//================================================================================
+
+#include "LorenzParticle.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class JobQueue;
+
+constexpr u32 kLyapunovDimensions = 3;
+
+struct LyapunovSettings
+{
+	// Ensemble size; the confidence interval needs at least two. The defaults
+	// take about 130 ms on one core.
+	u32 m_members = 32;
+
+	// RK4 step, in simulated seconds.
+	f64 m_stepSize = 0.005;
+
+	// Simulated seconds discarded before measuring, and measured. Members
+	// start anywhere in the initial_lorenz_particle() cube and take tens of
+	// seconds to settle; the confidence interval does not see that bias. For
+	// the classic parameters a 10 s transient gives lambda1 about 0.893, with
+	// intervals that miss 0.906, and 50 s gives about 0.904.
+	f64 m_transientTime = 50.0;
+	f64 m_measureTime = 200.0;
+
+	// Steps between Gram-Schmidt renormalizations.
+	u32 m_renormalizeSteps = 8;
+
+	// Two-sided confidence level of the intervals.
+	f64 m_confidence = 0.95;
+
+	// Seed for the members' initial_lorenz_particle() positions.
+	u32 m_seed = 1;
+};
+
+struct LyapunovSpectrum
+{
+	// Ensemble mean, largest first, and the half width of its confidence interval.
+	f64 m_exponents[kLyapunovDimensions];
+	f64 m_halfWidths[kLyapunovDimensions];
+
+	// Kaplan-Yorke dimension of the attractor, from the mean exponents.
+	f64 m_kaplanYorkeDimension;
+
+	// Members that stayed finite and were averaged.
+	u32 m_members;
+
+	// Wall clock seconds the estimate took.
+	f64 m_seconds;
+};
+
+// Estimate the spectrum for params, running members on pJobQueue (or on
+// sharedJobQueue() if null). Blocks until done.
+LyapunovSpectrum estimate_lyapunov_spectrum(const LorenzParameters& params, const LyapunovSettings& settings, JobQueue* pJobQueue = nullptr);
+
+// Exponents of a single trajectory from kStart, largest first. Returns false
+// if the trajectory left the finite range.
+bool lyapunov_exponents(const LorenzParameters& params, const LyapunovSettings& settings, const Float3& kStart, f64 exponents[kLyapunovDimensions]);
+
+// Kaplan-Yorke dimension of a spectrum sorted largest first.
+f64 kaplan_yorke_dimension(const f64 exponents[kLyapunovDimensions]);
+
+// Two-sided Student-t critical value for kConfidence with kDegreesOfFreedom.
+f64 student_t_critical(const f64 kConfidence, const u32 kDegreesOfFreedom);
+
+// ========================================================
+// class LyapunovEstimator
+// Recomputes the spectrum on a background thread, for UIs that change the
+// parameters every frame (the app's Sigma/Rho/Beta sliders). Only the
+// latest request matters: one arriving while an estimate runs replaces any
+// earlier pending one and starts as soon as the running estimate finishes.
+// ========================================================
+
+class LyapunovEstimator final
+{
+public:
+	explicit LyapunovEstimator(const LyapunovSettings& settings = LyapunovSettings(), JobQueue* pJobQueue = nullptr);
+
+	// Waits for a running estimate, then stops the thread.
+	~LyapunovEstimator();
+
+	LyapunovEstimator(const LyapunovEstimator&) = delete;
+	LyapunovEstimator& operator=(const LyapunovEstimator&) = delete;
+
+	// Ask for the spectrum of params. Does nothing if params equal the last
+	// request.
+	void request(const LorenzParameters& params);
+
+	// Copy out the newest finished spectrum and the parameters it is for.
+	// Returns false if none finished since the last call.
+	bool poll(LyapunovSpectrum& rSpectrum, LorenzParameters& rParams);
+
+	// An estimate is running or pending.
+	bool busy() const;
+
+private:
+	void run();
+
+	LyapunovSettings m_settings;
+	JobQueue* m_pJobQueue;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_wake;
+	LorenzParameters m_requested;
+	bool m_hasRequest;
+	bool m_pending;
+	bool m_running;
+	bool m_quit;
+
+	LyapunovSpectrum m_result;
+	LorenzParameters m_resultParams;
+	bool m_hasResult;
+
+	std::thread m_thread;
+};
@@ -0,0 +1,213 @@
+#include "ParameterSweep.h"
+
+#include "LittleEndian.h"
+#include "LorenzSimulator.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+bool parse_sweep_axis(const char* pValue, SweepAxis& rAxis)
+{
+	char* pEnd = nullptr;
+	rAxis.m_min = std::strtof(pValue, &pEnd);
+	rAxis.m_max = rAxis.m_min;
+	rAxis.m_count = 1;
+	if (*pEnd == '\0')
+	{
+		return pEnd != pValue;
+	}
+	if (*pEnd != ':')
+	{
+		return false;
+	}
+	rAxis.m_max = std::strtof(pEnd + 1, &pEnd);
+	if (*pEnd != ':')
+	{
+		return false;
+	}
+	rAxis.m_count = static_cast<u32>(std::strtoul(pEnd + 1, &pEnd, 10));
+	return *pEnd == '\0' && rAxis.m_count > 0;
+}
+
+SweepPointStats sweep_point(const LorenzParameters& params, const SweepSettings& settings)
+{
+	const u32 kEnsemble = settings.m_ensemble;
+	const f32 kDeltaTime = settings.m_stepSize;
+
+	std::vector<LorenzParticle> initial(kEnsemble);
+	const CounterRng rng(settings.m_seed);
+	for (u32 i = 0; i < kEnsemble; ++i)
+	{
+		initial[i] = initial_lorenz_particle(rng, i);
+	}
+	ParticleStreams streams;
+	streams.resize(kEnsemble);
+	streams.load_aos(initial.data(), 0, kEnsemble);
+	const ParticleStreamRange kRange = streams.range(0, kEnsemble);
+
+	for (u32 step = 0; step < settings.m_transientSteps; ++step)
+	{
+		lorenz_integrate_streams(kRange, params, kDeltaTime, settings.m_integrator, settings.m_tolerance);
+	}
+
+	// Lobe of each member: -1, +1, or 0 until it first enters one
+	const f32 kFixedPointSquared = params.m_beta * (params.m_rho - 1.0f);
+	const f32 kLobeThreshold = kFixedPointSquared > 0.0f ? 0.5f * std::sqrt(kFixedPointSquared) : INFINITY;
+	const f32 kRadiusSquared = settings.m_divergenceRadius * settings.m_divergenceRadius;
+	std::vector<s8> lobes(kEnsemble, 0);
+	std::vector<u8> live(kEnsemble, 1);
+
+	SweepPointStats stats;
+	stats.m_parameters = params;
+	stats.m_bounds = kEmptyParticleBounds;
+	stats.m_diverged = 0;
+	f64 sum[3] = {};
+	u64 samples = 0;
+	u64 switches = 0;
+
+	for (u32 step = 0; step < settings.m_measureSteps; ++step)
+	{
+		lorenz_integrate_streams(kRange, params, kDeltaTime, settings.m_integrator, settings.m_tolerance);
+
+		for (u32 i = 0; i < kEnsemble; ++i)
+		{
+			if (!live[i])
+			{
+				continue;
+			}
+
+			const f32 kX = kRange.m_pPosX[i];
+			const f32 kY = kRange.m_pPosY[i];
+			const f32 kZ = kRange.m_pPosZ[i];
+			// Also false for NaN
+			if (!(kX * kX + kY * kY + kZ * kZ <= kRadiusSquared))
+			{
+				live[i] = 0;
+				++stats.m_diverged;
+				continue;
+			}
+
+			const Float3 kPosition = { kX, kY, kZ };
+			stats.m_bounds = merge_bounds(stats.m_bounds, ParticleBounds{ kPosition, kPosition });
+			sum[0] += kX;
+			sum[1] += kY;
+			sum[2] += kZ;
+			++samples;
+
+			const s8 kLobe = kX > kLobeThreshold ? 1 : (kX < -kLobeThreshold ? -1 : 0);
+			if (kLobe != 0)
+			{
+				switches += lobes[i] != 0 && lobes[i] != kLobe ? 1 : 0;
+				lobes[i] = kLobe;
+			}
+		}
+	}
+
+	const f64 kSamples = static_cast<f64>(samples);
+	stats.m_mean = samples > 0
+		? Float3{ static_cast<f32>(sum[0] / kSamples), static_cast<f32>(sum[1] / kSamples), static_cast<f32>(sum[2] / kSamples) }
+		: Float3{ NAN, NAN, NAN };
+	stats.m_lobeSwitchRate = samples > 0 ? static_cast<f32>(switches / (kSamples * kDeltaTime)) : 0.0f;
+	return stats;
+}
+
+void run_parameter_sweep(const ParameterGrid& grid, const SweepSettings& settings, const u32 kFirst, const u32 kCount,
+	SweepPointStats* pOut, JobQueue* pJobQueue)
+{
+	assert(kFirst + kCount <= grid.point_count());
+	JobQueue& queue = pJobQueue ? *pJobQueue : sharedJobQueue();
+	parallel_for(queue, 0, kCount, 1, [&grid, &settings, kFirst, pOut](u32 first, u32 last) {
+		for (u32 i = first; i < last; ++i)
+		{
+			pOut[i] = sweep_point(grid.point(kFirst + i), settings);
+		}
+	});
+}
+
+bool write_sweep_csv_header(std::FILE* pFile)
+{
+	return std::fprintf(pFile, "sigma,rho,beta,min_x,min_y,min_z,max_x,max_y,max_z,mean_x,mean_y,mean_z,lobe_switch_rate,diverged\n") > 0;
+}
+
+bool write_sweep_csv(std::FILE* pFile, const SweepPointStats* pStats, const u32 kCount)
+{
+	for (u32 i = 0; i < kCount; ++i)
+	{
+		const SweepPointStats& s = pStats[i];
+		const int kWritten = std::fprintf(pFile, "%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%u\n",
+			s.m_parameters.m_sigma, s.m_parameters.m_rho, s.m_parameters.m_beta,
+			s.m_bounds.m_min.x, s.m_bounds.m_min.y, s.m_bounds.m_min.z, s.m_bounds.m_max.x, s.m_bounds.m_max.y, s.m_bounds.m_max.z,
+			s.m_mean.x, s.m_mean.y, s.m_mean.z, s.m_lobeSwitchRate, s.m_diverged);
+		if (kWritten < 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+namespace
+{
+	// Records serialized per fwrite.
+	constexpr u32 kSweepRecordsPerWrite = 256;
+}
+
+u8* put_sweep_axis(u8* pOut, const SweepAxis& kAxis)
+{
+	return put_u32(put_f32(put_f32(pOut, kAxis.m_min), kAxis.m_max), kAxis.m_count);
+}
+
+bool write_sweep_binary_header(std::FILE* pFile, const ParameterGrid& grid, const SweepSettings& settings)
+{
+	SweepFileHeader header;
+	std::memcpy(header.m_magic, "LZSW", 4);
+	header.m_version = kSweepFileVersion;
+	header.m_pointCount = grid.point_count();
+	header.m_recordSize = kSweepRecordSize;
+	header.m_grid = grid;
+	header.m_ensemble = settings.m_ensemble;
+	header.m_stepSize = settings.m_stepSize;
+	header.m_integrator = static_cast<u32>(settings.m_integrator);
+	header.m_tolerance = settings.m_tolerance;
+	header.m_transientSteps = settings.m_transientSteps;
+	header.m_measureSteps = settings.m_measureSteps;
+	header.m_divergenceRadius = settings.m_divergenceRadius;
+	header.m_seed = settings.m_seed;
+
+	u8 bytes[kSweepHeaderSize];
+	std::memcpy(bytes, header.m_magic, 4);
+	u8* pOut = put_u32(put_u32(put_u32(bytes + 4, header.m_version), header.m_pointCount), header.m_recordSize);
+	pOut = put_sweep_axis(put_sweep_axis(put_sweep_axis(pOut, header.m_grid.m_sigma), header.m_grid.m_rho), header.m_grid.m_beta);
+	pOut = put_f32(put_u32(put_f32(put_u32(pOut, header.m_ensemble), header.m_stepSize), header.m_integrator), header.m_tolerance);
+	pOut = put_u32(put_f32(put_u32(put_u32(pOut, header.m_transientSteps), header.m_measureSteps), header.m_divergenceRadius), header.m_seed);
+	assert(pOut == bytes + kSweepHeaderSize);
+	return std::fwrite(bytes, sizeof(bytes), 1, pFile) == 1;
+}
+
+bool write_sweep_binary(std::FILE* pFile, const SweepPointStats* pStats, const u32 kCount)
+{
+	u8 bytes[kSweepRecordsPerWrite * kSweepRecordSize];
+	for (u32 first = 0; first < kCount; first += kSweepRecordsPerWrite)
+	{
+		const u32 kBatch = std::min(kCount - first, kSweepRecordsPerWrite);
+		u8* pOut = bytes;
+		for (u32 i = first; i < first + kBatch; ++i)
+		{
+			const SweepPointStats& s = pStats[i];
+			pOut = put_f32(put_f32(put_f32(pOut, s.m_parameters.m_sigma), s.m_parameters.m_rho), s.m_parameters.m_beta);
+			pOut = put_float3(put_float3(put_float3(pOut, s.m_bounds.m_min), s.m_bounds.m_max), s.m_mean);
+			pOut = put_u32(put_f32(pOut, s.m_lobeSwitchRate), s.m_diverged);
+		}
+		assert(pOut == bytes + kBatch * kSweepRecordSize);
+		if (std::fwrite(bytes, kSweepRecordSize, kBatch, pFile) != kBatch)
+		{
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+//================================================================================
+// ParameterSweep
+// Summary statistics of the Lorenz system over a 1D, 2D or 3D grid of
+// (sigma, rho, beta), for exploring parameter space without dragging the
+// app's sliders one value at a time.
+//
+// Every grid point integrates its own small ensemble with the SIMD kernels,
+// one job per point, so points spread over all cores and each ensemble stays
+// in cache for the whole run. After a transient, every step updates the
+// point's statistics:
+//  - bounds and mean position of the live members over all measured steps;
+//  - lobe switches: a member is in a lobe once |x| exceeds half the x of the
+//    nontrivial fixed points, sqrt(beta (rho - 1)), and switches when it
+//    reaches the other one. Reported per member per simulated second; zero
+//    without nontrivial fixed points (beta (rho - 1) <= 0);
+//  - divergence: members that become non-finite or leave the divergence
+//    radius are counted and left out of the statistics from then on.
+//
+// Every point starts from the same initial_lorenz_particle() members, so
+// differences between points come from the parameters alone.
+//
+// Results can be written as CSV or as a compact binary table: a
+// SweepFileHeader followed by one SweepPointStats per point. Both are written
+// field by field in declaration order, every field a little-endian u32 or
+// IEEE f32 with no padding, so the file does not depend on the host's byte
+// order or struct layout.
+//================================================================================
+
+#include "LorenzKernels.h"
+
+#include <cstdio>
+
+class JobQueue;
+
+// One grid axis: kCount values spread evenly over [m_min, m_max]. A count of
+// one holds the axis at m_min.
+struct SweepAxis
+{
+	f32 m_min;
+	f32 m_max;
+	u32 m_count;
+
+	f32 value(const u32 kIndex) const
+	{
+		return m_count > 1 ? m_min + (m_max - m_min) * static_cast<f32>(kIndex) / static_cast<f32>(m_count - 1) : m_min;
+	}
+};
+
+// Grid of parameter sets; point indices run sigma fastest, then rho, then beta.
+struct ParameterGrid
+{
+	SweepAxis m_sigma;
+	SweepAxis m_rho;
+	SweepAxis m_beta;
+
+	u32 point_count() const { return m_sigma.m_count * m_rho.m_count * m_beta.m_count; }
+
+	LorenzParameters point(const u32 kIndex) const
+	{
+		const u32 kSigma = kIndex % m_sigma.m_count;
+		const u32 kRho = (kIndex / m_sigma.m_count) % m_rho.m_count;
+		const u32 kBeta = kIndex / (m_sigma.m_count * m_rho.m_count);
+		return LorenzParameters{ m_sigma.value(kSigma), m_rho.value(kRho), m_beta.value(kBeta) };
+	}
+};
+
+struct SweepSettings
+{
+	// Members per grid point. Multiples of kParticleLaneWidth step fastest.
+	u32 m_ensemble = 64;
+
+	f32 m_stepSize = 0.005f;
+	Integrator::IntegratorEnum m_integrator = Integrator::kRK4;
+	f32 m_tolerance = 1e-4f;
+
+	// Steps discarded, then measured.
+	u32 m_transientSteps = 2000;
+	u32 m_measureSteps = 4000;
+
+	// Members farther than this from the origin have diverged.
+	f32 m_divergenceRadius = 1.0e4f;
+
+	u32 m_seed = 1;
+};
+
+// Statistics of one grid point. Also the binary record: write_sweep_binary()
+// writes these fields, so update it, and the file version, with them.
+struct SweepPointStats
+{
+	LorenzParameters m_parameters;
+	ParticleBounds m_bounds;
+	Float3 m_mean;
+
+	// Lobe switches per member per simulated second.
+	f32 m_lobeSwitchRate;
+
+	// Members that diverged; nonzero means the point is flagged.
+	u32 m_diverged;
+};
+
+// Bytes per binary record.
+constexpr u32 kSweepRecordSize = 56;
+
+static_assert(sizeof(SweepPointStats) == kSweepRecordSize, "SweepPointStats is the binary record; update the file version if it changes");
+
+// Binary file header: the grid axes, then the settings with the integrator as
+// a u32 (see Integrator::IntegratorEnum).
+struct SweepFileHeader
+{
+	char m_magic[4];
+	u32 m_version;
+	u32 m_pointCount;
+	u32 m_recordSize;
+	ParameterGrid m_grid;
+	u32 m_ensemble;
+	f32 m_stepSize;
+	u32 m_integrator;
+	f32 m_tolerance;
+	u32 m_transientSteps;
+	u32 m_measureSteps;
+	f32 m_divergenceRadius;
+	u32 m_seed;
+};
+
+// Bytes of the binary header.
+constexpr u32 kSweepHeaderSize = 84;
+
+constexpr u32 kSweepFileVersion = 1;
+
+// Put kAxis into a binary header as little-endian m_min, m_max, m_count
+// (see LittleEndian.h). Returns the byte after it.
+u8* put_sweep_axis(u8* pOut, const SweepAxis& kAxis);
+
+// Parse "V" (a single value) or "MIN:MAX:N" into rAxis. Returns false if
+// malformed or if N is zero.
+bool parse_sweep_axis(const char* pValue, SweepAxis& rAxis);
+
+// Statistics for one parameter set.
+SweepPointStats sweep_point(const LorenzParameters& params, const SweepSettings& settings);
+
+// Statistics for grid points [kFirst, kFirst + kCount) into pOut, one job per
+// point on pJobQueue (or sharedJobQueue() if null).
+void run_parameter_sweep(const ParameterGrid& grid, const SweepSettings& settings, const u32 kFirst, const u32 kCount,
+	SweepPointStats* pOut, JobQueue* pJobQueue = nullptr);
+
+// Write a header, or kCount records, to an open file. Returns false on a
+// write error.
+bool write_sweep_csv_header(std::FILE* pFile);
+bool write_sweep_csv(std::FILE* pFile, const SweepPointStats* pStats, const u32 kCount);
+bool write_sweep_binary_header(std::FILE* pFile, const ParameterGrid& grid, const SweepSettings& settings);
+bool write_sweep_binary(std::FILE* pFile, const SweepPointStats* pStats, const u32 kCount);
@@ -0,0 +1,110 @@
+#include "ParticleBufferRing.h"
+
+#include "LorenzSimulator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+ParticleBufferRing::ParticleBufferRing(const u32 kNumBuffers) :
+	m_numBuffers(kNumBuffers),
+	m_simulated(0),
+	m_render(0)
+{
+	assert(kNumBuffers >= 2 && kNumBuffers <= kMaxParticleBuffers);
+}
+
+void ParticleBufferRing::reset()
+{
+	m_simulated = 0;
+	m_render = 0;
+}
+
+void ParticleBufferRing::simulate(ParticleBufferBackend& rBackend, const u32 kSubsteps, const u32 kCount)
+{
+	if (kCount == 0)
+	{
+		return;
+	}
+
+	for (u32 i = 0; i < kSubsteps; ++i)
+	{
+		const u32 kTarget = write_index();
+		rBackend.simulate(m_simulated, kTarget, kCount);
+		m_simulated = kTarget;
+		m_render = kTarget;
+	}
+}
+
+void ParticleBufferRing::upload(ParticleBufferBackend& rBackend, const LorenzParticle* pParticles, const u32 kCount)
+{
+	const u32 kTarget = write_index();
+	if (kCount > 0)
+	{
+		rBackend.upload(kTarget, pParticles, kCount);
+	}
+	m_render = kTarget;
+}
+
+// ========================================================
+// RecordingParticleBackend
+// ========================================================
+
+void RecordingParticleBackend::simulate(const u32 kSource, const u32 kTarget, const u32 kCount)
+{
+	m_records.push_back(Record{ kSimulate, kSource, kTarget, kCount });
+}
+
+void RecordingParticleBackend::upload(const u32 kTarget, const LorenzParticle* /*pParticles*/, const u32 kCount)
+{
+	m_records.push_back(Record{ kUpload, kTarget, kTarget, kCount });
+}
+
+void RecordingParticleBackend::copy(const u32 kTarget, const u32 kSource, const u32 kCount)
+{
+	m_records.push_back(Record{ kCopy, kSource, kTarget, kCount });
+}
+
+u32 RecordingParticleBackend::count(const Op kOp) const
+{
+	return static_cast<u32>(std::count_if(m_records.begin(), m_records.end(), [kOp](const Record& r) { return r.m_op == kOp; }));
+}
+
+u64 RecordingParticleBackend::particles(const Op kOp) const
+{
+	u64 total = 0;
+	for (const Record& r : m_records)
+	{
+		total += r.m_op == kOp ? r.m_count : 0;
+	}
+	return total;
+}
+
+// ========================================================
+// CpuParticleBackend
+// ========================================================
+
+CpuParticleBackend::CpuParticleBackend(const u32 kNumBuffers, const u32 kCapacity, const LorenzParticle* pInitial,
+	const LorenzParameters& params, const f32 kDeltaTime) :
+	m_buffers(kNumBuffers, std::vector<LorenzParticle>(pInitial, pInitial + kCapacity)),
+	m_parameters(params),
+	m_deltaTime(kDeltaTime),
+	m_copiedParticles(0)
+{}
+
+void CpuParticleBackend::simulate(const u32 kSource, const u32 kTarget, const u32 kCount)
+{
+	assert(kSource != kTarget);
+	lorenz_step(m_buffers[kSource].data(), m_buffers[kTarget].data(), kCount, m_parameters, m_deltaTime);
+}
+
+void CpuParticleBackend::upload(const u32 kTarget, const LorenzParticle* pParticles, const u32 kCount)
+{
+	std::memcpy(m_buffers[kTarget].data(), pParticles, kCount * sizeof(LorenzParticle));
+}
+
+void CpuParticleBackend::copy(const u32 kTarget, const u32 kSource, const u32 kCount)
+{
+	std::memcpy(m_buffers[kTarget].data(), m_buffers[kSource].data(), kCount * sizeof(LorenzParticle));
+	m_copiedParticles += kCount;
+}
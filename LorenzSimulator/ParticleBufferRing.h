@@ -0,0 +1,144 @@
+#pragma once
+
+//================================================================================
+// ParticleBufferRing
+// Which particle buffer to read, write and draw, without copying state
+// between buffers. The ring owns no memory: it hands buffer indices to a
+// ParticleBufferBackend, which owns the buffers (D3D11 structured buffers in
+// the app, host arrays on the CPU, or nothing at all for the recording
+// backend used to check the schedule on machines without a GPU).
+//
+// Substeps ping-pong round the ring: each reads the latest state and writes
+// the next buffer along, which then becomes the latest. Drawing reads the
+// latest state too, so nothing is ever copied just to move it to a fixed
+// slot. A host upload (the CPU simulation path) also goes to the next buffer
+// and is drawn from there, but does not become simulation state, so
+// switching back to GPU simulation resumes from the last simulated buffer.
+//
+// With more than two buffers, consecutive writes rotate through all of them,
+// so a buffer is only rewritten kNumBuffers - 1 writes after it was latest.
+// That is the slack needed by backends that do not order reads and writes
+// themselves; D3D11 does, and would be correct with two.
+//================================================================================
+
+#include "LorenzParticle.h"
+
+#include <vector>
+
+constexpr u32 kMaxParticleBuffers = 8;
+constexpr u32 kDefaultParticleBuffers = 3;
+
+class ParticleBufferBackend
+{
+public:
+	virtual ~ParticleBufferBackend() {}
+
+	// One simulation substep of kCount particles from buffer kSource into kTarget.
+	virtual void simulate(const u32 kSource, const u32 kTarget, const u32 kCount) = 0;
+
+	// Write kCount host particles into buffer kTarget.
+	virtual void upload(const u32 kTarget, const LorenzParticle* pParticles, const u32 kCount) = 0;
+
+	// Copy kCount particles from buffer kSource into kTarget. The ring never
+	// calls this; it is here for schedules that still copy, to compare with.
+	virtual void copy(const u32 kTarget, const u32 kSource, const u32 kCount) = 0;
+};
+
+class ParticleBufferRing
+{
+public:
+	explicit ParticleBufferRing(const u32 kNumBuffers = kDefaultParticleBuffers);
+
+	// Every buffer holds the same state again (e.g. after being recreated);
+	// buffer 0 is the latest.
+	void reset();
+
+	// Run kSubsteps substeps of kCount particles on the backend.
+	void simulate(ParticleBufferBackend& rBackend, const u32 kSubsteps, const u32 kCount);
+
+	// Upload kCount host particles to be drawn this frame.
+	void upload(ParticleBufferBackend& rBackend, const LorenzParticle* pParticles, const u32 kCount);
+
+	// Buffer holding the latest simulated state.
+	u32 simulated_index() const { return m_simulated; }
+
+	// Buffer to draw: the latest simulated state, or the last upload after it.
+	u32 render_index() const { return m_render; }
+
+	// Buffer the next substep or upload writes: the one after the render
+	// buffer, skipping the simulation state.
+	u32 write_index() const
+	{
+		const u32 kNext = (m_render + 1) % m_numBuffers;
+		return kNext != m_simulated ? kNext : (kNext + 1) % m_numBuffers;
+	}
+
+	u32 buffer_count() const { return m_numBuffers; }
+
+private:
+	u32 m_numBuffers;
+	u32 m_simulated;
+	u32 m_render;
+};
+
+// ========================================================
+// Backends for checking a schedule without a GPU
+// ========================================================
+
+// Records every operation and moves no data.
+class RecordingParticleBackend final : public ParticleBufferBackend
+{
+public:
+	enum Op
+	{
+		kSimulate,
+		kUpload,
+		kCopy
+	};
+
+	struct Record
+	{
+		Op m_op;
+		u32 m_source;
+		u32 m_target;
+		u32 m_count;
+	};
+
+	void simulate(const u32 kSource, const u32 kTarget, const u32 kCount) override;
+	void upload(const u32 kTarget, const LorenzParticle* pParticles, const u32 kCount) override;
+	void copy(const u32 kTarget, const u32 kSource, const u32 kCount) override;
+
+	void clear() { m_records.clear(); }
+	const std::vector<Record>& records() const { return m_records; }
+
+	// Number of kOp records, and the particles they moved.
+	u32 count(const Op kOp) const;
+	u64 particles(const Op kOp) const;
+
+private:
+	std::vector<Record> m_records;
+};
+
+// Host arrays stepped with lorenz_step(), the scalar reference of CS_Main.
+class CpuParticleBackend final : public ParticleBufferBackend
+{
+public:
+	// kNumBuffers buffers of kCapacity particles, each a copy of pInitial.
+	CpuParticleBackend(const u32 kNumBuffers, const u32 kCapacity, const LorenzParticle* pInitial,
+		const LorenzParameters& params, const f32 kDeltaTime);
+
+	void simulate(const u32 kSource, const u32 kTarget, const u32 kCount) override;
+	void upload(const u32 kTarget, const LorenzParticle* pParticles, const u32 kCount) override;
+	void copy(const u32 kTarget, const u32 kSource, const u32 kCount) override;
+
+	const LorenzParticle* buffer(const u32 kIndex) const { return m_buffers[kIndex].data(); }
+
+	// Particles moved by copy() so far.
+	u64 copied_particles() const { return m_copiedParticles; }
+
+private:
+	std::vector<std::vector<LorenzParticle>> m_buffers;
+	LorenzParameters m_parameters;
+	f32 m_deltaTime;
+	u64 m_copiedParticles;
+};
@@ -0,0 +1,228 @@
+#include "ParticleFramePipeline.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+namespace
+{
+	f32 plane_distance(const Float4& plane, const f32 x, const f32 y, const f32 z)
+	{
+		return plane.x*x + plane.y*y + plane.z*z + plane.w;
+	}
+}
+
+ParticleFramePipeline::ParticleFramePipeline(LorenzSimulator& rSimulator) :
+	m_simulator(rSimulator),
+	m_graph(rSimulator.job_queue()),
+	m_deltaTime(0.0f),
+	m_substeps(0),
+	m_view(),
+	m_visibleCount(0),
+	m_bounds(kEmptyParticleBounds),
+	m_deadCount(0)
+{}
+
+void ParticleFramePipeline::begin_frame(const f32 kDeltaTime, const u32 kSubsteps, const u32 kCount, const ParticleFrameView& view)
+{
+	assert(kCount <= m_simulator.particle_count());
+
+	m_graph.reset();
+	m_deltaTime = kDeltaTime;
+	m_substeps = kSubsteps;
+	m_view = view;
+
+	const u32 kNumChunks = (kCount + kPipelineGrain - 1) / kPipelineGrain;
+	m_chunks.resize(kNumChunks);
+	m_staging.resize(kCount);
+
+	// Stage that needs every chunk's visible count before anyone can write
+	JobHandle offsets = m_graph.addJob([this]() {
+		u32 offset = 0;
+		for (Chunk& chunk : m_chunks)
+		{
+			chunk.m_outputOffset = offset;
+			offset += static_cast<u32>(chunk.m_visible.size());
+		}
+		m_visibleCount = offset;
+
+		m_bounds = kEmptyParticleBounds;
+		m_deadCount = 0;
+		for (const Chunk& chunk : m_chunks)
+		{
+			m_bounds = merge_bounds(m_bounds, chunk.m_bounds);
+			m_deadCount += chunk.m_dead;
+		}
+	});
+	m_done = m_graph.addJob([]() {});
+
+	// Respawns can land in any chunk, so they finish before integration starts
+	JobHandle recycle = m_graph.addJob([this, kCount]() { m_simulator.recycle(kCount); });
+
+	for (u32 c = 0; c < kNumChunks; ++c)
+	{
+		Chunk* pChunk = &m_chunks[c];
+		pChunk->m_first = c * kPipelineGrain;
+		pChunk->m_count = std::min(kPipelineGrain, kCount - pChunk->m_first);
+
+		// Particles are independent, so a chunk can take all its substeps in a
+		// row, a cache-sized tile at a time
+		JobHandle integrate = m_graph.addJob([this, pChunk]() {
+			m_simulator.step_range(m_deltaTime, pChunk->m_first, pChunk->m_count, m_substeps);
+		});
+		JobHandle bounds = m_graph.addJob([this, pChunk]() { compute_bounds(*pChunk); });
+		JobHandle cull = m_graph.addJob([this, pChunk]() { this->cull(*pChunk); });
+		JobHandle sort = m_graph.addJob([this, pChunk]() { this->sort(*pChunk); });
+		JobHandle upload = m_graph.addJob([this, pChunk]() { this->upload(*pChunk); });
+
+		m_graph.dependsOn(integrate, recycle);
+		m_graph.dependsOn(bounds, integrate);
+		m_graph.dependsOn(cull, bounds);
+		m_graph.dependsOn(sort, cull);
+		m_graph.dependsOn(offsets, cull);
+		m_graph.dependsOn(upload, sort);
+		m_graph.dependsOn(upload, offsets);
+		m_graph.dependsOn(m_done, upload);
+	}
+	m_graph.dependsOn(m_done, offsets);
+	m_graph.dependsOn(m_done, recycle);
+
+	m_graph.submit();
+}
+
+void ParticleFramePipeline::end_frame()
+{
+	if (m_done.valid())
+	{
+		m_graph.wait(m_done);
+		m_simulator.advance_time(static_cast<f64>(m_deltaTime) * m_substeps);
+		m_done = JobHandle();
+	}
+}
+
+void ParticleFramePipeline::compute_bounds(Chunk& rChunk) const
+{
+	const ParticlePool& pool = m_simulator.pool();
+	const f32* pPosX = pool.stream(ParticleStreams::kPosX, rChunk.m_first);
+	const f32* pPosY = pool.stream(ParticleStreams::kPosY, rChunk.m_first);
+	const f32* pPosZ = pool.stream(ParticleStreams::kPosZ, rChunk.m_first);
+
+	ParticleBounds bounds = kEmptyParticleBounds;
+	for (u32 i = 0; i < rChunk.m_count; ++i)
+	{
+		bounds.m_min.x = std::min(bounds.m_min.x, pPosX[i]);
+		bounds.m_min.y = std::min(bounds.m_min.y, pPosY[i]);
+		bounds.m_min.z = std::min(bounds.m_min.z, pPosZ[i]);
+		bounds.m_max.x = std::max(bounds.m_max.x, pPosX[i]);
+		bounds.m_max.y = std::max(bounds.m_max.y, pPosY[i]);
+		bounds.m_max.z = std::max(bounds.m_max.z, pPosZ[i]);
+	}
+	rChunk.m_bounds = bounds;
+	rChunk.m_dead = m_simulator.count_dead(rChunk.m_first, rChunk.m_count);
+}
+
+void ParticleFramePipeline::cull(Chunk& rChunk) const
+{
+	rChunk.m_visible.clear();
+	rChunk.m_contiguous = false;
+
+	bool allInside = true;
+	if (m_view.m_cull)
+	{
+		// Classify the whole chunk against each plane using its bounds
+		const ParticleBounds& b = rChunk.m_bounds;
+		for (const Float4& plane : m_view.m_planes)
+		{
+			const f32 kFar = plane_distance(plane,
+				plane.x >= 0.0f ? b.m_max.x : b.m_min.x,
+				plane.y >= 0.0f ? b.m_max.y : b.m_min.y,
+				plane.z >= 0.0f ? b.m_max.z : b.m_min.z);
+			const f32 kNear = plane_distance(plane,
+				plane.x >= 0.0f ? b.m_min.x : b.m_max.x,
+				plane.y >= 0.0f ? b.m_min.y : b.m_max.y,
+				plane.z >= 0.0f ? b.m_min.z : b.m_max.z);
+
+			if (kFar < -m_view.m_cullRadius)
+			{
+				return; // Entirely outside this plane
+			}
+			allInside = allInside && kNear >= -m_view.m_cullRadius;
+		}
+	}
+
+	rChunk.m_visible.resize(rChunk.m_count);
+	std::iota(rChunk.m_visible.begin(), rChunk.m_visible.end(), rChunk.m_first);
+	if (allInside)
+	{
+		rChunk.m_contiguous = true;
+		return;
+	}
+
+	// Straddles the frustum: test particle by particle. The chunk lies in one
+	// page, so its streams are indexed relative to its first particle.
+	const ParticlePool& pool = m_simulator.pool();
+	const f32* pPosX = pool.stream(ParticleStreams::kPosX, rChunk.m_first);
+	const f32* pPosY = pool.stream(ParticleStreams::kPosY, rChunk.m_first);
+	const f32* pPosZ = pool.stream(ParticleStreams::kPosZ, rChunk.m_first);
+	const u32 kFirst = rChunk.m_first;
+
+	auto outside = [&](u32 i) {
+		i -= kFirst;
+		for (const Float4& plane : m_view.m_planes)
+		{
+			if (plane_distance(plane, pPosX[i], pPosY[i], pPosZ[i]) < -m_view.m_cullRadius)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+	rChunk.m_visible.erase(std::remove_if(rChunk.m_visible.begin(), rChunk.m_visible.end(), outside), rChunk.m_visible.end());
+}
+
+void ParticleFramePipeline::sort(Chunk& rChunk) const
+{
+	if (!m_view.m_sortBackToFront || rChunk.m_visible.empty())
+	{
+		return;
+	}
+
+	const ParticlePool& pool = m_simulator.pool();
+	const f32* pPosX = pool.stream(ParticleStreams::kPosX, rChunk.m_first);
+	const f32* pPosY = pool.stream(ParticleStreams::kPosY, rChunk.m_first);
+	const f32* pPosZ = pool.stream(ParticleStreams::kPosZ, rChunk.m_first);
+
+	// Squared distance to the eye, indexed relative to the chunk
+	rChunk.m_depths.resize(rChunk.m_count);
+	for (u32 i : rChunk.m_visible)
+	{
+		const u32 kLocal = i - rChunk.m_first;
+		const f32 dx = pPosX[kLocal] - m_view.m_eye.x;
+		const f32 dy = pPosY[kLocal] - m_view.m_eye.y;
+		const f32 dz = pPosZ[kLocal] - m_view.m_eye.z;
+		rChunk.m_depths[kLocal] = dx*dx + dy*dy + dz*dz;
+	}
+
+	rChunk.m_contiguous = false;
+	const f32* pDepths = rChunk.m_depths.data();
+	const u32 kFirst = rChunk.m_first;
+	std::sort(rChunk.m_visible.begin(), rChunk.m_visible.end(),
+		[pDepths, kFirst](u32 a, u32 b) { return pDepths[a - kFirst] > pDepths[b - kFirst]; });
+}
+
+void ParticleFramePipeline::upload(const Chunk& rChunk)
+{
+	const ParticlePool& pool = m_simulator.pool();
+	LorenzParticle* pOut = m_staging.data() + rChunk.m_outputOffset;
+
+	if (rChunk.m_contiguous)
+	{
+		pool.store_aos(pOut, rChunk.m_first, rChunk.m_count);
+		return;
+	}
+
+	for (u32 i : rChunk.m_visible)
+	{
+		pool.store_aos(pOut++, i, 1);
+	}
+}
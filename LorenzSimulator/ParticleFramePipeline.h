@@ -0,0 +1,103 @@
+#pragma once
+
+//================================================================================
+// ParticleFramePipeline
+// Runs one frame of CPU simulation as a JobGraph so that the stages overlap:
+//
+//   recycle -> integrate[c] -> bounds[c] -> cull[c] -> sort[c] -> upload[c] -> done
+//                                               \-> offsets (all chunks) -/
+//
+// recycle respawns expired particles (LorenzSimulator::recycle) before any
+// chunk integrates; it only touches the few slots at the ring cursor. bounds
+// also counts dead particles, for the caller to compact away between frames.
+//
+// Particles are split into chunks of kPipelineGrain. Each chunk moves through
+// the stages on its own, so chunk 0 can be culling while chunk 7 is still
+// integrating, and the thread that called begin_frame() is free until it
+// needs the result in end_frame(). Sorting is back to front within a chunk,
+// which is all additive particles need.
+//================================================================================
+
+#include "LorenzSimulator.h"
+
+#include "JobGraph.h"
+
+#include <vector>
+
+// Particles per chunk of the frame graph.
+constexpr u32 kPipelineGrain = 65536;
+static_assert(kParticlePageSize % kPipelineGrain == 0, "Pipeline chunks must not cross pool pages");
+
+// Camera data for the cull and sort stages.
+struct ParticleFrameView
+{
+	// Inward facing frustum planes (a, b, c, d), as in Camera::planes.
+	Float4 m_planes[6];
+	Float3 m_eye;
+
+	// Particles within this distance outside a plane are kept (billboard size).
+	f32 m_cullRadius;
+
+	bool m_cull;
+	bool m_sortBackToFront;
+};
+
+class ParticleFramePipeline
+{
+public:
+	explicit ParticleFramePipeline(LorenzSimulator& rSimulator);
+
+	// Build and submit this frame's graph over the first kCount particles,
+	// integrating kSubsteps steps of kDeltaTime (see FixedStepScheduler).
+	// Returns immediately; the simulator must not be touched until end_frame().
+	void begin_frame(const f32 kDeltaTime, const u32 kSubsteps, const u32 kCount, const ParticleFrameView& view);
+
+	// Wait for the upload stage and advance the simulator's time(). visible_particles()
+	// is then ready to copy to the GPU.
+	void end_frame();
+
+	// Results of the last completed frame.
+	const LorenzParticle* visible_particles() const { return m_staging.data(); }
+	u32 visible_count() const { return m_visibleCount; }
+	const ParticleBounds& bounds() const { return m_bounds; }
+
+	// Dead particles found by the bounds stage. The caller can compact() the
+	// simulator before the next frame when this is non-zero.
+	u32 dead_count() const { return m_deadCount; }
+
+private:
+	struct Chunk
+	{
+		u32 m_first;
+		u32 m_count;
+		ParticleBounds m_bounds;
+		u32 m_dead;
+
+		// Indices of visible particles, sorted if requested.
+		std::vector<u32> m_visible;
+		std::vector<f32> m_depths;
+		u32 m_outputOffset;
+
+		// m_visible is exactly [m_first, m_first + m_count) in order.
+		bool m_contiguous;
+	};
+
+	void compute_bounds(Chunk& rChunk) const;
+	void cull(Chunk& rChunk) const;
+	void sort(Chunk& rChunk) const;
+	void upload(const Chunk& rChunk);
+
+	LorenzSimulator& m_simulator;
+	JobGraph m_graph;
+	JobHandle m_done;
+
+	f32 m_deltaTime;
+	u32 m_substeps;
+	ParticleFrameView m_view;
+
+	std::vector<Chunk> m_chunks;
+	std::vector<LorenzParticle> m_staging;
+	u32 m_visibleCount;
+	ParticleBounds m_bounds;
+	u32 m_deadCount;
+};
@@ -0,0 +1,208 @@
+#include "ParticlePool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+	// Largest whole number of pages a u32 can index.
+	constexpr u32 kLargestCapacity = ~kParticlePageMask;
+}
+
+ParticlePool::ParticlePool() :
+	m_size(0),
+	m_maxCapacity(kLargestCapacity),
+	m_growthCount(0)
+{}
+
+ParticlePool::~ParticlePool()
+{
+	clear();
+}
+
+ParticlePool::ParticlePool(ParticlePool&& rOther) :
+	ParticlePool()
+{
+	*this = std::move(rOther);
+}
+
+ParticlePool& ParticlePool::operator=(ParticlePool&& rOther)
+{
+	if (this != &rOther)
+	{
+		clear();
+		m_pages = std::move(rOther.m_pages);
+		m_size = rOther.m_size;
+		m_maxCapacity = rOther.m_maxCapacity;
+		m_growthCount = rOther.m_growthCount;
+
+		rOther.m_pages.clear();
+		rOther.m_size = 0;
+		rOther.m_growthCount = 0;
+	}
+	return *this;
+}
+
+bool ParticlePool::resize(const u32 kCount)
+{
+	if (kCount > capacity())
+	{
+		if (kCount > std::min(m_maxCapacity, kLargestCapacity))
+		{
+			return false;
+		}
+
+		// Grow geometrically, but never past the max capacity
+		const u64 kGrown = static_cast<u64>(capacity()) * kParticlePoolGrowthNum / kParticlePoolGrowthDen;
+		const u64 kTarget = std::min<u64>(std::max<u64>(kCount, kGrown), std::min(m_maxCapacity, kLargestCapacity));
+		const u32 kPages = static_cast<u32>((kTarget + kParticlePageMask) >> kParticlePageShift);
+		if (!add_pages(kPages - page_count()) && !add_pages(((kCount + kParticlePageMask) >> kParticlePageShift) - page_count()))
+		{
+			return false;
+		}
+	}
+
+	// Zero the padding of the last batch so SIMD kernels read defined values
+	const u32 kPadded = (kCount + kParticleLaneWidth - 1) & ~(kParticleLaneWidth - 1);
+	if (kPadded > kCount)
+	{
+		for (u32 k = 0; k < ParticleStreams::kNumStreams; ++k)
+		{
+			std::memset(stream(static_cast<Stream>(k), kCount), 0, (kPadded - kCount) * sizeof(f32));
+		}
+	}
+
+	m_size = kCount;
+	return true;
+}
+
+bool ParticlePool::reserve(const u32 kCapacity)
+{
+	if (kCapacity <= capacity())
+	{
+		return true;
+	}
+	if (kCapacity > std::min(m_maxCapacity, kLargestCapacity))
+	{
+		return false;
+	}
+	return add_pages(((kCapacity + kParticlePageMask) >> kParticlePageShift) - page_count());
+}
+
+void ParticlePool::shrink_to_fit()
+{
+	const u32 kPagesUsed = (m_size + kParticlePageMask) >> kParticlePageShift;
+	for (u32 p = kPagesUsed; p < page_count(); ++p)
+	{
+		aligned_free_bytes(m_pages[p]);
+	}
+	m_pages.resize(kPagesUsed);
+	m_pages.shrink_to_fit();
+}
+
+void ParticlePool::clear()
+{
+	for (f32* pPage : m_pages)
+	{
+		aligned_free_bytes(pPage);
+	}
+	m_pages.clear();
+	m_size = 0;
+}
+
+bool ParticlePool::add_pages(const u32 kNumPages)
+{
+	// Allocate every page before publishing any, so failure leaves the pool as it was
+	std::vector<f32*> pages(kNumPages, nullptr);
+	for (f32*& pPage : pages)
+	{
+		pPage = static_cast<f32*>(aligned_alloc_bytes(kPageBytes, kParticleStreamAlignment));
+		if (!pPage)
+		{
+			for (f32* pAllocated : pages)
+			{
+				aligned_free_bytes(pAllocated);
+			}
+			return false;
+		}
+	}
+
+	m_pages.insert(m_pages.end(), pages.begin(), pages.end());
+	++m_growthCount;
+	return true;
+}
+
+void ParticlePool::load_aos(const LorenzParticle* pParticles, const u32 kFirst, const u32 kCount)
+{
+	assert(kFirst + kCount <= m_size);
+
+	u32 done = 0;
+	while (done < kCount)
+	{
+		const u32 kRun = std::min(kCount - done, page_remaining(kFirst + done));
+		ParticleStreamRange r = range(kFirst + done, kRun);
+		for (u32 i = 0; i < kRun; ++i)
+		{
+			const LorenzParticle& p = pParticles[done + i];
+			r.m_pPosX[i] = p.m_position.x;
+			r.m_pPosY[i] = p.m_position.y;
+			r.m_pPosZ[i] = p.m_position.z;
+			r.m_pAge[i] = p.m_age;
+			r.m_pVelX[i] = p.m_velocity.x;
+			r.m_pVelY[i] = p.m_velocity.y;
+			r.m_pVelZ[i] = p.m_velocity.z;
+		}
+		done += kRun;
+	}
+}
+
+void ParticlePool::store_aos(LorenzParticle* pParticles, const u32 kFirst, const u32 kCount) const
+{
+	assert(kFirst + kCount <= m_size);
+
+	u32 done = 0;
+	while (done < kCount)
+	{
+		const u32 kIndex = kFirst + done;
+		const u32 kRun = std::min(kCount - done, page_remaining(kIndex));
+		const f32* pPosX = stream(ParticleStreams::kPosX, kIndex);
+		const f32* pPosY = stream(ParticleStreams::kPosY, kIndex);
+		const f32* pPosZ = stream(ParticleStreams::kPosZ, kIndex);
+		const f32* pAge = stream(ParticleStreams::kAge, kIndex);
+		const f32* pVelX = stream(ParticleStreams::kVelX, kIndex);
+		const f32* pVelY = stream(ParticleStreams::kVelY, kIndex);
+		const f32* pVelZ = stream(ParticleStreams::kVelZ, kIndex);
+		for (u32 i = 0; i < kRun; ++i)
+		{
+			LorenzParticle& p = pParticles[done + i];
+			p.m_position = Float3{ pPosX[i], pPosY[i], pPosZ[i] };
+			p.m_age = pAge[i];
+			p.m_velocity = Float3{ pVelX[i], pVelY[i], pVelZ[i] };
+		}
+		done += kRun;
+	}
+}
+
+ParticleStreamRange ParticlePool::range(const u32 kFirst, const u32 kCount)
+{
+	assert(kFirst + kCount <= capacity());
+	assert(kCount <= page_remaining(kFirst));
+
+	ParticleStreamRange r = {};
+	if (kCount == 0)
+	{
+		return r;
+	}
+
+	r.m_pPosX = stream(ParticleStreams::kPosX, kFirst);
+	r.m_pPosY = stream(ParticleStreams::kPosY, kFirst);
+	r.m_pPosZ = stream(ParticleStreams::kPosZ, kFirst);
+	r.m_pAge = stream(ParticleStreams::kAge, kFirst);
+	r.m_pVelX = stream(ParticleStreams::kVelX, kFirst);
+	r.m_pVelY = stream(ParticleStreams::kVelY, kFirst);
+	r.m_pVelZ = stream(ParticleStreams::kVelZ, kFirst);
+	r.m_count = kCount;
+	return r;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+//================================================================================
+// ParticlePool
+// Paged structure-of-arrays particle storage for the CPU simulator. Particles
+// live in fixed pages of kParticlePageSize; each page holds every stream of
+// its particles in one 64-byte aligned allocation. Growing the pool only adds
+// pages, so existing particles never move and are never copied, and counts can
+// be raised at runtime up to tens of millions.
+//
+// Pages are added geometrically (see kParticlePoolGrowthNum/Den) so a pool
+// grown a step at a time allocates O(log N) times. A runtime max capacity
+// caps the growth.
+//
+// A page is a multiple of kParticleLaneWidth, and of every chunk size used to
+// walk the particles, so any such chunk lies inside one page and its streams
+// are contiguous; range() and stream() hand out pointers into a single page.
+//================================================================================
+
+#include "ParticleStreams.h"
+
+#include <vector>
+
+// Particles per page, 1.75 MB of streams.
+constexpr u32 kParticlePageShift = 16;
+constexpr u32 kParticlePageSize = 1u << kParticlePageShift;
+constexpr u32 kParticlePageMask = kParticlePageSize - 1;
+
+// When the pool runs out of pages it grows to at least 3/2 of its capacity.
+// Doubling would waste up to half of a multi-gigabyte pool.
+constexpr u32 kParticlePoolGrowthNum = 3;
+constexpr u32 kParticlePoolGrowthDen = 2;
+
+static_assert(kParticlePageSize % kParticleLaneWidth == 0, "Pages must hold whole SIMD batches");
+
+class ParticlePool
+{
+public:
+	typedef ParticleStreams::Stream Stream;
+
+	ParticlePool();
+	~ParticlePool();
+
+	ParticlePool(ParticlePool&& rOther);
+	ParticlePool& operator=(ParticlePool&& rOther);
+
+	ParticlePool(const ParticlePool&) = delete;
+	ParticlePool& operator=(const ParticlePool&) = delete;
+
+	// Set the number of particles. Particles below both the old and new size
+	// keep their contents; new ones are uninitialized apart from the padding
+	// up to the next lane boundary, which is zeroed. Adds pages as needed.
+	// Returns false, leaving the pool unchanged, if kCount is over
+	// max_capacity() or pages cannot be allocated.
+	bool resize(const u32 kCount);
+
+	// Allocate pages for at least kCapacity particles without changing size().
+	bool reserve(const u32 kCapacity);
+
+	// Free pages that hold no particles.
+	void shrink_to_fit();
+
+	// Free everything.
+	void clear();
+
+	// Upper bound on capacity(). Growth stops here rather than overshooting.
+	void set_max_capacity(const u32 kMaxCapacity) { m_maxCapacity = kMaxCapacity; }
+	u32 max_capacity() const { return m_maxCapacity; }
+
+	// Convert kCount AoS particles into the pool, starting at particle kFirst.
+	// The range may span pages.
+	void load_aos(const LorenzParticle* pParticles, const u32 kFirst, const u32 kCount);
+
+	// Convert kCount particles starting at kFirst back to AoS.
+	void store_aos(LorenzParticle* pParticles, const u32 kFirst, const u32 kCount) const;
+
+	// Stream pointers for particles [kFirst, kFirst + kCount), which must not
+	// cross a page boundary.
+	ParticleStreamRange range(const u32 kFirst, const u32 kCount);
+
+	// Pointer to particle kIndex of a stream, contiguous to the end of its page.
+	f32* stream(const Stream kStream, const u32 kIndex)
+	{
+		return m_pages[kIndex >> kParticlePageShift] + (size_t(kStream) << kParticlePageShift) + (kIndex & kParticlePageMask);
+	}
+	const f32* stream(const Stream kStream, const u32 kIndex) const
+	{
+		return m_pages[kIndex >> kParticlePageShift] + (size_t(kStream) << kParticlePageShift) + (kIndex & kParticlePageMask);
+	}
+
+	// Single attribute, for random access.
+	f32& at(const Stream kStream, const u32 kIndex) { return *stream(kStream, kIndex); }
+	f32 at(const Stream kStream, const u32 kIndex) const { return *stream(kStream, kIndex); }
+
+	// Number of particles left in kIndex's page from kIndex on.
+	static u32 page_remaining(const u32 kIndex) { return kParticlePageSize - (kIndex & kParticlePageMask); }
+
+	// Accessors.
+	u32 size() const { return m_size; }
+	u32 padded_size() const { return (m_size + kParticleLaneWidth - 1) & ~(kParticleLaneWidth - 1); }
+	u32 capacity() const { return static_cast<u32>(m_pages.size()) << kParticlePageShift; }
+	u32 page_count() const { return static_cast<u32>(m_pages.size()); }
+	size_t allocated_bytes() const { return m_pages.size() * kPageBytes; }
+
+	// Number of times pages were allocated.
+	u32 growth_count() const { return m_growthCount; }
+
+private:
+	static constexpr size_t kPageBytes = size_t(kParticlePageSize) * ParticleStreams::kNumStreams * sizeof(f32);
+
+	bool add_pages(const u32 kNumPages);
+
+	std::vector<f32*> m_pages;
+	u32 m_size;
+	u32 m_maxCapacity;
+	u32 m_growthCount;
+};
@@ -0,0 +1,158 @@
+#include "ParticleStreams.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#if defined(_MSC_VER)
+	#include <malloc.h>
+#endif
+
+void* aligned_alloc_bytes(const size_t kBytes, const size_t kAlignment)
+{
+#if defined(_MSC_VER)
+	return _aligned_malloc(kBytes, kAlignment);
+#else
+	void* ptr = nullptr;
+	if (posix_memalign(&ptr, kAlignment, kBytes) != 0)
+	{
+		return nullptr;
+	}
+	return ptr;
+#endif
+}
+
+void aligned_free_bytes(void* ptr)
+{
+#if defined(_MSC_VER)
+	_aligned_free(ptr);
+#else
+	std::free(ptr);
+#endif
+}
+
+ParticleStreams::ParticleStreams() :
+	m_pMemory(nullptr),
+	m_size(0),
+	m_paddedSize(0)
+{
+	for (f32*& pStream : m_pStreams)
+	{
+		pStream = nullptr;
+	}
+}
+
+ParticleStreams::~ParticleStreams()
+{
+	release();
+}
+
+ParticleStreams::ParticleStreams(ParticleStreams&& rOther) :
+	ParticleStreams()
+{
+	*this = std::move(rOther);
+}
+
+ParticleStreams& ParticleStreams::operator=(ParticleStreams&& rOther)
+{
+	if (this != &rOther)
+	{
+		release();
+		std::memcpy(m_pStreams, rOther.m_pStreams, sizeof(m_pStreams));
+		m_pMemory = rOther.m_pMemory;
+		m_size = rOther.m_size;
+		m_paddedSize = rOther.m_paddedSize;
+
+		std::memset(rOther.m_pStreams, 0, sizeof(rOther.m_pStreams));
+		rOther.m_pMemory = nullptr;
+		rOther.m_size = 0;
+		rOther.m_paddedSize = 0;
+	}
+	return *this;
+}
+
+void ParticleStreams::release()
+{
+	aligned_free_bytes(m_pMemory);
+	m_pMemory = nullptr;
+	std::memset(m_pStreams, 0, sizeof(m_pStreams));
+	m_size = 0;
+	m_paddedSize = 0;
+}
+
+void ParticleStreams::resize(const u32 kCount)
+{
+	release();
+	if (kCount == 0)
+	{
+		return;
+	}
+
+	// A multiple of the lane width is also a multiple of the cache line, so
+	// every stream starts aligned inside one shared allocation.
+	static_assert((kParticleLaneWidth * sizeof(f32)) % kParticleStreamAlignment == 0, "Streams must stay cache line aligned");
+	const u32 kPadded = (kCount + kParticleLaneWidth - 1) & ~(kParticleLaneWidth - 1);
+	const size_t kStreamBytes = size_t(kPadded) * sizeof(f32);
+
+	m_pMemory = aligned_alloc_bytes(kStreamBytes * kNumStreams, kParticleStreamAlignment);
+	assert(m_pMemory);
+
+	for (u32 i = 0; i < kNumStreams; ++i)
+	{
+		m_pStreams[i] = reinterpret_cast<f32*>(static_cast<u8*>(m_pMemory) + i * kStreamBytes);
+		// Only the padding needs clearing, the rest is overwritten by the caller
+		std::memset(m_pStreams[i] + kCount, 0, (kPadded - kCount) * sizeof(f32));
+	}
+
+	m_size = kCount;
+	m_paddedSize = kPadded;
+}
+
+void ParticleStreams::load_aos(const LorenzParticle* pParticles, const u32 kFirst, const u32 kCount)
+{
+	assert(kFirst + kCount <= m_size);
+
+	ParticleStreamRange r = range(kFirst, kCount);
+	for (u32 i = 0; i < kCount; ++i)
+	{
+		const LorenzParticle& p = pParticles[i];
+		r.m_pPosX[i] = p.m_position.x;
+		r.m_pPosY[i] = p.m_position.y;
+		r.m_pPosZ[i] = p.m_position.z;
+		r.m_pAge[i] = p.m_age;
+		r.m_pVelX[i] = p.m_velocity.x;
+		r.m_pVelY[i] = p.m_velocity.y;
+		r.m_pVelZ[i] = p.m_velocity.z;
+	}
+}
+
+void ParticleStreams::store_aos(LorenzParticle* pParticles, const u32 kFirst, const u32 kCount) const
+{
+	assert(kFirst + kCount <= m_size);
+
+	for (u32 i = 0; i < kCount; ++i)
+	{
+		const u32 kIndex = kFirst + i;
+		LorenzParticle& p = pParticles[i];
+		p.m_position = Float3{ m_pStreams[kPosX][kIndex], m_pStreams[kPosY][kIndex], m_pStreams[kPosZ][kIndex] };
+		p.m_age = m_pStreams[kAge][kIndex];
+		p.m_velocity = Float3{ m_pStreams[kVelX][kIndex], m_pStreams[kVelY][kIndex], m_pStreams[kVelZ][kIndex] };
+	}
+}
+
+ParticleStreamRange ParticleStreams::range(const u32 kFirst, const u32 kCount)
+{
+	assert(kFirst + kCount <= m_paddedSize);
+
+	ParticleStreamRange r;
+	r.m_pPosX = m_pStreams[kPosX] + kFirst;
+	r.m_pPosY = m_pStreams[kPosY] + kFirst;
+	r.m_pPosZ = m_pStreams[kPosZ] + kFirst;
+	r.m_pAge = m_pStreams[kAge] + kFirst;
+	r.m_pVelX = m_pStreams[kVelX] + kFirst;
+	r.m_pVelY = m_pStreams[kVelY] + kFirst;
+	r.m_pVelZ = m_pStreams[kVelZ] + kFirst;
+	r.m_count = kCount;
+	return r;
+}
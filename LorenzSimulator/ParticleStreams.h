@@ -0,0 +1,89 @@
+#pragma once
+
+//================================================================================
+// ParticleStreams
+// Structure-of-arrays particle storage for the CPU simulator. Each attribute
+// of LorenzParticle lives in its own 64-byte aligned float stream, padded to a
+// multiple of kParticleLaneWidth so SIMD kernels never need a scalar tail on
+// a full container. Conversion routines to/from the AoS layout are provided
+// for GPU upload.
+//================================================================================
+
+#include "LorenzParticle.h"
+
+#include <cstddef>
+
+// Widest SIMD batch (AVX-512, 16 floats). Streams are padded to this size.
+constexpr u32 kParticleLaneWidth = 16;
+
+// Alignment of every stream, one cache line.
+constexpr u32 kParticleStreamAlignment = 64;
+
+// Raw pointers to a range of particle streams, as consumed by the kernels.
+struct ParticleStreamRange
+{
+	f32* m_pPosX;
+	f32* m_pPosY;
+	f32* m_pPosZ;
+	f32* m_pAge;
+	f32* m_pVelX;
+	f32* m_pVelY;
+	f32* m_pVelZ;
+	u32 m_count;
+};
+
+class ParticleStreams
+{
+public:
+	enum Stream
+	{
+		kPosX,
+		kPosY,
+		kPosZ,
+		kAge,
+		kVelX,
+		kVelY,
+		kVelZ,
+		kNumStreams
+	};
+
+	ParticleStreams();
+	~ParticleStreams();
+
+	ParticleStreams(ParticleStreams&& rOther);
+	ParticleStreams& operator=(ParticleStreams&& rOther);
+
+	ParticleStreams(const ParticleStreams&) = delete;
+	ParticleStreams& operator=(const ParticleStreams&) = delete;
+
+	// Reallocate for kCount particles. Contents are not preserved; padding is zeroed.
+	void resize(const u32 kCount);
+
+	// Convert kCount AoS particles into streams, starting at particle kFirst.
+	void load_aos(const LorenzParticle* pParticles, const u32 kFirst, const u32 kCount);
+
+	// Convert kCount particles starting at kFirst back to AoS.
+	void store_aos(LorenzParticle* pParticles, const u32 kFirst, const u32 kCount) const;
+
+	// Stream pointers for particles [kFirst, kFirst + kCount).
+	ParticleStreamRange range(const u32 kFirst, const u32 kCount);
+
+	// Accessors.
+	f32* stream(const Stream kStream) { return m_pStreams[kStream]; }
+	const f32* stream(const Stream kStream) const { return m_pStreams[kStream]; }
+
+	u32 size() const { return m_size; }
+	u32 padded_size() const { return m_paddedSize; }
+
+private:
+	void release();
+
+	f32* m_pStreams[kNumStreams];
+	void* m_pMemory;
+	u32 m_size;
+	u32 m_paddedSize;
+};
+
+// Aligned allocation helpers shared by the simulator containers.
+void* aligned_alloc_bytes(const std::size_t kBytes, const std::size_t kAlignment);
+void aligned_free_bytes(void* ptr);
@@ -0,0 +1,253 @@
+#include "PoincareSection.h"
+
+#include "LittleEndian.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Newton iterations refining a crossing, at most; they stop once the
+	// distance is within kRefineTolerance of the distances at the step ends.
+	constexpr u32 kRefineIterations = 8;
+	constexpr f32 kRefineTolerance = 1e-6f;
+
+	f32 dot(const Float3& a, const Float3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	Float3 scaled(const Float3& v, const f32 kScale)
+	{
+		return Float3{ v.x * kScale, v.y * kScale, v.z * kScale };
+	}
+
+	// Records serialized per fwrite.
+	constexpr u32 kSectionRecordsPerWrite = 256;
+
+	// Nonzero if the signed distance went from kBefore to kAfter through the
+	// plane in a direction kept by the masks. Comparisons are false for NaN,
+	// so dead particles never cross.
+	u32 crossed(const f32 kBefore, const f32 kAfter, const u32 kUpwardMask, const u32 kDownwardMask)
+	{
+		const u32 kUpward = static_cast<u32>(kBefore < 0.0f) & static_cast<u32>(kAfter >= 0.0f);
+		const u32 kDownward = static_cast<u32>(kBefore >= 0.0f) & static_cast<u32>(kAfter < 0.0f);
+		return (kUpward & kUpwardMask) | (kDownward & kDownwardMask);
+	}
+
+	// Point and step fraction where the Hermite cubic through p0 and p1, with
+	// derivatives f0 and f1 scaled by the step, meets the plane. The signed
+	// distances kBefore and kAfter have opposite signs.
+	f32 refine_crossing(const Float3& p0, const Float3& p1, const Float3& f0, const Float3& f1, const Float3& normal,
+		const f32 kBefore, const f32 kAfter, Float3& rPoint)
+	{
+		// Distance along the cubic is itself a cubic in s
+		const f32 kSlope0 = dot(normal, f0);
+		const f32 kSlope1 = dot(normal, f1);
+		const f32 kTolerance = kRefineTolerance * (std::fabs(kBefore) + std::fabs(kAfter));
+		f32 lo = 0.0f;
+		f32 hi = 1.0f;
+		f32 s = kBefore / (kBefore - kAfter);
+		for (u32 i = 0; i < kRefineIterations; ++i)
+		{
+			const f32 kS2 = s * s;
+			const f32 kS3 = kS2 * s;
+			const f32 kValue = (2.0f * kS3 - 3.0f * kS2 + 1.0f) * kBefore + (kS3 - 2.0f * kS2 + s) * kSlope0
+				+ (-2.0f * kS3 + 3.0f * kS2) * kAfter + (kS3 - kS2) * kSlope1;
+			const f32 kDerivative = (6.0f * kS2 - 6.0f * s) * (kBefore - kAfter) + (3.0f * kS2 - 4.0f * s + 1.0f) * kSlope0
+				+ (3.0f * kS2 - 2.0f * s) * kSlope1;
+			if (std::fabs(kValue) <= kTolerance)
+			{
+				break;
+			}
+
+			// Keep a bracket, and bisect whenever Newton would leave it
+			if ((kValue < 0.0f) == (kBefore < 0.0f))
+			{
+				lo = s;
+			}
+			else
+			{
+				hi = s;
+			}
+			const f32 kNewton = kDerivative != 0.0f ? s - kValue / kDerivative : -1.0f;
+			s = (kNewton >= lo && kNewton <= hi) ? kNewton : 0.5f * (lo + hi);
+		}
+
+		const f32 kS2 = s * s;
+		const f32 kS3 = kS2 * s;
+		const f32 kH00 = 2.0f * kS3 - 3.0f * kS2 + 1.0f;
+		const f32 kH10 = kS3 - 2.0f * kS2 + s;
+		const f32 kH01 = -2.0f * kS3 + 3.0f * kS2;
+		const f32 kH11 = kS3 - kS2;
+		rPoint = Float3{
+			kH00 * p0.x + kH10 * f0.x + kH01 * p1.x + kH11 * f1.x,
+			kH00 * p0.y + kH10 * f0.y + kH01 * p1.y + kH11 * f1.y,
+			kH00 * p0.z + kH10 * f0.z + kH01 * p1.z + kH11 * f1.z };
+		return s;
+	}
+}
+
+const char* section_direction_name(const SectionDirection::SectionDirectionEnum kDirection)
+{
+	static const char* const s_names[SectionDirection::kNumDirections] = { "both", "up", "down" };
+	return (kDirection >= 0 && kDirection < SectionDirection::kNumDirections) ? s_names[kDirection] : "unknown";
+}
+
+bool parse_section_direction(const char* pName, SectionDirection::SectionDirectionEnum& rDirection)
+{
+	for (int direction = 0; direction < SectionDirection::kNumDirections; ++direction)
+	{
+		if (std::strcmp(pName, section_direction_name(static_cast<SectionDirection::SectionDirectionEnum>(direction))) == 0)
+		{
+			rDirection = static_cast<SectionDirection::SectionDirectionEnum>(direction);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool parse_section_normal(const char* pValue, Float3& rNormal)
+{
+	Float3 normal;
+	if (std::sscanf(pValue, "%f,%f,%f", &normal.x, &normal.y, &normal.z) != 3)
+	{
+		return false;
+	}
+	const f32 kLength = std::sqrt(dot(normal, normal));
+	if (!(kLength > 0.0f))
+	{
+		return false;
+	}
+	rNormal = scaled(normal, 1.0f / kLength);
+	return true;
+}
+
+bool write_section_csv_header(std::FILE* pFile)
+{
+	return std::fprintf(pFile, "time,x,y,z,particle\n") > 0;
+}
+
+bool write_section_csv(std::FILE* pFile, const SectionHit* pHits, const u32 kCount)
+{
+	for (u32 i = 0; i < kCount; ++i)
+	{
+		const SectionHit& hit = pHits[i];
+		if (std::fprintf(pFile, "%.17g,%.9g,%.9g,%.9g,%u\n", hit.m_time, hit.m_position.x, hit.m_position.y, hit.m_position.z, hit.m_particle) < 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool write_section_binary_header(std::FILE* pFile, const SectionPlane& plane)
+{
+	SectionFileHeader header;
+	std::memcpy(header.m_magic, "LZPS", 4);
+	header.m_version = kSectionFileVersion;
+	header.m_recordSize = kSectionRecordSize;
+	header.m_normal = plane.m_normal;
+	header.m_offset = plane.m_offset;
+	header.m_offsetFromRho = plane.m_offsetFromRho ? 1u : 0u;
+	header.m_direction = static_cast<u32>(plane.m_direction);
+
+	u8 bytes[kSectionHeaderSize];
+	std::memcpy(bytes, header.m_magic, 4);
+	u8* pOut = put_u32(put_u32(bytes + 4, header.m_version), header.m_recordSize);
+	pOut = put_f32(put_float3(pOut, header.m_normal), header.m_offset);
+	pOut = put_u32(put_u32(pOut, header.m_offsetFromRho), header.m_direction);
+	assert(pOut == bytes + kSectionHeaderSize);
+	return std::fwrite(bytes, sizeof(bytes), 1, pFile) == 1;
+}
+
+bool write_section_binary(std::FILE* pFile, const SectionHit* pHits, const u32 kCount)
+{
+	u8 bytes[kSectionRecordsPerWrite * kSectionRecordSize];
+	for (u32 first = 0; first < kCount; first += kSectionRecordsPerWrite)
+	{
+		const u32 kBatch = std::min(kCount - first, kSectionRecordsPerWrite);
+		u8* pOut = bytes;
+		for (u32 i = first; i < first + kBatch; ++i)
+		{
+			pOut = put_u32(put_float3(put_f64(pOut, pHits[i].m_time), pHits[i].m_position), pHits[i].m_particle);
+		}
+		assert(pOut == bytes + kBatch * kSectionRecordSize);
+		if (std::fwrite(bytes, kSectionRecordSize, kBatch, pFile) != kBatch)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+PoincareSection::PoincareSection(const SectionPlane& plane) :
+	m_plane(plane),
+	m_mergedCount(0)
+{}
+
+void PoincareSection::before_step(const u32 kFirst, const ParticleStreamRange& range)
+{
+	(void)kFirst;
+	m_buffers.local().m_previous.save(range);
+}
+
+void PoincareSection::after_step(const u32 kFirst, const ParticleStreamRange& range, const LorenzParameters& params,
+	const f64 kTime, const f32 kDeltaTime)
+{
+	ThreadBuffer& buffer = m_buffers.local();
+	const StepSnapshot& kPrevious = buffer.m_previous;
+
+	const Float3 kNormal = m_plane.m_normal;
+	const f32 kOffset = m_plane.m_offset + (m_plane.m_offsetFromRho ? params.m_rho - 1.0f : 0.0f);
+	const u32 kUpwardMask = m_plane.m_direction != SectionDirection::kDownward ? 1u : 0u;
+	const u32 kDownwardMask = m_plane.m_direction != SectionDirection::kUpward ? 1u : 0u;
+
+	// Crossings are rare (a few per particle per simulated second)
+	scan_step_events(kPrevious, range,
+		[kNormal, kOffset](const f32 kX, const f32 kY, const f32 kZ) { return kNormal.x * kX + kNormal.y * kY + kNormal.z * kZ - kOffset; },
+		[kUpwardMask, kDownwardMask](const f32 kBefore, const f32 kAfter) { return crossed(kBefore, kAfter, kUpwardMask, kDownwardMask); },
+		[&](const u32 i, const f32 kBefore, const f32 kAfter) {
+			const Float3 kOld = { kPrevious.x()[i], kPrevious.y()[i], kPrevious.z()[i] };
+			const Float3 kNew = { range.m_pPosX[i], range.m_pPosY[i], range.m_pPosZ[i] };
+			SectionHit hit;
+			const f32 kFraction = refine_crossing(kOld, kNew, scaled(lorenz_derivative(kOld, params), kDeltaTime),
+				scaled(lorenz_derivative(kNew, params), kDeltaTime), kNormal, kBefore, kAfter, hit.m_position);
+			hit.m_time = kTime + static_cast<f64>(kFraction) * kDeltaTime;
+			hit.m_particle = kFirst + i;
+			buffer.m_hits.push_back(hit);
+		});
+}
+
+bool PoincareSection::flush(std::FILE* pFile, const bool kBinary)
+{
+	bool written = true;
+	m_buffers.forEach([this, pFile, kBinary, &written](ThreadBuffer& buffer) {
+		const u32 kCount = static_cast<u32>(buffer.m_hits.size());
+		if (written && kCount > 0)
+		{
+			written = kBinary ? write_section_binary(pFile, buffer.m_hits.data(), kCount) : write_section_csv(pFile, buffer.m_hits.data(), kCount);
+		}
+		m_mergedCount += kCount;
+		buffer.m_hits.clear();
+	});
+	return written;
+}
+
+void PoincareSection::drain(std::vector<SectionHit>& rHits)
+{
+	m_buffers.forEach([this, &rHits](ThreadBuffer& buffer) {
+		rHits.insert(rHits.end(), buffer.m_hits.begin(), buffer.m_hits.end());
+		m_mergedCount += buffer.m_hits.size();
+		buffer.m_hits.clear();
+	});
+}
+
+u64 PoincareSection::buffered_count() const
+{
+	u64 count = 0;
+	m_buffers.forEach([&count](const ThreadBuffer& buffer) { count += buffer.m_hits.size(); });
+	return count;
+}
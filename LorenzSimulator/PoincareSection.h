@@ -0,0 +1,154 @@
+#pragma once
+
+//================================================================================
+// PoincareSection
+// Streams the crossings of particles with a plane while LorenzSimulator
+// steps them, so a Poincare section of millions of particles needs no stored
+// trajectories: memory is bounded by the hits found between two flushes.
+//
+// As a LorenzStepObserver it copies each range's positions before the step
+// and compares their signed distances to the plane with those after it. A
+// sign change is a crossing. Its point is refined on the cubic Hermite curve
+// through both positions and their Lorenz derivatives, which follows the
+// trajectory to third order in the step, with a few Newton iterations
+// kept inside the step and started from the linear interpolation.
+//
+// Hits go to a buffer owned by the stepping thread (see PerThread), so
+// stepping threads never lock or share a buffer. Between steps flush() or
+// drain() merges every buffer into a file or an array and empties them.
+//
+// Within a buffer a particle's hits are in time order, but buffers are
+// merged one after another, so sort by m_time when order matters. Particle
+// indices are pool slots, which compact() reassigns. Particles respawned by
+// recycle() move between steps, so they never produce a false crossing.
+//
+// Files are a SectionFileHeader followed by SectionHit records up to the end
+// of the file, or CSV. Both are written field by field in declaration order,
+// little-endian with no padding, so the file does not depend on the host's
+// byte order or struct layout.
+//================================================================================
+
+#include "LorenzSimulator.h"
+
+#include "PerThread.h"
+#include "StepScan.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace SectionDirection
+{
+	// Crossings to keep, relative to the plane normal.
+	enum SectionDirectionEnum
+	{
+		kBoth,
+		kUpward,
+		kDownward,
+		kNumDirections
+	};
+}
+
+// Short lower case name ("both", "up", "down").
+const char* section_direction_name(const SectionDirection::SectionDirectionEnum kDirection);
+
+// Look up a direction by name. Returns false if the name is unknown.
+bool parse_section_direction(const char* pName, SectionDirection::SectionDirectionEnum& rDirection);
+
+// Parse "X,Y,Z" into a unit normal. Returns false if malformed or zero.
+bool parse_section_normal(const char* pValue, Float3& rNormal);
+
+// The plane dot(m_normal, p) = m_offset, where m_offset is relative to
+// rho - 1 of the particle's parameters if m_offsetFromRho is set. The
+// default is z = rho - 1, the height of the nontrivial fixed points.
+struct SectionPlane
+{
+	Float3 m_normal = Float3{ 0.0f, 0.0f, 1.0f };
+	f32 m_offset = 0.0f;
+	bool m_offsetFromRho = true;
+	SectionDirection::SectionDirectionEnum m_direction = SectionDirection::kBoth;
+};
+
+// One crossing. Also the binary record: write_section_binary() writes these
+// fields, so update it, and the file version, with them.
+struct SectionHit
+{
+	// Simulated time of the crossing (see LorenzSimulator::time()).
+	f64 m_time;
+	Float3 m_position;
+	u32 m_particle;
+};
+
+// Bytes per binary record.
+constexpr u32 kSectionRecordSize = 24;
+
+static_assert(sizeof(SectionHit) == kSectionRecordSize, "SectionHit is the binary record; update the file version if it changes");
+
+// Binary file header: the plane, with m_offsetFromRho as a u32 of 0 or 1 and
+// the direction as a u32 (see SectionDirection::SectionDirectionEnum).
+struct SectionFileHeader
+{
+	char m_magic[4];
+	u32 m_version;
+	u32 m_recordSize;
+	Float3 m_normal;
+	f32 m_offset;
+	u32 m_offsetFromRho;
+	u32 m_direction;
+};
+
+// Bytes of the binary header.
+constexpr u32 kSectionHeaderSize = 36;
+
+constexpr u32 kSectionFileVersion = 1;
+
+// Write a header, or kCount hits, to an open file. Returns false on a write
+// error.
+bool write_section_csv_header(std::FILE* pFile);
+bool write_section_csv(std::FILE* pFile, const SectionHit* pHits, const u32 kCount);
+bool write_section_binary_header(std::FILE* pFile, const SectionPlane& plane);
+bool write_section_binary(std::FILE* pFile, const SectionHit* pHits, const u32 kCount);
+
+// ========================================================
+// class PoincareSection
+// Attach with LorenzSimulator::set_step_observer(). One section may observe
+// any number of simulators, provided their particle indices are told apart
+// by the caller.
+// ========================================================
+
+class PoincareSection final : public LorenzStepObserver
+{
+public:
+	explicit PoincareSection(const SectionPlane& plane = SectionPlane());
+
+	// Only between steps.
+	void set_plane(const SectionPlane& plane) { m_plane = plane; }
+	const SectionPlane& plane() const { return m_plane; }
+
+	// LorenzStepObserver.
+	void before_step(const u32 kFirst, const ParticleStreamRange& range) override;
+	void after_step(const u32 kFirst, const ParticleStreamRange& range, const LorenzParameters& params,
+		const f64 kTime, const f32 kDeltaTime) override;
+
+	// Write every buffered hit to pFile as binary records or CSV rows, and
+	// empty the buffers. Only between steps. Returns false on a write error;
+	// the hits are dropped either way.
+	bool flush(std::FILE* pFile, const bool kBinary);
+
+	// Append every buffered hit to rHits and empty the buffers. Only between steps.
+	void drain(std::vector<SectionHit>& rHits);
+
+	// Hits buffered now, and hits flushed or drained so far.
+	u64 buffered_count() const;
+	u64 merged_count() const { return m_mergedCount; }
+
+private:
+	struct ThreadBuffer
+	{
+		StepSnapshot m_previous;
+		std::vector<SectionHit> m_hits;
+	};
+
+	SectionPlane m_plane;
+	PerThread<ThreadBuffer> m_buffers;
+	u64 m_mergedCount;
+};
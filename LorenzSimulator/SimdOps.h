@@ -0,0 +1,246 @@
+#pragma once
+
+//================================================================================
+// Thin wrappers over SIMD intrinsics used to write each kernel once as a
+// template. Every wrapper exposes:
+//   Vec, kWidth, load, store, set1, add, sub, mul, fmadd (a*b + c),
+//   div, min, max, abs, sqrt
+// and per-lane masks for the adaptive kernels:
+//   Mask, cmp_gt (a > b), select (m ? a : b), any
+// and 32-bit integer lanes for the compact particle kernels:
+//   IVec, to_int (round to nearest), to_float, iset1, ior, iand,
+//   shift_left<N>, shift_right<N> (logical), and store_pairs / load_pairs,
+//   which interleave two IVecs as a0 b0 a1 b1 ... in memory and back
+//
+// The wrappers live in an anonymous namespace on purpose: kernel translation
+// units are compiled with different instruction set flags, and internal
+// linkage stops the linker from merging e.g. an AVX-encoded copy of SseOps
+// into a translation unit meant to run on SSE-only machines. That only
+// covers the wrappers themselves, so they call builtins and intrinsics, never
+// std::fabs, std::sqrt or std::nearbyint: those have external linkage, and a
+// build that does not inline them emits a weak copy in every kernel
+// translation unit and links whichever it finds first. The build rejects
+// weak symbols in the kernel objects (cmake/CheckKernelSymbols.cmake).
+//================================================================================
+
+#include "CoreTypes.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <immintrin.h>
+	#define LORENZ_HAS_SSE 1
+#endif
+
+namespace
+{
+	struct ScalarOps
+	{
+		using Vec = f32;
+		static constexpr u32 kWidth = 1;
+
+		static Vec load(const f32* p) { return *p; }
+		static void store(f32* p, Vec v) { *p = v; }
+		static Vec set1(f32 f) { return f; }
+		static Vec add(Vec a, Vec b) { return a + b; }
+		static Vec sub(Vec a, Vec b) { return a - b; }
+		static Vec mul(Vec a, Vec b) { return a * b; }
+		static Vec fmadd(Vec a, Vec b, Vec c) { return a * b + c; }
+		static Vec div(Vec a, Vec b) { return a / b; }
+		static Vec min(Vec a, Vec b) { return a < b ? a : b; }
+		static Vec max(Vec a, Vec b) { return a > b ? a : b; }
+#if defined(__GNUC__)
+		static Vec abs(Vec a) { return __builtin_fabsf(a); }
+		static Vec sqrt(Vec a) { return __builtin_sqrtf(a); }
+#elif defined(LORENZ_HAS_SSE)
+		static Vec abs(Vec a) { return _mm_cvtss_f32(_mm_andnot_ps(_mm_set_ss(-0.0f), _mm_set_ss(a))); }
+		static Vec sqrt(Vec a) { return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(a))); }
+#else
+		static Vec abs(Vec a) { return std::fabs(a); }
+		static Vec sqrt(Vec a) { return std::sqrt(a); }
+#endif
+
+		using Mask = bool;
+		static Mask cmp_gt(Vec a, Vec b) { return a > b; }
+		static Vec select(Mask m, Vec a, Vec b) { return m ? a : b; }
+		static bool any(Mask m) { return m; }
+
+		// Rounds half to even, as cvtps_epi32 does in the default rounding mode
+		using IVec = u32;
+#if defined(__GNUC__)
+		static IVec to_int(Vec a) { return static_cast<u32>(static_cast<s32>(__builtin_nearbyintf(a))); }
+#elif defined(LORENZ_HAS_SSE)
+		static IVec to_int(Vec a) { return static_cast<u32>(_mm_cvtss_si32(_mm_set_ss(a))); }
+#else
+		static IVec to_int(Vec a) { return static_cast<u32>(static_cast<s32>(std::nearbyint(a))); }
+#endif
+		static Vec to_float(IVec a) { return static_cast<f32>(static_cast<s32>(a)); }
+		static IVec iset1(u32 i) { return i; }
+		static IVec ior(IVec a, IVec b) { return a | b; }
+		static IVec iand(IVec a, IVec b) { return a & b; }
+		template<int N> static IVec shift_left(IVec a) { return a << N; }
+		template<int N> static IVec shift_right(IVec a) { return a >> N; }
+		static void store_pairs(u32* p, IVec a, IVec b) { const u32 pair[2] = { a, b }; std::memcpy(p, pair, sizeof(pair)); }
+		static void load_pairs(const u32* p, IVec& a, IVec& b) { u32 pair[2]; std::memcpy(pair, p, sizeof(pair)); a = pair[0]; b = pair[1]; }
+	};
+
+#if defined(LORENZ_HAS_SSE)
+	struct SseOps
+	{
+		using Vec = __m128;
+		static constexpr u32 kWidth = 4;
+
+		static Vec load(const f32* p) { return _mm_loadu_ps(p); }
+		static void store(f32* p, Vec v) { _mm_storeu_ps(p, v); }
+		static Vec set1(f32 f) { return _mm_set1_ps(f); }
+		static Vec add(Vec a, Vec b) { return _mm_add_ps(a, b); }
+		static Vec sub(Vec a, Vec b) { return _mm_sub_ps(a, b); }
+		static Vec mul(Vec a, Vec b) { return _mm_mul_ps(a, b); }
+		static Vec fmadd(Vec a, Vec b, Vec c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+		static Vec div(Vec a, Vec b) { return _mm_div_ps(a, b); }
+		static Vec min(Vec a, Vec b) { return _mm_min_ps(a, b); }
+		static Vec max(Vec a, Vec b) { return _mm_max_ps(a, b); }
+		static Vec abs(Vec a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+		static Vec sqrt(Vec a) { return _mm_sqrt_ps(a); }
+
+		// SSE2 only, so this wrapper stays usable outside the SSE4.1 translation unit
+		using Mask = __m128;
+		static Mask cmp_gt(Vec a, Vec b) { return _mm_cmpgt_ps(a, b); }
+		static Vec select(Mask m, Vec a, Vec b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+		static bool any(Mask m) { return _mm_movemask_ps(m) != 0; }
+
+		using IVec = __m128i;
+		static IVec to_int(Vec a) { return _mm_cvtps_epi32(a); }
+		static Vec to_float(IVec a) { return _mm_cvtepi32_ps(a); }
+		static IVec iset1(u32 i) { return _mm_set1_epi32(static_cast<int>(i)); }
+		static IVec ior(IVec a, IVec b) { return _mm_or_si128(a, b); }
+		static IVec iand(IVec a, IVec b) { return _mm_and_si128(a, b); }
+		template<int N> static IVec shift_left(IVec a) { return _mm_slli_epi32(a, N); }
+		template<int N> static IVec shift_right(IVec a) { return _mm_srli_epi32(a, N); }
+		static void store_pairs(u32* p, IVec a, IVec b)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_unpacklo_epi32(a, b));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p + 4), _mm_unpackhi_epi32(a, b));
+		}
+		static void load_pairs(const u32* p, IVec& a, IVec& b)
+		{
+			// a0 b0 a1 b1 -> a0 a1 b0 b1
+			const IVec kLow = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), _MM_SHUFFLE(3, 1, 2, 0));
+			const IVec kHigh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 4)), _MM_SHUFFLE(3, 1, 2, 0));
+			a = _mm_unpacklo_epi64(kLow, kHigh);
+			b = _mm_unpackhi_epi64(kLow, kHigh);
+		}
+	};
+#endif
+
+#if defined(__AVX2__)
+	struct Avx2Ops
+	{
+		using Vec = __m256;
+		static constexpr u32 kWidth = 8;
+
+		static Vec load(const f32* p) { return _mm256_loadu_ps(p); }
+		static void store(f32* p, Vec v) { _mm256_storeu_ps(p, v); }
+		static Vec set1(f32 f) { return _mm256_set1_ps(f); }
+		static Vec add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+		static Vec sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+		static Vec mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+	#if defined(__FMA__)
+		static Vec fmadd(Vec a, Vec b, Vec c) { return _mm256_fmadd_ps(a, b, c); }
+	#else
+		static Vec fmadd(Vec a, Vec b, Vec c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+	#endif
+		static Vec div(Vec a, Vec b) { return _mm256_div_ps(a, b); }
+		static Vec min(Vec a, Vec b) { return _mm256_min_ps(a, b); }
+		static Vec max(Vec a, Vec b) { return _mm256_max_ps(a, b); }
+		static Vec abs(Vec a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+		static Vec sqrt(Vec a) { return _mm256_sqrt_ps(a); }
+
+		using Mask = __m256;
+		static Mask cmp_gt(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+		static Vec select(Mask m, Vec a, Vec b) { return _mm256_blendv_ps(b, a, m); }
+		static bool any(Mask m) { return _mm256_movemask_ps(m) != 0; }
+
+		using IVec = __m256i;
+		static IVec to_int(Vec a) { return _mm256_cvtps_epi32(a); }
+		static Vec to_float(IVec a) { return _mm256_cvtepi32_ps(a); }
+		static IVec iset1(u32 i) { return _mm256_set1_epi32(static_cast<int>(i)); }
+		static IVec ior(IVec a, IVec b) { return _mm256_or_si256(a, b); }
+		static IVec iand(IVec a, IVec b) { return _mm256_and_si256(a, b); }
+		template<int N> static IVec shift_left(IVec a) { return _mm256_slli_epi32(a, N); }
+		template<int N> static IVec shift_right(IVec a) { return _mm256_srli_epi32(a, N); }
+		static void store_pairs(u32* p, IVec a, IVec b)
+		{
+			// Unpacks work within 128-bit lanes, so put the halves back in order
+			const IVec kLow = _mm256_unpacklo_epi32(a, b);
+			const IVec kHigh = _mm256_unpackhi_epi32(a, b);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm256_permute2x128_si256(kLow, kHigh, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(p + 8), _mm256_permute2x128_si256(kLow, kHigh, 0x31));
+		}
+		static void load_pairs(const u32* p, IVec& a, IVec& b)
+		{
+			// a0 b0 .. a3 b3 -> a0 .. a3 b0 .. b3
+			const IVec kOrder = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+			const IVec kLow = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), kOrder);
+			const IVec kHigh = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 8)), kOrder);
+			a = _mm256_permute2x128_si256(kLow, kHigh, 0x20);
+			b = _mm256_permute2x128_si256(kLow, kHigh, 0x31);
+		}
+	};
+#endif
+
+#if defined(__AVX512F__)
+	struct Avx512Ops
+	{
+		using Vec = __m512;
+		static constexpr u32 kWidth = 16;
+
+		static Vec load(const f32* p) { return _mm512_loadu_ps(p); }
+		static void store(f32* p, Vec v) { _mm512_storeu_ps(p, v); }
+		static Vec set1(f32 f) { return _mm512_set1_ps(f); }
+		static Vec add(Vec a, Vec b) { return _mm512_add_ps(a, b); }
+		static Vec sub(Vec a, Vec b) { return _mm512_sub_ps(a, b); }
+		static Vec mul(Vec a, Vec b) { return _mm512_mul_ps(a, b); }
+		static Vec fmadd(Vec a, Vec b, Vec c) { return _mm512_fmadd_ps(a, b, c); }
+		static Vec div(Vec a, Vec b) { return _mm512_div_ps(a, b); }
+		// Full-mask forms: GCC 12 warns about the undefined pass-through the
+		// unmasked min/max/sqrt intrinsics use internally
+		static Vec min(Vec a, Vec b) { return _mm512_mask_min_ps(a, 0xFFFF, a, b); }
+		static Vec max(Vec a, Vec b) { return _mm512_mask_max_ps(a, 0xFFFF, a, b); }
+		static Vec abs(Vec a) { return _mm512_abs_ps(a); }
+		static Vec sqrt(Vec a) { return _mm512_mask_sqrt_ps(a, 0xFFFF, a); }
+
+		using Mask = __mmask16;
+		static Mask cmp_gt(Vec a, Vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+		static Vec select(Mask m, Vec a, Vec b) { return _mm512_mask_blend_ps(m, b, a); }
+		static bool any(Mask m) { return m != 0; }
+
+		// Full-mask forms again, for the same GCC 12 warning
+		using IVec = __m512i;
+		static IVec to_int(Vec a) { return _mm512_mask_cvtps_epi32(_mm512_castps_si512(a), 0xFFFF, a); }
+		static Vec to_float(IVec a) { return _mm512_mask_cvtepi32_ps(_mm512_castsi512_ps(a), 0xFFFF, a); }
+		static IVec iset1(u32 i) { return _mm512_set1_epi32(static_cast<int>(i)); }
+		static IVec ior(IVec a, IVec b) { return _mm512_or_si512(a, b); }
+		static IVec iand(IVec a, IVec b) { return _mm512_and_si512(a, b); }
+		template<int N> static IVec shift_left(IVec a) { return _mm512_mask_slli_epi32(a, 0xFFFF, a, N); }
+		template<int N> static IVec shift_right(IVec a) { return _mm512_mask_srli_epi32(a, 0xFFFF, a, N); }
+		static void store_pairs(u32* p, IVec a, IVec b)
+		{
+			const IVec kLow = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+			const IVec kHigh = _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+			_mm512_storeu_si512(p, _mm512_permutex2var_epi32(a, kLow, b));
+			_mm512_storeu_si512(p + 16, _mm512_permutex2var_epi32(a, kHigh, b));
+		}
+		static void load_pairs(const u32* p, IVec& a, IVec& b)
+		{
+			const IVec kEven = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+			const IVec kOdd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+			const IVec kLow = _mm512_loadu_si512(p);
+			const IVec kHigh = _mm512_loadu_si512(p + 16);
+			a = _mm512_permutex2var_epi32(kLow, kEven, kHigh);
+			b = _mm512_permutex2var_epi32(kLow, kOdd, kHigh);
+		}
+	};
+#endif
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+//================================================================================
+// StepScan
+// Shared by the step observers that look for events within a step, such as
+// plane crossings (PoincareSection) or maxima of z (BifurcationDiagram).
+// before_step() saves the range's positions in a StepSnapshot, and
+// after_step() hands both ends of the step to scan_step_events(), which
+// evaluates a scalar at each end and reports the particles where the pair
+// marks an event.
+//================================================================================
+
+#include "LorenzSimulator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+// Particles checked for an event at once, in a branch-free pass the compiler
+// vectorizes; only blocks with one are scanned again particle by particle.
+// With around 1% of particles crossing a plane per step, 16 measured
+// fastest: at 256 nearly every block had a crossing.
+constexpr u32 kStepScanBlock = 16;
+
+// Positions of the range being stepped, saved before the step.
+class StepSnapshot
+{
+public:
+	void save(const ParticleStreamRange& range)
+	{
+		m_count = range.m_count;
+		if (m_positions.size() < 3 * static_cast<size_t>(m_count))
+		{
+			m_positions.resize(3 * static_cast<size_t>(m_count));
+		}
+		std::memcpy(m_positions.data(), range.m_pPosX, m_count * sizeof(f32));
+		std::memcpy(m_positions.data() + m_count, range.m_pPosY, m_count * sizeof(f32));
+		std::memcpy(m_positions.data() + 2 * static_cast<size_t>(m_count), range.m_pPosZ, m_count * sizeof(f32));
+	}
+
+	u32 count() const { return m_count; }
+	const f32* x() const { return m_positions.data(); }
+	const f32* y() const { return m_positions.data() + m_count; }
+	const f32* z() const { return m_positions.data() + 2 * static_cast<size_t>(m_count); }
+
+private:
+	// x then y then z
+	std::vector<f32> m_positions;
+	u32 m_count = 0;
+};
+
+// For every particle i of range, evaluate kBefore = value(x, y, z) at its
+// saved position and kAfter at its position now, and call
+// onEvent(i, kBefore, kAfter) where isEvent(kBefore, kAfter) is nonzero.
+// isEvent returns a u32 of 0 or 1 without branching, so the first pass over
+// a block vectorizes; it should be 0 for NaN so dead particles never count.
+template<typename ValueFn, typename EventFn, typename OnEventFn>
+void scan_step_events(const StepSnapshot& before, const ParticleStreamRange& range, const ValueFn& value, const EventFn& isEvent,
+	const OnEventFn& onEvent)
+{
+	const u32 kCount = range.m_count;
+	assert(before.count() == kCount);
+	const f32* pOldX = before.x();
+	const f32* pOldY = before.y();
+	const f32* pOldZ = before.z();
+
+	// Events are rare, so most blocks cost one vectorized pass
+	for (u32 block = 0; block < kCount; block += kStepScanBlock)
+	{
+		const u32 kBlockEnd = std::min(block + kStepScanBlock, kCount);
+		u32 any = 0;
+		for (u32 i = block; i < kBlockEnd; ++i)
+		{
+			any |= isEvent(value(pOldX[i], pOldY[i], pOldZ[i]), value(range.m_pPosX[i], range.m_pPosY[i], range.m_pPosZ[i]));
+		}
+		if (!any)
+		{
+			continue;
+		}
+
+		for (u32 i = block; i < kBlockEnd; ++i)
+		{
+			const f32 kBefore = value(pOldX[i], pOldY[i], pOldZ[i]);
+			const f32 kAfter = value(range.m_pPosX[i], range.m_pPosY[i], range.m_pPosZ[i]);
+			if (isEvent(kBefore, kAfter))
+			{
+				onEvent(i, kBefore, kAfter);
+			}
+		}
+	}
+}
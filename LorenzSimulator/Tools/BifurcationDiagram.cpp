@@ -0,0 +1,260 @@
+//================================================================================
+// BifurcationDiagram
+// Renders a bifurcation diagram of the Lorenz system to a PGM image, one
+// column per parameter value (see BifurcationDiagram.h).
+//
+// Usage: BifurcationDiagram [--parameter sigma|rho|beta] [--axis MIN:MAX:N]
+//                           [--sigma S] [--rho R] [--beta B] [--classic]
+//                           [--quantity zmax|section] [--normal X,Y,Z] [--offset C]
+//                           [--absolute] [--direction both|up|down] [--coordinate x|y|z]
+//                           [--ensemble E] [--dt SECONDS] [--integrator euler|rk4|dopri]
+//                           [--transient STEPS] [--steps STEPS] [--height H]
+//                           [--range MIN:MAX] [--batch VALUES] [--seed S] [--threads T]
+//                           [--out FILE] [--counts FILE] [--global]
+//
+// The default is the classic diagram of z maxima over rho in [1, 200], 2000 x
+// 1000 pixels, with the other parameters at the app's values; --classic
+// fixes them at (10, 28, 8/3) instead. The value range is fitted by a pilot
+// run unless --range is given. Columns are normalized one by one unless
+// --global is given. --counts also writes the raw counts for other tools.
+//
+// Example, the section x values at z = 27 over sigma:
+//   BifurcationDiagram --parameter sigma --axis 5:30:1000 --quantity section
+//                      --offset 27 --absolute --direction down --out sigma.pgm
+//================================================================================
+
+#include "BifurcationDiagram.h"
+
+#include "JobQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	struct Options
+	{
+		BifurcationSettings m_settings;
+		u32 m_batch = 0;
+		u32 m_threads = 0;
+		const char* m_pOut = "bifurcation.pgm";
+		const char* m_pCounts = nullptr;
+		bool m_perColumn = true;
+	};
+
+	void print_usage()
+	{
+		std::printf("Usage: BifurcationDiagram [--parameter sigma|rho|beta] [--axis MIN:MAX:N]\n"
+			"                          [--sigma S] [--rho R] [--beta B] [--classic]\n"
+			"                          [--quantity zmax|section] [--normal X,Y,Z] [--offset C]\n"
+			"                          [--absolute] [--direction both|up|down] [--coordinate x|y|z]\n"
+			"                          [--ensemble E] [--dt SECONDS] [--integrator euler|rk4|dopri]\n"
+			"                          [--transient STEPS] [--steps STEPS] [--height H]\n"
+			"                          [--range MIN:MAX] [--batch VALUES] [--seed S] [--threads T]\n"
+			"                          [--out FILE] [--counts FILE] [--global]\n");
+	}
+
+	bool parse_range(const char* pValue, f32& rMin, f32& rMax)
+	{
+		char* pEnd = nullptr;
+		rMin = std::strtof(pValue, &pEnd);
+		if (*pEnd != ':')
+		{
+			return false;
+		}
+		rMax = std::strtof(pEnd + 1, &pEnd);
+		return *pEnd == '\0' && rMin < rMax;
+	}
+
+	bool parse_coordinate(const char* pValue, u32& rCoordinate)
+	{
+		const char* const kNames[3] = { "x", "y", "z" };
+		for (u32 i = 0; i < 3; ++i)
+		{
+			if (std::strcmp(pValue, kNames[i]) == 0)
+			{
+				rCoordinate = i;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool parse_options(int argc, char** argv, Options& rOptions)
+	{
+		BifurcationSettings& rSettings = rOptions.m_settings;
+		for (int i = 1; i < argc; ++i)
+		{
+			const char* pArg = argv[i];
+			const char* pValue = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+			if (std::strcmp(pArg, "--help") == 0)
+			{
+				return false;
+			}
+			if (std::strcmp(pArg, "--classic") == 0)
+			{
+				rSettings.m_parameters = LorenzParameters{ 10.0f, 28.0f, 8.0f / 3.0f };
+				continue;
+			}
+			if (std::strcmp(pArg, "--absolute") == 0)
+			{
+				rSettings.m_plane.m_offsetFromRho = false;
+				continue;
+			}
+			if (std::strcmp(pArg, "--global") == 0)
+			{
+				rOptions.m_perColumn = false;
+				continue;
+			}
+			if (!pValue)
+			{
+				std::fprintf(stderr, "Missing value for %s\n", pArg);
+				return false;
+			}
+
+			bool valid = true;
+			if (std::strcmp(pArg, "--parameter") == 0)
+				valid = parse_bifurcation_parameter(pValue, rSettings.m_parameter);
+			else if (std::strcmp(pArg, "--axis") == 0)
+				valid = parse_sweep_axis(pValue, rSettings.m_axis);
+			else if (std::strcmp(pArg, "--sigma") == 0)
+				rSettings.m_parameters.m_sigma = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--rho") == 0)
+				rSettings.m_parameters.m_rho = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--beta") == 0)
+				rSettings.m_parameters.m_beta = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--quantity") == 0)
+				valid = parse_bifurcation_quantity(pValue, rSettings.m_quantity);
+			else if (std::strcmp(pArg, "--normal") == 0)
+				valid = parse_section_normal(pValue, rSettings.m_plane.m_normal);
+			else if (std::strcmp(pArg, "--offset") == 0)
+				rSettings.m_plane.m_offset = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--direction") == 0)
+				valid = parse_section_direction(pValue, rSettings.m_plane.m_direction);
+			else if (std::strcmp(pArg, "--coordinate") == 0)
+				valid = parse_coordinate(pValue, rSettings.m_sectionCoordinate);
+			else if (std::strcmp(pArg, "--ensemble") == 0)
+				rSettings.m_ensemble = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--dt") == 0)
+				rSettings.m_stepSize = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--integrator") == 0)
+				valid = parse_integrator(pValue, rSettings.m_integrator);
+			else if (std::strcmp(pArg, "--transient") == 0)
+				rSettings.m_transientSteps = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--steps") == 0)
+				rSettings.m_measureSteps = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--height") == 0)
+				rSettings.m_height = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--range") == 0)
+				valid = parse_range(pValue, rSettings.m_valueMin, rSettings.m_valueMax);
+			else if (std::strcmp(pArg, "--batch") == 0)
+				rOptions.m_batch = std::min(static_cast<u32>(std::strtoul(pValue, nullptr, 10)), kMaxParameterGroups);
+			else if (std::strcmp(pArg, "--seed") == 0)
+				rSettings.m_seed = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--threads") == 0)
+				rOptions.m_threads = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--out") == 0)
+				rOptions.m_pOut = pValue;
+			else if (std::strcmp(pArg, "--counts") == 0)
+				rOptions.m_pCounts = pValue;
+			else
+			{
+				std::fprintf(stderr, "Unknown option %s\n", pArg);
+				return false;
+			}
+
+			if (!valid)
+			{
+				std::fprintf(stderr, "Bad value for %s: %s\n", pArg, pValue);
+				return false;
+			}
+			++i;
+		}
+		return rSettings.m_ensemble > 0 && rSettings.m_height > 0 && rSettings.m_stepSize > 0.0f && rSettings.m_measureSteps > 0;
+	}
+
+	f64 seconds_since(const std::chrono::steady_clock::time_point& start)
+	{
+		return std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parse_options(argc, argv, options))
+	{
+		print_usage();
+		return 1;
+	}
+
+	JobQueue queue;
+	queue.launch(options.m_threads);
+
+	const BifurcationSettings& kSettings = options.m_settings;
+	const SweepAxis& kAxis = kSettings.m_axis;
+	const LorenzParameters& kParams = kSettings.m_parameters;
+	BifurcationDiagram diagram(kSettings, &queue);
+	const u32 kBatch = options.m_batch > 0 ? options.m_batch : diagram.default_batch();
+
+	std::fprintf(stderr, "%s over %s in [%g, %g], %u x %u pixels, sigma %g, rho %g, beta %g\n",
+		bifurcation_quantity_name(kSettings.m_quantity), bifurcation_parameter_name(kSettings.m_parameter), kAxis.m_min, kAxis.m_max,
+		kAxis.m_count, kSettings.m_height, kParams.m_sigma, kParams.m_rho, kParams.m_beta);
+	std::fprintf(stderr, "ensemble %u, %u + %u steps of %g s (%s), batches of %u values, %u threads, kernel: %s\n",
+		kSettings.m_ensemble, kSettings.m_transientSteps, kSettings.m_measureSteps, kSettings.m_stepSize,
+		integrator_name(kSettings.m_integrator), kBatch, queue.workerCount(), lorenz_kernels().m_pName);
+
+	const auto start = std::chrono::steady_clock::now();
+	if (!diagram.fit_range())
+	{
+		std::fprintf(stderr, "Cannot allocate the pilot run's particles\n");
+		return 1;
+	}
+	const BifurcationImage& kImage = diagram.image();
+	std::fprintf(stderr, "value range [%g, %g]%s, %.2f s\n", kImage.m_valueMin, kImage.m_valueMax,
+		kSettings.m_valueMin < kSettings.m_valueMax ? "" : " (fitted)", seconds_since(start));
+
+	for (u32 first = 0; first < kAxis.m_count; first += kBatch)
+	{
+		const u32 kCount = std::min(kBatch, kAxis.m_count - first);
+		if (!diagram.run_values(first, kCount))
+		{
+			std::fprintf(stderr, "Cannot allocate %llu particles\n", static_cast<unsigned long long>(kCount) * kSettings.m_ensemble);
+			return 1;
+		}
+
+		const f64 kSeconds = seconds_since(start);
+		std::fprintf(stderr, "%u / %u values, %.1f s, %.1f values/s\n", first + kCount, kAxis.m_count, kSeconds, (first + kCount) / kSeconds);
+	}
+
+	const f64 kSeconds = seconds_since(start);
+	const f64 kParticleSteps = static_cast<f64>(kAxis.m_count) * kSettings.m_ensemble * (kSettings.m_transientSteps + kSettings.m_measureSteps);
+	std::fprintf(stderr, "done: %.2f s (%.1f M particle-steps/s), %llu samples, %llu outside the range\n", kSeconds,
+		kParticleSteps / kSeconds * 1e-6, static_cast<unsigned long long>(kImage.m_samples), static_cast<unsigned long long>(kImage.m_outside));
+
+	std::FILE* pFile = std::fopen(options.m_pOut, "wb");
+	bool written = pFile && write_bifurcation_pgm(pFile, kImage, options.m_perColumn);
+	if (pFile && std::fclose(pFile) != 0)
+	{
+		written = false;
+	}
+	if (written && options.m_pCounts)
+	{
+		pFile = std::fopen(options.m_pCounts, "wb");
+		written = pFile && write_bifurcation_counts(pFile, kImage, kSettings);
+		if (pFile && std::fclose(pFile) != 0)
+		{
+			written = false;
+		}
+	}
+	if (!written)
+	{
+		std::fprintf(stderr, "Write failed\n");
+		return 1;
+	}
+	return 0;
+}
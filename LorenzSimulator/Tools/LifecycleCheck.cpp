@@ -0,0 +1,143 @@
+//================================================================================
+// LifecycleCheck
+// Checks that LorenzSimulator::recycle() respawns every expired particle
+// after calls that disturb the age order of its ring:
+//
+//  - regrow: shrink the live range, step, then grow it back, as the app's
+//    Particle Count slider does.
+//  - grow: grow() the pool and make the new particles live.
+//  - set-particles: load particles whose ages are far past the max age.
+//  - compact: kill scattered particles by making them non-finite and
+//    compact(), which swaps survivors from the tail into their slots.
+//  - respawn-on: let particles expire without respawn, compact() them away,
+//    then enable respawn.
+//
+// After each scenario the simulator steps on for a few max ages; after every
+// step no live particle may be older than the max age. Exits with 1 if one
+// is.
+//
+// Usage: LifecycleCheck [particles] [steps]
+//================================================================================
+
+#include "LorenzSimulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+	constexpr f32 kMaxAge = 1.0f;
+	constexpr f32 kDeltaTime = 1.0f / 60.0f;
+
+	LorenzLifecycle make_lifecycle()
+	{
+		LorenzLifecycle lifecycle;
+		lifecycle.m_maxAge = kMaxAge;
+		return lifecycle;
+	}
+
+	f32 max_live_age(const LorenzSimulator& simulator)
+	{
+		f32 oldest = 0.0f;
+		for (u32 i = 0; i < simulator.active_count(); ++i)
+		{
+			oldest = std::max(oldest, simulator.pool().at(ParticleStreams::kAge, i));
+		}
+		return oldest;
+	}
+
+	// Steps kSteps times and returns the oldest live particle seen after any step.
+	f32 step_and_track(LorenzSimulator& rSimulator, const u32 kSteps)
+	{
+		f32 oldest = 0.0f;
+		for (u32 i = 0; i < kSteps; ++i)
+		{
+			rSimulator.step(kDeltaTime);
+			oldest = std::max(oldest, max_live_age(rSimulator));
+		}
+		return oldest;
+	}
+
+	bool report(const char* pName, const f32 kOldest, const u32 kActive)
+	{
+		const bool kPassed = kOldest < kMaxAge;
+		std::printf("%-14s %9u live, oldest %.9g s of %g s  %s\n", pName, kActive, kOldest, kMaxAge, kPassed ? "ok" : "FAILED");
+		return kPassed;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const u32 kParticles = argc > 1 ? std::max(static_cast<u32>(std::strtoul(argv[1], nullptr, 10)), 2u) : 65536;
+	const u32 kSteps = argc > 2 ? static_cast<u32>(std::strtoul(argv[2], nullptr, 10)) : 200;
+
+	bool passed = true;
+	{
+		LorenzSimulator simulator;
+		simulator.set_lifecycle(make_lifecycle());
+		simulator.init(kParticles, 1);
+		simulator.set_active_count(kParticles / 2);
+		step_and_track(simulator, 50);
+		simulator.set_active_count(kParticles);
+		passed &= report("regrow", step_and_track(simulator, kSteps), simulator.active_count());
+	}
+	{
+		LorenzSimulator simulator;
+		simulator.set_lifecycle(make_lifecycle());
+		simulator.init(kParticles / 2, 1);
+		step_and_track(simulator, 50);
+		simulator.grow(kParticles, 1);
+		simulator.set_active_count(kParticles);
+		passed &= report("grow", step_and_track(simulator, kSteps), simulator.active_count());
+	}
+	{
+		LorenzSimulator simulator;
+		simulator.set_lifecycle(make_lifecycle());
+		simulator.init(kParticles, 1);
+		std::vector<LorenzParticle> particles(kParticles);
+		simulator.read_particles(particles.data());
+		for (u32 i = 0; i < kParticles; ++i)
+		{
+			particles[i].m_age = 5.0f * kMaxAge * static_cast<f32>((i * 7919u) % kParticles) / kParticles;
+		}
+		simulator.set_particles(particles.data(), kParticles);
+		passed &= report("set-particles", step_and_track(simulator, kSteps), simulator.active_count());
+	}
+	{
+		LorenzSimulator simulator;
+		simulator.set_lifecycle(make_lifecycle());
+		simulator.init(kParticles, 1);
+		step_and_track(simulator, 50);
+		for (u32 i = 0; i < kParticles; i += 7)
+		{
+			simulator.pool().at(ParticleStreams::kPosX, i) = NAN;
+		}
+		simulator.compact();
+		passed &= report("compact", step_and_track(simulator, kSteps), simulator.active_count());
+	}
+	{
+		LorenzLifecycle lifecycle = make_lifecycle();
+		lifecycle.m_respawn = false;
+		LorenzSimulator simulator;
+		simulator.set_lifecycle(lifecycle);
+		simulator.init(kParticles, 1);
+		for (u32 i = 0; i < 30; ++i)
+		{
+			simulator.step(kDeltaTime);
+			simulator.compact();
+		}
+		lifecycle.m_respawn = true;
+		simulator.set_lifecycle(lifecycle);
+		passed &= report("respawn-on", step_and_track(simulator, kSteps), simulator.active_count());
+	}
+
+	if (!passed)
+	{
+		std::printf("FAILED: particles outlived the max age\n");
+		return 1;
+	}
+	return 0;
+}
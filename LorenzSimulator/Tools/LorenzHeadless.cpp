@@ -0,0 +1,260 @@
+//================================================================================
+// LorenzHeadless
+// Command line driver for the CPU simulator. Steps particles without a GPU or
+// window and reports throughput, so it can run on render-farm nodes.
+//
+// Usage: LorenzHeadless [--particles N] [--steps K] [--dt SECONDS] [--seed S]
+//                       [--isa scalar|sse4|avx2|avx512] [--threads T] [--pipeline]
+//                       [--frame-time SECONDS] [--max-substeps M] [--budget-ms B]
+//                       [--integrator euler|rk4|dopri] [--tolerance TOL] [--max-age SECONDS]
+//                       [--no-respawn]
+//
+// --pipeline runs every step through the ParticleFramePipeline job graph
+// (integrate, bounds, sort, AoS upload) instead of a bare step.
+//
+// --frame-time turns each of the K steps into a frame of that length, run by
+// a FixedStepScheduler in substeps of --dt, and reports the dropped time.
+//
+// --no-respawn lets particles die at --max-age; they are compacted out of the
+// live range after each frame and the survivors are reported.
+//================================================================================
+
+#include "FixedStepScheduler.h"
+#include "LorenzKernels.h"
+#include "LorenzSimulator.h"
+#include "ParticleFramePipeline.h"
+
+#include "JobQueue.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	struct Options
+	{
+		u32 m_particles = 500000;
+		u32 m_steps = 100;
+		f32 m_deltaTime = 1.0f / 120.0f;
+		u32 m_seed = 1;
+		const char* m_pIsa = nullptr;
+		u32 m_threads = 0;
+		bool m_pipeline = false;
+		f32 m_frameTime = 0.0f;
+		u32 m_maxSubsteps = FixedStepSettings().m_maxSubsteps;
+		f32 m_budgetMs = 0.0f;
+		const char* m_pIntegrator = nullptr;
+		f32 m_tolerance = kDefaultIntegratorTolerance;
+		f32 m_maxAge = 0.0f;
+		bool m_respawn = true;
+	};
+
+	void print_usage()
+	{
+		std::printf("Usage: LorenzHeadless [--particles N] [--steps K] [--dt SECONDS] [--seed S]\n"
+			"                      [--isa scalar|sse4|avx2|avx512] [--threads T] [--pipeline]\n"
+			"                      [--frame-time SECONDS] [--max-substeps M] [--budget-ms B]\n"
+			"                      [--integrator euler|rk4|dopri] [--tolerance TOL] [--max-age SECONDS]\n"
+			"                      [--no-respawn]\n");
+	}
+
+	bool parse_options(int argc, char** argv, Options& rOptions)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const char* pArg = argv[i];
+			const char* pValue = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+			if (std::strcmp(pArg, "--help") == 0)
+			{
+				return false;
+			}
+			if (std::strcmp(pArg, "--pipeline") == 0)
+			{
+				rOptions.m_pipeline = true;
+				continue;
+			}
+			if (std::strcmp(pArg, "--no-respawn") == 0)
+			{
+				rOptions.m_respawn = false;
+				continue;
+			}
+			if (!pValue)
+			{
+				std::fprintf(stderr, "Missing value for %s\n", pArg);
+				return false;
+			}
+
+			if (std::strcmp(pArg, "--particles") == 0)
+				rOptions.m_particles = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--steps") == 0)
+				rOptions.m_steps = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--dt") == 0)
+				rOptions.m_deltaTime = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--seed") == 0)
+				rOptions.m_seed = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--isa") == 0)
+				rOptions.m_pIsa = pValue;
+			else if (std::strcmp(pArg, "--threads") == 0)
+				rOptions.m_threads = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--frame-time") == 0)
+				rOptions.m_frameTime = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--max-substeps") == 0)
+				rOptions.m_maxSubsteps = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--budget-ms") == 0)
+				rOptions.m_budgetMs = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--integrator") == 0)
+				rOptions.m_pIntegrator = pValue;
+			else if (std::strcmp(pArg, "--tolerance") == 0)
+				rOptions.m_tolerance = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--max-age") == 0)
+				rOptions.m_maxAge = std::strtof(pValue, nullptr);
+			else
+			{
+				std::fprintf(stderr, "Unknown option %s\n", pArg);
+				return false;
+			}
+			++i;
+		}
+		return true;
+	}
+
+	f64 seconds_since(const std::chrono::steady_clock::time_point& start)
+	{
+		return std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parse_options(argc, argv, options))
+	{
+		print_usage();
+		return 1;
+	}
+
+	if (options.m_pIsa)
+	{
+		SimdLevel::SimdLevelEnum level;
+		if (!parse_simd_level(options.m_pIsa, level) || !lorenz_force_kernels(level))
+		{
+			std::fprintf(stderr, "Instruction set '%s' is unknown or unsupported on this machine\n", options.m_pIsa);
+			return 1;
+		}
+	}
+
+	JobQueue jobQueue;
+	jobQueue.launch(options.m_threads);
+
+	LorenzSimulator simulator(&jobQueue);
+	if (options.m_pIntegrator)
+	{
+		Integrator::IntegratorEnum integrator;
+		if (!parse_integrator(options.m_pIntegrator, integrator))
+		{
+			std::fprintf(stderr, "Unknown integrator '%s'\n", options.m_pIntegrator);
+			return 1;
+		}
+		simulator.set_integrator(integrator);
+	}
+	simulator.set_tolerance(options.m_tolerance);
+
+	// Emit from the unstable fixed point at the origin, like the app
+	LorenzLifecycle lifecycle;
+	lifecycle.m_maxAge = options.m_maxAge;
+	lifecycle.m_respawn = options.m_respawn;
+	simulator.set_lifecycle(lifecycle);
+
+	auto start = std::chrono::steady_clock::now();
+	if (!simulator.init(options.m_particles, options.m_seed))
+	{
+		std::fprintf(stderr, "Cannot allocate %u particles\n", options.m_particles);
+		return 1;
+	}
+	const f64 initSeconds = seconds_since(start);
+
+	ParticleFramePipeline pipeline(simulator);
+	ParticleFrameView view = {};
+	view.m_eye = Float3{ -100.0f, 0.0f, -50.0f };
+	view.m_sortBackToFront = true;
+
+	// Without --frame-time every frame is exactly one step
+	const bool kScheduled = options.m_frameTime > 0.0f;
+	FixedStepSettings settings;
+	settings.m_stepSize = options.m_deltaTime;
+	settings.m_maxSubsteps = kScheduled ? options.m_maxSubsteps : 1;
+	settings.m_budgetSeconds = options.m_budgetMs * 1e-3f;
+	FixedStepScheduler scheduler(settings);
+	const f32 kFrameTime = kScheduled ? options.m_frameTime : options.m_deltaTime;
+
+	// Particle-steps actually taken, as the live range can shrink
+	f64 particleSteps = 0.0;
+	start = std::chrono::steady_clock::now();
+	for (u32 i = 0; i < options.m_steps; ++i)
+	{
+		const u32 kActive = simulator.active_count();
+		FixedStepPlan plan;
+		if (options.m_pipeline)
+		{
+			const auto frameStart = std::chrono::steady_clock::now();
+			plan = scheduler.plan_frame(kFrameTime);
+			pipeline.begin_frame(plan.m_stepSize, plan.m_substeps, kActive, view);
+			pipeline.end_frame();
+			if (pipeline.dead_count() > 0)
+			{
+				simulator.compact();
+			}
+			scheduler.record_cost(plan.m_substeps, seconds_since(frameStart));
+		}
+		else
+		{
+			plan = scheduler.advance(kFrameTime, [&](const f32 kStepSize) { simulator.step(kStepSize); });
+			if (!options.m_respawn)
+			{
+				simulator.compact();
+			}
+		}
+		particleSteps += static_cast<f64>(kActive) * plan.m_substeps;
+	}
+	const f64 stepSeconds = seconds_since(start);
+
+	// Centroid of the cloud, printed so runs can be compared for equality
+	f64 centroid[3] = { 0.0, 0.0, 0.0 };
+	const ParticlePool& pool = simulator.pool();
+	for (u32 i = 0; i < simulator.active_count(); ++i)
+	{
+		centroid[0] += pool.at(ParticleStreams::kPosX, i);
+		centroid[1] += pool.at(ParticleStreams::kPosY, i);
+		centroid[2] += pool.at(ParticleStreams::kPosZ, i);
+	}
+	const f64 invCount = simulator.active_count() ? 1.0 / simulator.active_count() : 0.0;
+
+	std::printf("kernel:          %s (%u wide)\n", lorenz_kernels().m_pName, lorenz_kernels().m_width);
+	std::printf("integrator:      %s\n", integrator_name(simulator.integrator()));
+	std::printf("threads:         %u\n", jobQueue.workerCount());
+	std::printf("particles:       %u\n", options.m_particles);
+	std::printf("steps:           %llu (dt = %g s)\n", static_cast<unsigned long long>(scheduler.total_substeps()), options.m_deltaTime);
+	if (kScheduled)
+	{
+		std::printf("frames:          %u (frame time = %g s, at most %u substeps)\n", options.m_steps, options.m_frameTime, options.m_maxSubsteps);
+		std::printf("simulated:       %.3f s\n", scheduler.total_simulated_time());
+		std::printf("dropped:         %.3f s\n", scheduler.total_dropped_time());
+	}
+	if (options.m_maxAge > 0.0f && options.m_respawn)
+	{
+		std::printf("respawned:       %llu (max age %g s)\n", static_cast<unsigned long long>(simulator.respawned_count()), options.m_maxAge);
+	}
+	if (simulator.active_count() != options.m_particles)
+	{
+		std::printf("alive:           %u\n", simulator.active_count());
+	}
+	std::printf("init:            %.3f s\n", initSeconds);
+	std::printf("step total:      %.3f s\n", stepSeconds);
+	std::printf("throughput:      %.1f M particle-steps/s\n", stepSeconds > 0.0 ? particleSteps / stepSeconds * 1e-6 : 0.0);
+	std::printf("centroid:        (%.4f, %.4f, %.4f)\n", centroid[0] * invCount, centroid[1] * invCount, centroid[2] * invCount);
+
+	return 0;
+}
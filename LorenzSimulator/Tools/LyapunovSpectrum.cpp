@@ -0,0 +1,147 @@
+//================================================================================
+// LyapunovSpectrum
+// Prints the Lyapunov spectrum of the Lorenz system for one (sigma, rho,
+// beta), with confidence intervals, the Kaplan-Yorke dimension and the time
+// taken, using estimate_lyapunov_spectrum() (see LyapunovEstimator.h).
+//
+// Usage: LyapunovSpectrum [--sigma S] [--rho R] [--beta B] [--classic]
+//                         [--members N] [--dt SECONDS] [--transient SECONDS]
+//                         [--time SECONDS] [--renormalize STEPS]
+//                         [--confidence C] [--seed S] [--threads T]
+//
+// Parameters default to the app's. --classic uses (10, 28, 8/3), whose
+// spectrum is known to be about (0.906, 0, -14.572). --members must be at
+// least 2, since the confidence intervals need a spread.
+//
+// Fails if the exponents do not sum to the trace of the Jacobian,
+// -(sigma + 1 + beta), to within 1e-3 of its size.
+//================================================================================
+
+#include "LyapunovEstimator.h"
+
+#include "JobQueue.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	struct Options
+	{
+		LorenzParameters m_parameters = kDefaultLorenzParameters;
+		LyapunovSettings m_settings;
+		u32 m_threads = 0;
+	};
+
+	void print_usage()
+	{
+		std::printf("Usage: LyapunovSpectrum [--sigma S] [--rho R] [--beta B] [--classic]\n"
+			"                        [--members N] [--dt SECONDS] [--transient SECONDS]\n"
+			"                        [--time SECONDS] [--renormalize STEPS]\n"
+			"                        [--confidence C] [--seed S] [--threads T]\n");
+	}
+
+	bool parse_options(int argc, char** argv, Options& rOptions)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const char* pArg = argv[i];
+			const char* pValue = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+			if (std::strcmp(pArg, "--help") == 0)
+			{
+				return false;
+			}
+			if (std::strcmp(pArg, "--classic") == 0)
+			{
+				rOptions.m_parameters = LorenzParameters{ 10.0f, 28.0f, 8.0f / 3.0f };
+				continue;
+			}
+			if (!pValue)
+			{
+				std::fprintf(stderr, "Missing value for %s\n", pArg);
+				return false;
+			}
+
+			if (std::strcmp(pArg, "--sigma") == 0)
+				rOptions.m_parameters.m_sigma = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--rho") == 0)
+				rOptions.m_parameters.m_rho = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--beta") == 0)
+				rOptions.m_parameters.m_beta = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--members") == 0)
+				rOptions.m_settings.m_members = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--dt") == 0)
+				rOptions.m_settings.m_stepSize = std::strtod(pValue, nullptr);
+			else if (std::strcmp(pArg, "--transient") == 0)
+				rOptions.m_settings.m_transientTime = std::strtod(pValue, nullptr);
+			else if (std::strcmp(pArg, "--time") == 0)
+				rOptions.m_settings.m_measureTime = std::strtod(pValue, nullptr);
+			else if (std::strcmp(pArg, "--renormalize") == 0)
+				rOptions.m_settings.m_renormalizeSteps = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--confidence") == 0)
+				rOptions.m_settings.m_confidence = std::strtod(pValue, nullptr);
+			else if (std::strcmp(pArg, "--seed") == 0)
+				rOptions.m_settings.m_seed = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--threads") == 0)
+				rOptions.m_threads = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else
+			{
+				std::fprintf(stderr, "Unknown option %s\n", pArg);
+				return false;
+			}
+			++i;
+		}
+		return rOptions.m_settings.m_members >= 2 && rOptions.m_settings.m_stepSize > 0.0 && rOptions.m_settings.m_confidence > 0.0
+			&& rOptions.m_settings.m_confidence < 1.0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parse_options(argc, argv, options))
+	{
+		print_usage();
+		return 1;
+	}
+
+	JobQueue queue;
+	queue.launch(options.m_threads);
+
+	const LorenzParameters& kParams = options.m_parameters;
+	const LyapunovSettings& kSettings = options.m_settings;
+	std::printf("sigma %g, rho %g, beta %g\n", kParams.m_sigma, kParams.m_rho, kParams.m_beta);
+	std::printf("members: %u on %u threads, dt %g s, transient %g s, measured %g s, renormalized every %u steps\n",
+		kSettings.m_members, queue.workerCount(), kSettings.m_stepSize, kSettings.m_transientTime, kSettings.m_measureTime,
+		kSettings.m_renormalizeSteps);
+
+	const LyapunovSpectrum kSpectrum = estimate_lyapunov_spectrum(kParams, kSettings, &queue);
+	if (kSpectrum.m_members == 0)
+	{
+		std::printf("every trajectory diverged\n");
+		return 1;
+	}
+
+	f64 sum = 0.0;
+	for (u32 i = 0; i < kLyapunovDimensions; ++i)
+	{
+		std::printf("lambda%u:         %+.5f +- %.5f (%g%%)\n", i + 1, kSpectrum.m_exponents[i], kSpectrum.m_halfWidths[i], 100.0 * kSettings.m_confidence);
+		sum += kSpectrum.m_exponents[i];
+	}
+
+	const f64 kTrace = -(static_cast<f64>(kParams.m_sigma) + 1.0 + static_cast<f64>(kParams.m_beta));
+	std::printf("sum:             %+.6f (trace %+.6f)\n", sum, kTrace);
+	std::printf("Kaplan-Yorke:    %.4f\n", kSpectrum.m_kaplanYorkeDimension);
+	std::printf("members used:    %u of %u\n", kSpectrum.m_members, kSettings.m_members);
+	std::printf("time:            %.1f ms\n", kSpectrum.m_seconds * 1e3);
+
+	if (std::fabs(sum - kTrace) > 1e-3 * std::fabs(kTrace))
+	{
+		std::printf("FAILED: exponents do not sum to the trace\n");
+		return 1;
+	}
+	return 0;
+}
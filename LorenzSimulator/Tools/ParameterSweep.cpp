@@ -0,0 +1,191 @@
+//================================================================================
+// ParameterSweep
+// Runs the Lorenz system over a grid of (sigma, rho, beta) and writes one
+// row of summary statistics per grid point (see ParameterSweep.h).
+//
+// Usage: ParameterSweep [--sigma V|MIN:MAX:N] [--rho V|MIN:MAX:N] [--beta V|MIN:MAX:N]
+//                       [--ensemble E] [--dt SECONDS] [--integrator euler|rk4|dopri]
+//                       [--transient STEPS] [--steps STEPS] [--radius R] [--seed S]
+//                       [--threads T] [--out FILE] [--format csv|binary] [--batch POINTS]
+//
+// Axes default to the app's parameters. Points are run in batches of
+// --batch (default 1024), and each batch is written as soon as it finishes,
+// so progress is visible and a long sweep keeps its results if stopped.
+// Without --out, CSV goes to stdout.
+//
+// Example, a 100 x 100 (sigma, rho) plane:
+//   ParameterSweep --sigma 5:30:100 --rho 1:60:100 --out sweep.bin --format binary
+//================================================================================
+
+#include "ParameterSweep.h"
+
+#include "JobQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	struct Options
+	{
+		ParameterGrid m_grid = {
+			{ kDefaultLorenzParameters.m_sigma, kDefaultLorenzParameters.m_sigma, 1 },
+			{ kDefaultLorenzParameters.m_rho, kDefaultLorenzParameters.m_rho, 1 },
+			{ kDefaultLorenzParameters.m_beta, kDefaultLorenzParameters.m_beta, 1 } };
+		SweepSettings m_settings;
+		u32 m_threads = 0;
+		const char* m_pOut = nullptr;
+		bool m_binary = false;
+		u32 m_batch = 1024;
+	};
+
+	void print_usage()
+	{
+		std::printf("Usage: ParameterSweep [--sigma V|MIN:MAX:N] [--rho V|MIN:MAX:N] [--beta V|MIN:MAX:N]\n"
+			"                      [--ensemble E] [--dt SECONDS] [--integrator euler|rk4|dopri]\n"
+			"                      [--transient STEPS] [--steps STEPS] [--radius R] [--seed S]\n"
+			"                      [--threads T] [--out FILE] [--format csv|binary] [--batch POINTS]\n");
+	}
+
+	bool parse_options(int argc, char** argv, Options& rOptions)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const char* pArg = argv[i];
+			const char* pValue = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+			if (std::strcmp(pArg, "--help") == 0)
+			{
+				return false;
+			}
+			if (!pValue)
+			{
+				std::fprintf(stderr, "Missing value for %s\n", pArg);
+				return false;
+			}
+
+			bool valid = true;
+			if (std::strcmp(pArg, "--sigma") == 0)
+				valid = parse_sweep_axis(pValue, rOptions.m_grid.m_sigma);
+			else if (std::strcmp(pArg, "--rho") == 0)
+				valid = parse_sweep_axis(pValue, rOptions.m_grid.m_rho);
+			else if (std::strcmp(pArg, "--beta") == 0)
+				valid = parse_sweep_axis(pValue, rOptions.m_grid.m_beta);
+			else if (std::strcmp(pArg, "--ensemble") == 0)
+				rOptions.m_settings.m_ensemble = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--dt") == 0)
+				rOptions.m_settings.m_stepSize = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--integrator") == 0)
+				valid = parse_integrator(pValue, rOptions.m_settings.m_integrator);
+			else if (std::strcmp(pArg, "--transient") == 0)
+				rOptions.m_settings.m_transientSteps = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--steps") == 0)
+				rOptions.m_settings.m_measureSteps = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--radius") == 0)
+				rOptions.m_settings.m_divergenceRadius = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--seed") == 0)
+				rOptions.m_settings.m_seed = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--threads") == 0)
+				rOptions.m_threads = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--out") == 0)
+				rOptions.m_pOut = pValue;
+			else if (std::strcmp(pArg, "--format") == 0)
+			{
+				rOptions.m_binary = std::strcmp(pValue, "binary") == 0;
+				valid = rOptions.m_binary || std::strcmp(pValue, "csv") == 0;
+			}
+			else if (std::strcmp(pArg, "--batch") == 0)
+				rOptions.m_batch = std::max(static_cast<u32>(std::strtoul(pValue, nullptr, 10)), 1u);
+			else
+			{
+				std::fprintf(stderr, "Unknown option %s\n", pArg);
+				return false;
+			}
+
+			if (!valid)
+			{
+				std::fprintf(stderr, "Bad value for %s: %s\n", pArg, pValue);
+				return false;
+			}
+			++i;
+		}
+		return rOptions.m_settings.m_ensemble > 0;
+	}
+
+	f64 seconds_since(const std::chrono::steady_clock::time_point& start)
+	{
+		return std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parse_options(argc, argv, options))
+	{
+		print_usage();
+		return 1;
+	}
+	if (options.m_binary && !options.m_pOut)
+	{
+		std::fprintf(stderr, "Binary output needs --out\n");
+		return 1;
+	}
+
+	std::FILE* pFile = options.m_pOut ? std::fopen(options.m_pOut, options.m_binary ? "wb" : "w") : stdout;
+	if (!pFile)
+	{
+		std::fprintf(stderr, "Cannot open %s\n", options.m_pOut);
+		return 1;
+	}
+
+	JobQueue queue;
+	queue.launch(options.m_threads);
+
+	const ParameterGrid& kGrid = options.m_grid;
+	const SweepSettings& kSettings = options.m_settings;
+	const u32 kNumPoints = kGrid.point_count();
+	std::fprintf(stderr, "grid: %u x %u x %u = %u points, ensemble %u, %u + %u steps of %g s (%s), %u threads, kernel: %s\n",
+		kGrid.m_sigma.m_count, kGrid.m_rho.m_count, kGrid.m_beta.m_count, kNumPoints, kSettings.m_ensemble,
+		kSettings.m_transientSteps, kSettings.m_measureSteps, kSettings.m_stepSize, integrator_name(kSettings.m_integrator),
+		queue.workerCount(), lorenz_kernels().m_pName);
+
+	bool written = options.m_binary ? write_sweep_binary_header(pFile, kGrid, kSettings) : write_sweep_csv_header(pFile);
+
+	std::vector<SweepPointStats> batch(std::min(options.m_batch, kNumPoints));
+	u32 divergedPoints = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for (u32 first = 0; first < kNumPoints && written; first += options.m_batch)
+	{
+		const u32 kCount = std::min(options.m_batch, kNumPoints - first);
+		run_parameter_sweep(kGrid, kSettings, first, kCount, batch.data(), &queue);
+		written = options.m_binary ? write_sweep_binary(pFile, batch.data(), kCount) : write_sweep_csv(pFile, batch.data(), kCount);
+		for (u32 i = 0; i < kCount; ++i)
+		{
+			divergedPoints += batch[i].m_diverged > 0 ? 1 : 0;
+		}
+
+		const f64 kSeconds = seconds_since(start);
+		std::fprintf(stderr, "%u / %u points, %.1f s, %.1f points/s\n", first + kCount, kNumPoints, kSeconds, (first + kCount) / kSeconds);
+	}
+
+	if (pFile != stdout && std::fclose(pFile) != 0)
+	{
+		written = false;
+	}
+	if (!written)
+	{
+		std::fprintf(stderr, "Write failed\n");
+		return 1;
+	}
+
+	const f64 kSeconds = seconds_since(start);
+	const f64 kParticleSteps = static_cast<f64>(kNumPoints) * kSettings.m_ensemble * (kSettings.m_transientSteps + kSettings.m_measureSteps);
+	std::fprintf(stderr, "done: %u points in %.2f s (%.1f M particle-steps/s), %u flagged as diverging\n", kNumPoints, kSeconds,
+		kParticleSteps / kSeconds * 1e-6, divergedPoints);
+	return 0;
+}
@@ -0,0 +1,157 @@
+//================================================================================
+// ParticleRingCheck
+// Checks the app's particle buffer schedule without a GPU. The same sequence
+// of frames (GPU simulated frames with 0 to 4 substeps, and CPU frames that
+// upload host particles) is run twice:
+//
+//  - copy: the schedule the app used before ParticleBufferRing, with fixed
+//    old / updated / render buffers and a copy after every substep plus one
+//    into the render buffer.
+//  - ring: ParticleBufferRing, which draws from whichever buffer was written
+//    last.
+//
+// Both run on a RecordingParticleBackend, to count operations, and on a
+// CpuParticleBackend, where the drawn buffer must match bit for bit after
+// every frame. Exits with 1 if the ring copies anything or any frame
+// differs.
+//
+// Usage: ParticleRingCheck [particles] [frames] [buffers]
+//================================================================================
+
+#include "LorenzSimulator.h"
+#include "ParticleBufferRing.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	// Fixed buffers of the copying schedule.
+	constexpr u32 kOldBuffer = 0;
+	constexpr u32 kUpdatedBuffer = 1;
+	constexpr u32 kRenderBuffer = 2;
+
+	struct Frame
+	{
+		u32 m_substeps;
+		bool m_upload;
+	};
+
+	// Runs of GPU frames with varying substep counts, broken up by CPU frames.
+	std::vector<Frame> make_frames(const u32 kNumFrames)
+	{
+		std::vector<Frame> frames(kNumFrames);
+		for (u32 i = 0; i < kNumFrames; ++i)
+		{
+			frames[i].m_upload = (i / 7) % 3 == 2;
+			frames[i].m_substeps = frames[i].m_upload ? 0 : (i * 3 + 1) % 5;
+		}
+		return frames;
+	}
+
+	// Returns the buffer to draw.
+	u32 run_copy_frame(ParticleBufferBackend& rBackend, const Frame& frame, const LorenzParticle* pUpload, const u32 kCount)
+	{
+		if (frame.m_upload)
+		{
+			rBackend.upload(kRenderBuffer, pUpload, kCount);
+			return kRenderBuffer;
+		}
+
+		for (u32 s = 0; s < frame.m_substeps; ++s)
+		{
+			rBackend.simulate(kOldBuffer, kUpdatedBuffer, kCount);
+			rBackend.copy(kOldBuffer, kUpdatedBuffer, kCount);
+		}
+		if (frame.m_substeps > 0)
+		{
+			rBackend.copy(kRenderBuffer, kUpdatedBuffer, kCount);
+		}
+		return kRenderBuffer;
+	}
+
+	u32 run_ring_frame(ParticleBufferRing& rRing, ParticleBufferBackend& rBackend, const Frame& frame, const LorenzParticle* pUpload, const u32 kCount)
+	{
+		if (frame.m_upload)
+		{
+			rRing.upload(rBackend, pUpload, kCount);
+		}
+		else
+		{
+			rRing.simulate(rBackend, frame.m_substeps, kCount);
+		}
+		return rRing.render_index();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const u32 kParticles = argc > 1 ? static_cast<u32>(std::strtoul(argv[1], nullptr, 10)) : 100000;
+	const u32 kFrames = argc > 2 ? static_cast<u32>(std::strtoul(argv[2], nullptr, 10)) : 120;
+	const u32 kBuffers = argc > 3 ? static_cast<u32>(std::strtoul(argv[3], nullptr, 10)) : kDefaultParticleBuffers;
+	const f32 kDeltaTime = 1.0f / 120.0f;
+	if (kBuffers < 2 || kBuffers > kMaxParticleBuffers)
+	{
+		std::printf("buffers must be 2 to %u\n", kMaxParticleBuffers);
+		return 1;
+	}
+
+	const std::vector<Frame> kFrameList = make_frames(kFrames);
+
+	// Initial state, as the app creates every buffer from one staging block,
+	// and a separately stepped simulator as the source of CPU frame uploads
+	LorenzSimulator simulator;
+	simulator.init(kParticles, 1);
+	std::vector<LorenzParticle> initial(kParticles);
+	simulator.read_particles(initial.data());
+	std::vector<LorenzParticle> upload(kParticles);
+
+	RecordingParticleBackend copyRecording;
+	RecordingParticleBackend ringRecording;
+	ParticleBufferRing recordingRing(kBuffers);
+	CpuParticleBackend copyBackend(3, kParticles, initial.data(), simulator.parameters(), kDeltaTime);
+	CpuParticleBackend ringBackend(kBuffers, kParticles, initial.data(), simulator.parameters(), kDeltaTime);
+	ParticleBufferRing ring(kBuffers);
+
+	u32 mismatchedFrames = 0;
+	u32 substeps = 0;
+	for (const Frame& frame : kFrameList)
+	{
+		if (frame.m_upload)
+		{
+			simulator.step(kDeltaTime);
+			simulator.read_particles(upload.data());
+		}
+		substeps += frame.m_substeps;
+
+		run_copy_frame(copyRecording, frame, upload.data(), kParticles);
+		run_ring_frame(recordingRing, ringRecording, frame, upload.data(), kParticles);
+
+		const u32 kCopyDrawn = run_copy_frame(copyBackend, frame, upload.data(), kParticles);
+		const u32 kRingDrawn = run_ring_frame(ring, ringBackend, frame, upload.data(), kParticles);
+		if (std::memcmp(copyBackend.buffer(kCopyDrawn), ringBackend.buffer(kRingDrawn), kParticles * sizeof(LorenzParticle)) != 0)
+		{
+			++mismatchedFrames;
+		}
+	}
+
+	std::printf("particles: %u, frames: %u (%u substeps), ring buffers: %u\n", kParticles, kFrames, substeps, kBuffers);
+	std::printf("%-6s %10s %10s %10s %14s %14s\n", "", "simulates", "uploads", "copies", "copies/frame", "copied MB");
+	const RecordingParticleBackend* pRecordings[] = { &copyRecording, &ringRecording };
+	const char* kNames[] = { "copy", "ring" };
+	for (u32 r = 0; r < 2; ++r)
+	{
+		const RecordingParticleBackend& recording = *pRecordings[r];
+		std::printf("%-6s %10u %10u %10u %14.2f %14.1f\n", kNames[r], recording.count(RecordingParticleBackend::kSimulate),
+			recording.count(RecordingParticleBackend::kUpload), recording.count(RecordingParticleBackend::kCopy),
+			static_cast<f64>(recording.count(RecordingParticleBackend::kCopy)) / kFrames,
+			recording.particles(RecordingParticleBackend::kCopy) * sizeof(LorenzParticle) / (1024.0 * 1024.0));
+	}
+
+	const bool kZeroCopies = ringRecording.count(RecordingParticleBackend::kCopy) == 0 && ringBackend.copied_particles() == 0;
+	std::printf("drawn buffers identical: %u of %u frames\n", kFrames - mismatchedFrames, kFrames);
+	std::printf("%s\n", kZeroCopies && mismatchedFrames == 0 ? "ok: ring makes zero copies" : "FAILED");
+	return kZeroCopies && mismatchedFrames == 0 ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+//================================================================================
+// PoincareSection
+// Steps a LorenzSimulator with a PoincareSection attached and streams every
+// crossing of the plane to a point cloud file (see PoincareSection.h).
+//
+// Usage: PoincareSection [--particles N] [--seed S] [--sigma S] [--rho R] [--beta B]
+//                        [--dt SECONDS] [--integrator euler|rk4|dopri] [--substeps K]
+//                        [--transient STEPS] [--steps STEPS] [--normal X,Y,Z]
+//                        [--offset C] [--absolute] [--direction both|up|down]
+//                        [--threads T] [--out FILE] [--format csv|binary]
+//
+// The plane defaults to z = rho - 1; --offset is added to rho - 1 unless
+// --absolute is given. The transient runs without the section, and its
+// throughput is printed next to the measured one to show what the section
+// costs. Hits are merged and written after every call of kSubsteps steps.
+// Without --out they are only counted.
+//
+// Fails if a hit lies farther than 1e-3 from the plane, which would mean the
+// crossing refinement is broken.
+//================================================================================
+
+#include "PoincareSection.h"
+
+#include "JobQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	struct Options
+	{
+		u32 m_particles = 1000000;
+		u32 m_seed = 1;
+		LorenzParameters m_parameters = kDefaultLorenzParameters;
+		f32 m_stepSize = 0.005f;
+		Integrator::IntegratorEnum m_integrator = Integrator::kRK4;
+		u32 m_substeps = 8;
+		u32 m_transientSteps = 2000;
+		u32 m_measureSteps = 4000;
+		SectionPlane m_plane;
+		u32 m_threads = 0;
+		const char* m_pOut = nullptr;
+		bool m_binary = false;
+	};
+
+	void print_usage()
+	{
+		std::printf("Usage: PoincareSection [--particles N] [--seed S] [--sigma S] [--rho R] [--beta B]\n"
+			"                       [--dt SECONDS] [--integrator euler|rk4|dopri] [--substeps K]\n"
+			"                       [--transient STEPS] [--steps STEPS] [--normal X,Y,Z]\n"
+			"                       [--offset C] [--absolute] [--direction both|up|down]\n"
+			"                       [--threads T] [--out FILE] [--format csv|binary]\n");
+	}
+
+	bool parse_options(int argc, char** argv, Options& rOptions)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const char* pArg = argv[i];
+			const char* pValue = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+			if (std::strcmp(pArg, "--help") == 0)
+			{
+				return false;
+			}
+			if (std::strcmp(pArg, "--absolute") == 0)
+			{
+				rOptions.m_plane.m_offsetFromRho = false;
+				continue;
+			}
+			if (!pValue)
+			{
+				std::fprintf(stderr, "Missing value for %s\n", pArg);
+				return false;
+			}
+
+			bool valid = true;
+			if (std::strcmp(pArg, "--particles") == 0)
+				rOptions.m_particles = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--seed") == 0)
+				rOptions.m_seed = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--sigma") == 0)
+				rOptions.m_parameters.m_sigma = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--rho") == 0)
+				rOptions.m_parameters.m_rho = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--beta") == 0)
+				rOptions.m_parameters.m_beta = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--dt") == 0)
+				rOptions.m_stepSize = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--integrator") == 0)
+				valid = parse_integrator(pValue, rOptions.m_integrator);
+			else if (std::strcmp(pArg, "--substeps") == 0)
+				rOptions.m_substeps = std::max(static_cast<u32>(std::strtoul(pValue, nullptr, 10)), 1u);
+			else if (std::strcmp(pArg, "--transient") == 0)
+				rOptions.m_transientSteps = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--steps") == 0)
+				rOptions.m_measureSteps = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--normal") == 0)
+				valid = parse_section_normal(pValue, rOptions.m_plane.m_normal);
+			else if (std::strcmp(pArg, "--offset") == 0)
+				rOptions.m_plane.m_offset = std::strtof(pValue, nullptr);
+			else if (std::strcmp(pArg, "--direction") == 0)
+				valid = parse_section_direction(pValue, rOptions.m_plane.m_direction);
+			else if (std::strcmp(pArg, "--threads") == 0)
+				rOptions.m_threads = static_cast<u32>(std::strtoul(pValue, nullptr, 10));
+			else if (std::strcmp(pArg, "--out") == 0)
+				rOptions.m_pOut = pValue;
+			else if (std::strcmp(pArg, "--format") == 0)
+			{
+				rOptions.m_binary = std::strcmp(pValue, "binary") == 0;
+				valid = rOptions.m_binary || std::strcmp(pValue, "csv") == 0;
+			}
+			else
+			{
+				std::fprintf(stderr, "Unknown option %s\n", pArg);
+				return false;
+			}
+
+			if (!valid)
+			{
+				std::fprintf(stderr, "Bad value for %s: %s\n", pArg, pValue);
+				return false;
+			}
+			++i;
+		}
+		return rOptions.m_particles > 0 && rOptions.m_stepSize > 0.0f;
+	}
+
+	f64 seconds_since(const std::chrono::steady_clock::time_point& start)
+	{
+		return std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parse_options(argc, argv, options))
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::FILE* pFile = nullptr;
+	if (options.m_pOut)
+	{
+		pFile = std::fopen(options.m_pOut, options.m_binary ? "wb" : "w");
+		if (!pFile)
+		{
+			std::fprintf(stderr, "Cannot open %s\n", options.m_pOut);
+			return 1;
+		}
+	}
+
+	JobQueue queue;
+	queue.launch(options.m_threads);
+
+	LorenzSimulator simulator(&queue);
+	simulator.parameters() = options.m_parameters;
+	simulator.set_integrator(options.m_integrator);
+	if (!simulator.init(options.m_particles, options.m_seed))
+	{
+		std::fprintf(stderr, "Cannot allocate %u particles\n", options.m_particles);
+		return 1;
+	}
+
+	const SectionPlane& kPlane = options.m_plane;
+	const LorenzParameters& kParams = options.m_parameters;
+	const f32 kOffset = kPlane.m_offset + (kPlane.m_offsetFromRho ? kParams.m_rho - 1.0f : 0.0f);
+	std::printf("%u particles, sigma %g, rho %g, beta %g, %s with dt %g s in calls of %u substeps, %u threads, kernel: %s\n",
+		options.m_particles, kParams.m_sigma, kParams.m_rho, kParams.m_beta, integrator_name(options.m_integrator),
+		options.m_stepSize, options.m_substeps, queue.workerCount(), lorenz_kernels().m_pName);
+	std::printf("plane: (%g, %g, %g) . p = %g, crossings: %s\n", kPlane.m_normal.x, kPlane.m_normal.y, kPlane.m_normal.z, kOffset,
+		section_direction_name(kPlane.m_direction));
+
+	bool written = true;
+	if (pFile)
+	{
+		written = options.m_binary ? write_section_binary_header(pFile, kPlane) : write_section_csv_header(pFile);
+	}
+
+	// Rounded up to whole calls
+	const u32 kSubsteps = options.m_substeps;
+	const u32 kTransientCalls = (options.m_transientSteps + kSubsteps - 1) / kSubsteps;
+	const u32 kMeasureCalls = (options.m_measureSteps + kSubsteps - 1) / kSubsteps;
+	const f64 kParticleStepsPerCall = static_cast<f64>(options.m_particles) * kSubsteps;
+
+	auto start = std::chrono::steady_clock::now();
+	for (u32 call = 0; call < kTransientCalls; ++call)
+	{
+		simulator.step(options.m_stepSize, kSubsteps);
+	}
+	const f64 kTransientSeconds = seconds_since(start);
+	if (kTransientCalls > 0)
+	{
+		std::printf("transient: %u steps in %.2f s, %.1f M particle-steps/s\n", kTransientCalls * kSubsteps, kTransientSeconds,
+			kTransientCalls * kParticleStepsPerCall / kTransientSeconds * 1e-6);
+	}
+
+	PoincareSection section(kPlane);
+	simulator.set_step_observer(&section);
+
+	std::vector<SectionHit> hits;
+	f32 maxDistance = 0.0f;
+	f64 writeSeconds = 0.0;
+	start = std::chrono::steady_clock::now();
+	for (u32 call = 0; call < kMeasureCalls && written; ++call)
+	{
+		simulator.step(options.m_stepSize, kSubsteps);
+
+		const auto writeStart = std::chrono::steady_clock::now();
+		hits.clear();
+		section.drain(hits);
+		for (const SectionHit& hit : hits)
+		{
+			const Float3& p = hit.m_position;
+			maxDistance = std::max(maxDistance, std::fabs(kPlane.m_normal.x * p.x + kPlane.m_normal.y * p.y + kPlane.m_normal.z * p.z - kOffset));
+		}
+		if (pFile)
+		{
+			const u32 kCount = static_cast<u32>(hits.size());
+			written = options.m_binary ? write_section_binary(pFile, hits.data(), kCount) : write_section_csv(pFile, hits.data(), kCount);
+		}
+		writeSeconds += seconds_since(writeStart);
+	}
+	const f64 kMeasureSeconds = seconds_since(start);
+	simulator.set_step_observer(nullptr);
+
+	if (pFile && std::fclose(pFile) != 0)
+	{
+		written = false;
+	}
+	if (!written)
+	{
+		std::fprintf(stderr, "Write failed\n");
+		return 1;
+	}
+
+	const u64 kHits = section.merged_count();
+	const f64 kSimulatedSeconds = static_cast<f64>(kMeasureCalls) * kSubsteps * options.m_stepSize;
+	std::printf("measured:  %u steps in %.2f s (%.2f s merging and writing), %.1f M particle-steps/s\n", kMeasureCalls * kSubsteps,
+		kMeasureSeconds, writeSeconds, kMeasureCalls * kParticleStepsPerCall / kMeasureSeconds * 1e-6);
+	std::printf("hits:      %llu, %.3f per particle per simulated second, %.1f M hits/s\n", static_cast<unsigned long long>(kHits),
+		kHits / (static_cast<f64>(options.m_particles) * kSimulatedSeconds), kHits / kMeasureSeconds * 1e-6);
+	std::printf("max distance from plane: %g\n", maxDistance);
+
+	if (maxDistance > 1e-3f)
+	{
+		std::printf("FAILED: hits off the plane\n");
+		return 1;
+	}
+	return 0;
+}
@@ -14,8 +14,12 @@ cbuffer PerFrameCBData : register(b2)
 	float3 currentColour;
 	float deltaTime;
 	bool streaksOn;
+	uint drawParticleCount;
 };
 
+// Quads per instance of the shared index pattern, kQuadPatternQuads in QuadIndices.h
+static const uint QuadPatternQuads = 16384;
+
 
 StructuredBuffer<Particle> ParticleBuffer : register(t1);
 Texture2D texture0 : register(t2);
@@ -48,13 +52,23 @@ static const float2 UVs[] =
 ///////////////////////
 // Vertex shader
 ///////////////////////
-PS_Input VS_Main(uint vertexID : SV_VertexID)
+PS_Input VS_Main(uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
 {
 	PS_Input output;
 
-	uint particleID = vertexID / 4;
+	uint particleID = instanceID * QuadPatternQuads + vertexID / 4;
 	uint cornerID = vertexID % 4;
 
+	// The last instance of the pattern runs past the draw count; w = 0 puts
+	// the quad outside the view volume so it is clipped
+	if (particleID >= drawParticleCount)
+	{
+		output.vpos = float4(0.0f, 0.0f, 0.0f, 0.0f);
+		output.colour = float4(0.0f, 0.0f, 0.0f, 0.0f);
+		output.uv = float2(0.0f, 0.0f);
+		return output;
+	}
+
 	Particle p = ParticleBuffer[particleID];
 	float3 position = p.position;
 
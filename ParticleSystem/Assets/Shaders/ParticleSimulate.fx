@@ -22,8 +22,23 @@ cbuffer SimulationParameters : register(b1)
 	float rho;
 	float beta;
 	int particleCount;
+	float maxAge;
 };
 
+// Half size of the cube around the emitter that respawned particles land in
+static const float kEmitterJitter = 0.1f;
+
+// Integer hash (Chris Wellons' lowbias32) for per-particle respawn jitter
+uint hash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
 StructuredBuffer<Particle> OldParticles : register(t0);
 RWStructuredBuffer<Particle> UpdatedParticles : register(u0);
 
@@ -41,7 +56,7 @@ void CS_Main(uint3 DispatchThreadID : SV_DispatchThreadID)
 	uint myID = DispatchThreadID.x;
 
 	// Prevent undefined behaviour by not utilising more threads than particles
-	if (myID <= particleCount)
+	if (myID < (uint)particleCount)
 	{
 		// Read an particle from the old buffer
 		Particle p = OldParticles[myID];
@@ -54,6 +69,17 @@ void CS_Main(uint3 DispatchThreadID : SV_DispatchThreadID)
 		p.position = p.position + deltaTime * p.velocity;
 		p.age += deltaTime;
 
+		// Recycle expired particles at the emitter. The emitter moves every
+		// frame, so it also seeds the jitter.
+		if (maxAge > 0.0f && p.age >= maxAge)
+		{
+			uint seed = (myID * 3u) ^ asuint(emitterLocation.x);
+			float3 jitter = float3(hash(seed), hash(seed + 1u), hash(seed + 2u)) * (2.0f / 4294967295.0f) - 1.0f;
+			p.position = emitterLocation + kEmitterJitter * jitter;
+			p.velocity = float3(0.0f, 0.0f, 0.0f);
+			p.age = fmod(p.age - maxAge, maxAge);
+		}
+
 		// Place the particle in the updated buffer
 		UpdatedParticles[myID] = p;
 	}
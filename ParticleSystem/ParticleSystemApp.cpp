@@ -4,6 +4,22 @@
 #include "Texture.h"
 #include "VertexFormats.h"
 
+#include "FixedStepScheduler.h"
+#include "DensityHistogram.h"
+#include "LorenzParticle.h"
+#include "LorenzSimulator.h"
+#include "LyapunovEstimator.h"
+#include "ParallelFor.h"
+#include "ParticleBufferRing.h"
+#include "ParticleFramePipeline.h"
+#include "PoincareSection.h"
+#include "ProcessMemory.h"
+#include "QuadIndices.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <new>
 #include <vector>
 
 // Helper function for aligning particles on 256 thread boundary
@@ -12,6 +28,111 @@ s32 align(s32 num, s32 alignment)
 	return (num + (alignment - 1)) & ~(alignment - 1);
 }
 
+// Particles per job when filling particle arrays in parallel
+constexpr u32 kParticleInitGrain = 16384;
+
+// Largest particle capacity pDevice can hold, up to kMaxCapacity. Every
+// buffer of the ring must fit the D3D11 limit on resource size, a quarter of
+// dedicated video memory clamped to [128 MB, 2 GB], and the whole ring must
+// fit in dedicated video memory when the adapter reports any.
+u32 device_particle_capacity(ID3D11Device* pDevice, const u32 kMaxCapacity)
+{
+	u64 videoMemory = 0;
+	ComPtr<IDXGIDevice> pDxgiDevice;
+	ComPtr<IDXGIAdapter> pAdapter;
+	DXGI_ADAPTER_DESC desc;
+	if (SUCCEEDED(pDevice->QueryInterface(IID_PPV_ARGS(&pDxgiDevice))) && SUCCEEDED(pDxgiDevice->GetAdapter(&pAdapter))
+		&& SUCCEEDED(pAdapter->GetDesc(&desc)))
+	{
+		videoMemory = desc.DedicatedVideoMemory;
+	}
+
+	const u64 kMinBytes = D3D11_REQ_RESOURCE_SIZE_IN_MEGABYTES_EXPRESSION_A_TERM * MB;
+	const u64 kMaxBytes = D3D11_REQ_RESOURCE_SIZE_IN_MEGABYTES_EXPRESSION_C_TERM * MB;
+	const u64 kScaledBytes = static_cast<u64>(videoMemory * D3D11_REQ_RESOURCE_SIZE_IN_MEGABYTES_EXPRESSION_B_TERM);
+	u64 bufferBytes = std::min(std::max(kScaledBytes, kMinBytes), kMaxBytes);
+	if (videoMemory > 0)
+	{
+		bufferBytes = std::min(bufferBytes, videoMemory / kDefaultParticleBuffers);
+	}
+	return static_cast<u32>(std::min<u64>(bufferBytes / sizeof(LorenzParticle), kMaxCapacity));
+}
+
+// D3D11 buffers behind ParticleBufferRing: one structured buffer per slot,
+// each with an SRV (read by CS_Main and VS_Main) and a UAV (written by
+// CS_Main). The caller binds the compute shader and its constant buffers
+// before simulate().
+class D3D11ParticleBuffers final : public ParticleBufferBackend
+{
+public:
+	// Returns false, with nothing created, if any buffer does not fit.
+	bool create(ID3D11Device* pDevice, u32 capacity, const LorenzParticle* pInitial)
+	{
+		D3D11_SUBRESOURCE_DATA data;
+		data.pSysMem = pInitial;
+		data.SysMemPitch = 0;
+		data.SysMemSlicePitch = 0;
+
+		for (u32 i = 0; i < kDefaultParticleBuffers; ++i)
+		{
+			m_pBuffers[i] = create_default_structured_buffer<LorenzParticle>(pDevice, capacity, &data);
+			if (!m_pBuffers[i])
+			{
+				release();
+				return false;
+			}
+			m_pSRVs[i] = create_structured_buffer_SRV(pDevice, capacity, m_pBuffers[i]);
+			m_pUAVs[i] = create_structured_buffer_UAV(pDevice, capacity, m_pBuffers[i]);
+		}
+		return true;
+	}
+
+	void release()
+	{
+		for (u32 i = 0; i < kDefaultParticleBuffers; ++i)
+		{
+			SAFE_RELEASE(m_pSRVs[i]);
+			SAFE_RELEASE(m_pUAVs[i]);
+			SAFE_RELEASE(m_pBuffers[i]);
+		}
+	}
+
+	void set_context(ID3D11DeviceContext* pContext) { m_pContext = pContext; }
+
+	ID3D11ShaderResourceView* srv(u32 index) const { return m_pSRVs[index]; }
+
+	void simulate(const u32 kSource, const u32 kTarget, const u32 kCount) override
+	{
+		// Bind the target as output first: that unbinds it as an input, and
+		// unbinds the source as an output from the previous substep
+		ID3D11UnorderedAccessView* arr_pUAVs[] = { m_pUAVs[kTarget] };
+		m_pContext->CSSetUnorderedAccessViews(0, 1, arr_pUAVs, nullptr);
+		ID3D11ShaderResourceView* arr_pSRVs[] = { m_pSRVs[kSource] };
+		m_pContext->CSSetShaderResources(0, 1, arr_pSRVs);
+
+		// Launch 1D thread groups, one thread per particle
+		m_pContext->Dispatch(static_cast<UINT>(align(static_cast<s32>(kCount), 256)) / 256, 1, 1);
+	}
+
+	void upload(const u32 kTarget, const LorenzParticle* pParticles, const u32 kCount) override
+	{
+		D3D11_BOX box = { 0, 0, 0, kCount * static_cast<UINT>(sizeof(LorenzParticle)), 1, 1 };
+		m_pContext->UpdateSubresource(m_pBuffers[kTarget], 0, &box, pParticles, 0, 0);
+	}
+
+	void copy(const u32 kTarget, const u32 kSource, const u32 kCount) override
+	{
+		D3D11_BOX box = { 0, 0, 0, kCount * static_cast<UINT>(sizeof(LorenzParticle)), 1, 1 };
+		m_pContext->CopySubresourceRegion(m_pBuffers[kTarget], 0, 0, 0, 0, m_pBuffers[kSource], 0, &box);
+	}
+
+private:
+	ID3D11DeviceContext* m_pContext = nullptr;
+	ID3D11Buffer* m_pBuffers[kDefaultParticleBuffers] = {};
+	ID3D11ShaderResourceView* m_pSRVs[kDefaultParticleBuffers] = {};
+	ID3D11UnorderedAccessView* m_pUAVs[kDefaultParticleBuffers] = {};
+};
+
 class ParticleSystemApp : public FrameworkApp
 {
 public:
@@ -21,6 +142,7 @@ public:
 		f32 m_age;
 		v3 m_velocity;
 	};
+	static_assert(sizeof(Particle) == sizeof(LorenzParticle), "Particle must stay layout compatible with the CPU simulator");
 
 	struct SimulationParameters
 	{
@@ -29,6 +151,7 @@ public:
 		f32 m_rho;
 		f32 m_beta;
 		u32 m_particleCount;
+		f32 m_maxAge;
 	};
 
 	struct PerFrameCBData
@@ -38,6 +161,7 @@ public:
 		v3 m_particleColour;
 		f32 m_deltaTime;
 		bool m_streak;
+		u32 m_drawParticleCount;
 	};
 
 	ParticleSystemApp() :
@@ -56,8 +180,18 @@ public:
 	}
 
 private:
-	void init_particle_buffers(ID3D11Device* pDevice);
+	void simulate_on_gpu(SystemsInterface& systems, const FixedStepPlan& plan);
+	bool begin_cpu_simulation(SystemsInterface& systems, const FixedStepPlan& plan);
+	void end_cpu_simulation(SystemsInterface& systems);
+
+	bool create_particle_resources(ID3D11Device* pDevice);
+	void release_particle_resources();
+	void apply_particle_capacity(SystemsInterface& systems);
+	bool init_particle_buffers(ID3D11Device* pDevice);
+	void fill_particles(LorenzParticle* pParticles, u32 count, f32 positionScale, bool randomVelocity, u32 seed);
 	void init_index_buffer(ID3D11Device* pDevice);
+	void close_section_file();
+	void write_density_files();
 
 private:
 	PerFrameCBData m_perFrameCBData;
@@ -66,19 +200,13 @@ private:
 	SimulationParameters m_simulationParameters;
 	ID3D11Buffer* m_pSimulationParameters_CB = nullptr;
 
-	std::vector<Particle> m_OldParticles;
-	ID3D11Buffer* m_pOldParticleBuffer = nullptr;
-	ID3D11ShaderResourceView* m_pOldParticleBuffer_SRV = nullptr;
-
-	std::vector<Particle> m_UpdatedParticles;
-	ID3D11Buffer* m_pUpdatedParticleBuffer = nullptr;	
-	ID3D11UnorderedAccessView* m_pUpdatedParticleBuffer_UAV = nullptr;
-
-	std::vector<Particle> m_RenderParticles;
-	ID3D11Buffer* m_pRenderParticleBuffer = nullptr;
-	ID3D11ShaderResourceView* m_pRenderParticleBuffer_SRV = nullptr;
+	// Particle state lives in a ring of buffers; substeps and uploads write
+	// the next one along and rendering reads the last one written, so no
+	// buffer is ever copied to another
+	D3D11ParticleBuffers m_particleBuffers;
+	ParticleBufferRing m_particleRing;
 
-	std::vector<UINT> m_Indices;
+	// Shared 16-bit quad pattern, drawn once per kQuadPatternQuads particles
 	ID3D11Buffer* m_pIndexBuffer = nullptr;
 
 	ID3D11SamplerState* m_pLinearMipSamplerState = nullptr;
@@ -87,6 +215,39 @@ private:
 	ID3D11DepthStencilState* m_pDisabledDepthTestState = nullptr;
 
 	ShaderSet m_particleSimulate;
+
+	// Turns frame time into a whole number of fixed size substeps
+	FixedStepScheduler m_scheduler;
+
+	// CPU simulation path, created the first time it is enabled
+	std::unique_ptr<LorenzSimulator> m_pCpuSimulator;
+	std::unique_ptr<ParticleFramePipeline> m_pCpuPipeline;
+	f64 m_cpuFrameStart;
+	u32 m_cpuSubsteps;
+	u32 m_cpuRequestedCount;
+
+	// Lyapunov spectrum of the current parameters, recomputed in the
+	// background whenever the sliders change them
+	std::unique_ptr<LyapunovEstimator> m_pLyapunovEstimator;
+	LyapunovSpectrum m_lyapunovSpectrum;
+	bool m_hasLyapunovSpectrum;
+
+	// Poincare section z = rho - 1 of the CPU simulation, streamed to
+	// kSectionFileName while recording
+	static constexpr const char* kSectionFileName = "poincare_section.bin";
+	std::unique_ptr<PoincareSection> m_pSection;
+	std::FILE* m_pSectionFile = nullptr;
+	bool m_recordSection;
+
+	// Density histogram of the CPU simulation, written to kDensityVolumeName
+	// and kDensityImageName when recording stops
+	static constexpr const char* kDensityVolumeName = "density.raw";
+	static constexpr const char* kDensityImageName = "density_mip.pgm";
+	std::unique_ptr<DensityHistogram> m_pDensity;
+	bool m_recordDensity;
+
+	// The section and the histogram share the CPU simulator's observer slot
+	LorenzStepObserverList m_stepObservers;
 	
 	Texture m_texture;
 
@@ -94,11 +255,31 @@ private:
 	f32 m_elapsedTime;
 	f32 m_speed;
 	int m_particleCount;
+	u32 m_drawParticleCount;
+	bool m_cpuSimulation;
+	Integrator::IntegratorEnum m_cpuIntegrator;
 	bool m_randomColour;
 	bool m_streak;
 	v3 m_particleColour;
 
-	static constexpr u32 m_maxNumParticles = 500000;
+	// Capacity of every particle buffer, and of the CPU simulator's pool. It
+	// can be raised at runtime from the UI, up to what the device can hold;
+	// the change is applied at the start of the next frame, when no CPU frame
+	// is in flight. A capacity that cannot be allocated leaves the previous
+	// one in place and is shown in the UI.
+	static constexpr u32 kDefaultParticleCapacity = 500000;
+	static constexpr u32 kMaxParticleCapacity = 50000000;
+	u32 m_maxNumParticles;
+	u32 m_capacityLimit;
+	int m_requestedCapacity;
+	bool m_capacityChangePending;
+	u32 m_failedCapacity;
+
+	// Startup cost, shown in the UI: all of on_init, the last particle
+	// resource creation, and the process's peak resident memory after it
+	f64 m_startupTime;
+	f64 m_particleInitTime;
+	u64 m_peakResidentBytes;
 };
 
 // Free up resources
@@ -106,12 +287,9 @@ ParticleSystemApp::~ParticleSystemApp()
 {
 	SAFE_RELEASE(m_pPerFrame_CB);
 	SAFE_RELEASE(m_pSimulationParameters_CB);
-	SAFE_RELEASE(m_pOldParticleBuffer);
-	SAFE_RELEASE(m_pOldParticleBuffer_SRV);
-	SAFE_RELEASE(m_pUpdatedParticleBuffer);
-	SAFE_RELEASE(m_pUpdatedParticleBuffer_UAV);
-	SAFE_RELEASE(m_pRenderParticleBuffer);
-	SAFE_RELEASE(m_pRenderParticleBuffer_SRV);
+	release_particle_resources();
+	close_section_file();
+	write_density_files();
 	SAFE_RELEASE(m_pIndexBuffer);
 	SAFE_RELEASE(m_pLinearMipSamplerState);
 	SAFE_RELEASE(m_pAdditiveBlendState);
@@ -120,6 +298,8 @@ ParticleSystemApp::~ParticleSystemApp()
 
 void ParticleSystemApp::on_init(SystemsInterface& systems)
 {
+	const f64 kStartTime = getTimeSeconds();
+
 	// Initialize camera setup
 	systems.pCamera->eye = v3(-100.0f, 0.0f, -50.0f);
 	systems.pCamera->look_at(v3(0.0f, 0.0f, 30.0f));
@@ -138,37 +318,51 @@ void ParticleSystemApp::on_init(SystemsInterface& systems)
 	PerFrameCBData frameData;
 	m_perFrameCBData = frameData;
 	m_perFrameCBData.m_particleColour = v3(0.0f, 255.0f, 0.0f);
+	m_perFrameCBData.m_drawParticleCount = 0;
 
 	// Create a simulation constant buffer and fill with uninitialized data
 	SimulationParameters simParams;
 	m_simulationParameters = simParams;
-	m_simulationParameters.m_sigma = 17.683f;
-	m_simulationParameters.m_rho = 25.0f;
-	m_simulationParameters.m_beta = 1.6666f;
+	m_simulationParameters.m_sigma = kDefaultLorenzParameters.m_sigma;
+	m_simulationParameters.m_rho = kDefaultLorenzParameters.m_rho;
+	m_simulationParameters.m_beta = kDefaultLorenzParameters.m_beta;
+	m_simulationParameters.m_maxAge = 20.0f;
+	m_capacityLimit = device_particle_capacity(systems.pD3DDevice, kMaxParticleCapacity);
+	m_maxNumParticles = std::min(kDefaultParticleCapacity, m_capacityLimit);
+	m_requestedCapacity = static_cast<int>(m_maxNumParticles);
+	m_capacityChangePending = false;
+	m_failedCapacity = 0;
+	m_startupTime = 0.0;
+	m_particleInitTime = 0.0;
+	m_peakResidentBytes = 0;
 	m_particleCount = m_maxNumParticles;
+	m_simulationParameters.m_particleCount = m_particleCount;
 
 	m_speed = 0.5f;
 
 	m_randomColour = true;
 	m_streak = true;
+	m_cpuSimulation = false;
+	m_cpuIntegrator = Integrator::kEuler;
+	m_cpuFrameStart = 0.0;
+	m_cpuSubsteps = 0;
+	m_cpuRequestedCount = m_maxNumParticles;
+	m_drawParticleCount = m_particleCount;
+	m_pLyapunovEstimator.reset(new LyapunovEstimator());
+	m_hasLyapunovSpectrum = false;
+	m_recordSection = false;
+	m_recordDensity = false;
 
 	// Create per-frame constant buffers
 	m_pPerFrame_CB = create_constant_buffer<PerFrameCBData>(systems.pD3DDevice, &m_perFrameCBData);
 	m_pSimulationParameters_CB = create_constant_buffer<SimulationParameters>(systems.pD3DDevice, &m_simulationParameters);
 	
-	// Prepare structured buffers containing particle data
-	init_particle_buffers(systems.pD3DDevice);
-
-	// Create an SRV to the updated particle buffer for the vertex shader
-	m_pRenderParticleBuffer_SRV = create_structured_buffer_SRV(systems.pD3DDevice, m_maxNumParticles, m_pRenderParticleBuffer);
-
-	// Create an SRV for the compute shader to read last frame's particles
-	m_pOldParticleBuffer_SRV = create_structured_buffer_SRV(systems.pD3DDevice, m_maxNumParticles, m_pOldParticleBuffer);
+	// Particle buffers and their views
+	const bool kCreated = create_particle_resources(systems.pD3DDevice);
+	ASSERT(kCreated);
 
-	// Create a UAV for the compute shader to write updated particle data
-	m_pUpdatedParticleBuffer_UAV = create_structured_buffer_UAV(systems.pD3DDevice, m_maxNumParticles, m_pUpdatedParticleBuffer);
-
-	// Create index buffer for rendering particles
+	// Create index buffer for rendering particles. It does not depend on the
+	// capacity, so it is made once.
 	init_index_buffer(systems.pD3DDevice);
 
 	// Get some textures
@@ -214,6 +408,8 @@ void ParticleSystemApp::on_init(SystemsInterface& systems)
 
 	// Set the depth stencil state
 	systems.pD3DContext->OMSetDepthStencilState(m_pDisabledDepthTestState, 0);
+
+	m_startupTime = getTimeSeconds() - kStartTime;
 }
 
 void ParticleSystemApp::on_update(SystemsInterface& systems)
@@ -223,21 +419,93 @@ void ParticleSystemApp::on_update(SystemsInterface& systems)
 	m_frameTime = updatedTime - m_elapsedTime;
 	m_elapsedTime = updatedTime;
 
+	if (m_capacityChangePending)
+	{
+		apply_particle_capacity(systems);
+	}
+
+	// Simulated time is advanced in fixed substeps, so the result does not
+	// depend on the frame rate and a long frame cannot take one huge step
+	const FixedStepPlan kPlan = m_scheduler.plan_frame(m_frameTime * m_speed);
+
+	// Start the CPU frame graph before anything else so that it overlaps
+	// with the UI and constant buffer work below. The checkbox takes effect
+	// next frame.
+	const bool kCpuSimulation = m_cpuSimulation && begin_cpu_simulation(systems, kPlan);
+
 	// Update simulation parameters
 	// Set emission point to be a random point within a sphere
 	v2 polars = DirectX::XM_2PI*randv2();
 	m_simulationParameters.m_emitterLocation = 1.0f*v3(sinf(polars.x)*cosf(polars.y), sinf(polars.x)*sinf(polars.y), cosf(polars.x));
 	ImGui::Text("Frame time: %.0f ms", 1000.0f*m_frameTime);
 	ImGui::Text("FPS: %.0f", (1.0f / m_frameTime));
+	ImGui::Text("Startup: %.0f ms (particle buffers %.0f ms), peak RSS %.0f MB", 1000.0*m_startupTime,
+		1000.0*m_particleInitTime, m_peakResidentBytes / (1024.0*1024.0));
 	
 	ImGui::SliderInt("Particle Count", &m_particleCount, 0, static_cast<int>(m_maxNumParticles), "%.0f");
+	ImGui::InputInt("Capacity", &m_requestedCapacity, 100000, 1000000);
+	m_requestedCapacity = std::max(1, std::min(m_requestedCapacity, static_cast<int>(m_capacityLimit)));
+	if (ImGui::Button("Apply Capacity"))
+	{
+		m_capacityChangePending = true;
+	}
+	ImGui::SameLine();
+	ImGui::Text("max %u", m_capacityLimit);
+	if (m_failedCapacity > 0)
+	{
+		ImGui::Text("Could not allocate %u particles, kept %u", m_failedCapacity, m_maxNumParticles);
+	}
 	
 	ImGui::SliderFloat("Sigma", (f32*)(&m_simulationParameters.m_sigma), 0.0f, 100.0f);
 	ImGui::SliderFloat("Rho", (f32*)(&m_simulationParameters.m_rho), 0.0f, 100.0f);
 	ImGui::SliderFloat("Beta", (f32*)(&m_simulationParameters.m_beta), 0.0f, 30.0f);
+	ImGui::SliderFloat("Max Age (0 = forever)", (f32*)(&m_simulationParameters.m_maxAge), 0.0f, 60.0f);
+
+	// Only the latest parameters are estimated, so dragging a slider never
+	// queues up stale work
+	const LorenzParameters kLorenzParams = { m_simulationParameters.m_sigma, m_simulationParameters.m_rho, m_simulationParameters.m_beta };
+	m_pLyapunovEstimator->request(kLorenzParams);
+	LorenzParameters spectrumParams;
+	if (m_pLyapunovEstimator->poll(m_lyapunovSpectrum, spectrumParams))
+	{
+		m_hasLyapunovSpectrum = true;
+	}
+	if (m_hasLyapunovSpectrum)
+	{
+		const LyapunovSpectrum& spectrum = m_lyapunovSpectrum;
+		ImGui::Text("Lyapunov: %.3f +- %.3f, %.3f +- %.3f, %.2f +- %.2f%s", spectrum.m_exponents[0], spectrum.m_halfWidths[0],
+			spectrum.m_exponents[1], spectrum.m_halfWidths[1], spectrum.m_exponents[2], spectrum.m_halfWidths[2],
+			m_pLyapunovEstimator->busy() ? " (updating)" : "");
+		ImGui::Text("Kaplan-Yorke dimension: %.3f (%.0f ms)", spectrum.m_kaplanYorkeDimension, 1000.0*spectrum.m_seconds);
+	}
+
 	ImGui::SliderFloat("Speed", (f32*)&m_speed, 0.01f, 1.0f);
 	ImGui::Checkbox("Random Particle Colour", &m_randomColour);
 	ImGui::Checkbox("Streaks", &m_streak);
+	ImGui::Checkbox("CPU Simulation", &m_cpuSimulation);
+	ImGui::Combo("CPU Integrator", (int*)&m_cpuIntegrator, "Euler\0RK4\0Dormand-Prince\0");
+	ImGui::Checkbox("Record Poincare Section", &m_recordSection);
+	if (m_pSection)
+	{
+		ImGui::Text("Section hits: %llu (%s)", static_cast<unsigned long long>(m_pSection->merged_count()), kSectionFileName);
+	}
+	ImGui::Checkbox("Record Density", &m_recordDensity);
+	if (m_pDensity)
+	{
+		ImGui::Text("Density: %llu positions in %u bricks of %u^3", static_cast<unsigned long long>(m_pDensity->binned_count()),
+			m_pDensity->brick_count(), m_pDensity->resolution());
+	}
+
+	FixedStepSettings& stepSettings = m_scheduler.settings();
+	f32 stepMs = 1000.0f*stepSettings.m_stepSize;
+	f32 budgetMs = 1000.0f*stepSettings.m_budgetSeconds;
+	ImGui::SliderFloat("Step (ms)", &stepMs, 1.0f, 33.0f);
+	ImGui::SliderInt("Max Substeps", (int*)&stepSettings.m_maxSubsteps, 1, 32);
+	ImGui::SliderFloat("Step Budget (ms)", &budgetMs, 0.0f, 33.0f);
+	stepSettings.m_stepSize = 0.001f*stepMs;
+	stepSettings.m_budgetSeconds = 0.001f*budgetMs;
+	ImGui::Text("Substeps: %u%s", kPlan.m_substeps, kPlan.m_budgetLimited ? " (over budget)" : "");
+	ImGui::Text("Dropped: %.1f ms (total %.2f s)", 1000.0f*kPlan.m_droppedTime, m_scheduler.total_dropped_time());
 
 	DemoFeatures::editorHud(systems.pDebugDrawContext);
 
@@ -253,40 +521,44 @@ void ParticleSystemApp::on_update(SystemsInterface& systems)
 		ImGui::SliderFloat("B", (f32*)&m_particleColour.z, 0.0f, 255.0f);
 	}
 
+	// The compute shader skips threads past the live particles
+	m_simulationParameters.m_particleCount = static_cast<u32>(m_particleCount);
+
 	// Update per-frame data
 	m_perFrameCBData.m_matProjection = systems.pCamera->projMatrix.Transpose();
 	m_perFrameCBData.m_matView = systems.pCamera->viewMatrix.Transpose();
-	m_perFrameCBData.m_deltaTime = m_frameTime * m_speed;
+	m_perFrameCBData.m_deltaTime = kPlan.m_stepSize;
 	m_perFrameCBData.m_particleColour = m_particleColour;
 	m_perFrameCBData.m_streak = m_streak;
 
-	// Bind compute shader
-	m_particleSimulate.bind(systems.pD3DContext);
-
 	// Push per-frame data to the GPU
 	push_constant_buffer(systems.pD3DContext, m_pPerFrame_CB, m_perFrameCBData);
 	push_constant_buffer(systems.pD3DContext, m_pSimulationParameters_CB, m_simulationParameters);
 
-	// Bind SRVs to compute shader
-	ID3D11ShaderResourceView* arr_pSRVs[] = { m_pOldParticleBuffer_SRV };
-	systems.pD3DContext->CSSetShaderResources(0, 1, arr_pSRVs);
+	if (kCpuSimulation)
+	{
+		end_cpu_simulation(systems);
+	}
+	else
+	{
+		simulate_on_gpu(systems, kPlan);
+	}
+}
 
-	// Bind UAVs to compute shader
-	ID3D11UnorderedAccessView* arr_pUAVs[] = { m_pUpdatedParticleBuffer_UAV};
-	systems.pD3DContext->CSSetUnorderedAccessViews(0, 1, arr_pUAVs, nullptr);
+void ParticleSystemApp::simulate_on_gpu(SystemsInterface& systems, const FixedStepPlan& plan)
+{
+	// Bind compute shader
+	m_particleSimulate.bind(systems.pD3DContext);
 
 	// Bind constant buffer to compute shader
 	ID3D11Buffer* arr_pCBs[] = { m_pPerFrame_CB, m_pSimulationParameters_CB };
 	systems.pD3DContext->CSSetConstantBuffers(0, 2, arr_pCBs);
 
-	// Launch 1D thread groups, one thread per particle
-	u32 numThreads = align(m_particleCount, 256);
-	systems.pD3DContext->Dispatch( numThreads/256, 1, 1);
-
-	// Set the updated particles to be next frame's old particles
-	systems.pD3DContext->CopyResource(m_pOldParticleBuffer, m_pUpdatedParticleBuffer);
-	// Obtain a copy of the updated particles to render
-	systems.pD3DContext->CopyResource(m_pRenderParticleBuffer, m_pUpdatedParticleBuffer);
+	// One dispatch per substep, each reading the previous substep's output.
+	// GPU time is not measured, so only the substep cap (not the time
+	// budget) limits this path.
+	m_particleBuffers.set_context(systems.pD3DContext);
+	m_particleRing.simulate(m_particleBuffers, plan.m_substeps, static_cast<u32>(m_particleCount));
 
 	// Unbind SRVs from compute shader
 	ID3D11ShaderResourceView* nullSRVs[] = { nullptr };
@@ -295,10 +567,133 @@ void ParticleSystemApp::on_update(SystemsInterface& systems)
 	// Unbind UAVS from compute shader
 	ID3D11UnorderedAccessView* nullUAVs[] = { nullptr };
 	systems.pD3DContext->CSSetUnorderedAccessViews(0, 1, nullUAVs, nullptr);
+
+	m_drawParticleCount = m_particleCount;
+}
+
+bool ParticleSystemApp::begin_cpu_simulation(SystemsInterface& systems, const FixedStepPlan& plan)
+{
+	if (!m_pCpuSimulator)
+	{
+		// Without room for the particles, stay on the GPU
+		m_pCpuSimulator.reset(new LorenzSimulator());
+		if (!m_pCpuSimulator->init(m_maxNumParticles, 1))
+		{
+			m_pCpuSimulator.reset();
+			m_cpuSimulation = false;
+			return false;
+		}
+		m_pCpuPipeline.reset(new ParticleFramePipeline(*m_pCpuSimulator));
+		m_cpuRequestedCount = m_maxNumParticles;
+	}
+
+	// The checkbox starts and stops recording between frames, while no
+	// particles are stepping
+	if (m_recordSection && !m_pSection)
+	{
+		m_pSectionFile = std::fopen(kSectionFileName, "wb");
+		if (m_pSectionFile && write_section_binary_header(m_pSectionFile, SectionPlane()))
+		{
+			m_pSection.reset(new PoincareSection());
+			m_stepObservers.add(m_pSection.get());
+		}
+		else
+		{
+			close_section_file();
+			m_recordSection = false;
+		}
+	}
+	else if (!m_recordSection && m_pSection)
+	{
+		m_stepObservers.remove(m_pSection.get());
+		m_pSection.reset();
+		close_section_file();
+	}
+
+	// The grid is fitted to the particles as they are when recording starts
+	if (m_recordDensity && !m_pDensity)
+	{
+		m_pDensity.reset(new DensityHistogram());
+		m_pDensity->fit_bounds(*m_pCpuSimulator);
+		m_stepObservers.add(m_pDensity.get());
+	}
+	else if (!m_recordDensity && m_pDensity)
+	{
+		m_stepObservers.remove(m_pDensity.get());
+		write_density_files();
+	}
+	m_pCpuSimulator->set_step_observer(m_stepObservers.empty() ? nullptr : &m_stepObservers);
+
+	// The slider sets the live range; otherwise it only shrinks as particles
+	// die and are compacted to the tail
+	if (static_cast<u32>(m_particleCount) != m_cpuRequestedCount)
+	{
+		m_cpuRequestedCount = static_cast<u32>(m_particleCount);
+		m_pCpuSimulator->set_active_count(m_cpuRequestedCount);
+	}
+	else if (m_pCpuPipeline->dead_count() > 0)
+	{
+		m_pCpuSimulator->compact();
+	}
+
+	m_pCpuSimulator->set_integrator(m_cpuIntegrator);
+
+	LorenzParameters& params = m_pCpuSimulator->parameters();
+	params.m_sigma = m_simulationParameters.m_sigma;
+	params.m_rho = m_simulationParameters.m_rho;
+	params.m_beta = m_simulationParameters.m_beta;
+
+	LorenzLifecycle lifecycle = m_pCpuSimulator->lifecycle();
+	lifecycle.m_maxAge = m_simulationParameters.m_maxAge;
+	const v3& emitter = m_simulationParameters.m_emitterLocation;
+	lifecycle.m_emitterLocation = Float3{ emitter.x, emitter.y, emitter.z };
+	m_pCpuSimulator->set_lifecycle(lifecycle);
+
+	ParticleFrameView view;
+	for (u32 i = 0; i < 6; ++i)
+	{
+		const v4& plane = systems.pCamera->planes[i];
+		view.m_planes[i] = Float4{ plane.x, plane.y, plane.z, plane.w };
+	}
+	view.m_eye = Float3{ systems.pCamera->eye.x, systems.pCamera->eye.y, systems.pCamera->eye.z };
+	view.m_cullRadius = 1.0f;
+	view.m_cull = true;
+	view.m_sortBackToFront = false; // Additive blending is order independent
+
+	m_cpuFrameStart = getTimeSeconds();
+	m_pCpuPipeline->begin_frame(plan.m_stepSize, plan.m_substeps, m_pCpuSimulator->active_count(), view);
+	m_cpuSubsteps = plan.m_substeps;
+	return true;
+}
+
+void ParticleSystemApp::end_cpu_simulation(SystemsInterface& systems)
+{
+	m_pCpuPipeline->end_frame();
+	// Includes the overlapped UI work, so the budget errs on the safe side
+	m_scheduler.record_cost(m_cpuSubsteps, getTimeSeconds() - m_cpuFrameStart);
+
+	if (m_pSection && !m_pSection->flush(m_pSectionFile, true))
+	{
+		m_recordSection = false;
+	}
+	if (m_pDensity)
+	{
+		m_pDensity->merge();
+	}
+
+	// Upload only the visible particles, into the next buffer of the ring.
+	// The GPU simulation state is left alone.
+	m_drawParticleCount = m_pCpuPipeline->visible_count();
+	m_particleBuffers.set_context(systems.pD3DContext);
+	m_particleRing.upload(m_particleBuffers, m_pCpuPipeline->visible_particles(), m_drawParticleCount);
 }
 
 void ParticleSystemApp::on_render(SystemsInterface& systems)
 {
+	// The draw count is only known once this frame's simulation is done
+	m_perFrameCBData.m_drawParticleCount = m_drawParticleCount;
+	push_constant_buffer(systems.pD3DContext, m_pPerFrame_CB, m_perFrameCBData);
+
 	// Bind constant buffers to vertex and pixel shaders
 	ID3D11Buffer* cbuffers[] = { m_pPerFrame_CB };
 	systems.pD3DContext->VSSetConstantBuffers(2, 1, cbuffers);
@@ -306,7 +701,7 @@ void ParticleSystemApp::on_render(SystemsInterface& systems)
 
 
 	// Bind particle buffer SRV to vertex shader
-	ID3D11ShaderResourceView* arr_pSRVs[] = { m_pRenderParticleBuffer_SRV };
+	ID3D11ShaderResourceView* arr_pSRVs[] = { m_particleBuffers.srv(m_particleRing.render_index()) };
 	systems.pD3DContext->VSSetShaderResources(1, 1, arr_pSRVs);
 
 	// Bind a texture to pixel shader
@@ -320,112 +715,179 @@ void ParticleSystemApp::on_render(SystemsInterface& systems)
 	systems.pD3DContext->OMSetBlendState(m_pAdditiveBlendState, nullptr, 0xFFFFFFFF);
 
 	// Set the index buffer
-	systems.pD3DContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	systems.pD3DContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
 
 	// Set the primitive topology
 	systems.pD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	// Draw the particles
-	systems.pD3DContext->DrawIndexed(m_particleCount*6, 0, 0);
+	// Draw the particles, one instance of the quad pattern per block of
+	// kQuadPatternQuads. SV_VertexID does not include a base vertex, so the
+	// shader offsets by SV_InstanceID instead, and drops quads past the
+	// draw count in the last block.
+	const UINT kInstances = quad_pattern_draw_count(m_drawParticleCount);
+	if (kInstances > 0)
+	{
+		systems.pD3DContext->DrawIndexedInstanced(kQuadPatternIndices, kInstances, 0, 0, 0);
+	}
 
 	// Unbind shader resources
 	ID3D11ShaderResourceView* nullSRVs[] = { nullptr };
 	systems.pD3DContext->VSSetShaderResources(1, 1, nullSRVs);
 }
 
-void ParticleSystemApp::init_particle_buffers(ID3D11Device* pDevice)
+bool ParticleSystemApp::create_particle_resources(ID3D11Device* pDevice)
 {
-	// Allocate an array that contains initial particle data
-	m_OldParticles.resize(m_maxNumParticles);
+	const f64 kStartTime = getTimeSeconds();
 
-	// Write in some initial particle data
-	for (u32 i = 0; i < m_maxNumParticles; ++i)
+	// Prepare structured buffers containing particle data, and their views
+	if (!init_particle_buffers(pDevice))
 	{
-		m_OldParticles[i].m_position = 10.0f*randv3();
-		m_OldParticles[i].m_velocity = randv3();
-		m_OldParticles[i].m_age = 20.0f*(randf()+1.0f)/2.0f;
+		return false;
 	}
 
-	// Copy the array into a subresource
-	D3D11_SUBRESOURCE_DATA particleData;
-	particleData.pSysMem = m_OldParticles.data();
-	particleData.SysMemPitch = 0;
-	particleData.SysMemSlicePitch = 0;
+	m_particleInitTime = getTimeSeconds() - kStartTime;
+	m_peakResidentBytes = peak_resident_bytes();
+	return true;
+}
 
-	// Create a structured buffer for old particle data
-	m_pOldParticleBuffer = create_default_structured_buffer<Particle>(pDevice, m_maxNumParticles, &particleData);
+void ParticleSystemApp::release_particle_resources()
+{
+	m_particleBuffers.release();
+}
 
-	//////////////////////////////////////////////////////////////////////////////////////////////////////
+void ParticleSystemApp::apply_particle_capacity(SystemsInterface& systems)
+{
+	m_capacityChangePending = false;
+	const u32 kCapacity = static_cast<u32>(std::max(1, std::min(m_requestedCapacity, static_cast<int>(m_capacityLimit))));
+	const u32 kOldCapacity = m_maxNumParticles;
+	m_requestedCapacity = static_cast<int>(kCapacity);
+	if (kCapacity == kOldCapacity)
+	{
+		return;
+	}
 
-	m_UpdatedParticles.resize(m_maxNumParticles);
+	// The GPU buffers are recreated, which restarts the GPU simulation. The
+	// CPU pool only adds pages, so CPU particles keep their state.
+	if (m_pCpuSimulator && !m_pCpuSimulator->grow(kCapacity, 1))
+	{
+		m_failedCapacity = kCapacity;
+		m_requestedCapacity = static_cast<int>(kOldCapacity);
+		return;
+	}
 
-	// Fill updated particles with any data, it will be overwritten by GPU
-	// Write in some initial particle data
-	for (u32 i = 0; i < m_maxNumParticles; ++i)
+	// The old buffers are released first so their memory can be reused. If
+	// the new ones still do not fit, the old capacity, which did, is rebuilt.
+	// A CPU pool that grew keeps its extra pages, which are never made live.
+	systems.pD3DContext->Flush();
+	release_particle_resources();
+	m_maxNumParticles = kCapacity;
+	if (!create_particle_resources(systems.pD3DDevice))
 	{
-		m_UpdatedParticles[i].m_position = 5.0f*randv3();
-		m_UpdatedParticles[i].m_velocity = v3(0.0f);
-		m_UpdatedParticles[i].m_age = 20.0f*(randf() + 1.0f) / 2.0f;
+		m_failedCapacity = kCapacity;
+		m_requestedCapacity = static_cast<int>(kOldCapacity);
+		m_maxNumParticles = kOldCapacity;
+		const bool kRestored = create_particle_resources(systems.pD3DDevice);
+		ASSERT(kRestored);
+		return;
 	}
-	
-	// Copy the array into a subresource
-	D3D11_SUBRESOURCE_DATA particleData2;
-	particleData2.pSysMem = m_UpdatedParticles.data();
-	particleData2.SysMemPitch = 0;
-	particleData2.SysMemSlicePitch = 0;
+	m_failedCapacity = 0;
+
+	m_particleCount = std::min(m_particleCount, static_cast<int>(m_maxNumParticles));
+	m_drawParticleCount = std::min(m_drawParticleCount, m_maxNumParticles);
+}
+
+void ParticleSystemApp::fill_particles(LorenzParticle* pParticles, u32 count, f32 positionScale, bool randomVelocity, u32 seed)
+{
+	// Every particle is a pure function of (seed, index), so the contents do
+	// not depend on which thread filled which chunk, and match the CPU
+	// simulator initialized with the same seed.
+	const CounterRng rng(seed);
+	parallel_for(0, count, kParticleInitGrain, [=, &rng](u32 first, u32 last)
+	{
+		for (u32 i = first; i < last; ++i)
+		{
+			pParticles[i] = initial_lorenz_particle(rng, i, positionScale, randomVelocity);
+		}
+	});
+}
+
+bool ParticleSystemApp::init_particle_buffers(ID3D11Device* pDevice)
+{
+	// One staging block, filled in parallel, is the initial data of every
+	// buffer in the ring. Only the first is read before being written, but
+	// any of them may be drawn before the first substep. At high capacities
+	// a block per buffer would multiply the peak host memory during startup
+	// for nothing. LorenzParticle has no constructor, so the block is not
+	// zeroed on one thread before the parallel fill.
+	std::unique_ptr<LorenzParticle[]> staging(new (std::nothrow) LorenzParticle[m_maxNumParticles]);
+	if (!staging)
+	{
+		return false;
+	}
+	fill_particles(staging.get(), m_maxNumParticles, 10.0f, true, 1);
 
-	m_pUpdatedParticleBuffer = create_default_structured_buffer<Particle>(pDevice, m_maxNumParticles, &particleData2);
+	if (!m_particleBuffers.create(pDevice, m_maxNumParticles, staging.get()))
+	{
+		return false;
+	}
+	m_particleRing.reset();
 
-	//////////////////////////////////////////////////////////////////////////////////////////////////////
+	// The staging block is released here, once the uploads have been made
+	return true;
+}
 
-	m_RenderParticles.resize(m_maxNumParticles);
+void ParticleSystemApp::close_section_file()
+{
+	if (m_pSectionFile)
+	{
+		std::fclose(m_pSectionFile);
+		m_pSectionFile = nullptr;
+	}
+}
 
-	// Fill updated particles with any data, it will be overwritten by GPU
-	// Write in some initial particle data
-	for (u32 i = 0; i < m_maxNumParticles; ++i)
+void ParticleSystemApp::write_density_files()
+{
+	if (!m_pDensity)
 	{
-		m_RenderParticles[i].m_position = 5.0f*randv3();
-		m_RenderParticles[i].m_velocity = v3(0.0f);
-		m_RenderParticles[i].m_age = 20.0f*(randf() + 1.0f) / 2.0f;
+		return;
 	}
 
-	// Copy the array into a subresource
-	D3D11_SUBRESOURCE_DATA particleData3;
-	particleData3.pSysMem = m_RenderParticles.data();
-	particleData3.SysMemPitch = 0;
-	particleData3.SysMemSlicePitch = 0;
+	std::FILE* pFile = std::fopen(kDensityVolumeName, "wb");
+	if (pFile)
+	{
+		m_pDensity->write_volume(pFile);
+		std::fclose(pFile);
+	}
 
-	m_pRenderParticleBuffer = create_default_structured_buffer<Particle>(pDevice, m_maxNumParticles, &particleData3);
+	// Projected along y, the view of the butterfly
+	pFile = std::fopen(kDensityImageName, "wb");
+	if (pFile)
+	{
+		m_pDensity->write_projection_pgm(pFile, 1);
+		std::fclose(pFile);
+	}
+	m_pDensity.reset();
 }
 
 void ParticleSystemApp::init_index_buffer(ID3D11Device* pDevice)
 {
 	ID3D11Buffer* pIndexBuffer;
-	
-	// Create data to fill index buffer
-	m_Indices.resize(6*m_maxNumParticles);
 
-	for (UINT i = 0; i < m_maxNumParticles; ++i)
-	{
-		m_Indices[6 * i] = 4 * i;
-		m_Indices[6 * i + 1] = 4 * i + 1;
-		m_Indices[6 * i + 2] = 4 * i + 2;
-		m_Indices[6 * i + 3] = 4 * i;
-		m_Indices[6 * i + 4] = 4 * i + 2;
-		m_Indices[6 * i + 5] = 4 * i + 3;
-	}
+	// One block of quads, 192 KB, whatever the particle count
+	std::vector<u16> indices(kQuadPatternIndices);
+	write_quad_pattern(indices.data(), kQuadPatternQuads);
 
 	// Create an index buffer description
 	D3D11_BUFFER_DESC desc;
 	desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	desc.ByteWidth = m_maxNumParticles * 6 * sizeof(UINT);
+	desc.ByteWidth = kQuadPatternIndices * sizeof(u16);
 	desc.CPUAccessFlags = 0;
 	desc.MiscFlags = 0;
 	desc.Usage = D3D11_USAGE_IMMUTABLE;
 
 	// Create subresource data
 	D3D11_SUBRESOURCE_DATA data;
-	data.pSysMem = m_Indices.data();
+	data.pSysMem = indices.data();
 	data.SysMemPitch = 0;
 	data.SysMemSlicePitch = 0;
 
@@ -0,0 +1,45 @@
+# Fails the build if a kernel translation unit defines a weak symbol.
+#
+# LorenzKernels<ISA>.cpp are compiled with different instruction set flags.
+# A weak (inline, template or COMDAT) definition in one of them, such as an
+# out-of-line std::sqrt(float) in a build that does not inline it, is merged
+# with the copies in the other kernel units, and the linker keeps one of
+# them for every caller. If it keeps the AVX copy, the SSE4 and scalar
+# kernels fault on CPUs without AVX. See SimdOps.h.
+#
+# Run with cmake -DNM=<nm> -DOBJECTS=<object list> -P CheckKernelSymbols.cmake.
+
+set(found_kernel_object FALSE)
+set(failed FALSE)
+foreach(object IN LISTS OBJECTS)
+	get_filename_component(name "${object}" NAME)
+	if(NOT name MATCHES "^LorenzKernels(Scalar|SSE4|AVX2|AVX512)\\.")
+		continue()
+	endif()
+	set(found_kernel_object TRUE)
+
+	execute_process(COMMAND "${NM}" -C "${object}" OUTPUT_VARIABLE symbols RESULT_VARIABLE result)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "${NM} failed on ${object}")
+	endif()
+
+	# W and V are weak definitions; DW.ref.__gxx_personality_v0 is the
+	# unwinder's data reference and carries no code
+	string(REPLACE "\n" ";" lines "${symbols}")
+	foreach(line IN LISTS lines)
+		if(line MATCHES "^[0-9a-fA-F]+ [WVu] (.*)$")
+			set(symbol "${CMAKE_MATCH_1}")
+			if(NOT symbol MATCHES "^DW\\.ref\\.")
+				message(SEND_ERROR "${name}: weak symbol ${symbol}")
+				set(failed TRUE)
+			endif()
+		endif()
+	endforeach()
+endforeach()
+
+if(NOT found_kernel_object)
+	message(FATAL_ERROR "No kernel objects in ${OBJECTS}")
+endif()
+if(failed)
+	message(FATAL_ERROR "Kernel translation units must not define weak symbols")
+endif()